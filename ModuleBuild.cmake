@@ -72,7 +72,8 @@ ${IMP_algebra_DOC}
 ${IMP_display_DOC}
 ${IMP_score_functor_DOC}
 ${IMP_core_DOC}
-${IMP_container_DOC} ${headers} ${docs} ${examples} ${CMAKE_SOURCE_DIR}/README.md ${IMP_insulinsecretion_TAG_DEPENDS}
+${IMP_container_DOC}
+${IMP_atom_DOC} ${headers} ${docs} ${examples} ${CMAKE_SOURCE_DIR}/README.md ${IMP_insulinsecretion_TAG_DEPENDS}
       WORKING_DIRECTORY ${CMAKE_BINARY_DIR}/doxygen/insulinsecretion/
       COMMENT "Running doxygen on insulinsecretion")
 
@@ -90,7 +91,7 @@ ${IMP_container_DOC} ${headers} ${docs} ${examples} ${CMAKE_SOURCE_DIR}/README.m
   endif(IMP_DOXYGEN_FOUND)
 
   if(0 EQUAL 0)
-    list(APPEND imp_insulinsecretion_libs ${IMP_kernel_LIBRARY};${IMP_cgal_LIBRARY};${IMP_algebra_LIBRARY};${IMP_display_LIBRARY};${IMP_score_functor_LIBRARY};${IMP_core_LIBRARY};${IMP_container_LIBRARY})
+    list(APPEND imp_insulinsecretion_libs ${IMP_kernel_LIBRARY};${IMP_cgal_LIBRARY};${IMP_algebra_LIBRARY};${IMP_display_LIBRARY};${IMP_score_functor_LIBRARY};${IMP_core_LIBRARY};${IMP_container_LIBRARY};${IMP_atom_LIBRARY})
     list(APPEND imp_insulinsecretion_libs ${BOOST.SYSTEM_LIBRARIES};${GPERFTOOLS_LIBRARIES};${BOOST.FILESYSTEM_LIBRARIES};${NUMPY_LIBRARIES};${BOOST.RANDOM_LIBRARIES};${BOOST.PROGRAMOPTIONS_LIBRARIES};${CGAL_LIBRARIES};${ANN_LIBRARIES};${HDF5_LIBRARIES};${PYTHON-IHM_LIBRARIES})
     list(REMOVE_DUPLICATES imp_insulinsecretion_libs)
 
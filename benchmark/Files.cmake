@@ -1,3 +1,3 @@
-set(pyfiles "")
-set(cppfiles "")
+set(pyfiles "benchmark_channel_gating.py;benchmark_multi_cell.py;benchmark_regression.py;benchmark_single_precision.py")
+set(cppfiles "benchmark_kernel_counters.cpp;benchmark_polydisperse_neighbors.cpp;benchmark_spatial_reordering.cpp")
 set(cudafiles "")
@@ -0,0 +1,80 @@
+"""
+Validation benchmark of the per-channel Markov gating of the Ca2+ channels.
+
+Runs ChannelMarkovGating at constant drives w, with and without inactivation,
+and with k dt from 0.1 to 10 (test.py uses k dt = 1), and compares the
+long-run open fraction of the channels with the stationary open probability
+of the rates, which is w without inactivation. Per-update probabilities that
+ignore round trips within an update bias the open fraction by several
+percent at k dt = 1, far beyond the tolerance.
+
+The open fraction is sampled every few updates after a burn-in, so the
+samples are nearly independent. The report ends with PASS or FAIL, and the
+exit status is non-zero on FAIL.
+"""
+
+from __future__ import print_function, division
+import argparse
+import math
+import sys
+import IMP
+import IMP.insulinsecretion
+
+# (w, k dt, ki dt, kr dt)
+CASES = [(w, k_dt, 0, 0) for w in (0.05, 0.2, 0.5, 0.9) for k_dt in (0.1, 1, 10)] \
+    + [(w, 1, 0.5, 0.3) for w in (0.2, 0.9)]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument("--channels", type=int, default=10000,
+                        help="number of channels")
+    parser.add_argument("--samples", type=int, default=400,
+                        help="samples of the open fraction of each case")
+    parser.add_argument("--z", type=float, default=5.0,
+                        help="allowed number of standard errors of the open fraction")
+    # IMP runs the benchmarks with these flags
+    parser.add_argument("--run_quick_test", action='store_true')
+    parser.add_argument("--deprecation_exceptions", action='store_true')
+    args = parser.parse_args()
+    if args.run_quick_test:
+        args.channels, args.samples = 1000, 50
+    return args
+
+
+def get_open_fraction(gating, n_updates, n_samples):
+    '''Return the mean open fraction over n_samples, n_updates apart'''
+    total = 0
+    for i in range(n_samples):
+        for j in range(n_updates):
+            gating.update()
+        total += gating.get_number_of_open_channels()
+    return total / (n_samples * gating.get_number_of_channels())
+
+
+def main():
+    args = parse_args()
+    passed = True
+    for w, k_dt, ki_dt, kr_dt in CASES:
+        # an interval of 1 s, so the rates are those per update
+        gating = IMP.insulinsecretion.ChannelMarkovGating(
+            args.channels, [w], 1., k_dt, ki_dt, kr_dt, 1)
+        expected = gating.get_stationary_open_probability(w)
+        # the slowest rate sets the relaxation and the spacing of the samples
+        slowest = min(r for r in (k_dt, ki_dt, kr_dt) if r > 0)
+        n_updates = max(1, int(math.ceil(3 / slowest)))
+        get_open_fraction(gating, n_updates, 10)
+        measured = get_open_fraction(gating, n_updates, args.samples)
+        se = math.sqrt(expected * (1 - expected) / (args.channels * args.samples))
+        ok = abs(measured - expected) <= args.z * se + 1e-4
+        print("w %-5g k dt %-5g ki dt %-4g kr dt %-4g open %.5f  expected %.5f  %s"
+              % (w, k_dt, ki_dt, kr_dt, measured, expected, "ok" if ok else "FAIL"))
+        passed &= ok
+    if not args.run_quick_test:
+        print("PASS" if passed else "FAIL")
+        if not passed:
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
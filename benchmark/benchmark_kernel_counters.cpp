@@ -0,0 +1,253 @@
+/**
+ *  \file benchmark_kernel_counters.cpp
+ *  \brief Hardware-counter profile of the kernels of the module on a synthetic cell.
+ *
+ * Description:
+ * 1, A synthetic cell of configurable size is built: vesicles at random points of the
+ *    cytoplasm and Ca2+ channels on the membrane, with the geometry of test.py.
+ * 2, Each kernel is wrapped with Linux perf_event_open counters: cycles, instructions,
+ *    L1 data cache read misses, last level cache misses and branch misses:
+ *    - rdf_score: RadialDistributionFunctionSingletonScore on every vesicle, with derivatives;
+ *    - docking_channel_index: VesicleDockingStage::update() with a ChannelSurfaceIndex;
+ *    - docking_pair_container: VesicleDockingStage::update() with its close pair container;
+ *    - reset_overlap_loop: secretion and reset of vesicles near the nucleus, whose random
+ *      positions are checked against every other vesicle.
+ * 3, Before each pass of the docking kernels, which is not counted, the vesicles are moved
+ *    from their initial positions by one BD step of test.py, so the close pairs are rebuilt
+ *    and the near-membrane vesicles change in every pass. The channels stay closed, so
+ *    every pass searches the same way and nothing docks.
+ * 4, The IPC and the misses per particle of each kernel are written as JSON. A counter that
+ *    cannot be opened (no kernel support, perf_event_paranoid, a virtual machine) is null,
+ *    and without counters only the wall time is reported.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/ChannelSurfaceIndex.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/RadialDistributionFunctionSingletonScore.h>
+#include <IMP/insulinsecretion/organelle_factory.h>
+#include <IMP/insulinsecretion/internal/lifecycle_stages.h>
+#include <IMP/algebra/vector_generators.h>
+#include <IMP/container/ListSingletonContainer.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/flags.h>
+#include <IMP/random.h>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "hardware_counters.h"
+
+namespace {
+boost::int64_t n_vesicles = 2000;
+boost::int64_t n_channels = 451;
+boost::int64_t n_repeats = 10;
+boost::int64_t n_resets = 100;
+std::string output = "";
+IMP::AddIntFlag nvf("vesicles", "Number of vesicles of the synthetic cell", &n_vesicles);
+IMP::AddIntFlag ncf("channels", "Number of Ca2+ channels of the synthetic cell", &n_channels);
+IMP::AddIntFlag nrf("repeats", "Number of passes of the score and docking kernels", &n_repeats);
+IMP::AddIntFlag nsf("resets", "Number of vesicles secreted and reset", &n_resets);
+IMP::AddStringFlag opf("output", "JSON output file, standard output if empty", &output);
+
+const double R_CELL = 30250; // PBC radius of test.py, A
+const double R_NUCLEUS = 18340; // NE radius of test.py, A
+const double R_VESICLE = 1200;
+const double R_CHANNEL = 100;
+const double CONTACT_RANGE = 100;
+const double SLACK = 10; // VDOS_SLACK of test.py, A
+const double D_VESICLE = 2.3e-10; // A^2/fs
+const double BD_STEP = 1e13; // 0.01 s of test.py, fs
+const double CUT_OFF = (R_CELL - R_NUCLEUS) / 3;
+const double PARAM_RDF[] = {-1.524e-20, 9.173e-16, -2.092e-11, 2.202e-07, -1.141e-03, 3.492e+00};
+
+//! The counters and the wall time of a kernel
+struct KernelProfile {
+  std::string name;
+  double n_particles; // the particles processed over all passes
+  double seconds;
+  std::vector<double> counts;
+};
+
+//! run n_passes passes of a kernel under the counters, each after an uncounted prepare()
+template <class Prepare, class Kernel>
+KernelProfile profile(std::string name, double n_particles,
+                      HardwareCounters &counters, unsigned int n_passes,
+                      Prepare prepare, Kernel kernel) {
+  KernelProfile ret;
+  ret.name = name;
+  ret.n_particles = n_particles;
+  ret.seconds = 0;
+  ret.counts.assign(N_COUNTERS, 0);
+  for (unsigned int r = 0; r < n_passes; ++r) {
+    prepare();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    counters.start();
+    kernel();
+    std::vector<double> counts = counters.stop();
+    ret.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                 - start).count();
+    for (unsigned int i = 0; i < N_COUNTERS; ++i) {
+      ret.counts[i] = counts[i] < 0 ? -1 : ret.counts[i] + counts[i];
+    }
+  }
+  return ret;
+}
+
+//! a JSON number, or null for an unavailable counter
+std::string get_json_number(double v) {
+  if (v < 0) {
+    return "null";
+  }
+  std::ostringstream oss;
+  oss.precision(6);
+  oss << v;
+  return oss.str();
+}
+
+void write_json(std::ostream &out, const std::vector<KernelProfile> &profiles,
+                bool has_counters) {
+  out << "{\n  \"vesicles\": " << n_vesicles << ",\n  \"channels\": " << n_channels
+      << ",\n  \"counters_available\": " << (has_counters ? "true" : "false")
+      << ",\n  \"kernels\": [";
+  for (unsigned int k = 0; k < profiles.size(); ++k) {
+    const KernelProfile &p = profiles[k];
+    const std::vector<double> &c = p.counts;
+    out << (k ? "," : "") << "\n    {\"name\": \"" << p.name << "\""
+        << ", \"particles\": " << p.n_particles
+        << ", \"seconds\": " << get_json_number(p.seconds)
+        << ", \"ns_per_particle\": " << get_json_number(1e9 * p.seconds / p.n_particles);
+    for (unsigned int i = 0; i < N_COUNTERS; ++i) {
+      out << ", \"" << COUNTER_NAMES[i] << "\": " << get_json_number(c[i]);
+    }
+    out << ", \"ipc\": "
+        << get_json_number(c[0] > 0 && c[1] >= 0 ? c[1] / c[0] : -1);
+    for (unsigned int i = 2; i < N_COUNTERS; ++i) {
+      out << ", \"" << COUNTER_NAMES[i] << "_per_particle\": "
+          << get_json_number(c[i] >= 0 ? c[i] / p.n_particles : -1);
+    }
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+//! random points between the nucleus and the membrane
+IMP::algebra::Vector3Ds get_random_points_in_cytoplasm(unsigned int n) {
+  IMP::algebra::Sphere3D cell(IMP::algebra::Vector3D(0, 0, 0), R_CELL - R_VESICLE);
+  IMP::algebra::Vector3Ds ret;
+  while (ret.size() < n) {
+    IMP::algebra::Vector3D v = IMP::algebra::get_random_vector_in(cell);
+    if (v.get_magnitude() > R_NUCLEUS + R_VESICLE) {
+      ret.push_back(v);
+    }
+  }
+  return ret;
+}
+}
+
+int main(int argc, char **argv) {
+  IMP::setup_from_argv(argc, argv,
+                       "Hardware-counter profile of the kernels of the module");
+  if (IMP::run_quick_test) {
+    n_vesicles = 200;
+    n_repeats = 1;
+    n_resets = 10;
+  }
+  IMP_NEW(IMP::Model, m, ());
+  IMP::algebra::Sphere3D cell_sphere(IMP::algebra::Vector3D(0, 0, 0), R_CELL);
+  IMP::algebra::Sphere3D nucleus_sphere(IMP::algebra::Vector3D(0, 0, 0), R_NUCLEUS);
+  IMP::atom::Hierarchy vesicles_root = IMP::insulinsecretion::create_vesicles(
+      m, get_random_points_in_cytoplasm(n_vesicles), R_VESICLE, D_VESICLE);
+  IMP::ParticleIndexes vesicles = vesicles_root.get_children_indexes();
+  IMP::algebra::Vector3Ds sites;
+  for (unsigned int i = 0; i < n_channels; ++i) {
+    sites.push_back(IMP::algebra::get_random_vector_on(cell_sphere));
+  }
+  IMP::atom::Hierarchy channels_root = IMP::insulinsecretion::create_ca_channels(
+      m, sites, IMP::Ints(n_channels, 0), R_CHANNEL);
+  IMP::ParticleIndexes channels = channels_root.get_children_indexes();
+
+  HardwareCounters counters;
+  bool has_counters = false;
+  for (unsigned int i = 0; i < N_COUNTERS; ++i) {
+    has_counters = has_counters || counters.get_is_available(i);
+  }
+  std::vector<KernelProfile> profiles;
+
+  IMP_NEW(IMP::insulinsecretion::RadialDistributionFunctionSingletonScore, rdf,
+          (cell_sphere, nucleus_sphere,
+           IMP::Floats(PARAM_RDF, PARAM_RDF + 6), 1.0));
+  double score = 0;
+  IMP::DerivativeAccumulator da;
+  auto no_prepare = []() {};
+  profiles.push_back(profile("rdf_score", n_repeats * vesicles.size(), counters,
+                             n_repeats, no_prepare, [&]() {
+    for (unsigned int i = 0; i < vesicles.size(); ++i) {
+      score += rdf->evaluate_index(m, vesicles[i], &da);
+    }
+  }));
+
+  // one BD step from the initial positions before each pass of the docking kernels
+  IMP::algebra::Vector3Ds initial_positions;
+  for (unsigned int i = 0; i < vesicles.size(); ++i) {
+    initial_positions.push_back(IMP::core::XYZ(m, vesicles[i]).get_coordinates());
+  }
+  std::normal_distribution<double> bd_step(0, std::sqrt(2 * D_VESICLE * BD_STEP));
+  auto move_vesicles = [&]() {
+    for (unsigned int i = 0; i < vesicles.size(); ++i) {
+      IMP::algebra::Vector3D d(bd_step(IMP::random_number_generator),
+                               bd_step(IMP::random_number_generator),
+                               bd_step(IMP::random_number_generator));
+      IMP::core::XYZ(m, vesicles[i]).set_coordinates(initial_positions[i] + d);
+    }
+  };
+  IMP_NEW(IMP::container::ListSingletonContainer, vesicles_container, (m, vesicles));
+  IMP_NEW(IMP::container::ListSingletonContainer, channels_container, (m, channels));
+
+  IMP_NEW(IMP::insulinsecretion::ChannelSurfaceIndex, channel_index,
+          (m, channels, cell_sphere, R_VESICLE + R_CHANNEL + CONTACT_RANGE));
+  IMP::insulinsecretion::internal::VesicleDockingStage index_docking(
+      vesicles_container.get(), channel_index, CONTACT_RANGE, 1);
+  profiles.push_back(profile("docking_channel_index", n_repeats * vesicles.size(), counters,
+                             n_repeats, move_vesicles, [&]() {
+    index_docking.update(m);
+  }));
+
+  IMP::insulinsecretion::internal::VesicleDockingStage pair_docking(
+      vesicles_container.get(), channels_container.get(), CONTACT_RANGE, SLACK, 1);
+  profiles.push_back(profile("docking_pair_container", n_repeats * vesicles.size(), counters,
+                             n_repeats, move_vesicles, [&]() {
+    pair_docking.update(m);
+  }));
+  unsigned int n_docked = 0;
+  for (unsigned int i = 0; i < vesicles.size(); ++i) {
+    n_docked += m->get_attribute(IMP::insulinsecretion::DockingStateDecorator::get_dstate_key(),
+                                 vesicles[i]) != 0;
+  }
+
+  IMP::insulinsecretion::internal::VesicleSecretionStage secretion(
+      vesicles, nucleus_sphere, 1, CUT_OFF);
+  profiles.push_back(profile("reset_overlap_loop", n_resets * vesicles.size(), counters,
+                             1, no_prepare, [&]() {
+    for (unsigned int i = 0; i < n_resets; ++i) {
+      secretion.secrete(m, vesicles[i % vesicles.size()]);
+    }
+  }));
+
+  std::cerr << "score " << score << ", docked vesicles " << n_docked << std::endl;
+  if (output.empty()) {
+    write_json(std::cout, profiles, has_counters);
+  } else {
+    std::ofstream out(output.c_str());
+    write_json(out, profiles, has_counters);
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+"""
+Validation benchmark of the multi-cell (islet) mode of the insulin secretion model.
+
+Builds an islet of several test.py cells in one model, none of them centered
+at the origin, assigns the vesicles to their cells in a CellGeometryTable and
+checks that:
+ - MultiCellRadialRestraint, on several threads, gives the score and the
+   derivatives of the single-cell RDF and trafficking scores of each cell;
+ - a secreted vesicle is reset near the nucleus of its own cell, between the
+   nuclear envelope and the cut-off, for all vesicles over several rounds;
+ - after a Brownian dynamics run with the per-cell scores, every vesicle is
+   still inside its own cell.
+The report ends with PASS or FAIL, and the exit status is non-zero on FAIL.
+"""
+
+from __future__ import print_function, division
+import argparse
+import random
+import sys
+import IMP
+import IMP.algebra
+import IMP.atom
+import IMP.container
+import IMP.core
+import IMP.insulinsecretion
+import IMP.insulinsecretion.cell
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument("--cells", type=int, default=3,
+                        help="number of cells, at least 2")
+    parser.add_argument("--vesicles", type=int, default=100,
+                        help="number of vesicles of each cell")
+    parser.add_argument("--rounds", type=int, default=5,
+                        help="rounds of secretion of all vesicles")
+    parser.add_argument("--frames", type=int, default=500,
+                        help="BD frames of the run")
+    parser.add_argument("--threads", type=int, default=2,
+                        help="threads of the multi-cell restraint")
+    parser.add_argument("--k-rdf", type=float, default=1.0,
+                        help="K_RDF of the cells")
+    parser.add_argument("--k-traffic", type=float, default=1e-3,
+                        help="K_TRAFFIC of the cells")
+    parser.add_argument("--score-tolerance", type=float, default=1e-6,
+                        help="allowed relative difference of the multi-cell score")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="seed of the Python and IMP generators")
+    # IMP runs the benchmarks with these flags
+    parser.add_argument("--run_quick_test", action='store_true')
+    parser.add_argument("--deprecation_exceptions", action='store_true')
+    args = parser.parse_args()
+    if args.run_quick_test:
+        args.vesicles, args.rounds, args.frames = 20, 2, 50
+    if args.cells < 2:
+        parser.error("--cells must be at least 2")
+    return args
+
+
+def create_islet(m, params, n_cells):
+    '''Return the cell table and the vesicles of each cell of a row of cells,
+       shifted off the origin'''
+    cells = IMP.insulinsecretion.CellGeometryTable()
+    vesicles = []
+    spacing = 2 * params.R + params.R_VESICLES
+    for c in range(n_cells):
+        center = IMP.algebra.Vector3D((c + 0.5) * spacing, spacing / 3, -spacing / 5)
+        cell_sphere = IMP.algebra.Sphere3D(center, params.R)
+        nucleus_sphere = IMP.algebra.Sphere3D(center, params.R_NUCLEUS)
+        radii = IMP.insulinsecretion.cell.get_vesicle_radii(
+            params.N_VESICLES, params.R_VESICLES, params.R_VESICLES_CV,
+            params.R_VESICLES_RANGE)
+        positions = [IMP.algebra.Vector3D(v) + center
+                     for v in IMP.insulinsecretion.cell.get_random_vesicles_in_cytoplasm(
+                         IMP.algebra.Sphere3D([0, 0, 0], params.R),
+                         IMP.algebra.Sphere3D([0, 0, 0], params.R_NUCLEUS), radii)]
+        h = IMP.insulinsecretion.create_vesicles(m, positions, radii, params.D_VESICLES,
+                                                 "Vesicles%d" % c)
+        cell_vesicles = h.get_children()
+        cells.set_cell(cell_vesicles, cells.add_cell(cell_sphere, nucleus_sphere))
+        vesicles.append(cell_vesicles)
+    return cells, vesicles
+
+
+def check_scores(m, cells, vesicles, args):
+    '''Compare the multi-cell restraint with the single-cell scores of each cell'''
+    param_rdf = IMP.insulinsecretion.cell.RDF_FITS['c1']
+    per_cell = []
+    for c, cell_vesicles in enumerate(vesicles):
+        cell_sphere = cells.get_cell_sphere(c)
+        rdf = IMP.insulinsecretion.RadialDistributionFunctionSingletonScore(
+            cell_sphere, cells.get_nucleus_sphere(c), param_rdf, args.k_rdf)
+        traffic = IMP.insulinsecretion.VesicleTraffickingSingletonScore(
+            cell_sphere.get_center(), args.k_traffic)
+        per_cell.append(IMP.container.SingletonsRestraint(rdf, cell_vesicles))
+        per_cell.append(IMP.container.SingletonsRestraint(traffic, cell_vesicles))
+    # the spheres and the center of these are replaced by those of each cell,
+    # so those of the first cell must not leak into the others
+    rdf = IMP.insulinsecretion.RadialDistributionFunctionSingletonScore(
+        cells.get_cell_sphere(0), cells.get_nucleus_sphere(0), param_rdf, args.k_rdf)
+    traffic = IMP.insulinsecretion.VesicleTraffickingSingletonScore(
+        cells.get_cell_sphere(0).get_center(), args.k_traffic)
+    all_vesicles = sum((list(v) for v in vesicles), [])
+    multi = IMP.insulinsecretion.MultiCellRadialRestraint(
+        all_vesicles, cells, rdf, traffic, args.threads)
+
+    def evaluate(restraints):
+        score = IMP.core.RestraintsScoringFunction(restraints).evaluate(True)
+        return score, [IMP.core.XYZ(v).get_derivatives() for v in all_vesicles]
+
+    expected, expected_derivatives = evaluate(per_cell)
+    score, derivatives = evaluate([multi])
+    scale = max(1., abs(expected))
+    max_difference = max((d - e).get_magnitude()
+                         for d, e in zip(derivatives, expected_derivatives))
+    max_derivative = max([1.] + [e.get_magnitude() for e in expected_derivatives])
+    ok = abs(score - expected) <= args.score_tolerance * scale \
+        and max_difference <= args.score_tolerance * max_derivative
+    print("score multi-cell %.10g  per cell %.10g  max derivative difference %.3g  %s"
+          % (score, expected, max_difference, "ok" if ok else "FAIL"))
+    return ok, multi
+
+
+def check_resets(m, cells, vesicles, params, args):
+    '''Secrete all vesicles and check that each is reset near its own nucleus'''
+    ready_state = 1
+    all_vesicles = sum((list(v) for v in vesicles), [])
+    # the default nucleus is that of no cell, so it is never used
+    sos = IMP.insulinsecretion.InsulinSecretionOptimizerState(
+        m, all_vesicles, IMP.algebra.Sphere3D([0, 0, 0], params.R_NUCLEUS),
+        ready_state, params.CUT_OFF)
+    sos.set_cell_geometry(cells)
+    n_wrong = 0
+    for r in range(args.rounds):
+        for v in all_vesicles:
+            IMP.insulinsecretion.DockingStateDecorator(v).set_dstate(ready_state)
+        sos.update()
+        for c, cell_vesicles in enumerate(vesicles):
+            nucleus = cells.get_nucleus_sphere(c)
+            for v in cell_vesicles:
+                xyzr = IMP.core.XYZR(v)
+                d = (xyzr.get_coordinates() - nucleus.get_center()).get_magnitude()
+                inside = nucleus.get_radius() + xyzr.get_radius() < d \
+                    <= nucleus.get_radius() + params.CUT_OFF - xyzr.get_radius() + 1e-6
+                secreted = IMP.insulinsecretion.SecretionCounterDecorator(v) \
+                    .get_secretion() == r + 1
+                if not (inside and secreted):
+                    n_wrong += 1
+    n = args.rounds * len(all_vesicles)
+    ok = n_wrong == 0
+    print("resets near the own nucleus %d of %d  %s" % (n - n_wrong, n, "ok" if ok else "FAIL"))
+    return ok, sos
+
+
+def check_run(m, cells, vesicles, multi, sos, params, args):
+    '''Run BD with the per-cell scores and check that the vesicles stay in their cells'''
+    bb_harmonic = IMP.core.HarmonicUpperBound(0, params.K_BB)
+    rs = [multi]
+    for c, cell_vesicles in enumerate(vesicles):
+        bsss = IMP.core.BoundingSphere3DSingletonScore(bb_harmonic, cells.get_cell_sphere(c))
+        rs.append(IMP.container.SingletonsRestraint(bsss, cell_vesicles))
+    bd = IMP.atom.BrownianDynamics(m)
+    bd.set_log_level(IMP.SILENT)
+    bd.set_scoring_function(IMP.core.RestraintsScoringFunction(rs))
+    bd.set_maximum_time_step(params.get_bd_step_size_fs())
+    bd.set_temperature(310.15)
+    bd.add_optimizer_state(sos)
+    bd.optimize(args.frames)
+    n_outside, n = 0, 0
+    for c, cell_vesicles in enumerate(vesicles):
+        cell_sphere = cells.get_cell_sphere(c)
+        for v in cell_vesicles:
+            d = (IMP.core.XYZ(v).get_coordinates() - cell_sphere.get_center()).get_magnitude()
+            # the harmonic bound is soft, allow a vesicle radius beyond it
+            n_outside += d > cell_sphere.get_radius() + params.R_VESICLES
+            n += 1
+    ok = n_outside == 0
+    print("vesicles in their own cell after %d frames %d of %d  %s"
+          % (args.frames, n - n_outside, n, "ok" if ok else "FAIL"))
+    return ok
+
+
+def main():
+    args = parse_args()
+    IMP.set_log_level(IMP.SILENT)
+    random.seed(args.seed)
+    IMP.random_number_generator.seed(args.seed)
+    params = IMP.insulinsecretion.cell.CellParameters(N_VESICLES=args.vesicles)
+    m = IMP.Model()
+    cells, vesicles = create_islet(m, params, args.cells)
+    passed, multi = check_scores(m, cells, vesicles, args)
+    ok, sos = check_resets(m, cells, vesicles, params, args)
+    passed &= ok
+    passed &= check_run(m, cells, vesicles, multi, sos, params, args)
+    if not args.run_quick_test:
+        print("PASS" if passed else "FAIL")
+        if not passed:
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
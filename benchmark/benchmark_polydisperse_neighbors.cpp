@@ -0,0 +1,90 @@
+/**
+ *  \file benchmark_polydisperse_neighbors.cpp
+ *  \brief Benchmark of the shared close pair list with polydisperse vesicle radii.
+ *
+ * Description:
+ * 1, 50000 vesicles (1000 in a quick test) and the nucleus are placed at random points of
+ *    the cytoplasm, with radii log-uniform in a 1-, 2- and 3-fold range around the same
+ *    median radius.
+ * 2, Each range times the build of the close pair list of a SharedNeighborProvider, which
+ *    pairs the nucleus directly and grids each radius class of the vesicles separately, so the time per vesicle should stay close to that
+ *    of the monodisperse vesicles as the range grows.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/SharedNeighborProvider.h>
+#include <IMP/benchmark/benchmark_macros.h>
+#include <IMP/benchmark/utility.h>
+#include <IMP/algebra/vector_generators.h>
+#include <IMP/container/ListSingletonContainer.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/flags.h>
+#include <IMP/random.h>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+namespace {
+const double R_CELL = 30250; // PBC radius of test.py, A
+const double R_NUCLEUS = 18340; // NE radius of test.py, A
+const double R_VESICLE = 200; // the median radius, small enough for 50000 vesicles to fit, A
+const double CONTACT_RANGE = 100;
+const double SLACK = 10;
+
+//! XYZR particles at random points between the nucleus and the membrane
+IMP::ParticleIndexes create_vesicles(IMP::Model *m, unsigned int n, double range) {
+  std::uniform_real_distribution<double> log_radius(-0.5 * std::log(range),
+                                                    0.5 * std::log(range));
+  IMP::algebra::Sphere3D cell(IMP::algebra::Vector3D(0, 0, 0), R_CELL);
+  IMP::ParticleIndexes ret;
+  while (ret.size() < n) {
+    double r = R_VESICLE * std::exp(log_radius(IMP::random_number_generator));
+    IMP::algebra::Vector3D v = IMP::algebra::get_random_vector_in(cell);
+    if (v.get_magnitude() < R_NUCLEUS + r || v.get_magnitude() > R_CELL - r) {
+      continue;
+    }
+    IMP::ParticleIndex pi = m->add_particle("Vesicle");
+    IMP::core::XYZR::setup_particle(m, pi, IMP::algebra::Sphere3D(v, r))
+        .set_coordinates_are_optimized(true);
+    ret.push_back(pi);
+  }
+  return ret;
+}
+
+//! time the build of the close pair list of vesicles in one radius range
+void time_range(double range, unsigned int n_vesicles) {
+  IMP_NEW(IMP::Model, m, ());
+  IMP::ParticleIndexes particles = create_vesicles(m, n_vesicles, range);
+  IMP::ParticleIndex nucleus = m->add_particle("Nucleus");
+  IMP::core::XYZR::setup_particle(
+      m, nucleus, IMP::algebra::Sphere3D(IMP::algebra::Vector3D(0, 0, 0), R_NUCLEUS));
+  particles.push_back(nucleus);
+  IMP_NEW(IMP::container::ListSingletonContainer, lsc, (m, particles));
+  double runtime, n_pairs = 0;
+  unsigned int n_classes = 0;
+  IMP_TIME({
+    // a new provider always builds its list
+    IMP_NEW(IMP::insulinsecretion::SharedNeighborProvider, neighbors,
+            (lsc.get(), CONTACT_RANGE + SLACK, SLACK));
+    neighbors->set_large_particles(IMP::ParticleIndexes(1, nucleus));
+    neighbors->update();
+    n_pairs += neighbors->get_candidate_pairs().size();
+    n_classes = neighbors->get_number_of_radius_classes();
+  }, runtime);
+  std::ostringstream oss;
+  oss << range << "-fold radii, " << n_classes << " classes";
+  IMP::benchmark::report("polydisperse close pairs", oss.str(), runtime, n_pairs);
+}
+}
+
+int main(int argc, char **argv) {
+  IMP::setup_from_argv(argc, argv,
+                       "Benchmark of the shared close pair list with polydisperse radii");
+  unsigned int n_vesicles = IMP::run_quick_test ? 1000 : 50000;
+  time_range(1, n_vesicles);
+  time_range(2, n_vesicles);
+  time_range(3, n_vesicles);
+  return IMP::benchmark::get_return_value();
+}
@@ -0,0 +1,258 @@
+"""
+Performance and statistical regression benchmark of the insulin secretion model.
+
+Runs the test.py cell (IMP.insulinsecretion.cell) with fixed seeds for several
+numbers of vesicles and records, for each size:
+ - BD steps per second, peak RSS and the time spent in scoring, in the
+   lifecycle optimizer state and in the rest of the integrator;
+ - the secretion rate, the docked fraction and the 8-shell RDF of the
+   vesicles between the nucleus and the cell membrane, over several seeds.
+
+The results are compared with stored baselines: performance must not drop
+by more than a relative tolerance, and each biological observable must be
+within a number of standard errors of its baseline. The report ends with
+PASS or FAIL, and the exit status is non-zero on FAIL so it can gate merges.
+
+Baselines are only written by --update-baselines, from a run on the
+reference machine. A size without a baseline of the same number of frames
+fails the gate, unless --allow-missing-baselines is given, so that a
+missing or stale baseline file does not pass without comparing anything.
+"""
+
+from __future__ import print_function, division
+import argparse
+import json
+import math
+import os
+import random
+import resource
+import sys
+import time
+import IMP
+import IMP.core
+import IMP.insulinsecretion
+import IMP.insulinsecretion.cell
+
+N_SHELLS = 8
+DEFAULT_BASELINES = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                 'regression_baselines.json')
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument("--sizes", nargs='+', type=int, default=[100, 200, 400],
+                        help="numbers of vesicles")
+    parser.add_argument("--seeds", nargs='+', type=int, default=[1, 2, 3, 4],
+                        help="seeds of the replicate runs of each size")
+    parser.add_argument("--frames", type=int, default=2000,
+                        help="BD frames of each run")
+    parser.add_argument("--sample-interval", type=int, default=100,
+                        help="BD frames between samples of the observables")
+    parser.add_argument("--ready-state", type=int, default=20,
+                        help="READY_STATE of the runs")
+    parser.add_argument("--baselines", default=DEFAULT_BASELINES,
+                        help="baseline file")
+    parser.add_argument("--update-baselines", action='store_true',
+                        help="write the results as the new baselines")
+    parser.add_argument("--allow-missing-baselines", action='store_true',
+                        help="only report the sizes without a comparable baseline")
+    parser.add_argument("--performance-tolerance", type=float, default=0.2,
+                        help="allowed relative drop of the steps per second")
+    parser.add_argument("--z", type=float, default=3.0,
+                        help="allowed number of standard errors of the observables")
+    parser.add_argument("--report", default=None,
+                        help="also write the results as JSON to this file")
+    # IMP runs the benchmarks with these flags
+    parser.add_argument("--run_quick_test", action='store_true')
+    parser.add_argument("--deprecation_exceptions", action='store_true')
+    args = parser.parse_args()
+    if args.run_quick_test:
+        args.sizes, args.seeds, args.frames = [50], [1], 200
+    return args
+
+
+def get_peak_rss_mb():
+    '''Return the peak resident set size of this process in MB'''
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # kilobytes on Linux, bytes on macOS
+    return rss / 1024. / 1024. if sys.platform == 'darwin' else rss / 1024.
+
+
+def get_shell_densities(cell):
+    '''Return the vesicle number density in N_SHELLS equal-width shells
+       between the nucleus and the cell membrane, normalized to mean 1'''
+    r0 = cell.nucleus_sphere.get_radius()
+    r1 = cell.pbc_sphere.get_radius()
+    center = cell.pbc_sphere.get_center()
+    counts = [0] * N_SHELLS
+    for v in cell.vesicles:
+        r = (IMP.core.XYZ(v).get_coordinates() - center).get_magnitude()
+        i = int((r - r0) / (r1 - r0) * N_SHELLS)
+        counts[min(max(i, 0), N_SHELLS - 1)] += 1
+    volumes = [(r0 + (i + 1) * (r1 - r0) / N_SHELLS) ** 3
+               - (r0 + i * (r1 - r0) / N_SHELLS) ** 3 for i in range(N_SHELLS)]
+    densities = [c / v for c, v in zip(counts, volumes)]
+    mean = sum(densities) / N_SHELLS
+    return [d / mean if mean > 0 else 0. for d in densities]
+
+
+def get_docked_fraction(cell):
+    return sum(1 for v in cell.vesicles
+               if IMP.insulinsecretion.DockingStateDecorator(v).get_dstate() != 0) \
+        / len(cell.vesicles)
+
+
+def time_components(cell, sf, lcos, n):
+    '''Time n evaluations of the scoring function and n periods of the
+       lifecycle optimizer state, restoring the cell afterwards'''
+    snapshot = cell.create_snapshot()
+    t = time.time()
+    for i in range(n):
+        sf.evaluate(True)
+    t_score = (time.time() - t) / n
+    t = time.time()
+    for i in range(n * cell.params.PERIOD):
+        lcos.update()
+    t_lifecycle = (time.time() - t) / n
+    snapshot.restore()
+    return t_score, t_lifecycle
+
+
+def seed_generators(seed):
+    '''Seed the Python and the IMP random number generators'''
+    random.seed(seed)
+    IMP.random_number_generator.seed(seed)
+
+
+def run(n_vesicles, seed, args):
+    '''Run one seeded scenario and return its measurements'''
+    IMP.set_log_level(IMP.SILENT)
+    params = IMP.insulinsecretion.cell.CellParameters(N_VESICLES=n_vesicles, SEED=seed)
+    cell = IMP.insulinsecretion.cell.Cell(params)
+    sf = cell.create_scoring_function()
+    bd = cell.create_simulator(sf)
+    lcos = cell.create_lifecycle(args.ready_state)
+    t_score, t_lifecycle = time_components(
+        cell, sf, cell.create_lifecycle(args.ready_state), 5)
+    # every draw of the run (BD noise, phase flips, resets) comes from the
+    # seeded generators, whatever ran before in this process
+    seed_generators(seed)
+    bd.add_optimizer_state(lcos)
+    docked, shells = [], [0.] * N_SHELLS
+    n_samples = 0
+    t = time.time()
+    done = 0
+    while done < args.frames:
+        n = min(args.sample_interval, args.frames - done)
+        bd.optimize(n)
+        done += n
+        docked.append(get_docked_fraction(cell))
+        shells = [s + d for s, d in zip(shells, get_shell_densities(cell))]
+        n_samples += 1
+    elapsed = time.time() - t
+    sim_time_s = args.frames * params.BD_STEP_SIZE_SEC
+    t_step_score = t_score
+    t_step_lifecycle = t_lifecycle / params.PERIOD
+    return {'steps_per_second': args.frames / elapsed,
+            'time_scoring_per_step': t_step_score,
+            'time_lifecycle_per_step': t_step_lifecycle,
+            'time_integrator_per_step': max(0., elapsed / args.frames
+                                            - t_step_score - t_step_lifecycle),
+            'secretion_rate': cell.get_number_of_secretions() / sim_time_s,
+            'docked_fraction': sum(docked) / len(docked),
+            'rdf': [s / n_samples for s in shells]}
+
+
+def get_mean_and_se(values):
+    n = len(values)
+    mean = sum(values) / n
+    if n < 2:
+        return mean, 0.
+    var = sum((v - mean) ** 2 for v in values) / (n - 1)
+    return mean, math.sqrt(var / n)
+
+
+def summarize(runs):
+    '''Return the mean and standard error of each observable over the seeds'''
+    summary = {'peak_rss_mb': get_peak_rss_mb()}
+    for key in runs[0]:
+        if key == 'rdf':
+            summary['rdf'] = [get_mean_and_se([r['rdf'][i] for r in runs])
+                              for i in range(N_SHELLS)]
+        else:
+            summary[key] = get_mean_and_se([r[key] for r in runs])
+    return summary
+
+
+def compare(size, summary, baseline, args):
+    '''Return the lines of the report of one size and whether it passed'''
+    lines, ok = [], True
+
+    def check(name, value, base, passed):
+        lines.append("  %-28s %12.5g  baseline %12.5g  %s"
+                     % (name, value, base, "ok" if passed else "FAIL"))
+        return passed
+
+    base, value = baseline['steps_per_second'][0], summary['steps_per_second'][0]
+    ok &= check('steps_per_second', value, base,
+                value >= (1 - args.performance_tolerance) * base)
+    observables = [('secretion_rate', summary['secretion_rate'], baseline['secretion_rate']),
+                   ('docked_fraction', summary['docked_fraction'], baseline['docked_fraction'])]
+    observables += [('rdf_shell_%d' % i, summary['rdf'][i], baseline['rdf'][i])
+                    for i in range(N_SHELLS)]
+    for name, (mean, se), (base_mean, base_se) in observables:
+        tolerance = args.z * math.sqrt(se ** 2 + base_se ** 2)
+        # a floor for observables that did not vary in the replicates
+        tolerance = max(tolerance, 1e-6 + 1e-3 * abs(base_mean))
+        ok &= check(name, mean, base_mean, abs(mean - base_mean) <= tolerance)
+    return lines, ok
+
+
+def main():
+    args = parse_args()
+    results = {}
+    for size in args.sizes:
+        runs = [run(size, seed, args) for seed in args.seeds]
+        results[str(size)] = summarize(runs)
+
+    baselines = None
+    if os.path.exists(args.baselines) and not args.update_baselines:
+        with open(args.baselines) as fh:
+            baselines = json.load(fh)
+
+    passed = True
+    for size in args.sizes:
+        s = results[str(size)]
+        print("N_VESICLES=%d: %.1f steps/s, peak RSS %.1f MB, per step: scoring %.3g s,"
+              " lifecycle %.3g s, integrator %.3g s"
+              % (size, s['steps_per_second'][0], s['peak_rss_mb'],
+                 s['time_scoring_per_step'][0], s['time_lifecycle_per_step'][0],
+                 s['time_integrator_per_step'][0]))
+        if baselines is None or str(size) not in baselines \
+                or baselines[str(size)].get('frames') != args.frames:
+            print("  no comparable baseline%s"
+                  % ("" if args.allow_missing_baselines else "  FAIL"))
+            passed &= args.allow_missing_baselines
+            continue
+        lines, ok = compare(size, s, baselines[str(size)], args)
+        print('\n'.join(lines))
+        passed &= ok
+
+    for size in args.sizes:
+        results[str(size)]['frames'] = args.frames
+        results[str(size)]['seeds'] = args.seeds
+    if args.report:
+        with open(args.report, 'w') as fh:
+            json.dump(results, fh, indent=1)
+    if args.update_baselines:
+        with open(args.baselines, 'w') as fh:
+            json.dump(results, fh, indent=1)
+        print("Baselines written to %s" % args.baselines)
+    elif not args.run_quick_test:
+        print("PASS" if passed else "FAIL")
+        if not passed:
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
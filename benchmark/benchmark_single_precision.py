@@ -0,0 +1,167 @@
+"""
+Validation benchmark of the single precision mode of the insulin secretion model.
+
+Runs the test.py cell (IMP.insulinsecretion.cell) with fixed seeds in double
+and in single precision (the float radial kernel of MultiCellRadialRestraint
+and the float position history of MultiTauDiffusionOptimizerState), and
+records for each mode:
+ - the score of the initial cell;
+ - the time of a scoring function evaluation and of a diffusion history
+   update, the two kernels that stream the per-vesicle arrays;
+ - the secretion rate and the docked fraction over several seeds.
+
+The Python and IMP generators are seeded before the cell is built and again
+before the BD run, so the two modes of a seed start from the same cell and
+draw the same random numbers. The run fails if:
+ - the single precision score of a seed differs from the double precision
+   one by more than a relative tolerance;
+ - a single precision kernel is slower than in double precision;
+ - the secretion statistics of the two modes differ by more than a number
+   of standard errors.
+The report ends with PASS or FAIL, and the exit status is non-zero on FAIL.
+"""
+
+from __future__ import print_function, division
+import argparse
+import math
+import random
+import sys
+import time
+import IMP
+import IMP.insulinsecretion
+import IMP.insulinsecretion.cell
+
+MODES = [('double', False), ('single', True)]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument("--vesicles", type=int, default=2000,
+                        help="number of vesicles")
+    parser.add_argument("--seeds", nargs='+', type=int, default=[1, 2, 3, 4],
+                        help="seeds of the replicate runs of each mode")
+    parser.add_argument("--frames", type=int, default=2000,
+                        help="BD frames of each run")
+    parser.add_argument("--repeats", type=int, default=20,
+                        help="evaluations of each timed kernel")
+    parser.add_argument("--ready-state", type=int, default=20,
+                        help="READY_STATE of the runs")
+    parser.add_argument("--k-rdf", type=float, default=1.0,
+                        help="K_RDF of the runs, non-zero so that the RDF kernel works")
+    parser.add_argument("--z", type=float, default=3.0,
+                        help="allowed number of standard errors of the observables")
+    parser.add_argument("--score-tolerance", type=float, default=1e-3,
+                        help="allowed relative difference of the single precision score")
+    parser.add_argument("--min-speedup", type=float, default=1.0,
+                        help="required speedup of each single precision kernel")
+    # IMP runs the benchmarks with these flags
+    parser.add_argument("--run_quick_test", action='store_true')
+    parser.add_argument("--deprecation_exceptions", action='store_true')
+    args = parser.parse_args()
+    if args.run_quick_test:
+        args.vesicles, args.seeds, args.frames, args.repeats = 100, [1], 100, 2
+    return args
+
+
+def seed_generators(seed):
+    '''Seed the Python and IMP generators'''
+    random.seed(seed)
+    IMP.random_number_generator.seed(seed)
+
+
+def get_docked_fraction(cell):
+    return sum(1 for v in cell.vesicles
+               if IMP.insulinsecretion.DockingStateDecorator(v).get_dstate() != 0) \
+        / len(cell.vesicles)
+
+
+def time_kernels(cell, sf, mtds, n):
+    '''Time n evaluations of the scoring function and n diffusion history
+       updates, restoring the cell afterwards'''
+    snapshot = cell.create_snapshot()
+    t = time.time()
+    for i in range(n):
+        sf.evaluate(True)
+    t_score = (time.time() - t) / n
+    t = time.time()
+    for i in range(n):
+        mtds.update_always()
+    t_history = (time.time() - t) / n
+    snapshot.restore()
+    return t_score, t_history
+
+
+def run(seed, single_precision, args):
+    '''Run one seeded scenario in one mode and return its measurements'''
+    IMP.set_log_level(IMP.SILENT)
+    seed_generators(seed)
+    params = IMP.insulinsecretion.cell.CellParameters(N_VESICLES=args.vesicles, SEED=seed)
+    cell = IMP.insulinsecretion.cell.Cell(params)
+    sf = cell.create_scoring_function(k_rdf=args.k_rdf,
+                                      single_precision=single_precision)
+    score = sf.evaluate(False)
+    mtds = IMP.insulinsecretion.MultiTauDiffusionOptimizerState(
+        cell.m, cell.vesicles, params.get_bd_step_size_fs(), 16, 16, 1,
+        single_precision)
+    t_score, t_history = time_kernels(cell, sf, mtds, args.repeats)
+    bd = cell.create_simulator(sf)
+    bd.add_optimizer_state(cell.create_lifecycle(args.ready_state))
+    seed_generators(seed)
+    bd.optimize(args.frames)
+    sim_time_s = args.frames * params.BD_STEP_SIZE_SEC
+    return {'score': score,
+            'time_scoring': t_score,
+            'time_history': t_history,
+            'secretion_rate': cell.get_number_of_secretions() / sim_time_s,
+            'docked_fraction': get_docked_fraction(cell)}
+
+
+def get_mean_and_se(values):
+    n = len(values)
+    mean = sum(values) / n
+    if n < 2:
+        return mean, 0.
+    var = sum((v - mean) ** 2 for v in values) / (n - 1)
+    return mean, math.sqrt(var / n)
+
+
+def main():
+    args = parse_args()
+    runs, results = {}, {}
+    for name, single_precision in MODES:
+        runs[name] = [run(seed, single_precision, args) for seed in args.seeds]
+        results[name] = dict((key, get_mean_and_se([r[key] for r in runs[name]]))
+                             for key in runs[name][0])
+
+    passed = True
+    for seed, d, s in zip(args.seeds, runs['double'], runs['single']):
+        difference = abs(s['score'] - d['score'])
+        ok = difference <= args.score_tolerance * max(1., abs(d['score']))
+        print("score seed %-6d double %14.8g  single %14.8g  %s"
+              % (seed, d['score'], s['score'], "ok" if ok else "FAIL"))
+        passed &= ok
+    double, single = results['double'], results['single']
+    for key in ('time_scoring', 'time_history'):
+        speedup = double[key][0] / single[key][0] if single[key][0] > 0 else float('inf')
+        ok = speedup >= args.min_speedup
+        print("%-16s double %10.4g s  single %10.4g s  speedup %.2f  %s"
+              % (key, double[key][0], single[key][0], speedup,
+                 "ok" if ok else "FAIL"))
+        passed &= ok
+    for key in ('secretion_rate', 'docked_fraction'):
+        (mean, se), (base_mean, base_se) = single[key], double[key]
+        tolerance = args.z * math.sqrt(se ** 2 + base_se ** 2)
+        # a floor for observables that did not vary in the replicates
+        tolerance = max(tolerance, 1e-6 + 1e-3 * abs(base_mean))
+        ok = abs(mean - base_mean) <= tolerance
+        print("%-16s double %10.5g  single %10.5g  %s"
+              % (key, base_mean, mean, "ok" if ok else "FAIL"))
+        passed &= ok
+    if not args.run_quick_test:
+        print("PASS" if passed else "FAIL")
+        if not passed:
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,169 @@
+/**
+ *  \file benchmark_spatial_reordering.cpp
+ *  \brief Benchmark of the vesicle containers in index order and in Morton order.
+ *
+ * Description:
+ * 1, 50000 vesicles (1000 in a quick test) are placed at random points of the cytoplasm,
+ *    as after many secretion cycles, so their index order has no spatial locality.
+ * 2, The excluded volume of the active set, the docking lookups of every vesicle in the
+ *    channel index and the multi-tau correlator update are timed in index order, then again
+ *    after a SpatialReorderingOptimizerState sorted the containers and permuted the
+ *    correlator history along a Morton curve.
+ * 3, One more pass of each workload is run under the hardware counters, and its L1 data
+ *    and last level cache misses per vesicle are reported next to the time (null if the
+ *    counters are not available, see hardware_counters.h).
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/ActiveSetExcludedVolumeRestraint.h>
+#include <IMP/insulinsecretion/ChannelSurfaceIndex.h>
+#include <IMP/insulinsecretion/MultiTauDiffusionOptimizerState.h>
+#include <IMP/insulinsecretion/SpatialReorderingOptimizerState.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/benchmark/benchmark_macros.h>
+#include <IMP/benchmark/utility.h>
+#include <IMP/algebra/vector_generators.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/flags.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "hardware_counters.h"
+
+namespace {
+std::string order = "both";
+IMP::AddStringFlag orf("order", "Containers to time: index, morton or both", &order);
+
+const double R_CELL = 30250; // PBC radius of test.py, A
+const double R_NUCLEUS = 18340; // NE radius of test.py, A
+const double R_VESICLE = 200; // small enough for 50000 vesicles to fit, A
+const double R_CHANNEL = 100;
+const double CONTACT_RANGE = 100;
+
+//! XYZR particles at random points between the nucleus and the membrane
+IMP::ParticleIndexes create_vesicles(IMP::Model *m, unsigned int n) {
+  IMP::algebra::Sphere3D cell(IMP::algebra::Vector3D(0, 0, 0), R_CELL - R_VESICLE);
+  IMP::ParticleIndexes ret;
+  while (ret.size() < n) {
+    IMP::algebra::Vector3D v = IMP::algebra::get_random_vector_in(cell);
+    if (v.get_magnitude() < R_NUCLEUS + R_VESICLE) {
+      continue;
+    }
+    IMP::ParticleIndex pi = m->add_particle("Vesicle");
+    IMP::core::XYZR::setup_particle(m, pi, IMP::algebra::Sphere3D(v, R_VESICLE))
+        .set_coordinates_are_optimized(true);
+    ret.push_back(pi);
+  }
+  return ret;
+}
+
+//! XYZR particles on the membrane
+IMP::ParticleIndexes create_channels(IMP::Model *m, unsigned int n) {
+  IMP::algebra::Sphere3D membrane(IMP::algebra::Vector3D(0, 0, 0), R_CELL);
+  IMP::ParticleIndexes ret;
+  for (unsigned int i = 0; i < n; ++i) {
+    IMP::ParticleIndex pi = m->add_particle("CaChannel");
+    IMP::core::XYZR::setup_particle(
+        m, pi, IMP::algebra::Sphere3D(IMP::algebra::get_random_vector_on(membrane),
+                                      R_CHANNEL));
+    ret.push_back(pi);
+  }
+  return ret;
+}
+
+//! print the cache misses per vesicle of one pass of a workload
+template <class Workload>
+void count_misses(std::string name, std::string order_name, unsigned int n_vesicles,
+                  HardwareCounters &counters, Workload workload) {
+  counters.start();
+  workload();
+  std::vector<double> counts = counters.stop();
+  std::cout << name << " " << order_name << " cache misses per vesicle:";
+  for (unsigned int i = 2; i < 4; ++i) {
+    std::cout << " " << COUNTER_NAMES[i] << " ";
+    if (counts[i] < 0) {
+      std::cout << "null";
+    } else {
+      std::cout << counts[i] / n_vesicles;
+    }
+  }
+  std::cout << std::endl;
+}
+
+//! time and count one pass of each workload over the current order
+void time_workloads(std::string order_name, IMP::Model *m,
+                    IMP::insulinsecretion::VesicleActiveSet *active_set,
+                    IMP::insulinsecretion::ChannelSurfaceIndex *channel_index,
+                    IMP::ScoringFunction *sf,
+                    IMP::insulinsecretion::MultiTauDiffusionOptimizerState *mtds,
+                    HardwareCounters &counters) {
+  unsigned int n_vesicles = active_set->get_number_of_active_particles();
+  double runtime, score = 0;
+  sf->evaluate(true); // rebuild the close pairs of the new order outside the timing
+  IMP_TIME({ score += sf->evaluate(true); }, runtime);
+  IMP::benchmark::report("spatial reordering excluded volume", order_name,
+                         runtime, score);
+  count_misses("excluded volume", order_name, n_vesicles, counters,
+               [&]() { score += sf->evaluate(true); });
+
+  double n_contacts = 0;
+  auto docking_lookup = [&]() {
+    IMP::ParticleIndexes vesicles = active_set->get_active_container()->get_contents();
+    for (unsigned int i = 0; i < vesicles.size(); ++i) {
+      IMP::core::XYZR xyzr(m, vesicles[i]);
+      if (channel_index->get_is_near_surface(xyzr.get_coordinates())) {
+        n_contacts += channel_index->get_sites_in_contact(
+            xyzr.get_sphere(), CONTACT_RANGE).size();
+      }
+    }
+  };
+  IMP_TIME(docking_lookup(), runtime);
+  IMP::benchmark::report("spatial reordering docking lookup", order_name,
+                         runtime, n_contacts);
+  count_misses("docking lookup", order_name, n_vesicles, counters, docking_lookup);
+
+  IMP_TIME(mtds->update(), runtime);
+  IMP::benchmark::report("spatial reordering diffusion update", order_name,
+                         runtime, mtds->get_diffusion_coefficient());
+  count_misses("diffusion update", order_name, n_vesicles, counters,
+               [&]() { mtds->update(); });
+}
+}
+
+int main(int argc, char **argv) {
+  IMP::setup_from_argv(argc, argv,
+                       "Benchmark of the vesicle containers in index and Morton order");
+  unsigned int n_vesicles = IMP::run_quick_test ? 1000 : 50000;
+  IMP_NEW(IMP::Model, m, ());
+  IMP::ParticleIndexes vesicles = create_vesicles(m, n_vesicles);
+  IMP::ParticleIndexes channels = create_channels(m, 451);
+
+  IMP_NEW(IMP::insulinsecretion::VesicleActiveSet, active_set, (m, vesicles, channels));
+  active_set->update();
+  IMP_NEW(IMP::insulinsecretion::ActiveSetExcludedVolumeRestraint, ev,
+          (active_set, 1e-5, 10));
+  IMP::Pointer<IMP::ScoringFunction> sf = ev->create_scoring_function();
+  IMP_NEW(IMP::insulinsecretion::ChannelSurfaceIndex, channel_index,
+          (m, channels, IMP::algebra::Sphere3D(IMP::algebra::Vector3D(0, 0, 0), R_CELL),
+           R_VESICLE + R_CHANNEL + CONTACT_RANGE));
+  IMP_NEW(IMP::insulinsecretion::MultiTauDiffusionOptimizerState, mtds,
+          (m, vesicles, 1.0, 8, 4));
+  HardwareCounters counters;
+
+  if (order == "index" || order == "both") {
+    time_workloads("index", m, active_set, channel_index, sf, mtds, counters);
+  }
+  if (order == "morton" || order == "both") {
+    IMP_NEW(IMP::insulinsecretion::SpatialReorderingOptimizerState, sros,
+            (m, vesicles,
+             IMP::algebra::BoundingBox3D(IMP::algebra::Vector3D(-R_CELL, -R_CELL, -R_CELL),
+                                         IMP::algebra::Vector3D(R_CELL, R_CELL, R_CELL))));
+    sros->set_active_set(active_set);
+    sros->add_diffusion_state(mtds);
+    sros->update_always();
+    time_workloads("morton", m, active_set, channel_index, sf, mtds, counters);
+  }
+  return IMP::benchmark::get_return_value();
+}
@@ -0,0 +1,132 @@
+/**
+ *  \file hardware_counters.h
+ *  \brief Linux perf_event_open counters of the calling thread for the benchmarks.
+ *
+ * Description:
+ * 1, Cycles, instructions, L1 data cache read misses, last level cache misses and branch
+ *    misses are counted in user space between start() and stop().
+ * 2, A counter that cannot be opened (no kernel support, perf_event_paranoid, a virtual
+ *    machine, not Linux) reads as -1, so the benchmarks still run without counters.
+ * 3, The counters are one perf group, so they count over the same time slices. If the PMU
+ *    multiplexes the group, the counts are scaled by the enabled over the running time;
+ *    if the group never ran, e.g., it needs more counters than the PMU has, all read as -1.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_BENCHMARK_HARDWARE_COUNTERS_H
+#define IMPINSULINSECRETION_BENCHMARK_HARDWARE_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const unsigned int N_COUNTERS = 5;
+const char *const COUNTER_NAMES[N_COUNTERS] = {"cycles", "instructions", "l1d_misses",
+                                               "llc_misses", "branch_misses"};
+
+//! A set of hardware counters of this thread, each of which may be unavailable
+class HardwareCounters {
+  int fds_[N_COUNTERS];
+  int leader_; // the fd of the group leader, the first counter opened, or -1
+
+#ifdef __linux__
+  static int open_counter(std::uint32_t type, std::uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd < 0; // the members follow the leader
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+  }
+#endif
+
+ public:
+  HardwareCounters() : leader_(-1) {
+#ifdef __linux__
+    const std::uint32_t types[N_COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                             PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+                                             PERF_TYPE_HARDWARE};
+    const std::uint64_t configs[N_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (unsigned int i = 0; i < N_COUNTERS; ++i) {
+      fds_[i] = open_counter(types[i], configs[i], leader_);
+      if (leader_ < 0) {
+        leader_ = fds_[i];
+      }
+    }
+#else
+    for (unsigned int i = 0; i < N_COUNTERS; ++i) {
+      fds_[i] = -1;
+    }
+#endif
+  }
+
+  ~HardwareCounters() {
+#ifdef __linux__
+    // the members before the leader
+    for (unsigned int i = N_COUNTERS; i > 0; --i) {
+      if (fds_[i - 1] >= 0) {
+        close(fds_[i - 1]);
+      }
+    }
+#endif
+  }
+
+  bool get_is_available(unsigned int i) const { return fds_[i] >= 0; }
+
+  void start() {
+#ifdef __linux__
+    if (leader_ >= 0) {
+      ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+  }
+
+  //! stop the counters and read them, -1 for an unavailable counter
+  /** The counts are scaled to the enabled time if the group was multiplexed. */
+  std::vector<double> stop() {
+    std::vector<double> ret(N_COUNTERS, -1);
+#ifdef __linux__
+    if (leader_ < 0) {
+      return ret;
+    }
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // nr, time_enabled, time_running, then the values in the order of opening
+    std::uint64_t data[3 + N_COUNTERS];
+    ssize_t n_read = read(leader_, data, sizeof(data));
+    if (n_read < static_cast<ssize_t>(3 * sizeof(std::uint64_t))
+        || n_read < static_cast<ssize_t>((3 + data[0]) * sizeof(std::uint64_t))
+        || data[2] == 0) {
+      return ret;
+    }
+    double scale = static_cast<double>(data[1]) / data[2];
+    unsigned int k = 0;
+    for (unsigned int i = 0; i < N_COUNTERS && k < data[0]; ++i) {
+      if (fds_[i] >= 0) {
+        ret[i] = data[3 + k++] * scale;
+      }
+    }
+#endif
+    return ret;
+  }
+};
+
+#endif /* IMPINSULINSECRETION_BENCHMARK_HARDWARE_COUNTERS_H */
@@ -1,3 +1,3 @@
-set(pyfiles "")
-set(cppfiles "")
+set(pyfiles "insulinsecretion_sweep;insulinsecretion_trajectory_to_rmf")
+set(cppfiles "insulinsecretion_analyze.cpp")
 set(cudafiles "")
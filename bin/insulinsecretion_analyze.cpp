@@ -0,0 +1,445 @@
+/**
+ *  \file insulinsecretion_analyze.cpp
+ *  \brief Streaming analysis of insulin vesicle trajectories.
+ *
+ * Description:
+ * 1, Reads a compact trajectory (memory mapped, see CompactTrajectoryReader) or the
+ *    text output of test.py (*_coord.xvg with the optional *_docked.xvg and
+ *    *_secretion.xvg), one frame at a time, so memory stays bounded by the longest
+ *    MSD lag and the block size, not by the length of the trajectory.
+ * 2, Computes in one pass the mean-squared displacement at log-spaced lags, the radial
+ *    distribution of the vesicles around the nucleus in windows of frames, the histogram
+ *    of the docking dwell times and the cumulative secretion curve.
+ * 3, Frames are buffered in blocks; the MSD and RDF of a full block are split across
+ *    threads, while the dwell times and secretions are tracked frame by frame as read.
+ * 4, A vesicle that is secreted is reset near the nucleus, so displacements are only
+ *    counted between frames of the same life of a vesicle.
+ * 5, The RDF is centered on the nucleus, whose center and radius are read from a compact
+ *    trajectory or given by the nucleus_x, nucleus_y and nucleus_z flags, so off-center
+ *    cells are analyzed correctly; for a multi-cell run, analyze one cell at a time with
+ *    its nucleus, the vesicles of the other cells being beyond rdf_max.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/CompactTrajectoryReader.h>
+#include <IMP/flags.h>
+#include <IMP/exception.h>
+#include <IMP/algebra/Sphere3D.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::string output_prefix = "analysis";
+boost::int64_t max_lag = 1000;
+boost::int64_t rdf_window = 100;
+boost::int64_t block_frames = 256;
+boost::int64_t n_threads = 0;
+double time_step = 1.0;
+double rdf_bin = 500.0;
+double rdf_max = 30250.0; // PBC radius of test.py, A
+double nucleus_radius = 18340.0; // NE radius of test.py, A
+double nucleus_x = 0, nucleus_y = 0, nucleus_z = 0; // NE center of test.py, A
+std::string nucleus_name = "md";
+
+IMP::AddStringFlag opf("output_prefix", "Prefix of the output files", &output_prefix);
+IMP::AddIntFlag mlf("max_lag", "Longest MSD lag in frames", &max_lag);
+IMP::AddIntFlag rwf("rdf_window", "Number of frames averaged in each RDF", &rdf_window);
+IMP::AddIntFlag bff("block_frames", "Number of frames analyzed per block", &block_frames);
+IMP::AddIntFlag ntf("threads", "Number of analysis threads, 0 for all cores", &n_threads);
+IMP::AddFloatFlag tsf("time_step", "Time between two frames, for the time columns", &time_step);
+IMP::AddFloatFlag rbf("rdf_bin", "Width of the RDF shells in A", &rdf_bin);
+IMP::AddFloatFlag rmf("rdf_max", "Outer radius of the RDF in A", &rdf_max);
+IMP::AddFloatFlag nrf("nucleus_radius",
+                      "Radius of the nucleus in A, read from a compact trajectory if present",
+                      &nucleus_radius);
+IMP::AddFloatFlag nxf("nucleus_x",
+                      "x of the nucleus center in A, read from a compact trajectory if present",
+                      &nucleus_x);
+IMP::AddFloatFlag nyf("nucleus_y",
+                      "y of the nucleus center in A, read from a compact trajectory if present",
+                      &nucleus_y);
+IMP::AddFloatFlag nzf("nucleus_z",
+                      "z of the nucleus center in A, read from a compact trajectory if present",
+                      &nucleus_z);
+IMP::AddStringFlag nnf("nucleus_name",
+                       "Name of the nucleus particle in a compact trajectory", &nucleus_name);
+
+const double PI = 3.14159265358979323846;
+
+//! One frame of the trajectory
+struct Frame {
+  std::vector<double> coordinates; // 3 per vesicle
+  IMP::Ints dstates; // one per vesicle, empty if not recorded
+  IMP::Ints secretions; // one per vesicle, empty if not recorded
+  int total_secretion; // -1 if not recorded
+};
+
+//! A sequential source of frames
+class FrameSource {
+ public:
+  virtual ~FrameSource() {}
+  virtual unsigned int get_number_of_vesicles() const = 0;
+  //! read the next frame into frame, returns false at the end
+  virtual bool read_next_frame(Frame &frame) = 0;
+};
+
+//! Frames of a compact trajectory
+class CompactFrameSource : public FrameSource {
+  IMP::Pointer<IMP::insulinsecretion::CompactTrajectoryReader> reader_;
+
+ public:
+  CompactFrameSource(std::string file_name)
+    : reader_(new IMP::insulinsecretion::CompactTrajectoryReader(file_name)) {
+    for (unsigned int i = 0; i < reader_->get_number_of_static_particles(); ++i) {
+      if (reader_->get_static_name(i) == nucleus_name) {
+        IMP::algebra::Sphere3D nucleus = reader_->get_static_sphere(i);
+        nucleus_radius = nucleus.get_radius();
+        nucleus_x = nucleus.get_center()[0];
+        nucleus_y = nucleus.get_center()[1];
+        nucleus_z = nucleus.get_center()[2];
+      }
+    }
+  }
+
+  unsigned int get_number_of_vesicles() const override {
+    return reader_->get_number_of_vesicles();
+  }
+
+  bool read_next_frame(Frame &frame) override {
+    using namespace IMP::insulinsecretion;
+    if (!reader_->read_next_frame()) return false;
+    unsigned int n = get_number_of_vesicles();
+    frame.coordinates.resize(3 * n);
+    frame.dstates.assign(n, 0);
+    frame.secretions.assign(n, 0);
+    frame.total_secretion = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+      IMP::algebra::Vector3D v = reader_->get_vesicle_sphere(i).get_center();
+      for (unsigned int k = 0; k < 3; ++k) {
+        frame.coordinates[3 * i + k] = v[k];
+      }
+      if (reader_->get_vesicle_has_field(i, DOCKING_STATE_FIELD)) {
+        frame.dstates[i] = reader_->get_vesicle_field(i, DOCKING_STATE_FIELD);
+      }
+      if (reader_->get_vesicle_has_field(i, SECRETION_COUNTER_FIELD)) {
+        frame.secretions[i] = reader_->get_vesicle_field(i, SECRETION_COUNTER_FIELD);
+        frame.total_secretion += frame.secretions[i];
+      }
+    }
+    return true;
+  }
+};
+
+//! parse the numbers of one text line into values, returns their count
+unsigned int parse_line(const std::string &line, std::vector<double> &values) {
+  values.clear();
+  const char *p = line.c_str();
+  char *end;
+  for (double d = std::strtod(p, &end); end != p; d = std::strtod(p, &end)) {
+    values.push_back(d);
+    p = end;
+  }
+  return values.size();
+}
+
+//! Frames of the text output of test.py, one line per frame in each file
+class XvgFrameSource : public FrameSource {
+  std::ifstream coord_;
+  std::ifstream docked_;
+  std::ifstream secretion_;
+  std::string line_; // reused, a coordinate line holds 3 values per vesicle
+  std::vector<double> values_;
+  unsigned int n_;
+  bool has_first_; // the first coordinate line was read to count the vesicles
+
+ public:
+  XvgFrameSource(std::string coord_name)
+    : coord_(coord_name.c_str()), n_(0), has_first_(false) {
+    if (!coord_) {
+      IMP_THROW("Cannot open " << coord_name, IMP::IOException);
+    }
+    std::string base = coord_name.substr(0, coord_name.size() - std::string("_coord.xvg").size());
+    docked_.open((base + "_docked.xvg").c_str());
+    secretion_.open((base + "_secretion.xvg").c_str());
+    if (std::getline(coord_, line_)) {
+      n_ = parse_line(line_, values_) / 3;
+      has_first_ = true;
+    }
+  }
+
+  unsigned int get_number_of_vesicles() const override { return n_; }
+
+  bool read_next_frame(Frame &frame) override {
+    if (!has_first_) {
+      if (!std::getline(coord_, line_)) return false;
+      parse_line(line_, values_);
+    }
+    has_first_ = false;
+    if (values_.size() < 3 * n_) return false; // truncated last line
+    frame.coordinates.assign(values_.begin(), values_.begin() + 3 * n_);
+    frame.dstates.clear();
+    if (docked_.is_open() && std::getline(docked_, line_)
+        && parse_line(line_, values_) >= n_) {
+      frame.dstates.assign(values_.begin(), values_.begin() + n_);
+    }
+    frame.secretions.clear();
+    frame.total_secretion = -1;
+    if (secretion_.is_open() && std::getline(secretion_, line_)
+        && parse_line(line_, values_) > 0) {
+      frame.total_secretion = static_cast<int>(values_[0]);
+    }
+    return true;
+  }
+};
+
+//! returns the log-spaced MSD lags up to max_lag, about ten per decade
+IMP::Ints get_lags(int max_lag) {
+  IMP::Ints ret;
+  for (int k = 0;; ++k) {
+    int lag = static_cast<int>(std::floor(std::pow(10.0, k / 10.0) + 0.5));
+    if (lag > max_lag) break;
+    if (ret.empty() || lag != ret.back()) ret.push_back(lag);
+  }
+  return ret;
+}
+
+//! Accumulates the statistics of the frames in one pass
+class StreamingAnalysis {
+  unsigned int n_; // the number of vesicles
+  unsigned int block_; // frames per block, a multiple of the RDF window
+  unsigned int capacity_; // frames kept in the history ring
+  unsigned int n_threads_;
+  IMP::Ints lags_;
+  IMP::algebra::Vector3D center_; // the center of the nucleus
+  unsigned int n_bins_;
+  std::vector<double> coordinates_; // history ring, 3 per vesicle per frame
+  IMP::Ints segments_; // history ring, the life of each vesicle per frame
+  IMP::Ints segment_; // the current life of each vesicle
+  IMP::Ints dstate_; // the docking states of the previous frame
+  IMP::Ints secretion_; // the secretion counters of the previous frame
+  IMP::Ints dock_start_; // the frame at which each docked vesicle docked, -1 if unknown
+  std::map<int, int> dwell_; // dwell time in frames -> number of undockings
+  std::vector<double> msd_sum_;
+  std::vector<double> msd_count_;
+  int previous_total_;
+  int n_frames_;
+  int block_begin_;
+  std::ofstream rdf_out_;
+  std::ofstream secretion_out_;
+
+  std::ofstream open_output(std::string suffix) {
+    std::string name = output_prefix + suffix;
+    std::ofstream out(name.c_str());
+    if (!out) {
+      IMP_THROW("Cannot open " << name, IMP::IOException);
+    }
+    return out;
+  }
+
+  unsigned int get_slot(int frame) const { return frame % capacity_; }
+
+  //! track the lives, docking dwell times and secretions of a new frame
+  void update_lifecycle(const Frame &frame) {
+    for (unsigned int i = 0; i < n_; ++i) {
+      int dstate = frame.dstates.empty() ? 0 : frame.dstates[i];
+      bool secreted = !frame.secretions.empty() && frame.secretions[i] != secretion_[i];
+      if (dstate != 0 && dstate_[i] == 0) {
+        dock_start_[i] = n_frames_ > 0 ? n_frames_ : -1;
+      } else if (dstate == 0 && dstate_[i] != 0) {
+        if (dock_start_[i] >= 0) ++dwell_[n_frames_ - dock_start_[i]];
+        secreted = true; // released vesicles are secreted and reset
+      }
+      if (secreted && n_frames_ > 0) ++segment_[i];
+      dstate_[i] = dstate;
+      if (!frame.secretions.empty()) secretion_[i] = frame.secretions[i];
+    }
+    if (frame.total_secretion >= 0) {
+      int added = n_frames_ > 0 ? frame.total_secretion - previous_total_ : 0;
+      secretion_out_ << n_frames_ << " " << n_frames_ * time_step << " "
+                     << frame.total_secretion << " " << added << "\n";
+      previous_total_ = frame.total_secretion;
+    }
+  }
+
+  //! accumulate the MSD and the RDF shell counts of the frames [begin, end)
+  void analyze_frames(int begin, int end, std::vector<double> &msd_sum,
+                      std::vector<double> &msd_count, std::vector<double> &shells) const {
+    double r0 = nucleus_radius;
+    for (int t = begin; t < end; ++t) {
+      const double *x = &coordinates_[3 * n_ * get_slot(t)];
+      const int *s = &segments_[n_ * get_slot(t)];
+      for (unsigned int k = 0; k < lags_.size() && lags_[k] <= t; ++k) {
+        const double *y = &coordinates_[3 * n_ * get_slot(t - lags_[k])];
+        const int *sy = &segments_[n_ * get_slot(t - lags_[k])];
+        for (unsigned int i = 0; i < n_; ++i) {
+          if (s[i] != sy[i]) continue;
+          double dx = x[3 * i] - y[3 * i];
+          double dy = x[3 * i + 1] - y[3 * i + 1];
+          double dz = x[3 * i + 2] - y[3 * i + 2];
+          msd_sum[k] += dx * dx + dy * dy + dz * dz;
+          msd_count[k] += 1;
+        }
+      }
+      double *h = &shells[n_bins_ * ((t - block_begin_) / rdf_window)];
+      for (unsigned int i = 0; i < n_; ++i) {
+        IMP::algebra::Vector3D v(x[3 * i], x[3 * i + 1], x[3 * i + 2]);
+        double r = IMP::algebra::get_distance(v, center_);
+        if (r < r0 || r >= rdf_max) continue;
+        h[static_cast<unsigned int>((r - r0) / rdf_bin)] += 1;
+      }
+    }
+  }
+
+  //! analyze the buffered block across the threads and write its RDF windows
+  void process_block() {
+    int end = n_frames_;
+    if (end == block_begin_) return;
+    unsigned int n_windows = (end - block_begin_ + rdf_window - 1) / rdf_window;
+    unsigned int n_workers = std::min<unsigned int>(n_threads_, end - block_begin_);
+    std::vector<std::vector<double> > sums(n_workers, std::vector<double>(lags_.size(), 0));
+    std::vector<std::vector<double> > counts(sums);
+    std::vector<std::vector<double> > shells(n_workers,
+                                             std::vector<double>(n_windows * n_bins_, 0));
+    std::vector<std::thread> workers;
+    int chunk = (end - block_begin_ + n_workers - 1) / n_workers;
+    for (unsigned int w = 0; w < n_workers; ++w) {
+      int b = block_begin_ + w * chunk;
+      int e = std::min(end, b + chunk);
+      workers.push_back(std::thread([this, b, e, w, &sums, &counts, &shells]() {
+        analyze_frames(b, e, sums[w], counts[w], shells[w]);
+      }));
+    }
+    for (unsigned int w = 0; w < n_workers; ++w) {
+      workers[w].join();
+      for (unsigned int k = 0; k < lags_.size(); ++k) {
+        msd_sum_[k] += sums[w][k];
+        msd_count_[k] += counts[w][k];
+      }
+      if (w > 0) {
+        for (unsigned int j = 0; j < shells[0].size(); ++j) shells[0][j] += shells[w][j];
+      }
+    }
+    // g(r) is the shell density over the mean density between the nucleus and rdf_max
+    double density = n_ / (4.0 / 3.0 * PI * (std::pow(rdf_max, 3)
+                                             - std::pow(nucleus_radius, 3)));
+    for (unsigned int wi = 0; wi < n_windows; ++wi) {
+      int first = block_begin_ + wi * rdf_window;
+      int n_in_window = std::min<int>(rdf_window, end - first);
+      rdf_out_ << first << " " << first * time_step;
+      for (unsigned int b = 0; b < n_bins_; ++b) {
+        double r1 = nucleus_radius + b * rdf_bin;
+        double r2 = std::min(rdf_max, r1 + rdf_bin);
+        double volume = 4.0 / 3.0 * PI * (std::pow(r2, 3) - std::pow(r1, 3));
+        rdf_out_ << " " << shells[0][wi * n_bins_ + b] / (n_in_window * volume * density);
+      }
+      rdf_out_ << "\n";
+    }
+    block_begin_ = end;
+  }
+
+ public:
+  StreamingAnalysis(unsigned int n_vesicles)
+    : n_(n_vesicles),
+    n_threads_(n_threads > 0 ? n_threads
+               : std::max(1u, std::thread::hardware_concurrency())),
+    lags_(get_lags(max_lag)),
+    center_(nucleus_x, nucleus_y, nucleus_z),
+    n_bins_(std::max(1, static_cast<int>(std::ceil((rdf_max - nucleus_radius) / rdf_bin)))),
+    segment_(n_vesicles, 0),
+    dstate_(n_vesicles, 0),
+    secretion_(n_vesicles, 0),
+    dock_start_(n_vesicles, -1),
+    msd_sum_(lags_.size(), 0),
+    msd_count_(lags_.size(), 0),
+    previous_total_(0),
+    n_frames_(0),
+    block_begin_(0),
+    rdf_out_(open_output("_rdf.txt")),
+    secretion_out_(open_output("_secretion.txt"))
+  {
+    IMP_USAGE_CHECK(rdf_window > 0 && block_frames > 0, "Window and block must be positive");
+    IMP_USAGE_CHECK(rdf_max > nucleus_radius, "rdf_max must exceed the nucleus radius");
+    block_ = ((block_frames + rdf_window - 1) / rdf_window) * rdf_window;
+    capacity_ = block_ + (lags_.empty() ? 0 : lags_.back());
+    coordinates_.resize(3 * n_ * capacity_);
+    segments_.resize(n_ * capacity_);
+    rdf_out_ << "# frame time g(r) at r =";
+    for (unsigned int b = 0; b < n_bins_; ++b) {
+      rdf_out_ << " " << nucleus_radius + (b + 0.5) * rdf_bin;
+    }
+    rdf_out_ << "\n";
+    secretion_out_ << "# frame time cumulative_secretions new_secretions\n";
+  }
+
+  void add_frame(const Frame &frame) {
+    update_lifecycle(frame);
+    std::copy(frame.coordinates.begin(), frame.coordinates.end(),
+              coordinates_.begin() + 3 * n_ * get_slot(n_frames_));
+    std::copy(segment_.begin(), segment_.end(),
+              segments_.begin() + n_ * get_slot(n_frames_));
+    ++n_frames_;
+    if (n_frames_ - block_begin_ == static_cast<int>(block_)) {
+      process_block();
+    }
+  }
+
+  //! analyze the last partial block and write the MSD and dwell times
+  void finish() {
+    process_block();
+    std::ofstream msd_out(open_output("_msd.txt"));
+    msd_out << "# lag_frames lag_time msd_A2 n_displacements\n";
+    for (unsigned int k = 0; k < lags_.size(); ++k) {
+      if (msd_count_[k] == 0) continue;
+      msd_out << lags_[k] << " " << lags_[k] * time_step << " "
+              << msd_sum_[k] / msd_count_[k] << " " << msd_count_[k] << "\n";
+    }
+    std::ofstream dwell_out(open_output("_dwell.txt"));
+    dwell_out << "# dwell_frames dwell_time n_undockings\n";
+    for (std::map<int, int>::const_iterator it = dwell_.begin(); it != dwell_.end(); ++it) {
+      dwell_out << it->first << " " << it->first * time_step << " " << it->second << "\n";
+    }
+  }
+
+  int get_number_of_frames() const { return n_frames_; }
+};
+
+bool get_has_suffix(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size()
+         && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+}
+
+int main(int argc, char **argv) {
+  IMP::Strings files = IMP::setup_from_argv(
+    argc, argv,
+    "Compute the MSD, the RDF around the nucleus, the docking dwell times and the "
+    "secretion curve of a trajectory in one streaming pass. The input is either a "
+    "compact trajectory or the *_coord.xvg file of test.py, next to which the "
+    "*_docked.xvg and *_secretion.xvg files are read if present.",
+    "trajectory", 1);
+  std::unique_ptr<FrameSource> source;
+  if (get_has_suffix(files[0], "_coord.xvg")) {
+    source.reset(new XvgFrameSource(files[0]));
+  } else {
+    source.reset(new CompactFrameSource(files[0]));
+  }
+  StreamingAnalysis analysis(source->get_number_of_vesicles());
+  Frame frame;
+  while (source->read_next_frame(frame)) {
+    analysis.add_frame(frame);
+  }
+  analysis.finish();
+  std::cout << "Analyzed " << analysis.get_number_of_frames() << " frames of "
+            << source->get_number_of_vesicles() << " vesicles" << std::endl;
+  return 0;
+}
@@ -1,3 +1,3 @@
-required_modules = 'container:core'
+required_modules = 'container:core:atom'
 required_dependencies = ''
 optional_dependencies = ''
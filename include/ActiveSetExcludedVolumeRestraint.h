@@ -0,0 +1,68 @@
+/**
+ *  \file IMP/insulinsecretion/ActiveSetExcludedVolumeRestraint.h
+ *  \brief An excluded volume restraint that skips the pairs of frozen particles.
+ *
+ * Description:
+ * 1, Scores the close pairs among the active particles of a VesicleActiveSet and the
+ *    close pairs between active and frozen particles with a soft sphere score.
+ * 2, Frozen-frozen pairs (docked vesicles, the nucleus, Ca2+ channels) never move
+ *    relative to each other, so they are neither searched nor scored.
+ * 3, The close pair lists follow the active set when it changes on docking and secretion.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_ACTIVE_SET_EXCLUDED_VOLUME_RESTRAINT_H
+#define IMPINSULINSECRETION_ACTIVE_SET_EXCLUDED_VOLUME_RESTRAINT_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/Restraint.h>
+#include <IMP/PairScore.h>
+#include <IMP/container/ClosePairContainer.h>
+#include <IMP/container/CloseBipartitePairContainer.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   An excluded volume restraint over the active-active and active-frozen
+   close pairs of a VesicleActiveSet.
+ */
+class IMPINSULINSECRETIONEXPORT ActiveSetExcludedVolumeRestraint
+: public Restraint
+{
+ private:
+  PointerMember<VesicleActiveSet> active_set_;
+  PointerMember<PairScore> score_; // soft sphere score of overlapping pairs
+  PointerMember<container::ClosePairContainer> active_pairs_; // active-active pairs
+  PointerMember<container::CloseBipartitePairContainer> frozen_pairs_; // active-frozen pairs
+
+ public:
+  /**
+     An excluded volume restraint that skips frozen-frozen pairs.
+
+     @param active_set the active and frozen particles
+     @param k the spring constant of the soft sphere score in kcal/mol/A^2
+     @param slack the slack of the close pair containers in A (affects speed only)
+     @param name the name of the restraint
+   */
+  ActiveSetExcludedVolumeRestraint
+    ( VesicleActiveSet *active_set,
+      double k = 1,
+      double slack = 10,
+      std::string name = "ActiveSetExcludedVolumeRestraint%1%" );
+
+  virtual double unprotected_evaluate
+  ( DerivativeAccumulator *da ) const override;
+
+  virtual ModelObjectsTemp do_get_inputs() const override;
+
+  IMP_OBJECT_METHODS(ActiveSetExcludedVolumeRestraint);
+};
+
+IMP_OBJECTS(ActiveSetExcludedVolumeRestraint, ActiveSetExcludedVolumeRestraints);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_ACTIVE_SET_EXCLUDED_VOLUME_RESTRAINT_H */
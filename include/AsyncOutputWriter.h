@@ -0,0 +1,147 @@
+/**
+ *  \file IMP/insulinsecretion/AsyncOutputWriter.h
+ *  \brief A background writer thread for the output files of a simulation.
+ *
+ * Description:
+ * 1, The simulation thread fills a frame buffer and hands it to a background thread, which
+ *    formats it (optional), writes it to the file and, when its queue empties, flushes
+ *    and optionally fsyncs the file, so the simulation does not wait on the disk.
+ * 2, The frame buffers are a ring of n_buffers strings reserved once with frame_capacity
+ *    bytes, so handing a frame over copies nothing and allocates nothing once the frames
+ *    fit; with the default of two, one is filled while the other is written.
+ * 3, When all buffers are queued, the simulation thread waits for the writer (back-pressure),
+ *    so the memory stays bounded if the disk is slower than the simulation; the waits are
+ *    counted by get_number_of_stalls().
+ * 4, A formatter set from C++ turns each frame into the bytes of the file on the writer
+ *    thread, e.g., CompactTrajectoryOptimizerState hands over raw coordinates and encodes
+ *    them there. Without one, the frames are written as they are, and write() appends text
+ *    or bytes, so a writer can stand in for a Python file in print(..., file=writer).
+ * 5, A write, flush, fsync or close error is raised as an IOException by the next call of
+ *    the simulation thread, at the latest by close(), which writes the queued frames, ends
+ *    the thread and closes the file. Destruction closes the writer too, but only warns.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_ASYNC_OUTPUT_WRITER_H
+#define IMPINSULINSECRETION_ASYNC_OUTPUT_WRITER_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/Object.h>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! A writer thread with a ring of preallocated frame buffers and back-pressure.
+class IMPINSULINSECRETIONEXPORT AsyncOutputWriter : public Object
+{
+ public:
+#ifndef SWIG
+  //! Appends the file bytes of a frame to the output, called on the writer thread
+  typedef std::function<void(const std::string &frame, std::string &out)> Formatter;
+#endif
+
+ private:
+  std::string file_name_;
+  std::FILE *file_;
+  unsigned int frame_capacity_;
+  std::vector<std::string> frames_; // the ring of frame buffers
+  unsigned int current_; // the frame being filled, used by the simulation thread only
+  unsigned int first_; // the oldest queued frame, the one being written
+  unsigned int size_; // the number of queued frames
+  bool closing_;
+  bool fsync_;
+  unsigned int n_frames_; // the frames handed over
+  unsigned int n_stalls_; // the hand-overs that waited for a free buffer
+  double n_bytes_; // the bytes written to the file
+  std::string error_; // the first write error of the writer thread
+#ifndef SWIG
+  Formatter formatter_;
+  std::string formatted_; // the formatted frame, used by the writer thread only
+  mutable std::mutex mutex_;
+  std::condition_variable queued_; // signals the writer thread
+  std::condition_variable freed_; // signals the simulation thread
+  std::thread thread_;
+#endif
+
+  //! the loop of the writer thread
+  void run();
+
+  //! write one frame, on the writer thread
+  void write_frame(const std::string &frame);
+
+  //! raise the error of the writer thread, if any; the mutex must be held
+  void check_error() const;
+
+  //! keep the first error; takes the mutex
+  void set_error(std::string error);
+
+ protected:
+  //! Close the writer, warning instead of raising an error
+  virtual void do_destroy() override;
+
+ public:
+  /**
+     A background writer of one output file.
+
+     @param file_name the output file, truncated
+     @param frame_capacity the bytes reserved for each frame buffer
+     @param n_buffers the number of frame buffers, at least 2
+   */
+  AsyncOutputWriter(std::string file_name,
+                    unsigned int frame_capacity = 1 << 20,
+                    unsigned int n_buffers = 2);
+
+#ifndef SWIG
+  //! Set the formatter of the frames, before the first frame is handed over
+  /** An empty formatter may be set at any time to remove the formatter, e.g.,
+      when its owner is destroyed; it waits until the queued frames are
+      written and drops the bytes not handed over yet. */
+  void set_formatter(Formatter formatter);
+
+  //! returns the buffer of the next frame, to be filled and handed over by end_frame()
+  /** The buffer may already hold bytes appended by write(). */
+  std::string &begin_frame() { return frames_[current_]; }
+#endif
+
+  //! Hand the current frame to the writer thread, waiting for a free buffer if none is left
+  void end_frame();
+
+  //! Append data to the current frame, handing it over once it reaches the frame capacity
+  void write(std::string data);
+
+  //! Fsync the file each time the writer thread flushes it, off by default
+  void set_fsync(bool fsync);
+
+  //! Hand over the current frame and wait until all frames are written and flushed
+  void flush();
+
+  //! Write the queued frames, end the writer thread and close the file
+  void close();
+
+  //! returns the number of frames handed over
+  unsigned int get_number_of_frames() const { return n_frames_; }
+
+  //! returns the number of hand-overs that waited for the writer thread
+  unsigned int get_number_of_stalls() const { return n_stalls_; }
+
+  //! returns the number of bytes written to the file so far
+  double get_number_of_bytes() const;
+
+  std::string get_file_name() const { return file_name_; }
+
+  IMP_OBJECT_METHODS(AsyncOutputWriter);
+};
+
+IMP_OBJECTS(AsyncOutputWriter, AsyncOutputWriters);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_ASYNC_OUTPUT_WRITER_H */
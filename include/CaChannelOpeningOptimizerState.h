@@ -6,6 +6,10 @@
  * 1, Get optimizer state for each frame of the trajectory (CaChannel).
  * 2, Set the binary state parameter (i.e., 0 or 1) for a subset of Ca2+ channels.
  * 3, Update the optimizer state.
+ * 4, Optionally, the phase flips are enqueued on a LifecycleEventScheduler instead of
+ *    advancing the timer of every closed channel each period.
+ * 5, Optionally, each channel is gated by a ChannelMarkovGating instead of the global
+ *    phase flips, and only the channels that changed are written each period.
  *
  *
  *  Copyright 2007-2019 IMP Inventors. All rights reserved.
@@ -16,6 +20,8 @@
 
 #include <IMP/insulinsecretion/insulinsecretion_config.h> // provide macros to mark functions and classes as exported and to set up namespaces
 #include <IMP/insulinsecretion/CaChannelStateDecorator.h>
+#include <IMP/insulinsecretion/LifecycleEventScheduler.h>
+#include <IMP/insulinsecretion/internal/lifecycle_stages.h>
 #include <IMP/OptimizerState.h> // an owning Optimizer commits to a new set of coordinates
 #include <IMP/core/PeriodicOptimizerState.h>
 
@@ -30,15 +36,9 @@ class IMPINSULINSECRETIONEXPORT CaChannelOpeningOptimizerState
 {
  private:
    typedef core::PeriodicOptimizerState P; // define P as the member initializer
-   Particles cachannel_; // Ca2+ channel
-   int oscillation_;
-   int troughn_; // the number of Ca2+ channels in the opening state at the trough
-   int peakn_; // the number of Ca2+ channels in the opening state at the peak
+   internal::ChannelOscillationStage oscillation_; // the shared channel oscillation pass
    unsigned int periodicity_; // the frame interval
 
-  //! update the secretion counter decorator
-  void channel_oscillation(); 
-
  protected:
   //! Update the optimizer state.
   // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
@@ -62,8 +62,43 @@ class IMPINSULINSECRETIONEXPORT CaChannelOpeningOptimizerState
       int peakn,
       unsigned int periodicity = 1 );
 
+  /**
+     An optimizer state that updates the open/closed of the sites of a ChannelSiteArray.
+
+     @param m the model
+     @param sites Ca2+ channel sites, whose states are updated in place
+     @param oscillation the opening state of Ca2+ channels to detect oscilation
+     @param troughn the number of Ca2+ channels in the opening state at the trough
+     @param peakn the number of Ca2+ channels in the opening state at the peak
+     @param periodicity the frame interval for updating this optimizer state
+   */
+  CaChannelOpeningOptimizerState
+    ( Model *m,
+      ChannelSiteArray *sites,
+      int oscillation,
+      int troughn,
+      int peakn,
+      unsigned int periodicity = 1 );
+
   //! Set the particles to use.
-  void set_cachannel(const Particles &cachannel) { cachannel_ = cachannel; }
+  void set_cachannel(const Particles &cachannel) {
+    oscillation_.set_cachannel(IMP::get_indexes(cachannel));
+  }
+
+  //! Enqueue the phase flips on a scheduler instead of counting them per channel.
+  /** The scheduler must share the periodicity of this optimizer state and be
+      updated before it. The closed channels then keep the state 0 instead of
+      counting up to oscillation; the flips happen at the same updates. */
+  void set_scheduler(LifecycleEventScheduler *scheduler) {
+    oscillation_.set_scheduler(scheduler);
+  }
+
+  //! Gate each channel stochastically instead of by the global phase flips.
+  /** The gating must have one state per channel and advances once per update
+      of this optimizer state; it takes precedence over a scheduler. */
+  void set_gating(ChannelMarkovGating *gating) {
+    oscillation_.set_gating(gating);
+  }
 
   IMP_OBJECT_METHODS(CaChannelOpeningOptimizerState);
 };
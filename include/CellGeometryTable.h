@@ -0,0 +1,74 @@
+/**
+ *  \file IMP/insulinsecretion/CellGeometryTable.h
+ *  \brief The cell and nucleus spheres of the cells of an islet and the cell of each vesicle.
+ *
+ * Description:
+ * 1, An islet is simulated in one model: each cell has its own cell sphere (the membrane)
+ *    and nucleus sphere, stored in a table indexed by cell id.
+ * 2, Each vesicle is assigned to one cell, in a dense array indexed by particle index, so
+ *    the radial scores and the secretion pass look up the geometry of a vesicle in O(1)
+ *    (see MultiCellRadialRestraint and InsulinCellLifecycleOptimizerState::set_cell_geometry()).
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_CELL_GEOMETRY_TABLE_H
+#define IMPINSULINSECRETION_CELL_GEOMETRY_TABLE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/Object.h>
+#include <IMP/Model.h>
+#include <IMP/algebra/Sphere3D.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! The geometry of the cells of an islet and the cell of each vesicle
+class IMPINSULINSECRETIONEXPORT CellGeometryTable : public Object
+{
+  algebra::Sphere3Ds cell_spheres_;
+  algebra::Sphere3Ds nucleus_spheres_;
+  Ints cells_; // the cell of each vesicle by particle index, -1 if not assigned
+
+ public:
+  CellGeometryTable();
+
+  //! Add a cell and return its id
+  /** @param cell_sphere the sphere of the cell (its membrane), A
+      @param nucleus_sphere the sphere of its nucleus, A
+   */
+  unsigned int add_cell(algebra::Sphere3D cell_sphere,
+                        algebra::Sphere3D nucleus_sphere);
+
+  unsigned int get_number_of_cells() const { return cell_spheres_.size(); }
+
+  algebra::Sphere3D get_cell_sphere(unsigned int cell) const {
+    return cell_spheres_[cell];
+  }
+
+  algebra::Sphere3D get_nucleus_sphere(unsigned int cell) const {
+    return nucleus_spheres_[cell];
+  }
+
+  //! Assign the vesicles to a cell
+  void set_cell(ParticleIndexesAdaptor vesicles, unsigned int cell);
+
+  //! Assign each vesicle to the cell whose center is closest to it
+  void set_cells_by_position(Model *m, ParticleIndexesAdaptor vesicles);
+
+  //! returns the cell of a vesicle, -1 if it is not assigned
+  int get_cell(ParticleIndex pi) const {
+    return pi.get_index() < static_cast<int>(cells_.size()) ? cells_[pi.get_index()] : -1;
+  }
+
+  //! returns the vesicles assigned to a cell, in particle index order
+  ParticleIndexes get_vesicles(unsigned int cell) const;
+
+  IMP_OBJECT_METHODS(CellGeometryTable);
+};
+
+IMP_OBJECTS(CellGeometryTable, CellGeometryTables);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_CELL_GEOMETRY_TABLE_H */
@@ -0,0 +1,87 @@
+/**
+ *  \file IMP/insulinsecretion/CellSnapshot.h
+ *  \brief A snapshot of the coordinates and lifecycle states of a cell that can be restored.
+ *
+ * Description:
+ * 1, Saves the coordinates, the optimized flag and the lifecycle attributes (docking,
+ *    maturation, secretion counter, docked site, Ca2+ channel state) of a set of particles,
+ *    the states of a ChannelSiteArray and the LifecycleClock of the model.
+ * 2, restore() writes them back, so one equilibrated cell can start many runs, e.g., the
+ *    points of a parameter sweep (see IMP.insulinsecretion.sweep), without rebuilding it.
+ * 3, The hierarchy, the radii and the static geometry are not copied; they are shared by
+ *    all the runs that restore the snapshot.
+ * 4, write() and read() store the saved state in a binary file, so an equilibrated cell can
+ *    also start runs in other processes (see ConfigurationCache); perturb() displaces the
+ *    restored particles so that those runs do not start from the same coordinates.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_CELL_SNAPSHOT_H
+#define IMPINSULINSECRETION_CELL_SNAPSHOT_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/ChannelSiteArray.h>
+#include <IMP/Object.h>
+#include <IMP/Model.h>
+#include <IMP/algebra/Vector3D.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! A restorable snapshot of the coordinates and lifecycle states of a cell.
+class IMPINSULINSECRETIONEXPORT CellSnapshot : public Object
+{
+ private:
+  WeakPointer<Model> m_;
+  ParticleIndexes particles_;
+  PointerMember<ChannelSiteArray> sites_;
+  algebra::Vector3Ds coordinates_;
+  Ints optimized_; // the coordinates_are_optimized flag of each particle
+  Ints values_; // the lifecycle attributes, one per particle and key
+  Ints masks_; // the lifecycle attributes that each particle carries
+  Ints site_states_;
+  int tick_; // the LifecycleClock of the model
+
+ public:
+  /**
+     Save a snapshot of the particles (and the site states).
+
+     @param m the model
+     @param particles the particles to save, e.g., the insulin vesicles; all must be XYZ
+     @param sites the Ca2+ channel sites whose states are saved, if any
+   */
+  CellSnapshot(Model *m,
+               ParticleIndexesAdaptor particles,
+               ChannelSiteArray *sites = nullptr);
+
+  //! Save the current state again, replacing the previous one
+  void save();
+
+  //! Restore the saved state
+  void restore() const;
+
+  //! Write the saved state to a binary file
+  void write(std::string file_name) const;
+
+  //! Replace the saved state by the one in a file written by write(), without restoring it
+  /** The file must hold as many particles and site states as this snapshot.
+      If it cannot be read, an IOException is raised and the saved state is
+      unchanged. */
+  void read(std::string file_name);
+
+  //! Move each particle with optimized coordinates to a random point within max_displacement
+  /** Uses the IMP random number generator, so the displacements follow its seed. */
+  void perturb(double max_displacement) const;
+
+  //! returns the number of saved particles
+  unsigned int get_number_of_particles() const { return particles_.size(); }
+
+  IMP_OBJECT_METHODS(CellSnapshot);
+};
+
+IMP_OBJECTS(CellSnapshot, CellSnapshots);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_CELL_SNAPSHOT_H */
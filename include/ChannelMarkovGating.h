@@ -0,0 +1,113 @@
+/**
+ *  \file IMP/insulinsecretion/ChannelMarkovGating.h
+ *  \brief Stochastic per-channel Markov gating of Ca2+ channels driven by a waveform.
+ *
+ * Description:
+ * 1, Each channel is closed (C), open (O) or, in the three-state model, inactivated (I), with
+ *    C -> O at rate k w(t), O -> C at rate k (1 - w(t)), O -> I at rate ki and I -> C at rate kr.
+ *    The drive w(t) in [0, 1] is a periodic waveform sampled once per update, e.g., a
+ *    normalized membrane potential or Ca2+ oscillation; without inactivation it is the
+ *    stationary open probability, and k sets how fast the channels follow it. An update
+ *    applies the exact transition probabilities over its interval, whatever k dt is.
+ * 2, The states are a dense array of one byte per channel. An update draws one counter-based
+ *    random number per channel, a hash of (seed, update, channel), so the draws need no
+ *    shared generator state and any update can be replayed.
+ * 3, The transition of a channel is selected with masks instead of branches, so the update
+ *    is a straight loop over the byte array that the compiler vectorizes. Only the channels
+ *    whose open/closed state changed are reported to the consumers.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_CHANNEL_MARKOV_GATING_H
+#define IMPINSULINSECRETION_CHANNEL_MARKOV_GATING_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/Object.h>
+#include <cstdint>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! The gating states of a ChannelMarkovGating
+enum ChannelGatingState {
+  CLOSED_GATING_STATE = 0,
+  OPEN_GATING_STATE = 1,
+  INACTIVATED_GATING_STATE = 2
+};
+
+//! Two- or three-state Markov gating of a dense array of Ca2+ channels.
+class IMPINSULINSECRETIONEXPORT ChannelMarkovGating : public Object
+{
+ private:
+  std::vector<std::uint8_t> states_; // the gating state of each channel
+  std::vector<std::uint8_t> next_states_;
+  Ints changed_; // the channels whose open/closed state changed in the last update
+  Floats waveform_; // the drive w of each update, repeated
+  double interval_; // the time between updates, s
+  double rate_; // k, 1/s
+  double inactivation_rate_; // ki, 1/s
+  double recovery_rate_; // kr, 1/s
+  std::uint32_t seed_;
+  std::uint32_t n_updates_;
+
+ public:
+  /**
+     Markov gating of n_channels channels, all closed at the start.
+
+     @param n_channels the number of channels
+     @param waveform the drive w(t) in [0, 1] of each update, repeated periodically
+     @param interval the time between updates, s
+     @param rate the gating rate k, 1/s
+     @param inactivation_rate the rate of O -> I, 1/s; 0 for the two-state model
+     @param recovery_rate the rate of I -> C, 1/s
+     @param seed the key of the counter-based random numbers
+   */
+  ChannelMarkovGating(unsigned int n_channels,
+                      const Floats &waveform,
+                      double interval,
+                      double rate,
+                      double inactivation_rate = 0,
+                      double recovery_rate = 0,
+                      unsigned int seed = 0);
+
+  //! Advance the states of all channels by one update
+  void update();
+
+  //! returns the number of channels
+  unsigned int get_number_of_channels() const { return states_.size(); }
+
+  //! returns the gating state of channel i
+  ChannelGatingState get_state(unsigned int i) const {
+    return static_cast<ChannelGatingState>(states_[i]);
+  }
+
+  //! returns true if channel i is open
+  bool get_is_open(unsigned int i) const { return states_[i] == OPEN_GATING_STATE; }
+
+  //! returns the number of open channels
+  unsigned int get_number_of_open_channels() const;
+
+  //! returns the long-run open fraction of the channels at a constant drive w
+  /** It is w without inactivation; the updates follow the exact propagator
+      of the rates, so it does not depend on the interval. */
+  double get_stationary_open_probability(double w) const;
+
+  //! returns the channels whose open/closed state changed in the last update
+  const Ints &get_changed_channels() const { return changed_; }
+
+  //! returns the drive of the next update
+  double get_drive() const { return waveform_[n_updates_ % waveform_.size()]; }
+
+  //! returns the number of updates so far
+  unsigned int get_number_of_updates() const { return n_updates_; }
+
+  IMP_OBJECT_METHODS(ChannelMarkovGating);
+};
+
+IMP_OBJECTS(ChannelMarkovGating, ChannelMarkovGatings);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_CHANNEL_MARKOV_GATING_H */
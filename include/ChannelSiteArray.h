@@ -0,0 +1,88 @@
+/**
+ *  \file IMP/insulinsecretion/ChannelSiteArray.h
+ *  \brief A dense array of Ca2+ channel sites holding only their positions and open/closed states.
+ *
+ * Description:
+ * 1, Ca2+ channels never move, so a channel needs no particle, decorators or rigid body;
+ *    a site is a position on the cell membrane and an open/closed state.
+ * 2, All sites share one radius (the Ca2+ microdomain radius).
+ * 3, The states follow CaChannelStateDecorator: -1 is open, 0..oscillation count the
+ *    updates of a closed channel.
+ * 4, CaChannelOpeningOptimizerState updates the states in place, and the docking states
+ *    look the sites up through a ChannelSurfaceIndex built on the array; a docked vesicle
+ *    records the id of its site (DockingStateDecorator::get_site()) instead of joining
+ *    the rigid body of a channel particle.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_CHANNEL_SITE_ARRAY_H
+#define IMPINSULINSECRETION_CHANNEL_SITE_ARRAY_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/Object.h>
+#include <IMP/algebra/Sphere3D.h>
+#include <IMP/algebra/Vector3D.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! A dense array of static Ca2+ channel sites with an open/closed state each.
+class IMPINSULINSECRETIONEXPORT ChannelSiteArray : public Object
+{
+ private:
+  algebra::Vector3Ds positions_; // center of each site
+  Ints states_; // open/closed state of each site
+  double radius_; // radius of all sites, A
+
+ public:
+  /**
+     A dense array of static Ca2+ channel sites.
+
+     @param positions the centers of the channel sites on the cell membrane, A
+     @param radius the radius of every site (the Ca2+ microdomain), A
+     @param state the initial state of every site (-1 open, 0 closed)
+   */
+  ChannelSiteArray(const algebra::Vector3Ds &positions,
+                   double radius,
+                   int state = 0);
+
+  //! returns the number of sites
+  unsigned int get_number_of_sites() const { return positions_.size(); }
+
+  //! returns the center of site i
+  const algebra::Vector3D &get_coordinates(unsigned int i) const {
+    return positions_[i];
+  }
+
+  //! returns the sphere of site i
+  algebra::Sphere3D get_sphere(unsigned int i) const {
+    return algebra::Sphere3D(positions_[i], radius_);
+  }
+
+  //! returns the radius of all sites, A
+  double get_radius() const { return radius_; }
+
+  //! returns the state of site i
+  int get_state(unsigned int i) const { return states_[i]; }
+
+  //! sets the state of site i
+  void set_state(unsigned int i, int state) { states_[i] = state; }
+
+  //! returns true if site i is open
+  bool get_is_open(unsigned int i) const { return states_[i] == -1; }
+
+  //! returns the states of all sites
+  const Ints &get_states() const { return states_; }
+
+  //! returns the number of open sites
+  unsigned int get_number_of_open_sites() const;
+
+  IMP_OBJECT_METHODS(ChannelSiteArray);
+};
+
+IMP_OBJECTS(ChannelSiteArray, ChannelSiteArrays);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_CHANNEL_SITE_ARRAY_H */
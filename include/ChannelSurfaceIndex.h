@@ -0,0 +1,161 @@
+/**
+ *  \file IMP/insulinsecretion/ChannelSurfaceIndex.h
+ *  \brief A static angular index of Ca2+ channel sites on the cell sphere.
+ *
+ * Description:
+ * 1, Ca2+ channels are placed once on the cell membrane and never move.
+ * 2, The cell sphere is divided into equal-area polar bands (uniform in cos(theta)),
+ *    and each band into azimuthal buckets of about the same angular size (HEALPix-like).
+ * 3, Each channel site is stored in every bucket that its angular reach overlaps, so
+ *    the docking candidates of a vesicle are obtained by a single bucket lookup of
+ *    the projected direction of the vesicle center.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_CHANNEL_SURFACE_INDEX_H
+#define IMPINSULINSECRETION_CHANNEL_SURFACE_INDEX_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/ChannelSiteArray.h>
+#include <IMP/Object.h>
+#include <IMP/Model.h>
+#include <IMP/algebra/Vector3D.h>
+#include <IMP/algebra/Sphere3D.h>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! A static angular index of Ca2+ channel sites on the cell sphere.
+/**
+   The index is built once from the (static) channel positions. A query with
+   a point inside the cell returns all channel sites whose center is within
+   max_reach of that point, after an O(1) bucket lookup and an exact distance
+   test over the few sites stored in the bucket.
+ */
+class IMPINSULINSECRETIONEXPORT ChannelSurfaceIndex : public Object
+{
+ private:
+  algebra::Sphere3D cell_sphere_;
+  double max_reach_; // the largest center-to-center distance that is queried, A
+  unsigned int n_bands_; // number of polar bands
+  Ints band_offsets_; // index of the first bucket of each band
+  Ints band_sizes_; // number of azimuthal buckets in each band
+  std::vector<Ints> buckets_; // site ids stored in each bucket
+  ParticleIndexes channels_; // channel particle of each site, empty for a site array
+  PointerMember<ChannelSiteArray> site_array_; // the indexed site array, if any
+  algebra::Vector3Ds sites_; // center of each site
+  Floats radii_; // radius of each site
+  double max_site_radius_; // the largest site radius, A
+  double min_site_distance_; // the smallest distance of a site from the cell center, A
+
+  //! store a site and update the site extent
+  void add_site(const algebra::Vector3D &center, double radius);
+
+  //! choose the bands and fill the buckets
+  void setup_index();
+
+  //! set up the bands and buckets
+  void setup_buckets();
+
+  //! store site i in all buckets overlapping its angular reach
+  void add_site_to_buckets(unsigned int i);
+
+  //! returns the band of a cos(theta) value
+  unsigned int get_band(double cos_theta) const;
+
+  //! returns the bucket of an azimuth within a band
+  unsigned int get_bucket_in_band(unsigned int band, double phi) const;
+
+ public:
+  /**
+     A static angular index of Ca2+ channel sites on the cell sphere.
+
+     @param m the model of the channels
+     @param cachannel Ca2+ channels, which must be XYZR particles that do not move
+     @param cell_sphere the sphere of the cell with center point and radius, A.
+     @param max_reach the largest center-to-center distance between a vesicle and
+            a channel that will be queried, A. For docking this is the contact range
+            plus the vesicle and the channel radii.
+     @param n_bands the number of polar bands; if 0, it is chosen so that the buckets
+            are about as wide as the angular reach of a channel.
+   */
+  ChannelSurfaceIndex(Model *m,
+                      ParticleIndexesAdaptor cachannel,
+                      algebra::Sphere3D cell_sphere,
+                      double max_reach,
+                      unsigned int n_bands = 0);
+
+  /**
+     A static angular index of the sites of a ChannelSiteArray.
+
+     @param sites the Ca2+ channel sites; the site ids of the index are the
+            ids of the array
+     @param cell_sphere the sphere of the cell with center point and radius, A.
+     @param max_reach the largest center-to-center distance between a vesicle and
+            a channel that will be queried, A.
+     @param n_bands the number of polar bands, chosen automatically if 0.
+   */
+  ChannelSurfaceIndex(ChannelSiteArray *sites,
+                      algebra::Sphere3D cell_sphere,
+                      double max_reach,
+                      unsigned int n_bands = 0);
+
+  //! returns the bucket that contains the projected direction of v
+  unsigned int get_bucket(const algebra::Vector3D &v) const;
+
+  //! returns the number of buckets
+  unsigned int get_number_of_buckets() const { return buckets_.size(); }
+
+  //! returns the number of polar bands
+  unsigned int get_number_of_bands() const { return n_bands_; }
+
+  //! returns the site ids stored in the bucket of v (a superset of the sites in reach)
+  const Ints &get_candidate_sites(const algebra::Vector3D &v) const {
+    return buckets_[get_bucket(v)];
+  }
+
+  //! returns the ids of the sites whose surface is within range of the sphere s
+  /** The radius of s plus range plus the site radius must not exceed max_reach. */
+  Ints get_sites_in_contact(const algebra::Sphere3D &s, double range) const;
+
+  //! returns the channels whose surface is within range of the sphere s
+  /** Only for an index built on channel particles. */
+  ParticleIndexes get_channels_in_contact(const algebra::Sphere3D &s,
+                                          double range) const;
+
+  //! returns true if a point at v may be within max_reach of a site
+  /** Points deeper in the cytoplasm than the innermost site minus
+      max_reach can be skipped without a bucket lookup. */
+  bool get_is_near_surface(const algebra::Vector3D &v) const {
+    return algebra::get_distance(v, cell_sphere_.get_center())
+           >= min_site_distance_ - max_reach_;
+  }
+
+  //! returns the number of indexed channel sites
+  unsigned int get_number_of_sites() const { return sites_.size(); }
+
+  //! returns the channel particle of site i
+  ParticleIndex get_channel(unsigned int i) const { return channels_[i]; }
+
+  //! returns the indexed site array, or nullptr for an index of channel particles
+  ChannelSiteArray *get_site_array() const { return site_array_; }
+
+  //! returns the center of site i
+  const algebra::Vector3D &get_site(unsigned int i) const { return sites_[i]; }
+
+  //! returns the largest center-to-center distance that can be queried, A
+  double get_max_reach() const { return max_reach_; }
+
+  //! returns the cell sphere
+  algebra::Sphere3D get_cell_sphere() const { return cell_sphere_; }
+
+  IMP_OBJECT_METHODS(ChannelSurfaceIndex);
+};
+
+IMP_OBJECTS(ChannelSurfaceIndex, ChannelSurfaceIndexes);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_CHANNEL_SURFACE_INDEX_H */
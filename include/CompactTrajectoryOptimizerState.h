@@ -0,0 +1,154 @@
+/**
+ *  \file IMP/insulinsecretion/CompactTrajectoryOptimizerState.h
+ *  \brief An optimizer state that writes a compact, delta-encoded trajectory of the insulin vesicles.
+ *
+ * Description:
+ * 1, The static particles (Ca2+ channels, nucleus) are written once in the header, with
+ *    their names, coordinates and radii.
+ * 2, Each frame stores only the vesicle coordinates, quantized to a given resolution and
+ *    delta-encoded against the previous frame as zigzag varints, so a vesicle that moved
+ *    less than 64 resolution units along an axis takes a single byte for that axis.
+ * 3, Each frame also stores the lifecycle fields (docking, maturation and secretion counter
+ *    of vesicles, open/closed state of channels) that changed since the previous frame.
+ * 4, CompactTrajectoryReader reads the file back, and the insulinsecretion_trajectory_to_rmf
+ *    script converts it to a full RMF file for visualization.
+ * 5, Given an AsyncOutputWriter instead of a file name, each frame only copies the quantized
+ *    coordinates and the lifecycle fields into a frame buffer; the delta encoding and the
+ *    file writes run on the writer thread, with the same file as a result.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_COMPACT_TRAJECTORY_OPTIMIZER_STATE_H
+#define IMPINSULINSECRETION_COMPACT_TRAJECTORY_OPTIMIZER_STATE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/AsyncOutputWriter.h>
+#include <IMP/OptimizerState.h>
+#include <fstream>
+#include <string>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! The lifecycle fields stored in a compact trajectory
+enum CompactTrajectoryField {
+  //! DockingStateDecorator::get_dstate() of a vesicle
+  DOCKING_STATE_FIELD = 0,
+  //! MaturationStateDecorator::get_state() of a vesicle
+  MATURATION_STATE_FIELD = 1,
+  //! SecretionCounterDecorator::get_secretion() of a vesicle
+  SECRETION_COUNTER_FIELD = 2,
+  //! CaChannelStateDecorator::get_channelstate() of a static particle
+  CHANNEL_STATE_FIELD = 3,
+  NUMBER_OF_COMPACT_TRAJECTORY_FIELDS = 4
+};
+
+/**
+   An optimizer state that writes the static particles once and then
+   only the quantized vesicle coordinates and changed lifecycle fields
+   of each frame.
+ */
+class IMPINSULINSECRETIONEXPORT CompactTrajectoryOptimizerState
+: public OptimizerState
+{
+ private:
+   typedef OptimizerState P; // define P as the member initializer
+   ParticleIndexes vesicles_;
+   ParticleIndexes static_particles_;
+   double resolution_; // the quantization step of the coordinates, A
+   std::ofstream out_;
+   PointerMember<AsyncOutputWriter> writer_; // encodes and writes the frames, if set
+   std::string buffer_; // the encoded frame, reused between frames
+   Ints snapshot_; // the quantized coordinates, then the fields of each particle
+   Ints encoder_snapshot_; // the snapshot being encoded on the writer thread
+   Ints last_q_; // the quantized coordinates of the previous frame, 3 per vesicle
+   Ints last_values_; // the lifecycle fields of the previous frame, one per particle and field
+   Ints field_masks_; // the fields that each vesicle, then each static particle, carries
+   unsigned int n_frames_;
+   unsigned int n_encoded_frames_;
+
+   void initialize();
+
+   //! returns the lifecycle field f of particle pi
+   int get_field(ParticleIndex pi, unsigned int f) const;
+
+   //! returns the bit mask of the fields that particle pi carries
+   int get_field_mask(ParticleIndex pi) const;
+
+   //! encode the header into buffer_
+   void write_header();
+
+   //! copy the quantized coordinates and the lifecycle fields of the current frame
+   void snapshot_frame(int *snapshot) const;
+
+   //! append the encoding of a snapshot against the previous one to out
+   void encode_frame(const int *snapshot, std::string &out);
+
+   void write_frame();
+
+ protected:
+  //! Update the optimizer state.
+  // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
+  virtual void do_update(unsigned int call_num) override; // Cause a compile error if this method does not override a parent method
+
+  //! Flush the file at the end of each optimization run
+  virtual void do_set_is_optimizing(bool is_optimizing) override;
+
+  //! Write the frames still queued on the writer and remove the formatter of this object
+  virtual void do_destroy() override;
+
+ public:
+  /**
+     An optimizer state that writes a compact trajectory of the insulin vesicles.
+
+     @param m the model
+     @param vesicles insulin vesicles, written in every frame
+     @param static_particles particles that never move, e.g., the Ca2+ channels and the
+                             nucleus, written once in the header
+     @param file_name the output file
+     @param resolution the quantization step of the vesicle coordinates in A
+     @param periodicity the frame interval for writing a frame
+   */
+  CompactTrajectoryOptimizerState
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      ParticleIndexesAdaptor static_particles,
+      std::string file_name,
+      double resolution = 1.0,
+      unsigned int periodicity = 1 );
+
+  /**
+     An optimizer state that writes a compact trajectory through a writer thread.
+
+     The writer must not be used by anything else, as it encodes the frames
+     with this optimizer state; see the other constructor for the parameters.
+   */
+  CompactTrajectoryOptimizerState
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      ParticleIndexesAdaptor static_particles,
+      AsyncOutputWriter *writer,
+      double resolution = 1.0,
+      unsigned int periodicity = 1 );
+
+  //! Write the current frame regardless of the periodicity
+  void update_always() { write_frame(); }
+
+  //! Flush the buffered frames to the file, waiting for the writer thread if any
+  void flush();
+
+  //! returns the number of frames written so far
+  unsigned int get_number_of_frames() const { return n_frames_; }
+
+  //! returns the quantization step of the vesicle coordinates in A
+  double get_resolution() const { return resolution_; }
+
+  IMP_OBJECT_METHODS(CompactTrajectoryOptimizerState);
+};
+
+IMP_OBJECTS(CompactTrajectoryOptimizerState, CompactTrajectoryOptimizerStates);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_COMPACT_TRAJECTORY_OPTIMIZER_STATE_H */
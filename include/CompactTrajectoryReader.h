@@ -0,0 +1,117 @@
+/**
+ *  \file IMP/insulinsecretion/CompactTrajectoryReader.h
+ *  \brief Reads a compact trajectory written by CompactTrajectoryOptimizerState.
+ *
+ * Description:
+ * 1, The static particles and the vesicle radii are read from the header on construction.
+ * 2, Each call of read_next_frame() decodes the next frame, adding the coordinate deltas
+ *    and the changed lifecycle fields to the previous frame once the whole frame parsed.
+ * 3, The file is memory mapped and decoded in place, so only the current frame is held
+ *    in memory regardless of the length of the trajectory.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_COMPACT_TRAJECTORY_READER_H
+#define IMPINSULINSECRETION_COMPACT_TRAJECTORY_READER_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/CompactTrajectoryOptimizerState.h>
+#include <IMP/insulinsecretion/internal/mapped_file.h>
+#include <IMP/Object.h>
+#include <IMP/algebra/Sphere3D.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   Reads a compact trajectory written by CompactTrajectoryOptimizerState
+   frame by frame.
+ */
+class IMPINSULINSECRETIONEXPORT CompactTrajectoryReader : public Object
+{
+  std::unique_ptr<internal::MappedFile> file_;
+  const char *pos_; // the next byte to decode
+  const char *end_;
+  double resolution_;
+  Strings static_names_;
+  algebra::Sphere3Ds static_spheres_;
+  Strings vesicle_names_;
+  Floats vesicle_radii_;
+  Ints field_masks_; // the fields that each vesicle, then each static particle, carries
+  Ints q_; // the quantized coordinates of the current frame, 3 per vesicle
+  Ints values_; // the lifecycle fields of the current frame, one per particle and field
+  int frame_; // the number of the current frame, -1 before the first one
+  Ints dq_; // the coordinate deltas of the frame being decoded
+  // the (values_ index, delta) field changes of the frame being decoded
+  std::vector<std::pair<unsigned int, int> > changes_;
+
+  void read_header(std::string file_name);
+
+  int get_value(unsigned int j, CompactTrajectoryField field) const;
+
+ public:
+  //! Open a compact trajectory and read its header
+  /** The file is memory mapped, so frames are paged in as they are decoded. */
+  CompactTrajectoryReader(std::string file_name);
+
+  //! Decode the next frame, returns false at the end of the file
+  /** A frame truncated partway is not applied, so the current frame is
+      unchanged; a frame with out of range particles raises an IOException. */
+  bool read_next_frame();
+
+  //! returns the number of the current frame, -1 before the first one
+  int get_frame_number() const { return frame_; }
+
+  //! returns the quantization step of the vesicle coordinates in A
+  double get_resolution() const { return resolution_; }
+
+  unsigned int get_number_of_static_particles() const {
+    return static_spheres_.size();
+  }
+
+  std::string get_static_name(unsigned int i) const { return static_names_[i]; }
+
+  algebra::Sphere3D get_static_sphere(unsigned int i) const {
+    return static_spheres_[i];
+  }
+
+  //! returns whether static particle i carries the given lifecycle field
+  bool get_static_has_field(unsigned int i, CompactTrajectoryField field) const {
+    return field_masks_[vesicle_radii_.size() + i] & (1 << field);
+  }
+
+  //! returns the lifecycle field of static particle i in the current frame
+  int get_static_field(unsigned int i, CompactTrajectoryField field) const {
+    return get_value(vesicle_radii_.size() + i, field);
+  }
+
+  unsigned int get_number_of_vesicles() const { return vesicle_radii_.size(); }
+
+  std::string get_vesicle_name(unsigned int i) const { return vesicle_names_[i]; }
+
+  //! returns the sphere of vesicle i in the current frame
+  algebra::Sphere3D get_vesicle_sphere(unsigned int i) const;
+
+  //! returns whether vesicle i carries the given lifecycle field
+  bool get_vesicle_has_field(unsigned int i, CompactTrajectoryField field) const {
+    return field_masks_[i] & (1 << field);
+  }
+
+  //! returns the lifecycle field of vesicle i in the current frame
+  int get_vesicle_field(unsigned int i, CompactTrajectoryField field) const {
+    return get_value(i, field);
+  }
+
+  IMP_OBJECT_METHODS(CompactTrajectoryReader);
+};
+
+IMP_OBJECTS(CompactTrajectoryReader, CompactTrajectoryReaders);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_COMPACT_TRAJECTORY_READER_H */
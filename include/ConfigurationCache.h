@@ -0,0 +1,78 @@
+/**
+ *  \file IMP/insulinsecretion/ConfigurationCache.h
+ *  \brief An on-disk cache of equilibrated cell configurations keyed by their parameters.
+ *
+ * Description:
+ * 1, An entry is the file of a CellSnapshot (coordinates and lifecycle states) in the
+ *    cache directory, named by a key that hashes the parameters the equilibration depends
+ *    on, e.g., the geometry, the counts and radii of the vesicles and Ca2+ channels, the
+ *    RDF fit, the force constants and the number of equilibration frames.
+ * 2, The key is the 64-bit FNV-1a hash of the bytes of the parameters as doubles, so the
+ *    same parameters give the same key in every run and on every machine of the same
+ *    byte order; any change of a parameter gives another entry.
+ * 3, store() writes the entry to a temporary file and renames it, so runs that share the
+ *    cache directory never read a partly written entry. restore() reads it through a
+ *    memory mapping, restores the snapshot and optionally perturbs it with the seed of
+ *    the run, so the repeats skip the equilibration but do not start from the same state;
+ *    an unreadable entry is treated as missing until store() replaces it.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_CONFIGURATION_CACHE_H
+#define IMPINSULINSECRETION_CONFIGURATION_CACHE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/CellSnapshot.h>
+#include <IMP/Object.h>
+#include <string>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! A directory of equilibrated CellSnapshot files keyed by a hash of their parameters.
+class IMPINSULINSECRETIONEXPORT ConfigurationCache : public Object
+{
+ private:
+  std::string directory_;
+
+ public:
+  /**
+     A cache of configurations in a directory.
+
+     @param directory an existing directory, shared by the runs
+   */
+  ConfigurationCache(std::string directory);
+
+  //! returns the key of a list of parameters, 16 hexadecimal digits
+  static std::string get_key(const Floats &parameters);
+
+  //! returns the file of the entry of key
+  std::string get_file_name(std::string key) const;
+
+  //! whether there is an entry for key
+  bool get_has_configuration(std::string key) const;
+
+  //! Save the state of the snapshot as the entry of key, replacing any previous one
+  void store(std::string key, CellSnapshot *snapshot) const;
+
+  //! Restore the entry of key into the model, returns false if there is none
+  /** The snapshot is replaced by the entry and restored, then its particles
+      with optimized coordinates are moved by up to max_displacement
+      (see CellSnapshot::perturb()). For an entry that cannot be read, e.g.,
+      a truncated one or one of another snapshot version, it warns and
+      returns false with the snapshot unchanged, so the caller equilibrates
+      and stores a fresh entry over it. */
+  bool restore(std::string key, CellSnapshot *snapshot,
+               double max_displacement = 0) const;
+
+  std::string get_directory() const { return directory_; }
+
+  IMP_OBJECT_METHODS(ConfigurationCache);
+};
+
+IMP_OBJECTS(ConfigurationCache, ConfigurationCaches);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_CONFIGURATION_CACHE_H */
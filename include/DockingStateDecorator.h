@@ -56,12 +56,32 @@ class IMPINSULINSECRETIONEXPORT DockingStateDecorator
     get_model()->set_attribute(get_dstate_key(), get_particle_index(), d);
   }
 
+  //! returns the ChannelSiteArray site the vesicle is docked to, or -1
+  Int get_site() const {
+    Model *m = get_model();
+    return m->get_has_attribute(get_site_key(), get_particle_index())
+           ? m->get_attribute(get_site_key(), get_particle_index()) : -1;
+  }
+
+  //! sets the ChannelSiteArray site the vesicle is docked to, -1 if none
+  void set_site(Int site) {
+    Model *m = get_model();
+    if (m->get_has_attribute(get_site_key(), get_particle_index())) {
+      m->set_attribute(get_site_key(), get_particle_index(), site);
+    } else {
+      m->add_attribute(get_site_key(), get_particle_index(), site);
+    }
+  }
+
   IMP_DECORATOR_METHODS(DockingStateDecorator, Decorator);
   /** Add the specified docking state to the particle. */
   IMP_DECORATOR_SETUP_1(DockingStateDecorator, Int, dstate);
   IMP_DECORATOR_SETUP_1(DockingStateDecorator, DockingStateDecorator, other);
   /** Get the key used to store the docking state. */
   static IntKey get_dstate_key();
+  /** Get the key used to store the docked channel site, only added
+      when the vesicle docks to a ChannelSiteArray. */
+  static IntKey get_site_key();
 };
 
 IMPINSULINSECRETION_END_NAMESPACE
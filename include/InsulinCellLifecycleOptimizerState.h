@@ -0,0 +1,190 @@
+/**
+ *  \file IMP/insulinsecretion/InsulinCellLifecycleOptimizerState.h
+ *  \brief An optimizer state that runs the Ca2+ channel, docking and secretion passes in one update.
+ *
+ * Description:
+ * 1, Updates the open/closed state of the Ca2+ channels (as CaChannelOpeningOptimizerState).
+ * 2, Docks the insulin vesicles near open Ca2+ channels and releases the ready ones
+ *    (as VesicleDockingOptimizerState).
+ * 3, Advances the maturation and docking states, secretes the ready vesicles and resets
+ *    them near the nucleus (as InsulinSecretionOptimizerState).
+ * 4, The three passes run back to back in the order above, which is the order in which
+ *    the three separate optimizer states were added to the simulator, so the results are
+ *    the same while the simulator dispatches one optimizer state instead of three.
+ * 5, Optionally, the Ca2+ channels are gated by a ChannelMarkovGating in the first pass.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_INSULIN_CELL_LIFECYCLE_OPTIMIZER_STATE_H
+#define IMPINSULINSECRETION_INSULIN_CELL_LIFECYCLE_OPTIMIZER_STATE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/ChannelSurfaceIndex.h>
+#include <IMP/insulinsecretion/LifecycleEventScheduler.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/insulinsecretion/SecretionEventLog.h>
+#include <IMP/insulinsecretion/CellGeometryTable.h>
+#include <IMP/insulinsecretion/internal/lifecycle_stages.h>
+#include <IMP/OptimizerState.h>
+#include <IMP/algebra/Sphere3D.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   An optimizer state that updates the Ca2+ channels, docks the insulin
+   vesicles and secretes the ready ones in a single update.
+ */
+class IMPINSULINSECRETIONEXPORT InsulinCellLifecycleOptimizerState
+: public OptimizerState
+{
+ private:
+   typedef OptimizerState P; // define P as the member initializer
+   internal::ChannelOscillationStage oscillation_; // the Ca2+ channel pass
+   internal::VesicleDockingStage docking_; // the docking pass
+   internal::VesicleSecretionStage secretion_; // the secretion pass
+   unsigned int periodicity_; // the frame interval
+
+ protected:
+  //! Update the optimizer state.
+  // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
+  virtual void do_update(unsigned int call_num) override; // Cause a compile error if this method does not override a parent method
+
+ public:
+  /**
+     An optimizer state that updates the Ca2+ channels, docks the insulin
+     vesicles and secretes the ready ones in a single update.
+
+     @param m the model
+     @param vesicles insulin vesicles
+     @param cachannel Ca2+ channels
+     @param nucleus_sphere, a sphere3D object which represents the nucleus
+     @param oscillation the opening state of Ca2+ channels to detect oscilation
+     @param troughn the number of Ca2+ channels in the opening state at the trough
+     @param peakn the number of Ca2+ channels in the opening state at the peak
+     @param contact_range the range of sphere distance in angstroms under which vesicles and cachannel will be tested for rigidification
+     @param slack slack in angstroms for the IMP::container::CloseBipartitePairContainer that tracks nearby vesicles and channels
+     @param ready_state an integer defining the ready state of the docking state decorator
+     @param cut_off the cut-off from the NE surface to vesicle center to reset vesicles, it needs to be larger than 2*R_vesicleS, A
+     @param periodicity the frame interval for updating this optimizer state
+   */
+  InsulinCellLifecycleOptimizerState
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      ParticleIndexesAdaptor cachannel,
+      algebra::Sphere3D nucleus_sphere,
+      int oscillation,
+      int troughn,
+      int peakn,
+      double contact_range,
+      double slack,
+      int ready_state,
+      double cut_off,
+      unsigned int periodicity = 1 );
+
+  /**
+     An optimizer state that updates the Ca2+ channel sites of a
+     ChannelSiteArray, docks the insulin vesicles to the open sites
+     and secretes the ready ones in a single update.
+
+     @param m the model
+     @param vesicles insulin vesicles
+     @param channel_index the angular index of a ChannelSiteArray (see
+            ChannelSurfaceIndex::get_site_array()); its max_reach must cover
+            contact_range plus the vesicle and site radii
+     @param nucleus_sphere, a sphere3D object which represents the nucleus
+     @param oscillation the opening state of Ca2+ channels to detect oscilation
+     @param troughn the number of Ca2+ channels in the opening state at the trough
+     @param peakn the number of Ca2+ channels in the opening state at the peak
+     @param contact_range the range of sphere distance in angstroms under which vesicles dock to an open site
+     @param ready_state an integer defining the ready state of the docking state decorator
+     @param cut_off the cut-off from the NE surface to vesicle center to reset vesicles, A
+     @param periodicity the frame interval for updating this optimizer state
+   */
+  InsulinCellLifecycleOptimizerState
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      ChannelSurfaceIndex *channel_index,
+      algebra::Sphere3D nucleus_sphere,
+      int oscillation,
+      int troughn,
+      int peakn,
+      double contact_range,
+      int ready_state,
+      double cut_off,
+      unsigned int periodicity = 1 );
+
+  //! Look up the docking channels in a static channel index instead of a close pair container.
+  /** The index must hold the same Ca2+ channels, and its max_reach must cover
+      contact_range plus the vesicle and channel radii. */
+  void set_channel_surface_index(ChannelSurfaceIndex *channel_index) {
+    docking_.set_channel_index(channel_index);
+  }
+
+  //! Filter the docking pairs from a shared close pair list instead of searching them.
+  /** The list must hold the vesicles and the channels (or their cores) and
+      reach contact_range + slack, e.g., the one of a NeighborExcludedVolumeRestraint.
+      Raises a UsageException if the channels are a site array or a channel index. */
+  void set_neighbor_provider(SharedNeighborProvider *neighbors) {
+    docking_.set_neighbor_provider(neighbors);
+  }
+
+  //! Enqueue the phase flips, undockings and secretions on a scheduler.
+  /** The scheduler must share the periodicity of this optimizer state and be
+      updated before it (see the three separate optimizer states). */
+  void set_scheduler(LifecycleEventScheduler *scheduler) {
+    oscillation_.set_scheduler(scheduler);
+    docking_.set_scheduler(scheduler);
+    secretion_.set_scheduler(scheduler);
+  }
+
+  //! Gate each Ca2+ channel stochastically (see CaChannelOpeningOptimizerState).
+  void set_gating(ChannelMarkovGating *gating) {
+    oscillation_.set_gating(gating);
+  }
+
+  //! sets the cut_off for resetting insulin vesicles after secretion
+  //!in A
+  void set_cut_off(double cut_off)
+  { secretion_.set_cut_off(cut_off); }
+
+  //! returns the cut_off for resetting insulin vesicles after secretion
+  //!in A
+  double get_cut_off() const
+  { return secretion_.get_cut_off(); }
+
+  //! Store and visit the vesicles in the given order, e.g., along a Morton curve.
+  /** See SpatialReorderingOptimizerState; the vesicles not in it go last. */
+  void set_order(ParticleIndexesAdaptor order) {
+    secretion_.set_order(order);
+  }
+
+  //! Freeze the vesicles of an active set when they dock and release them when they are secreted.
+  void set_active_set(VesicleActiveSet *active_set) {
+    docking_.set_active_set(active_set);
+    secretion_.set_active_set(active_set);
+  }
+
+  //! Append each secretion, with its docking time and channel, to an event log
+  void set_event_log(SecretionEventLog *event_log) {
+    docking_.set_event_log(event_log);
+    secretion_.set_event_log(event_log);
+  }
+
+  //! Reset each secreted vesicle near the nucleus of its own cell of an islet.
+  /** Vesicles that are not assigned to a cell are reset near nucleus_sphere.
+      Docking by close pairs of channel particles works for any number of
+      cells; a ChannelSurfaceIndex covers a single cell. */
+  void set_cell_geometry(CellGeometryTable *cells) {
+    secretion_.set_cell_geometry(cells);
+  }
+
+  IMP_OBJECT_METHODS(InsulinCellLifecycleOptimizerState);
+};
+
+IMP_OBJECTS(InsulinCellLifecycleOptimizerState, InsulinCellLifecycleOptimizerStates);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_INSULIN_CELL_LIFECYCLE_OPTIMIZER_STATE_H */
@@ -6,11 +6,13 @@
  *
  * Description:
  * 1. Get optimizer state for each frame of the trajectory (insulin vesicles).
- * 3. Check all vesicles for their maturation state decorator, and add 1 to the decorator.
+ * 3. Advance the LifecycleClock of the model, so every vesicle gains one maturation state.
  * 4. When the docking state exceeds the ready_state, update the secretion counter decorator.
  * 5. Resets the vesicle positions randomly within a cut-off near the nucleus without overlapping
  *    with any other organelles. Reset the MaturationState and DockingStatedecorator for vesicles to 0.
  * 6. Update the optimizer state.
+ * 7. Optionally, secretions are taken from the due events of a LifecycleEventScheduler
+ *    instead of advancing the docking state of every vesicle each period.
  *
  *
  *  Copyright 2007-2019 IMP Inventors. All rights reserved.
@@ -22,6 +24,12 @@
 #include <IMP/insulinsecretion/insulinsecretion_config.h> 
 #include <IMP/insulinsecretion/SecretionCounterDecorator.h>
 #include <IMP/insulinsecretion/MaturationStateDecorator.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/LifecycleEventScheduler.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/insulinsecretion/SecretionEventLog.h>
+#include <IMP/insulinsecretion/CellGeometryTable.h>
+#include <IMP/insulinsecretion/internal/lifecycle_stages.h>
 #include <IMP/algebra/Transformation3D.h>
 #include <IMP/algebra/ReferenceFrame3D.h>
 #include <IMP/atom/Hierarchy.h>
@@ -42,21 +50,9 @@ class IMPINSULINSECRETIONEXPORT InsulinSecretionOptimizerState
 {
  private:
    typedef OptimizerState P; // define P as the member initializer
-   Particles vesicles_;
-   algebra::Sphere3D nucleus_sphere_;
-   int ready_state_;
-   double cut_off_; // cut-off for new locations where vesicles are reset
+   internal::VesicleSecretionStage secretion_; // the shared secretion pass
    unsigned int periodicity_; // the framee interval
 
-  //! Secret insulin vesicles
-  void count_secretion();
-
-  //! Reset insulin vesicles
-  void do_reset(ParticleIndex pi);
-
-  //! get random vector in and without overlapping with particles
-  algebra::Vector3D get_random_vector_in(algebra::Sphere3D sphere, core::XYZR xyzr) const;
-
  protected:
   //! Update the optimizer state.
   // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
@@ -87,15 +83,49 @@ class IMPINSULINSECRETIONEXPORT InsulinSecretionOptimizerState
   //! sets the cut_off for resetting insulin vesicles after secretion
   //!in A
   void set_cut_off(double cut_off) 
-  { cut_off_= cut_off; }
+  { secretion_.set_cut_off(cut_off); }
 
   //! returns the cut_off for resetting insulin vesicles after secretion
   //!in A
   double get_cut_off() const 
-  { return cut_off_; }
+  { return secretion_.get_cut_off(); }
 
   //! Set the particles to use.
-  void set_vesicles(const Particles &vesicles) { vesicles_ = vesicles; }
+  void set_vesicles(const Particles &vesicles) {
+    secretion_.set_vesicles(IMP::get_indexes(vesicles));
+  }
+
+  //! Store and visit the vesicles in the given order, e.g., along a Morton curve.
+  /** See SpatialReorderingOptimizerState; the vesicles not in it go last. */
+  void set_order(ParticleIndexesAdaptor order) {
+    secretion_.set_order(order);
+  }
+
+  //! Take the secretions from the due SECRETION_EVENTs of a scheduler.
+  /** The scheduler must share the periodicity of this optimizer state and be
+      updated before it; the docking state enqueues the events. The docking
+      state of the vesicles is then no longer advanced every period. */
+  void set_scheduler(LifecycleEventScheduler *scheduler) {
+    secretion_.set_scheduler(scheduler);
+  }
+
+  //! Move the vesicles back to the active part of an active set when they are secreted.
+  void set_active_set(VesicleActiveSet *active_set) {
+    secretion_.set_active_set(active_set);
+  }
+
+  //! Append each secretion to an event log.
+  /** The docking time and channel of the events are only known if the
+      log is also set on the docking state. */
+  void set_event_log(SecretionEventLog *event_log) {
+    secretion_.set_event_log(event_log);
+  }
+
+  //! Reset each secreted vesicle near the nucleus of its own cell of an islet.
+  /** Vesicles that are not assigned to a cell are reset near nucleus_sphere. */
+  void set_cell_geometry(CellGeometryTable *cells) {
+    secretion_.set_cell_geometry(cells);
+  }
 
   IMP_OBJECT_METHODS(InsulinSecretionOptimizerState);
 };
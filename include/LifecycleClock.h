@@ -0,0 +1,60 @@
+/**
+ *  \file IMP/insulinsecretion/LifecycleClock.h
+ *  \brief The number of secretion passes of a model, from which the maturation states are computed.
+ *
+ * Description:
+ * 1, The maturation state of a vesicle is the number of secretion passes since it was created
+ *    or last secreted. Instead of incrementing it for every vesicle in every pass, each model
+ *    keeps one clock of the passes (stored as model data) and each vesicle stores the tick at
+ *    which it was born or reset (see MaturationStateDecorator).
+ * 2, A secretion pass only advances the clock and writes the vesicles it secretes, so its cost
+ *    depends on the vesicles whose docking state changes, not on all vesicles.
+ *
+ * Note: all secretion passes of a model share its clock, so a model should have one.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_LIFECYCLE_CLOCK_H
+#define IMPINSULINSECRETION_LIFECYCLE_CLOCK_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/Object.h>
+#include <IMP/Model.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! The secretion pass clock of a model
+class IMPINSULINSECRETIONEXPORT LifecycleClock : public Object
+{
+  int tick_;
+
+ public:
+  LifecycleClock();
+
+  //! returns the clock of a model, creating it at tick 0 if needed
+  static LifecycleClock *get_clock(Model *m);
+
+  //! returns the current tick of the clock of a model, 0 if it has none
+  static int get_tick(Model *m);
+
+  //! the key of the clock in the model data
+  static ModelKey get_key();
+
+  int get_tick() const { return tick_; }
+
+  //! Set the tick, e.g., to restore a snapshot
+  void set_tick(int tick) { tick_ = tick; }
+
+  //! Advance the clock by one secretion pass
+  void advance() { ++tick_; }
+
+  IMP_OBJECT_METHODS(LifecycleClock);
+};
+
+IMP_OBJECTS(LifecycleClock, LifecycleClocks);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_LIFECYCLE_CLOCK_H */
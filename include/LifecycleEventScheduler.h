@@ -0,0 +1,117 @@
+/**
+ *  \file IMP/insulinsecretion/LifecycleEventScheduler.h
+ *  \brief An optimizer state that schedules vesicle and Ca2+ channel lifecycle events on a timing wheel.
+ *
+ * Description:
+ * 1, Each update of this optimizer state advances the lifecycle clock by one tick.
+ * 2, Other optimizer states enqueue events a number of ticks ahead, e.g., the docking
+ *    state enqueues the undocking/secretion of a vesicle at t + ready_state and the
+ *    Ca2+ channel oscillator enqueues its next phase flip.
+ * 3, Events are stored in the slot (due tick mod wheel size) of a timing wheel, so each
+ *    consumer only visits the events of the current slot instead of scanning all
+ *    vesicles and channels every period.
+ *
+ * Note: the scheduler must be added to the simulator before its consumers and share
+ *       their period, so that the clock advances once before they run in each update.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_LIFECYCLE_EVENT_SCHEDULER_H
+#define IMPINSULINSECRETION_LIFECYCLE_EVENT_SCHEDULER_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/OptimizerState.h>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! The type of a lifecycle event
+enum LifecycleEventType {
+  //! a docked vesicle is ready and must be released from its channel
+  UNDOCK_EVENT = 0,
+  //! a released vesicle is secreted and reset near the nucleus
+  SECRETION_EVENT = 1,
+  //! the Ca2+ channels switch between the trough and the peak phase
+  CHANNEL_FLIP_EVENT = 2
+};
+
+#ifndef SWIG
+//! A lifecycle event stored in the timing wheel
+struct LifecycleEvent {
+  unsigned int due; // the tick at which the event fires
+  LifecycleEventType type;
+  ParticleIndex vesicle; // the vesicle concerned, if any
+  ParticleIndex channel; // the Ca2+ channel concerned, if any
+};
+typedef std::vector<LifecycleEvent> LifecycleEvents;
+#endif
+
+/**
+   An optimizer state that schedules vesicle and Ca2+ channel lifecycle
+   events on a timing wheel.
+ */
+class IMPINSULINSECRETIONEXPORT LifecycleEventScheduler
+: public OptimizerState
+{
+ private:
+   typedef OptimizerState P; // define P as the member initializer
+   std::vector<std::vector<LifecycleEvent> > wheel_; // one slot per tick modulo the wheel size
+   unsigned int mask_; // wheel size - 1, the wheel size is a power of two
+   unsigned int tick_; // the current tick
+   unsigned int n_pending_; // the number of events in the wheel
+
+ protected:
+  //! Update the optimizer state.
+  // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
+  virtual void do_update(unsigned int call_num) override; // Cause a compile error if this method does not override a parent method
+
+ public:
+  /**
+     An optimizer state that schedules lifecycle events on a timing wheel.
+
+     @param m the model
+     @param periodicity the frame interval for advancing the clock, which must be
+            the periodicity of the optimizer states that use this scheduler
+     @param wheel_size the number of slots of the wheel (rounded up to a power of two);
+            events further ahead than this stay in their slot for extra revolutions
+   */
+  LifecycleEventScheduler
+    ( Model *m,
+      unsigned int periodicity = 1,
+      unsigned int wheel_size = 1024 );
+
+  //! returns the current tick of the lifecycle clock
+  unsigned int get_current_tick() const { return tick_; }
+
+  //! enqueue an event delay ticks ahead of the current tick
+  /** An event with zero delay fires in the current tick, for consumers
+      that run later in the same update. */
+  void schedule(unsigned int delay,
+                LifecycleEventType type,
+                ParticleIndex vesicle = ParticleIndex(),
+                ParticleIndex channel = ParticleIndex());
+
+#ifndef SWIG
+  //! remove and return the events of the given type that are due
+  LifecycleEvents pop_due_events(LifecycleEventType type);
+#endif
+
+  //! returns the number of events that have not fired yet
+  unsigned int get_number_of_pending_events() const { return n_pending_; }
+
+  //! returns the number of slots of the timing wheel
+  unsigned int get_wheel_size() const { return wheel_.size(); }
+
+  //! drop all pending events and restart the clock at zero
+  void clear();
+
+  IMP_OBJECT_METHODS(LifecycleEventScheduler);
+};
+
+IMP_OBJECTS(LifecycleEventScheduler, LifecycleEventSchedulers);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_LIFECYCLE_EVENT_SCHEDULER_H */
@@ -5,6 +5,10 @@
  * Description:
  * 1, Set a decorator to describe the maturation state of an insulin vesicle.
  * 2, It starts with zero.
+ * 3, The state is not incremented per vesicle: the vesicle stores the tick of the
+ *    LifecycleClock of its model at which it was born or reset, and the state is the
+ *    number of ticks since then. The "state" attribute is only written by set_state()
+ *    and update_states(), for the writers that read the raw attributes (e.g., RMF).
  *
  *
  *  Copyright 2007-2019 IMP Inventors. All rights reserved.
@@ -14,6 +18,7 @@
 #define IMPINSULINSECRETION_MATURATION_STATE_DECORATOR_H
 
 #include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/LifecycleClock.h>
 #include <IMP/Decorator.h>
 #include <IMP/decorator_macros.h>
 
@@ -36,6 +41,7 @@ class IMPINSULINSECRETIONEXPORT MaturationStateDecorator
                                ParticleIndex pi,
                                int state) {
    m->add_attribute(get_state_key(), pi, state);
+   m->add_attribute(get_birth_key(), pi, LifecycleClock::get_tick(m) - state);
  }
 
  static void do_setup_particle(Model *m, ParticleIndex pi,
@@ -49,19 +55,35 @@ class IMPINSULINSECRETIONEXPORT MaturationStateDecorator
   }
 
   Int get_state() const {
-    return get_model()->get_attribute(get_state_key(), get_particle_index());
+    Model *m = get_model();
+    if (m->get_has_attribute(get_birth_key(), get_particle_index())) {
+      return LifecycleClock::get_tick(m)
+             - m->get_attribute(get_birth_key(), get_particle_index());
+    }
+    return m->get_attribute(get_state_key(), get_particle_index());
   }
 
   void set_state(Int d) { 
-    get_model()->set_attribute(get_state_key(), get_particle_index(), d);
+    Model *m = get_model();
+    m->set_attribute(get_state_key(), get_particle_index(), d);
+    if (m->get_has_attribute(get_birth_key(), get_particle_index())) {
+      m->set_attribute(get_birth_key(), get_particle_index(),
+                       LifecycleClock::get_tick(m) - d);
+    }
   }
 
+  //! Write the current state of each vesicle to its "state" attribute
+  /** Call it before the writers that read the raw attributes, e.g., RMF. */
+  static void update_states(Model *m, ParticleIndexesAdaptor vesicles);
+
   IMP_DECORATOR_METHODS(MaturationStateDecorator, Decorator);
   /** Add the specified maturation state to the particle. */
   IMP_DECORATOR_SETUP_1(MaturationStateDecorator, Int, state);
   IMP_DECORATOR_SETUP_1(MaturationStateDecorator, MaturationStateDecorator, other);
   /** Get the key used to store the maturation state. */
   static IntKey get_state_key();
+  /** Get the key used to store the clock tick of the birth or reset. */
+  static IntKey get_birth_key();
 };
 
 IMPINSULINSECRETION_END_NAMESPACE
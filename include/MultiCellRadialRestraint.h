@@ -0,0 +1,114 @@
+/**
+ *  \file IMP/insulinsecretion/MultiCellRadialRestraint.h
+ *  \brief The radial scores of the vesicles of all cells of an islet, evaluated in parallel.
+ *
+ * Description:
+ * 1, Each vesicle is scored by RadialDistributionFunctionSingletonScore with the cell and
+ *    nucleus spheres of its own cell, and optionally by VesicleTraffickingSingletonScore
+ *    around the center of its cell, as looked up in a CellGeometryTable.
+ * 2, All vesicles of all cells are scored in one pass, split in contiguous ranges over
+ *    threads; each thread sums its own score and writes the derivatives of its own vesicles,
+ *    so the threads share nothing but the read-only geometry table.
+ * 3, In single precision mode each range is gathered into float arrays of the positions
+ *    relative to the cell centers and of the radial bounds, scored by a branch-free float
+ *    loop the compiler can vectorize, and its derivatives are scattered back to the model.
+ *    The score is summed in double in both modes. The float arrays of each thread are kept
+ *    between evaluations, so they are only allocated when the number of vesicles grows.
+ *
+ * Note: each vesicle must appear once in the container, and vesicles that are not assigned
+ *       to a cell are not scored.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_MULTI_CELL_RADIAL_RESTRAINT_H
+#define IMPINSULINSECRETION_MULTI_CELL_RADIAL_RESTRAINT_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/CellGeometryTable.h>
+#include <IMP/insulinsecretion/RadialDistributionFunctionSingletonScore.h>
+#include <IMP/insulinsecretion/VesicleTraffickingSingletonScore.h>
+#include <IMP/Restraint.h>
+#include <IMP/SingletonContainer.h>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   The RDF and trafficking scores of the vesicles of many cells, each in
+   the geometry of its own cell, evaluated by several threads.
+ */
+class IMPINSULINSECRETIONEXPORT MultiCellRadialRestraint
+: public Restraint
+{
+ private:
+  PointerMember<SingletonContainer> vesicles_;
+  PointerMember<CellGeometryTable> cells_;
+  PointerMember<RadialDistributionFunctionSingletonScore> rdf_;
+  PointerMember<VesicleTraffickingSingletonScore> traffic_;
+  unsigned int n_threads_;
+  bool single_precision_;
+
+  //! the float arrays of the range of one thread
+  struct SingleBuffers {
+    std::vector<float> dx, dy, dz, r_min, s_max, valid, score, g;
+    //! keeps the capacity, so it allocates only to grow
+    void resize(unsigned int n);
+  };
+  mutable std::vector<SingleBuffers> single_buffers_; // one per thread
+
+  //! the score of the vesicles in [begin, end) of vesicles
+  double evaluate_range(const ParticleIndexes &vesicles, unsigned int begin,
+                        unsigned int end, DerivativeAccumulator *da) const;
+
+  //! the score of the vesicles in [begin, end) of vesicles, computed in float
+  double evaluate_range_single(const ParticleIndexes &vesicles, unsigned int begin,
+                               unsigned int end, DerivativeAccumulator *da,
+                               SingleBuffers &buffers) const;
+
+ public:
+  /**
+     The radial scores of the vesicles of an islet.
+
+     @param vesicles the vesicles of all cells, e.g., the active container of
+            a VesicleActiveSet
+     @param cells the geometry of the cells and the cell of each vesicle
+     @param rdf the RDF score, whose own spheres are ignored
+     @param traffic the trafficking score, whose own center is replaced by the
+            center of the cell of each vesicle, or nullptr
+     @param n_threads the number of threads, 0 for all cores
+     @param name the name of the restraint
+   */
+  MultiCellRadialRestraint
+    ( SingletonContainerAdaptor vesicles,
+      CellGeometryTable *cells,
+      RadialDistributionFunctionSingletonScore *rdf,
+      VesicleTraffickingSingletonScore *traffic = nullptr,
+      unsigned int n_threads = 0,
+      std::string name = "MultiCellRadialRestraint%1%" );
+
+  void set_number_of_threads(unsigned int n_threads) { n_threads_ = n_threads; }
+
+  unsigned int get_number_of_threads() const { return n_threads_; }
+
+  //! Compute the scores and derivatives in float, summing the score in double
+  void set_single_precision(bool single_precision) {
+    single_precision_ = single_precision;
+  }
+
+  bool get_is_single_precision() const { return single_precision_; }
+
+  virtual double unprotected_evaluate
+  ( DerivativeAccumulator *da ) const override;
+
+  virtual ModelObjectsTemp do_get_inputs() const override;
+
+  IMP_OBJECT_METHODS(MultiCellRadialRestraint);
+};
+
+IMP_OBJECTS(MultiCellRadialRestraint, MultiCellRadialRestraints);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_MULTI_CELL_RADIAL_RESTRAINT_H */
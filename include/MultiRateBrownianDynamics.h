@@ -0,0 +1,131 @@
+/**
+ *  \file IMP/insulinsecretion/MultiRateBrownianDynamics.h
+ *  \brief Brownian dynamics that advances the vesicles in the bulk of the cytoplasm with a large time step.
+ *
+ * Description:
+ * 1, Only vesicles near the membrane can dock, so they need the fine BD time step; the vesicles
+ *    whose surface is farther than fine_distance from both the membrane and the nucleus are bulk
+ *    vesicles, which only feel the smooth radial RDF and trafficking potentials.
+ * 2, Every frame, the fine particles (all particles but the bulk vesicles) are advanced by the
+ *    BD step as in atom::BrownianDynamics. Every n_substeps frames, the bulk vesicles are
+ *    advanced by n_substeps BD steps at once, by the exact Gaussian propagator of a constant
+ *    force: the radial force at their start position gives the drift, and the noise has
+ *    variance 2 D n_substeps dt per coordinate. Then the vesicles are classified again.
+ * 3, The simulator time step stays the fine one, so the frames, the optimizer state periods,
+ *    READY_STATE and the Ca2+ oscillation keep their meaning.
+ *
+ * 4, A bulk vesicle must not reach the docking range within one coarse step, so fine_distance
+ *    must exceed the contact range by a few rms displacements of a coarse step; see
+ *    get_minimum_fine_distance(), which setup() checks against set_contact_range().
+ *
+ * Note: all particles are synchronized only at the end of each n_substeps frames, so the
+ *       periods of the optimizer states that read the vesicle coordinates should be multiples
+ *       of n_substeps (e.g., n_substeps = the lifecycle periodicity). Bulk vesicles are not
+ *       moved by the scoring function, so the singleton restraints should be applied to
+ *       get_fine_container() to skip them.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_MULTI_RATE_BROWNIAN_DYNAMICS_H
+#define IMPINSULINSECRETION_MULTI_RATE_BROWNIAN_DYNAMICS_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/RadialDistributionFunctionSingletonScore.h>
+#include <IMP/insulinsecretion/VesicleTraffickingSingletonScore.h>
+#include <IMP/atom/BrownianDynamics.h>
+#include <IMP/container/ListSingletonContainer.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   Brownian dynamics with a fine time step near the membrane and the
+   nucleus, and a coarse time step for the vesicles in between.
+ */
+class IMPINSULINSECRETIONEXPORT MultiRateBrownianDynamics
+: public atom::BrownianDynamics
+{
+ private:
+  ParticleIndexes vesicles_;
+  PointerMember<RadialDistributionFunctionSingletonScore> rdf_;
+  PointerMember<VesicleTraffickingSingletonScore> traffic_;
+  double fine_distance_; // A
+  double contact_range_; // the docking contact range, A
+  unsigned int n_substeps_;
+  unsigned int n_steps_; // the fine steps since the bulk vesicles were last advanced
+  double elapsed_; // the time of these steps, fs
+  ParticleIndexes bulk_;
+  Ints is_bulk_; // by particle index
+  PointerMember<container::ListSingletonContainer> fine_;
+
+  //! classify the vesicles as bulk or fine from their positions
+  void update_bulk();
+
+  //! advance the bulk vesicles by a time dt, fs
+  void advance_bulk(double dt);
+
+ protected:
+  virtual void setup(const ParticleIndexes &ps) override;
+
+  virtual double do_step(const ParticleIndexes &ps, double dt) override;
+
+ public:
+  /**
+     Brownian dynamics with a coarse time step in the bulk of the cytoplasm.
+
+     @param m the model
+     @param vesicles the insulin vesicles
+     @param rdf the RDF score, whose spheres define the cell
+     @param traffic the trafficking score, around the center of the cell, or nullptr
+     @param fine_distance vesicles whose surface is closer than this to the
+            membrane or the nucleus are advanced with the fine step, A.
+            It must be at least get_minimum_fine_distance() of the
+            contact range.
+     @param n_substeps the number of fine steps in a coarse step
+     @param name the name of the simulator
+   */
+  MultiRateBrownianDynamics
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      RadialDistributionFunctionSingletonScore *rdf,
+      VesicleTraffickingSingletonScore *traffic,
+      double fine_distance,
+      unsigned int n_substeps,
+      std::string name = "MultiRateBrownianDynamics%1%" );
+
+  //! returns the smallest safe fine_distance, A
+  /** The contact range plus 3 rms displacements per coordinate of a coarse
+      step, sqrt(2 D n_substeps dt), so that a bulk vesicle reaches the
+      docking range (or crosses the membrane) in one coarse step with a
+      probability of about 1e-3 per coordinate.
+
+      @param contact_range the docking contact range, A
+      @param diffusion_coefficient the largest diffusion coefficient of the vesicles, A^2/fs
+      @param time_step the fine BD time step, fs
+      @param n_substeps the number of fine steps in a coarse step
+   */
+  static double get_minimum_fine_distance(double contact_range,
+                                          double diffusion_coefficient,
+                                          double time_step,
+                                          unsigned int n_substeps);
+
+  //! Set the docking contact range that setup() checks fine_distance against, 0 by default
+  void set_contact_range(double contact_range) { contact_range_ = contact_range; }
+
+  //! returns the vesicles that are advanced with the fine step
+  SingletonContainer *get_fine_container() const { return fine_; }
+
+  //! returns the vesicles that are advanced with the coarse step
+  ParticleIndexes get_bulk_vesicles() const { return bulk_; }
+
+  unsigned int get_number_of_substeps() const { return n_substeps_; }
+
+  IMP_OBJECT_METHODS(MultiRateBrownianDynamics);
+};
+
+IMP_OBJECTS(MultiRateBrownianDynamics, MultiRateBrownianDynamicsList);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_MULTI_RATE_BROWNIAN_DYNAMICS_H */
@@ -0,0 +1,135 @@
+/**
+ *  \file IMP/insulinsecretion/MultiTauDiffusionOptimizerState.h
+ *  \brief An optimizer state that estimates the mean-squared displacement of vesicles with a multi-tau correlator.
+ *
+ * Description:
+ * 1, Each vesicle keeps a few positions per level of a multi-tau correlator: level 0 holds
+ *    the last p positions, level l the last p positions sampled every 2^l updates, so
+ *    lags up to p*2^(L-1) updates are covered with O(p*L) memory per vesicle.
+ * 2, Each new position is compared with the positions stored at its levels and the squared
+ *    displacements are accumulated per lag, so the MSD curve and the apparent diffusion
+ *    coefficient are available at any time without writing a trajectory.
+ * 3, The history of a vesicle is dropped when it is secreted (it is reset near the nucleus)
+ *    and while it is docked (it does not diffuse), so only free diffusion is measured.
+ * 4, In single precision mode the positions are stored as float, which halves the largest
+ *    per-vesicle array; float resolves positions in a cell to ~0.01 A, far below the
+ *    displacements measured. The displacements are accumulated in double in both modes.
+ * 5, The per-vesicle arrays are stored in slot order, which set_order() permutes, e.g., along
+ *    the Morton curve of SpatialReorderingOptimizerState; the particle indexes stay the ids
+ *    of the vesicles and are mapped to their slots.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_MULTI_TAU_DIFFUSION_OPTIMIZER_STATE_H
+#define IMPINSULINSECRETION_MULTI_TAU_DIFFUSION_OPTIMIZER_STATE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/OptimizerState.h>
+#include <IMP/algebra/Vector3D.h>
+#include <limits>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   An optimizer state that accumulates the mean-squared displacement of
+   free insulin vesicles at log-spaced lags with a multi-tau correlator.
+ */
+class IMPINSULINSECRETIONEXPORT MultiTauDiffusionOptimizerState
+: public OptimizerState
+{
+ private:
+   typedef OptimizerState P; // define P as the member initializer
+   ParticleIndexes vesicles_; // the vesicle of each slot
+   Ints slots_; // the slot of each vesicle, -1 for other particles, by particle index
+   double time_step_; // the time step of the simulator, fs
+   unsigned int n_per_level_; // p, the number of positions kept per level
+   unsigned int n_levels_; // L
+   std::vector<double> history_; // p positions per level per vesicle, 3 coordinates each
+   std::vector<float> history_single_; // the same in single precision mode
+   Ints lengths_; // the number of positions stored per level per vesicle
+   Ints heads_; // the slot of the newest position per level per vesicle
+   std::vector<unsigned int> n_samples_; // the positions sampled since the vesicle was last reset
+   Ints last_secretion_; // the secretion counter of each vesicle at its last reset
+   Ints lags_; // the lags in updates, increasing
+   Ints lag_index_; // the index in lags_ of lag k of level l, -1 if covered by a lower level
+   Floats msd_sum_;
+   Floats msd_count_;
+
+   //! map the particle index of each vesicle to its slot
+   void update_slots();
+
+   //! drop the stored positions of vesicle i
+   void clear_vesicle(unsigned int i);
+
+   //! store a position of vesicle i in history and accumulate its displacements
+   template <class T>
+   void add_sample(std::vector<T> &history, unsigned int i,
+                   const algebra::Vector3D &v);
+
+ protected:
+  //! Update the optimizer state.
+  // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
+  virtual void do_update(unsigned int call_num) override; // Cause a compile error if this method does not override a parent method
+
+ public:
+  /**
+     An optimizer state that estimates the diffusion of insulin vesicles.
+
+     @param m the model
+     @param vesicles the insulin vesicles to follow
+     @param time_step the time step of the simulator in fs, for the lag times
+     @param n_per_level the number of positions kept per correlator level
+     @param n_levels the number of correlator levels, the longest lag is
+            n_per_level * 2^(n_levels - 1) updates
+     @param periodicity the frame interval for sampling the positions
+     @param single_precision store the positions as float instead of double
+   */
+  MultiTauDiffusionOptimizerState
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      double time_step,
+      unsigned int n_per_level = 16,
+      unsigned int n_levels = 16,
+      unsigned int periodicity = 1,
+      bool single_precision = false );
+
+  //! returns the lag times in fs, increasing
+  Floats get_lag_times() const;
+
+  //! returns the mean-squared displacement at each lag time in A^2, 0 if not sampled yet
+  Floats get_mean_squared_displacements() const;
+
+  //! returns the number of displacements accumulated at each lag time
+  Floats get_number_of_displacements() const { return msd_count_; }
+
+  //! returns the apparent diffusion coefficient in A^2/fs
+  /** Least-squares fit of MSD = 6 D t over the sampled lag times in
+      [min_time, max_time], comparable to the diffusion coefficient set
+      with atom::Diffusion. Returns 0 if no lag time was sampled. */
+  double get_diffusion_coefficient
+    ( double min_time = 0,
+      double max_time = std::numeric_limits<double>::max() ) const;
+
+  //! drop all stored positions and accumulated displacements
+  void clear();
+
+  //! Permute the per-vesicle arrays to the given order, the vesicles not in it last
+  /** The accumulated displacements do not change. */
+  void set_order(ParticleIndexesAdaptor order);
+
+  //! returns the positions sampled since the vesicle was last reset or docked
+  unsigned int get_number_of_samples(ParticleIndex pi) const;
+
+  bool get_is_single_precision() const { return !history_single_.empty(); }
+
+  IMP_OBJECT_METHODS(MultiTauDiffusionOptimizerState);
+};
+
+IMP_OBJECTS(MultiTauDiffusionOptimizerState, MultiTauDiffusionOptimizerStates);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_MULTI_TAU_DIFFUSION_OPTIMIZER_STATE_H */
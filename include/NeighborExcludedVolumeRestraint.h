@@ -0,0 +1,61 @@
+/**
+ *  \file IMP/insulinsecretion/NeighborExcludedVolumeRestraint.h
+ *  \brief An excluded volume restraint over the candidate pairs of a SharedNeighborProvider.
+ *
+ * Description:
+ * 1, Scores the candidate pairs of a SharedNeighborProvider with a soft sphere score, so the
+ *    excluded volume and the docking pass share one close pair list.
+ * 2, As in core::ExcludedVolumeRestraint, pairs of members of the same rigid body (a Ca2+
+ *    channel and its docked vesicles) are not scored.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_NEIGHBOR_EXCLUDED_VOLUME_RESTRAINT_H
+#define IMPINSULINSECRETION_NEIGHBOR_EXCLUDED_VOLUME_RESTRAINT_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/SharedNeighborProvider.h>
+#include <IMP/Restraint.h>
+#include <IMP/PairScore.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   An excluded volume restraint that reads its close pairs from a
+   SharedNeighborProvider instead of keeping its own.
+ */
+class IMPINSULINSECRETIONEXPORT NeighborExcludedVolumeRestraint
+: public Restraint
+{
+ private:
+  PointerMember<SharedNeighborProvider> neighbors_;
+  PointerMember<PairScore> score_; // soft sphere score of overlapping pairs
+
+ public:
+  /**
+     An excluded volume restraint over shared close pairs.
+
+     @param neighbors the shared close pair list of the particles
+     @param k the spring constant of the soft sphere score in kcal/mol/A^2
+     @param name the name of the restraint
+   */
+  NeighborExcludedVolumeRestraint
+    ( SharedNeighborProvider *neighbors,
+      double k = 1,
+      std::string name = "NeighborExcludedVolumeRestraint%1%" );
+
+  virtual double unprotected_evaluate
+  ( DerivativeAccumulator *da ) const override;
+
+  virtual ModelObjectsTemp do_get_inputs() const override;
+
+  IMP_OBJECT_METHODS(NeighborExcludedVolumeRestraint);
+};
+
+IMP_OBJECTS(NeighborExcludedVolumeRestraint, NeighborExcludedVolumeRestraints);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_NEIGHBOR_EXCLUDED_VOLUME_RESTRAINT_H */
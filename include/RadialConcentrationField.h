@@ -0,0 +1,142 @@
+/**
+ *  \file IMP/insulinsecretion/RadialConcentrationField.h
+ *  \brief An optimizer state that represents the vesicles deep in the cytoplasm as a radial concentration field.
+ *
+ * Description:
+ * 1, Only vesicles near the membrane can dock, so free vesicles whose center is farther than
+ *    field_distance from the membrane are absorbed into a radial field: their count is added
+ *    to the shell of the field they are in, and their particles stop being simulated and
+ *    scored (see VesicleActiveSet::set_is_absorbed()).
+ * 2, The field is evolved by a 1D Fokker-Planck equation in the potential of a
+ *    RadialDistributionFunctionSingletonScore, discretized by finite volumes with
+ *    Scharfetter-Gummel fluxes, so the shell counts relax to the same Boltzmann distribution
+ *    as the particles and no mass is lost between shells.
+ * 3, The field boundary is reflecting at the nucleus. At the outer boundary, the vesicles
+ *    that flow out of the field are accumulated and each whole vesicle is emitted back as a
+ *    particle in the buffer shell just outside the field, while vesicles that diffuse into the
+ *    field are absorbed, so field + particles always hold all vesicles.
+ * 4, Polydisperse vesicles are binned in narrow radius classes, each with its own shell
+ *    counts evolved in the RDF potential of its mean radius, since the scored range of the
+ *    RDF depends on the vesicle radius. The shells span the range of the smallest vesicles
+ *    at the nucleus to the field radius of the largest ones.
+ *
+ * Note: the coordinates of absorbed vesicles are not updated; the singleton and excluded
+ *       volume restraints must be applied to the active container of the active set.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_RADIAL_CONCENTRATION_FIELD_H
+#define IMPINSULINSECRETION_RADIAL_CONCENTRATION_FIELD_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/RadialDistributionFunctionSingletonScore.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/OptimizerState.h>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   An optimizer state that evolves the vesicles deep in the cytoplasm as a
+   radial concentration field and exchanges them with the particles at a
+   buffer shell.
+ */
+class IMPINSULINSECRETIONEXPORT RadialConcentrationField
+: public OptimizerState
+{
+ private:
+   typedef OptimizerState P; // define P as the member initializer
+   ParticleIndexes vesicles_;
+   PointerMember<VesicleActiveSet> active_set_;
+   PointerMember<RadialDistributionFunctionSingletonScore> rdf_;
+   double time_step_; // the time step of the simulator, fs
+   double diffusion_coefficient_; // A^2/fs
+   double kt_; // kcal/mol
+   Ints classes_; // the radius class of each vesicle
+   Floats class_radii_; // the mean radius of the vesicles of each class, A
+   double r_min_; // the innermost vesicle center, on the nucleus
+   double r_field_; // the outer radius of the field
+   double bin_width_;
+   unsigned int n_shells_;
+   Floats counts_; // the number of vesicles in each shell of the field, n_shells per class
+   Floats right_; // the rate coefficient from shell i to shell i + 1 (or out of the field)
+   Floats left_; // the rate coefficient from shell i to shell i - 1
+   Floats outflow_; // the vesicles of each class that left the field and are not emitted yet
+   std::vector<ParticleIndexes> absorbed_; // the particles of the vesicles in the field, per class
+
+   //! compute the Scharfetter-Gummel rate coefficients of the shells
+   void update_rates();
+
+   //! absorb the free vesicles inside the field
+   void absorb_vesicles();
+
+   //! evolve the shell counts of radius class c for a time dt
+   void evolve(unsigned int c, double dt);
+
+   //! emit a vesicle of radius class c from the field as a particle in the buffer shell
+   void emit_vesicle(unsigned int c);
+
+ protected:
+  //! Update the optimizer state.
+  // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
+  virtual void do_update(unsigned int call_num) override; // Cause a compile error if this method does not override a parent method
+
+ public:
+  /**
+     An optimizer state for the hybrid particle/field representation of vesicles.
+
+     @param m the model
+     @param vesicles the insulin vesicles
+     @param active_set the active set of the vesicles, whose active container
+            the restraints are applied to
+     @param rdf the radial score of the vesicles, with the cell and nucleus spheres
+     @param field_distance the vesicles farther than this from the membrane are
+            in the field, A
+     @param time_step the time step of the simulator in fs
+     @param diffusion_coefficient the diffusion coefficient of the vesicles in A^2/fs
+     @param bin_width the approximate width of the shells of the field in A
+     @param temperature the temperature of the simulator in K
+     @param periodicity the frame interval for updating the field
+   */
+  RadialConcentrationField
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      VesicleActiveSet *active_set,
+      RadialDistributionFunctionSingletonScore *rdf,
+      double field_distance,
+      double time_step,
+      double diffusion_coefficient,
+      double bin_width = 250,
+      double temperature = 310.15,
+      unsigned int periodicity = 1 );
+
+  //! returns the outer radius of the field, from the cell center
+  double get_field_radius() const { return r_field_; }
+
+  unsigned int get_number_of_shells() const { return n_shells_; }
+
+  //! returns the number of radius classes, each with its own shell counts
+  unsigned int get_number_of_radius_classes() const { return class_radii_.size(); }
+
+  //! returns the inner radius of shell i
+  double get_shell_radius(unsigned int i) const { return r_min_ + i * bin_width_; }
+
+  //! returns the number of vesicles in each shell of the field, summed over the radius classes
+  Floats get_shell_counts() const;
+
+  //! returns the number of vesicles held by the field, including those flowing out
+  double get_number_of_field_vesicles() const;
+
+  //! returns the number of vesicles whose particles are absorbed
+  unsigned int get_number_of_absorbed_vesicles() const;
+
+  IMP_OBJECT_METHODS(RadialConcentrationField);
+};
+
+IMP_OBJECTS(RadialConcentrationField, RadialConcentrationFields);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_RADIAL_CONCENTRATION_FIELD_H */
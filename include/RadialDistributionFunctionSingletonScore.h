@@ -107,6 +107,25 @@ class IMPINSULINSECRETIONEXPORT RadialDistributionFunctionSingletonScore
   Floats get_poly_param() const
   { return poly_param_;}
 
+  //! returns the score of a vesicle of the given radius whose center is at
+  //! distance r from the center of the cell, 0 outside the scored range
+  double get_radial_score(double r, double radius) const;
+
+  //! returns the derivative of get_radial_score() with respect to r
+  double get_radial_derivative(double r, double radius) const;
+
+#ifndef SWIG
+  //! returns the score of vesicle pi in a cell with the given spheres
+  /** Does not log, so it can be called from several threads for
+      different vesicles (see MultiCellRadialRestraint). */
+  double evaluate_in_cell
+  ( Model *m,
+    ParticleIndex pi,
+    const algebra::Sphere3D &cell_sphere,
+    const algebra::Sphere3D &nucleus_sphere,
+    DerivativeAccumulator *da ) const;
+#endif
+
   virtual double evaluate_index
   ( Model *m, 
     ParticleIndex pi,
@@ -0,0 +1,158 @@
+/**
+ *  \file IMP/insulinsecretion/SecretionEventLog.h
+ *  \brief A log of timestamped secretion events in a preallocated ring buffer.
+ *
+ * Description:
+ * 1, The secretion optimizer states append one event per secretion, with the simulation
+ *    time, the vesicle, the channel it was docked to, the docking time and the position
+ *    of the vesicle when it was secreted.
+ * 2, Events are stored in a ring buffer allocated once; when an output file is set, full
+ *    buffers are flushed to it, otherwise the oldest events are overwritten.
+ * 3, A running count of all secretions is kept, so the secretion time series is read in
+ *    O(1) instead of summing the SecretionCounterDecorator of every vesicle.
+ * 4, With an AsyncOutputWriter instead of an output file, a full buffer is copied into a
+ *    frame of the writer and written to disk on its thread.
+ * 5, A failed write to the output file, e.g., on a full disk, raises an IOException from the
+ *    call that wrote the buffer or from flush(); destruction flushes and closes the file and
+ *    only warns, as AsyncOutputWriter does.
+ *
+ * File layout: "IMPISSEC", then one record per event of
+ *   time (double, fs), dock time (double, fs, -1 if unknown), vesicle (int32, particle index),
+ *   channel (int32, channel particle index or site id, -1 if unknown), x, y, z (float, A).
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_SECRETION_EVENT_LOG_H
+#define IMPINSULINSECRETION_SECRETION_EVENT_LOG_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/AsyncOutputWriter.h>
+#include <IMP/Object.h>
+#include <IMP/algebra/Vector3D.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+#ifndef SWIG
+//! A secretion event stored in the log
+struct SecretionEvent {
+  double time; // the simulation time of the secretion, fs
+  double dock_time; // the simulation time of the docking, fs, -1 if unknown
+  int vesicle; // the particle index of the vesicle
+  int channel; // the particle index of the channel or the site id, -1 if unknown
+  float position[3]; // the position of the vesicle before it was reset, A
+};
+#endif
+
+/**
+   A log of timestamped secretion events in a preallocated ring buffer,
+   filled by InsulinSecretionOptimizerState or
+   InsulinCellLifecycleOptimizerState (see set_event_log()).
+ */
+class IMPINSULINSECRETIONEXPORT SecretionEventLog : public Object
+{
+  double time_step_; // the time of one simulation step, fs
+  std::vector<SecretionEvent> ring_;
+  unsigned int first_; // the slot of the oldest buffered event
+  unsigned int size_; // the number of buffered events
+  unsigned int n_secretions_; // all secretions since construction or clear()
+  unsigned int n_dropped_; // events overwritten before they were written to a file
+  std::vector<double> dock_times_; // per vesicle particle index, -1 if not docked
+  Ints dock_channels_; // per vesicle particle index
+  std::ofstream out_;
+  std::string file_name_; // the name of out_, for the errors
+  PointerMember<AsyncOutputWriter> writer_;
+
+  bool get_has_output() const { return out_.is_open() || writer_; }
+
+  const SecretionEvent &get_event(unsigned int i) const {
+    return ring_[(first_ + i) % ring_.size()];
+  }
+
+  template <class Out>
+  void write_events(Out &out) const;
+
+  void write_buffered_events();
+
+  //! raise an IOException if a write to the output file failed
+  void check_output() const;
+
+ protected:
+  //! Write the buffered events to the output, if any, so they are not lost
+  virtual void do_destroy() override;
+
+ public:
+  /**
+     A log of timestamped secretion events.
+
+     @param capacity the number of events held in memory
+     @param time_step the time of one simulation step in fs, i.e., the
+            time step of the simulator
+   */
+  SecretionEventLog(unsigned int capacity = 4096, double time_step = 1.0);
+
+  //! Write the events to a binary file as the buffer fills up
+  void set_output_file(std::string file_name);
+
+  //! Write the events through a writer thread as the buffer fills up, instead of a file
+  void set_output_writer(AsyncOutputWriter *writer);
+
+  //! Write the buffered events to the output file, if any, and empty the buffer
+  /** Raises an IOException if the events could not be written. */
+  void flush();
+
+#ifndef SWIG
+  //! Record that vesicle pi docked to a channel at the given simulation step
+  void add_docking(ParticleIndex pi, int channel, unsigned long step);
+
+  //! Record the secretion of vesicle pi at the given position and simulation step
+  void add_secretion(ParticleIndex pi, const algebra::Vector3D &position,
+                     unsigned long step);
+#endif
+
+  //! returns the number of secretions since construction or clear(), in O(1)
+  unsigned int get_number_of_secretions() const { return n_secretions_; }
+
+  //! returns the number of events in the buffer, oldest first
+  unsigned int get_number_of_buffered_events() const { return size_; }
+
+  //! returns the number of events overwritten without an output file
+  unsigned int get_number_of_dropped_events() const { return n_dropped_; }
+
+  unsigned int get_capacity() const { return ring_.size(); }
+
+  double get_time_step() const { return time_step_; }
+
+  //! returns the time of buffered event i in fs
+  double get_event_time(unsigned int i) const { return get_event(i).time; }
+
+  //! returns the docking time of buffered event i in fs, -1 if unknown
+  double get_event_dock_time(unsigned int i) const { return get_event(i).dock_time; }
+
+  //! returns the particle index of the vesicle of buffered event i
+  int get_event_vesicle(unsigned int i) const { return get_event(i).vesicle; }
+
+  //! returns the channel particle index or site id of buffered event i, -1 if unknown
+  int get_event_channel(unsigned int i) const { return get_event(i).channel; }
+
+  //! returns the position of the vesicle of buffered event i
+  algebra::Vector3D get_event_position(unsigned int i) const {
+    const SecretionEvent &e = get_event(i);
+    return algebra::Vector3D(e.position[0], e.position[1], e.position[2]);
+  }
+
+  //! Drop the buffered events and the docking records and restart the count at zero
+  void clear();
+
+  IMP_OBJECT_METHODS(SecretionEventLog);
+};
+
+IMP_OBJECTS(SecretionEventLog, SecretionEventLogs);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_SECRETION_EVENT_LOG_H */
@@ -0,0 +1,112 @@
+/**
+ *  \file IMP/insulinsecretion/SharedNeighborProvider.h
+ *  \brief One close pair list of the vesicles, channels and nucleus, shared by the excluded volume and docking.
+ *
+ * Description:
+ * 1, The candidate pairs are all pairs of particles whose sphere distance was below
+ *    distance + 2 * slack when the list was built, found with uniform grids whose cell
+ *    size fits the typical (vesicle) radius. Polydisperse vesicles are binned in geometric
+ *    radius classes (ratio 1.5) with one grid each, so small vesicles are not searched in
+ *    cells sized for the largest ones. The few very large particles given to
+ *    set_large_particles() (the nucleus) are paired with all others directly instead of
+ *    being gridded.
+ * 2, The list is rebuilt only when a particle moved more than slack since the last build,
+ *    or the particles changed, so it stays valid for all pairs closer than distance.
+ * 3, As a score state it is checked once before each evaluation; the excluded volume
+ *    (NeighborExcludedVolumeRestraint) scores the candidates directly, and the docking pass
+ *    (set_neighbor_provider() of the docking optimizer states) filters the (channel, vesicle)
+ *    candidates instead of searching a second grid.
+ *
+ * Note: distance must cover the largest range of the consumers, e.g., the docking contact
+ *       range plus its slack; the excluded volume only needs 0.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_SHARED_NEIGHBOR_PROVIDER_H
+#define IMPINSULINSECRETION_SHARED_NEIGHBOR_PROVIDER_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/ScoreState.h>
+#include <IMP/SingletonContainer.h>
+#include <IMP/algebra/Vector3D.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   A score state that keeps the close pairs of a set of spheres for
+   several consumers, with one displacement check and at most one
+   rebuild per evaluation.
+ */
+class IMPINSULINSECRETIONEXPORT SharedNeighborProvider : public ScoreState
+{
+ private:
+  PointerMember<SingletonContainer> particles_;
+  double distance_; // the largest sphere distance of the consumers, A
+  double slack_; // A
+  ParticleIndexes indexes_; // the particles at the last build
+  algebra::Vector3Ds positions_; // their positions at the last build
+  ParticleIndexPairs pairs_;
+  Ints is_large_; // 1 for the particles paired with all others directly, by particle index
+  unsigned int n_rebuilds_;
+  unsigned int n_radius_classes_; // the grids of the last build
+
+  //! whether a particle moved more than slack or the particles changed
+  bool get_needs_rebuild(const ParticleIndexes &indexes) const;
+
+  //! find the candidate pairs of the current positions
+  void rebuild(const ParticleIndexes &indexes);
+
+ public:
+  /**
+     A shared close pair list.
+
+     @param particles the spheres of all consumers, e.g., the leaves of the cell
+     @param distance the largest sphere distance any consumer queries, A
+     @param slack the displacement allowed before a rebuild, A (affects speed only)
+     @param name the name of the score state
+   */
+  SharedNeighborProvider
+    ( SingletonContainerAdaptor particles,
+      double distance,
+      double slack = 10,
+      std::string name = "SharedNeighborProvider%1%" );
+
+  //! Pair these particles with all others directly instead of gridding them
+  /** For a few particles much larger than the rest, e.g., the nucleus, whose
+      grid cells would hold all other particles. None by default. */
+  void set_large_particles(ParticleIndexesAdaptor large);
+
+  //! Check the displacements and rebuild the list if needed
+  void update();
+
+  //! returns the candidate pairs, a superset of the pairs closer than get_distance()
+  const ParticleIndexPairs &get_candidate_pairs() const { return pairs_; }
+
+  double get_distance() const { return distance_; }
+
+  double get_slack() const { return slack_; }
+
+  //! returns the number of times the list was built
+  unsigned int get_number_of_rebuilds() const { return n_rebuilds_; }
+
+  //! returns the number of radius classes gridded separately at the last build
+  unsigned int get_number_of_radius_classes() const { return n_radius_classes_; }
+
+  virtual void do_before_evaluate() override;
+
+  virtual void do_after_evaluate(DerivativeAccumulator *) override {}
+
+  virtual ModelObjectsTemp do_get_inputs() const override;
+
+  virtual ModelObjectsTemp do_get_outputs() const override;
+
+  IMP_OBJECT_METHODS(SharedNeighborProvider);
+};
+
+IMP_OBJECTS(SharedNeighborProvider, SharedNeighborProviders);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_SHARED_NEIGHBOR_PROVIDER_H */
@@ -0,0 +1,109 @@
+/**
+ *  \file IMP/insulinsecretion/SpatialReorderingOptimizerState.h
+ *  \brief An optimizer state that periodically sorts the vesicle containers along a Morton curve.
+ *
+ * Description:
+ * 1, After many secretion cycles the vesicles are reset to random points near the nucleus,
+ *    so the order of the containers has nothing to do with where the vesicles are.
+ * 2, The centers of the vesicles are quantized to 21 bits per axis in a bounding box and their
+ *    bits are interleaved into a Morton code; the vesicles are sorted by the code, so vesicles
+ *    next to each other in the order are mostly next to each other in space.
+ * 3, The order is applied to a VesicleActiveSet and to list containers, so the close pair
+ *    searches, the restraints and the docking queries visit neighbours one after the other.
+ * 4, The dense per-vesicle arrays of the module are permuted to the order: the vesicles of
+ *    the secretion pass and the correlator history of MultiTauDiffusionOptimizerState, which
+ *    maps the particle indexes to their new slots. The particle indexes stay the ids of the
+ *    vesicles in all output; the coordinates and the decorator attributes stay in the tables
+ *    of the Model, which are indexed by particle index and cannot be renumbered.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_SPATIAL_REORDERING_OPTIMIZER_STATE_H
+#define IMPINSULINSECRETION_SPATIAL_REORDERING_OPTIMIZER_STATE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/insulinsecretion/InsulinSecretionOptimizerState.h>
+#include <IMP/insulinsecretion/InsulinCellLifecycleOptimizerState.h>
+#include <IMP/insulinsecretion/MultiTauDiffusionOptimizerState.h>
+#include <IMP/OptimizerState.h>
+#include <IMP/algebra/BoundingBoxD.h>
+#include <IMP/container/ListSingletonContainer.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+/**
+   An optimizer state that sorts the iteration order of vesicle containers
+   along a Morton (Z-order) space-filling curve.
+ */
+class IMPINSULINSECRETIONEXPORT SpatialReorderingOptimizerState
+: public OptimizerState
+{
+ private:
+   typedef OptimizerState P; // define P as the member initializer
+   ParticleIndexes vesicles_;
+   algebra::BoundingBox3D bb_;
+   ParticleIndexes order_; // the vesicles in Morton order
+   PointerMember<VesicleActiveSet> active_set_;
+   container::ListSingletonContainers containers_;
+   InsulinSecretionOptimizerStates secretion_states_;
+   InsulinCellLifecycleOptimizerStates lifecycle_states_;
+   MultiTauDiffusionOptimizerStates diffusion_states_;
+
+ protected:
+  //! Update the optimizer state.
+  // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
+  virtual void do_update(unsigned int call_num) override; // Cause a compile error if this method does not override a parent method
+
+ public:
+  /**
+     An optimizer state that sorts vesicles along a Morton curve.
+
+     @param m the model
+     @param vesicles the insulin vesicles
+     @param bb a box that contains the cell; centers outside are clamped to it
+     @param periodicity the frame interval for sorting, e.g., the period of
+            the secretion optimizer state
+   */
+  SpatialReorderingOptimizerState
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      algebra::BoundingBox3D bb,
+      unsigned int periodicity = 100 );
+
+  //! Sort the active and frozen containers of the active set
+  void set_active_set(VesicleActiveSet *active_set) { active_set_ = active_set; }
+
+  //! Sort a list container; particles not among the vesicles are put last
+  void add_container(container::ListSingletonContainer *c) {
+    containers_.push_back(c);
+  }
+
+  //! Store the vesicles of the secretion pass in the order
+  void add_secretion_state(InsulinSecretionOptimizerState *s) {
+    secretion_states_.push_back(s);
+  }
+
+  //! Store the vesicles of the secretion pass in the order
+  void add_lifecycle_state(InsulinCellLifecycleOptimizerState *s) {
+    lifecycle_states_.push_back(s);
+  }
+
+  //! Permute the correlator history of the vesicles to the order
+  void add_diffusion_state(MultiTauDiffusionOptimizerState *s) {
+    diffusion_states_.push_back(s);
+  }
+
+  //! returns the vesicles in the order of the last update
+  const ParticleIndexes &get_order() const { return order_; }
+
+  IMP_OBJECT_METHODS(SpatialReorderingOptimizerState);
+};
+
+IMP_OBJECTS(SpatialReorderingOptimizerState, SpatialReorderingOptimizerStates);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_SPATIAL_REORDERING_OPTIMIZER_STATE_H */
@@ -0,0 +1,158 @@
+/**
+ *  \file IMP/insulinsecretion/SteadyStateOptimizerState.h
+ *  \brief An optimizer state that detects when the secretion statistics of a run have converged.
+ *
+ * Description:
+ * 1, Every period it samples the secretion rate (secretions since the last sample per second),
+ *    the docked fraction and the occupancy of n_shells equal radial shells between the nucleus
+ *    and the membrane (the fraction of vesicles whose center is in each shell).
+ * 2, After burn_in samples, the samples are averaged in batches. When 2 * min_batches batches
+ *    are full, adjacent batches are merged and the batch size doubles, so the batches grow with
+ *    the run and become longer than the correlation time of the observables.
+ * 3, The confidence half-width of each observable is z * sd(batch means) / sqrt(batches).
+ *    Convergence is tested right after each merge, once the batches hold at least
+ *    min_batch_size samples, so the first test is not made on a few autocorrelated samples.
+ *    The run is converged when every observable with a precision target has a positive
+ *    half-width at or below it (zero variance means too few distinct samples, not
+ *    precision); it stays converged afterwards.
+ * 4, The simulator is not stopped from inside an update: the run loop checks
+ *    get_is_converged() between optimize() calls and ends the run, and write_record() saves
+ *    the estimates with the other output files.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_STEADY_STATE_OPTIMIZER_STATE_H
+#define IMPINSULINSECRETION_STEADY_STATE_OPTIMIZER_STATE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/OptimizerState.h>
+#include <IMP/algebra/Sphere3D.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! The observables of a SteadyStateOptimizerState
+enum SteadyStateObservable {
+  //! the secretions per second
+  SECRETION_RATE_OBSERVABLE = 0,
+  //! the fraction of vesicles with a non-zero docking state
+  DOCKED_FRACTION_OBSERVABLE = 1,
+  //! the fraction of vesicles in the innermost shell, the other shells follow
+  SHELL_OCCUPANCY_OBSERVABLE = 2
+};
+
+/**
+   An optimizer state that estimates the steady-state secretion rate,
+   docked fraction and radial shell occupancy with batch-means
+   confidence intervals, and tells when they reach set precisions.
+ */
+class IMPINSULINSECRETIONEXPORT SteadyStateOptimizerState
+: public OptimizerState
+{
+ private:
+   typedef OptimizerState P; // define P as the member initializer
+   ParticleIndexes vesicles_;
+   algebra::Sphere3D cell_sphere_;
+   algebra::Sphere3D nucleus_sphere_;
+   unsigned int n_shells_;
+   double time_step_; // the time step of the simulator, fs
+   unsigned int periodicity_;
+   unsigned int burn_in_; // the samples discarded at the start
+   unsigned int min_batches_;
+   unsigned int min_batch_size_; // the samples per batch needed before convergence is tested
+   double z_;
+   Floats targets_; // the half-width target of each observable, 0 if none
+   unsigned int n_updates_;
+   int last_secretions_; // the total secretion count at the last update, -1 if none
+   Floats batch_sums_; // the sums of the current batch, one per observable
+   unsigned int n_in_batch_;
+   unsigned int batch_size_;
+   Floats batch_means_; // the means of the full batches, one row of observables per batch
+   unsigned int n_converged_; // the update at which the run converged, 0 if not yet
+
+   //! returns the number of observables
+   unsigned int get_number_of_observables() const { return 2 + n_shells_; }
+
+   //! add the observables of one update to the current batch, true if batches were merged
+   bool add_sample(const Floats &sample);
+
+   //! whether all targeted observables reached their precision
+   bool get_targets_are_met() const;
+
+ protected:
+  //! Update the optimizer state.
+  // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
+  virtual void do_update(unsigned int call_num) override; // Cause a compile error if this method does not override a parent method
+
+ public:
+  /**
+     An optimizer state that detects the steady state of a run.
+
+     @param m the model
+     @param vesicles the insulin vesicles
+     @param cell_sphere the sphere of the cell membrane
+     @param nucleus_sphere the sphere of the nucleus, with the same center
+     @param time_step the time step of the simulator in fs, for the secretion rate
+     @param n_shells the number of radial shells between the nucleus and the membrane
+     @param burn_in the number of updates discarded before the batches start
+     @param min_batches the batches needed before the run can converge
+     @param periodicity the frame interval for sampling the observables
+   */
+  SteadyStateOptimizerState
+    ( Model *m,
+      ParticleIndexesAdaptor vesicles,
+      algebra::Sphere3D cell_sphere,
+      algebra::Sphere3D nucleus_sphere,
+      double time_step,
+      unsigned int n_shells = 5,
+      unsigned int burn_in = 0,
+      unsigned int min_batches = 10,
+      unsigned int periodicity = 1 );
+
+  //! Set the target half-width of the confidence interval of an observable
+  /** The units are those of the observable, i.e., 1/s for the secretion
+      rate and a fraction for the others; the target of the shell occupancy
+      applies to every shell. 0 removes the target. */
+  void set_precision(SteadyStateObservable observable, double half_width);
+
+  //! Set the number of standard errors of the half-widths, 1.96 by default
+  void set_z(double z);
+
+  //! Set the samples per batch needed before convergence is tested, 8 by default
+  /** With min_batches batches, the first test is made after
+      min_batches * min_batch_size samples past the burn-in. */
+  void set_min_batch_size(unsigned int min_batch_size);
+
+  //! returns the estimates: secretion rate, docked fraction, then the shell occupancies
+  Floats get_means() const;
+
+  //! returns the confidence half-widths of the estimates, 0 before two batches
+  Floats get_half_widths() const;
+
+  //! returns the number of full batches
+  unsigned int get_number_of_batches() const;
+
+  //! returns the number of updates per batch
+  unsigned int get_batch_size() const { return batch_size_; }
+
+  //! whether the targeted observables reached their precision
+  bool get_is_converged() const { return n_converged_ > 0; }
+
+  //! returns the simulated time at which the run converged in s, 0 if not converged
+  double get_converged_time() const;
+
+  //! Write the estimates and the convergence state to a text file
+  void write_record(std::string file_name) const;
+
+  //! drop all samples, e.g., after restoring a snapshot
+  void clear();
+
+  IMP_OBJECT_METHODS(SteadyStateOptimizerState);
+};
+
+IMP_OBJECTS(SteadyStateOptimizerState, SteadyStateOptimizerStates);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_STEADY_STATE_OPTIMIZER_STATE_H */
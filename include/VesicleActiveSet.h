@@ -0,0 +1,117 @@
+/**
+ *  \file IMP/insulinsecretion/VesicleActiveSet.h
+ *  \brief Keeps the diffusing (active) and the frozen particles of a cell in two containers.
+ *
+ * Description:
+ * 1, A docked vesicle does not move (its coordinates are not optimized) until it is
+ *    secreted, and the nucleus and Ca2+ channels never move.
+ * 2, The set keeps the active particles and the frozen ones in two ListSingletonContainers,
+ *    so singleton restraints can be applied to the active container only, and the
+ *    excluded volume can skip frozen-frozen pairs (see ActiveSetExcludedVolumeRestraint).
+ * 3, The docking and secretion passes freeze and release the vesicles incrementally
+ *    (set_is_frozen()), and the containers are refreshed once per pass in update().
+ * 4, Vesicles absorbed into a RadialConcentrationField are in neither container
+ *    (set_is_absorbed()) until they are emitted back as particles.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_VESICLE_ACTIVE_SET_H
+#define IMPINSULINSECRETION_VESICLE_ACTIVE_SET_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/Object.h>
+#include <IMP/Model.h>
+#include <IMP/container/ListSingletonContainer.h>
+#include <limits>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! The active and frozen particles of a cell, updated incrementally.
+class IMPINSULINSECRETIONEXPORT VesicleActiveSet : public Object
+{
+ private:
+  WeakPointer<Model> m_;
+  ParticleIndexes active_;
+  ParticleIndexes frozen_;
+  Ints slots_; // position in active_ (>= 0) or frozen_ (-2 - position), by particle index
+  unsigned int n_absorbed_;
+  PointerMember<container::ListSingletonContainer> active_container_;
+  PointerMember<container::ListSingletonContainer> frozen_container_;
+  bool changed_; // the lists changed since the containers were refreshed
+
+  //! the slot of an absorbed particle
+  static int get_absorbed_slot() { return std::numeric_limits<int>::min(); }
+
+  //! remove the particle at position i of list, keeping the slots of the moved particle
+  void remove_at(ParticleIndexes &list, int i, bool active);
+
+  //! remove the particle from the list it is in
+  void remove(ParticleIndex pi);
+
+  //! append the particle to a list and record its slot
+  void append(ParticleIndexes &list, ParticleIndex pi, bool active);
+
+ public:
+  /**
+     The active and frozen particles of a cell.
+
+     @param m the model
+     @param vesicles the insulin vesicles; those whose coordinates are not
+            optimized start frozen, the others active
+     @param static_particles particles that never move, e.g., the nucleus and
+            the Ca2+ channels; they are frozen for good
+   */
+  VesicleActiveSet(Model *m,
+                   ParticleIndexesAdaptor vesicles,
+                   ParticleIndexesAdaptor static_particles = ParticleIndexesAdaptor());
+
+  //! Move a particle to the frozen or to the active container
+  /** The containers change at the next update(). */
+  void set_is_frozen(ParticleIndex pi, bool frozen);
+
+  //! returns true if the particle is frozen
+  bool get_is_frozen(ParticleIndex pi) const {
+    return slots_[pi.get_index()] < -1 && !get_is_absorbed(pi);
+  }
+
+  //! Remove a vesicle from both containers, or return it to the active one
+  /** An absorbed vesicle is represented by a field, not by its particle.
+      The containers change at the next update(). */
+  void set_is_absorbed(ParticleIndex pi, bool absorbed);
+
+  //! returns true if the vesicle is absorbed
+  bool get_is_absorbed(ParticleIndex pi) const {
+    return slots_[pi.get_index()] == get_absorbed_slot();
+  }
+
+  //! Sort both containers in the given order, the particles not in it last
+  /** The lists and the slots of their particles are permuted, e.g., to a
+      space-filling curve (see SpatialReorderingOptimizerState). The
+      containers change at the next update(). */
+  void set_order(ParticleIndexesAdaptor order);
+
+  //! Refresh the containers if the set changed since the last call
+  void update();
+
+  //! returns the container of the active particles
+  SingletonContainer *get_active_container() const { return active_container_; }
+
+  //! returns the container of the frozen particles
+  SingletonContainer *get_frozen_container() const { return frozen_container_; }
+
+  unsigned int get_number_of_active_particles() const { return active_.size(); }
+
+  unsigned int get_number_of_frozen_particles() const { return frozen_.size(); }
+
+  unsigned int get_number_of_absorbed_particles() const { return n_absorbed_; }
+
+  IMP_OBJECT_METHODS(VesicleActiveSet);
+};
+
+IMP_OBJECTS(VesicleActiveSet, VesicleActiveSets);
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_VESICLE_ACTIVE_SET_H */
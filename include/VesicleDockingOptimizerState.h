@@ -10,6 +10,12 @@
  * 3. Once docked, the calcium channels and insulin vesicles form a rigid body, and the docking state decorator is set to 1.
  * 4. The docking state increments by 1 for docked vesicles.
  * 5. Update the optimizer state.
+ * 6. Alternatively, docking candidates are looked up in a static ChannelSurfaceIndex
+ *    of the channel sites instead of a CloseBipartitePairContainer.
+ * 7. Optionally, the release of a docked vesicle is enqueued on a LifecycleEventScheduler
+ *    at docking time instead of being detected from its docking state every period.
+ * 8. Alternatively, docking candidates are filtered from the close pairs of a
+ *    SharedNeighborProvider that the excluded volume restraint also uses.
  *
  *
  *  Copyright 2007-2019 IMP Inventors. All rights reserved.
@@ -21,6 +27,11 @@
 #include <IMP/insulinsecretion/insulinsecretion_config.h> 
 #include <IMP/insulinsecretion/DockingStateDecorator.h>
 #include <IMP/insulinsecretion/CaChannelStateDecorator.h>
+#include <IMP/insulinsecretion/ChannelSurfaceIndex.h>
+#include <IMP/insulinsecretion/LifecycleEventScheduler.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/insulinsecretion/SecretionEventLog.h>
+#include <IMP/insulinsecretion/internal/lifecycle_stages.h>
 #include <IMP/algebra/Transformation3D.h>
 #include <IMP/algebra/ReferenceFrame3D.h>
 #include <IMP/atom/Hierarchy.h>
@@ -43,14 +54,9 @@ class IMPINSULINSECRETIONEXPORT VesicleDockingOptimizerState
 {
  private:
    typedef OptimizerState P; // define P as the member initializer
-   IMP::PointerMember<IMP::container::CloseBipartitePairContainer>
-     close_bipartite_pair_container_; // maintains a list of nearby particle pairs in a bipartite graph
-   int ready_state_;
+   internal::VesicleDockingStage docking_; // the shared docking pass
    unsigned int periodicity_; // the framee interval
 
-  //! rigidify the calcium channel and insulin vesicle upon docking
-  void rigidify_pair(ParticleIndexPair pip);
-
  protected:
   //! Update the optimizer state.
   // The number of times this method has been called since the last reset or start of the optimization run is passed with call_num.
@@ -82,6 +88,53 @@ class IMPINSULINSECRETIONEXPORT VesicleDockingOptimizerState
       int ready_state,
       unsigned int periodicity=1 );
 
+  /**
+      An optimizer state that docks the insulin vesicle when
+      it is in the vicinty of Ca2+ channels in the open state, where the
+      channels are static and looked up in a ChannelSurfaceIndex.
+
+     @param vesicles_container container of diffusing vesicles (which may change dynamically after construction)
+     @param channel_index static angular index of the calcium channels on cell membrane; its max_reach
+                          must cover contact_range plus the vesicle and channel radii
+     @param contact_range the range of sphere distance in angstroms under which vesicles and cachannel will be tested for rigidification
+     @param ready_state an integer defining the ready state of the docking state decorator
+     @param periodicity the frame interval for updating this optimizer state
+   */
+  VesicleDockingOptimizerState
+    ( IMP::SingletonContainerAdaptor vesicles_container,
+      ChannelSurfaceIndex *channel_index,
+      double contact_range,
+      int ready_state,
+      unsigned int periodicity=1 );
+
+  //! Enqueue the release of each docked vesicle on a scheduler.
+  /** The scheduler must share the periodicity of this optimizer state and be
+      updated before it. A vesicle docked at tick t is released at
+      t + ready_state and handed to the SECRETION_EVENT consumer in the same
+      update; docked vesicles keep the docking state -1 until then. */
+  void set_scheduler(LifecycleEventScheduler *scheduler) {
+    docking_.set_scheduler(scheduler);
+  }
+
+  //! Filter the docking pairs from a shared close pair list.
+  /** Replaces the search of the CloseBipartitePairContainer; the list must
+      hold the vesicles and the channels (or their cores) and reach
+      contact_range + slack. Raises a UsageException if the channels are
+      a site array or a channel index. */
+  void set_neighbor_provider(SharedNeighborProvider *neighbors) {
+    docking_.set_neighbor_provider(neighbors);
+  }
+
+  //! Move the vesicles to the frozen part of an active set when they dock.
+  void set_active_set(VesicleActiveSet *active_set) {
+    docking_.set_active_set(active_set);
+  }
+
+  //! Record the docking time and channel of each vesicle in an event log
+  void set_event_log(SecretionEventLog *event_log) {
+    docking_.set_event_log(event_log);
+  }
+
   IMP_OBJECT_METHODS(VesicleDockingOptimizerState);
 };
 
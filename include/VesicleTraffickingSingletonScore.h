@@ -58,6 +58,17 @@ class IMPINSULINSECRETIONEXPORT VesicleTraffickingSingletonScore
   //!in kcal/mol/A (negative=pull)
   double get_k() const 
   { return k_; }
+
+#ifndef SWIG
+  //! returns the score of vesicle pi around the given center
+  /** Does not log, so it can be called from several threads for
+      different vesicles (see MultiCellRadialRestraint). */
+  double evaluate_at_center
+  ( Model *m,
+    ParticleIndex pi,
+    const algebra::Vector3D &center,
+    DerivativeAccumulator *da ) const;
+#endif
   
   virtual double evaluate_index
   ( Model *m, 
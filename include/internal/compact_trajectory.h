@@ -0,0 +1,106 @@
+/**
+ *  \file IMP/insulinsecretion/internal/compact_trajectory.h
+ *  \brief Encoding helpers shared by the compact trajectory writer and reader.
+ *
+ * Description:
+ * 1, Integers are written as little-endian base-128 varints, signed ones after a
+ *    zigzag mapping, so small coordinate deltas and state values take one or two bytes.
+ * 2, Doubles and strings of the static header are written as raw bytes and
+ *    length-prefixed bytes.
+ * 3, Frames are decoded from a memory-mapped file (see MappedFile) through a ByteCursor.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_INTERNAL_COMPACT_TRAJECTORY_H
+#define IMPINSULINSECRETION_INTERNAL_COMPACT_TRAJECTORY_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+
+IMPINSULINSECRETION_BEGIN_INTERNAL_NAMESPACE
+
+//! the first bytes of a compact trajectory file
+const char COMPACT_TRAJECTORY_MAGIC[8] = {'I', 'M', 'P', 'I', 'S', 'T', 'R', 'J'};
+const unsigned int COMPACT_TRAJECTORY_VERSION = 1;
+//! the tag that starts every frame record
+const char COMPACT_TRAJECTORY_FRAME_TAG = 'F';
+
+inline std::uint64_t get_zigzag(std::int64_t v) {
+  return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+}
+
+inline std::int64_t get_unzigzag(std::uint64_t u) {
+  return static_cast<std::int64_t>(u >> 1) ^ -static_cast<std::int64_t>(u & 1);
+}
+
+//! append an unsigned varint to a byte buffer
+inline void write_varint(std::string &out, std::uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+inline void write_signed_varint(std::string &out, std::int64_t v) {
+  write_varint(out, get_zigzag(v));
+}
+
+//! a read position in an encoded byte buffer
+struct ByteCursor {
+  const char *pos;
+  const char *end;
+};
+
+//! read an unsigned varint, returns false at the end of the buffer
+inline bool read_varint(ByteCursor &in, std::uint64_t &v) {
+  v = 0;
+  for (unsigned int shift = 0; shift < 64 && in.pos < in.end; shift += 7) {
+    unsigned char c = *in.pos++;
+    v |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+inline bool read_signed_varint(ByteCursor &in, std::int64_t &v) {
+  std::uint64_t u;
+  if (!read_varint(in, u)) return false;
+  v = get_unzigzag(u);
+  return true;
+}
+
+inline void write_double(std::string &out, double d) {
+  char bytes[sizeof(double)];
+  std::memcpy(bytes, &d, sizeof(double));
+  out.append(bytes, sizeof(double));
+}
+
+inline bool read_double(ByteCursor &in, double &d) {
+  if (in.end - in.pos < static_cast<std::ptrdiff_t>(sizeof(double))) return false;
+  std::memcpy(&d, in.pos, sizeof(double));
+  in.pos += sizeof(double);
+  return true;
+}
+
+inline void write_string(std::string &out, const std::string &s) {
+  write_varint(out, s.size());
+  out.append(s);
+}
+
+inline bool read_string(ByteCursor &in, std::string &s) {
+  std::uint64_t n;
+  if (!read_varint(in, n) || static_cast<std::uint64_t>(in.end - in.pos) < n) return false;
+  s.assign(in.pos, n);
+  in.pos += n;
+  return true;
+}
+
+IMPINSULINSECRETION_END_INTERNAL_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_INTERNAL_COMPACT_TRAJECTORY_H */
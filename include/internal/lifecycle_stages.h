@@ -0,0 +1,235 @@
+/**
+ *  \file IMP/insulinsecretion/internal/lifecycle_stages.h
+ *  \brief The Ca2+ channel, docking and secretion passes shared by the lifecycle optimizer states.
+ *
+ * Description:
+ * 1, ChannelOscillationStage updates the open/closed state of the Ca2+ channels.
+ * 2, VesicleDockingStage docks vesicles to open channels and releases them when ready.
+ * 3, VesicleSecretionStage advances the maturation and docking states and secretes
+ *    and resets the ready vesicles. The maturation states advance with the LifecycleClock
+ *    of the model, so only the vesicles whose states change are written.
+ * 4, Each stage works on particle indexes and attribute keys of one model, so several
+ *    stages can run back to back in one optimizer state update.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_INTERNAL_LIFECYCLE_STAGES_H
+#define IMPINSULINSECRETION_INTERNAL_LIFECYCLE_STAGES_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/insulinsecretion/ChannelMarkovGating.h>
+#include <IMP/insulinsecretion/ChannelSiteArray.h>
+#include <IMP/insulinsecretion/ChannelSurfaceIndex.h>
+#include <IMP/insulinsecretion/CaChannelStateDecorator.h>
+#include <IMP/insulinsecretion/CellGeometryTable.h>
+#include <IMP/insulinsecretion/LifecycleEventScheduler.h>
+#include <IMP/insulinsecretion/SecretionEventLog.h>
+#include <IMP/insulinsecretion/SharedNeighborProvider.h>
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/Model.h>
+#include <IMP/SingletonContainer.h>
+#include <IMP/algebra/Sphere3D.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/container/CloseBipartitePairContainer.h>
+
+IMPINSULINSECRETION_BEGIN_INTERNAL_NAMESPACE
+
+//! Update the open/closed state of Ca2+ channels (see CaChannelOpeningOptimizerState)
+class IMPINSULINSECRETIONEXPORT ChannelOscillationStage {
+  ParticleIndexes cachannel_;
+  PointerMember<ChannelSiteArray> sites_; // used instead of cachannel_ if set
+  int oscillation_;
+  int troughn_; // the number of Ca2+ channels in the opening state at the trough
+  int peakn_; // the number of Ca2+ channels in the opening state at the peak
+  PointerMember<LifecycleEventScheduler> scheduler_;
+  bool flip_scheduled_;
+  PointerMember<ChannelMarkovGating> gating_;
+
+  unsigned int get_number_of_channels() const {
+    return sites_ ? sites_->get_number_of_sites() : cachannel_.size();
+  }
+
+  int get_state(Model *m, unsigned int i) const {
+    return sites_ ? sites_->get_state(i)
+      : m->get_attribute(CaChannelStateDecorator::get_channelstate_key(), cachannel_[i]);
+  }
+
+  void set_state(Model *m, unsigned int i, int state) {
+    if (sites_) {
+      sites_->set_state(i, state);
+    } else {
+      m->set_attribute(CaChannelStateDecorator::get_channelstate_key(), cachannel_[i], state);
+    }
+  }
+
+  //! advance the timer of every closed channel and flip when one is due
+  void update_timers(Model *m);
+
+  //! flip when the scheduled phase flip is due
+  void update_scheduled(Model *m);
+
+  //! open a new random block of channels when the phase flips
+  void flip_phase(Model *m, int count);
+
+  //! advance the Markov gating and write the channels that opened or closed
+  void update_gating(Model *m);
+
+ public:
+  ChannelOscillationStage(ParticleIndexesAdaptor cachannel,
+                          int oscillation, int troughn, int peakn);
+
+  void set_cachannel(const ParticleIndexes &cachannel) { cachannel_ = cachannel; }
+
+  const ParticleIndexes &get_cachannel() const { return cachannel_; }
+
+  //! update the states of a site array instead of channel particles
+  void set_sites(ChannelSiteArray *sites) { sites_ = sites; }
+
+  void set_scheduler(LifecycleEventScheduler *scheduler) {
+    scheduler_ = scheduler;
+    flip_scheduled_ = false;
+  }
+
+  //! gate each channel by a Markov model instead of the global phase flips
+  void set_gating(ChannelMarkovGating *gating);
+
+  void update(Model *m);
+};
+
+//! Dock vesicles to open Ca2+ channels (see VesicleDockingOptimizerState)
+class IMPINSULINSECRETIONEXPORT VesicleDockingStage {
+  PointerMember<container::CloseBipartitePairContainer>
+    close_bipartite_pair_container_; // pairs (channel, vesicle), unless a channel index is used
+  PointerMember<SingletonContainer> vesicles_container_;
+  PointerMember<SingletonContainer> cachannel_container_;
+  PointerMember<ChannelSurfaceIndex> channel_index_;
+  PointerMember<SharedNeighborProvider> neighbors_;
+  Ints channel_of_; // the channel of each channel particle or rigid member by particle index, -1 if none
+  PointerMember<LifecycleEventScheduler> scheduler_;
+  PointerMember<VesicleActiveSet> active_set_;
+  PointerMember<SecretionEventLog> event_log_;
+  double contact_range_;
+  double slack_;
+  int ready_state_;
+  unsigned long steps_; // the simulation steps taken so far, for the event log
+
+  //! release the vesicles whose undocking event is due
+  void release_due_vesicles(Model *m);
+
+  //! dock the (channel, vesicle) pairs of the close pair container
+  void dock_with_pair_container(Model *m);
+
+  //! dock the (channel, vesicle) pairs among the candidates of the shared close pair list
+  void dock_with_neighbor_provider(Model *m);
+
+  //! look up the docking candidates of each near-membrane vesicle in the channel index
+  void dock_with_channel_index(Model *m);
+
+  //! dock vesicles to the open sites of the site array of the channel index
+  void dock_with_site_array(Model *m);
+
+ public:
+  //! track the (channel, vesicle) pairs with a CloseBipartitePairContainer
+  VesicleDockingStage(SingletonContainerAdaptor vesicles_container,
+                      SingletonContainerAdaptor cachannel_container,
+                      double contact_range, double slack, int ready_state);
+
+  //! look up the channels near each vesicle in a static channel index
+  VesicleDockingStage(SingletonContainerAdaptor vesicles_container,
+                      ChannelSurfaceIndex *channel_index,
+                      double contact_range, int ready_state);
+
+  void set_scheduler(LifecycleEventScheduler *scheduler) { scheduler_ = scheduler; }
+
+  void set_channel_index(ChannelSurfaceIndex *channel_index) {
+    channel_index_ = channel_index;
+  }
+
+  //! filter the docking pairs from a shared close pair list instead of the
+  //! close pair container; requires the channel container
+  void set_neighbor_provider(SharedNeighborProvider *neighbors);
+
+  void set_active_set(VesicleActiveSet *active_set) { active_set_ = active_set; }
+
+  void set_event_log(SecretionEventLog *event_log) { event_log_ = event_log; }
+
+  //! advance the clock of the event log by the steps since the previous update
+  void advance_clock(unsigned int steps) { steps_ += steps; }
+
+  //! rigidify the calcium channel (pip[0]) and insulin vesicle (pip[1]) upon docking
+  void rigidify_pair(Model *m, ParticleIndexPair pip);
+
+  //! release the insulin vesicle (pip[1]) from the calcium channel (pip[0])
+  void release_pair(Model *m, ParticleIndexPair pip);
+
+  //! freeze the insulin vesicle pi at the channel site
+  void dock_to_site(Model *m, ParticleIndex pi, int site);
+
+  //! release the insulin vesicle pi from its channel site
+  void release_site(Model *m, ParticleIndex pi);
+
+  void update(Model *m);
+};
+
+//! Secrete ready vesicles and reset them (see InsulinSecretionOptimizerState)
+class IMPINSULINSECRETIONEXPORT VesicleSecretionStage {
+  ParticleIndexes vesicles_;
+  algebra::Sphere3D nucleus_sphere_;
+  int ready_state_;
+  double cut_off_; // cut-off for new locations where vesicles are reset
+  PointerMember<LifecycleEventScheduler> scheduler_;
+  PointerMember<VesicleActiveSet> active_set_;
+  PointerMember<SecretionEventLog> event_log_;
+  PointerMember<CellGeometryTable> cells_;
+  unsigned long steps_; // the simulation steps taken so far, for the event log
+
+  //! the nucleus of the cell of vesicle pi
+  algebra::Sphere3D get_nucleus_sphere(ParticleIndex pi) const;
+
+  //! Reset insulin vesicles
+  void do_reset(Model *m, ParticleIndex pi);
+
+  //! get random vector in and without overlapping with particles
+  algebra::Vector3D get_random_vector_in(Model *m, algebra::Sphere3D sphere,
+                                         algebra::Sphere3D nucleus_sphere,
+                                         core::XYZR xyzr) const;
+
+ public:
+  VesicleSecretionStage(ParticleIndexesAdaptor vesicles,
+                        algebra::Sphere3D nucleus_sphere,
+                        int ready_state, double cut_off);
+
+  void set_vesicles(const ParticleIndexes &vesicles) { vesicles_ = vesicles; }
+
+  const ParticleIndexes &get_vesicles() const { return vesicles_; }
+
+  //! Sort the vesicles in the given order, the vesicles not in it last
+  void set_order(ParticleIndexesAdaptor order);
+
+  void set_cut_off(double cut_off) { cut_off_ = cut_off; }
+
+  double get_cut_off() const { return cut_off_; }
+
+  void set_scheduler(LifecycleEventScheduler *scheduler) { scheduler_ = scheduler; }
+
+  void set_active_set(VesicleActiveSet *active_set) { active_set_ = active_set; }
+
+  void set_event_log(SecretionEventLog *event_log) { event_log_ = event_log; }
+
+  //! reset each vesicle near the nucleus of its own cell
+  void set_cell_geometry(CellGeometryTable *cells) { cells_ = cells; }
+
+  //! advance the clock of the event log by the steps since the previous update
+  void advance_clock(unsigned int steps) { steps_ += steps; }
+
+  //! Count the secretion of a vesicle and reset it near the nucleus
+  void secrete(Model *m, ParticleIndex pi);
+
+  void update(Model *m);
+};
+
+IMPINSULINSECRETION_END_INTERNAL_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_INTERNAL_LIFECYCLE_STAGES_H */
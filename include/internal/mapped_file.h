@@ -0,0 +1,46 @@
+/**
+ *  \file IMP/insulinsecretion/internal/mapped_file.h
+ *  \brief A read-only memory mapping of a file.
+ *
+ * Description:
+ * 1, The file is mapped with mmap on POSIX systems, so trajectories are paged in as they
+ *    are decoded and memory stays bounded by the page cache, not the file size.
+ * 2, Elsewhere the file is read into memory.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_INTERNAL_MAPPED_FILE_H
+#define IMPINSULINSECRETION_INTERNAL_MAPPED_FILE_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_INTERNAL_NAMESPACE
+
+//! A read-only mapping of a whole file
+class IMPINSULINSECRETIONEXPORT MappedFile {
+  const char *data_;
+  std::size_t size_;
+  std::vector<char> buffer_; // the file contents if it could not be mapped
+
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+ public:
+  //! Map the file, throws IOException if it cannot be read
+  MappedFile(std::string file_name);
+
+  ~MappedFile();
+
+  const char *get_data() const { return data_; }
+
+  std::size_t get_size() const { return size_; }
+};
+
+IMPINSULINSECRETION_END_INTERNAL_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_INTERNAL_MAPPED_FILE_H */
@@ -0,0 +1,36 @@
+/**
+ *  \file IMP/insulinsecretion/internal/radius_classes.h
+ *  \brief Geometric size classes of polydisperse spheres.
+ *
+ * Description:
+ * 1, Class c holds the radii in [r0 * ratio^c, r0 * ratio^(c + 1)), where r0 is the smallest
+ *    radius, so a neighbor grid per class can fit its cell size to the largest radius of the
+ *    class instead of the largest radius of all spheres.
+ * 2, Empty classes are dropped, so monodisperse spheres have one class. Points (radius 0)
+ *    join the first class.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_INTERNAL_RADIUS_CLASSES_H
+#define IMPINSULINSECRETION_INTERNAL_RADIUS_CLASSES_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/base_types.h>
+
+IMPINSULINSECRETION_BEGIN_INTERNAL_NAMESPACE
+
+//! Assign the radii to geometric size classes
+/** @param radii the radii, not negative
+    @param ratio the ratio of the largest to the smallest radius of a class, > 1
+    @param classes set to the class of each radius, increasing with the radius
+    @return the largest radius of each class
+ */
+IMPINSULINSECRETIONEXPORT Floats get_radius_classes(const Floats &radii,
+                                                    double ratio,
+                                                    Ints &classes);
+
+IMPINSULINSECRETION_END_INTERNAL_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_INTERNAL_RADIUS_CLASSES_H */
@@ -0,0 +1,88 @@
+/**
+ *  \file IMP/insulinsecretion/organelle_factory.h
+ *  \brief Create populations of insulin vesicles and Ca2+ channels in bulk.
+ *
+ * Description:
+ * 1, The C++ counterparts of VesicleFactory and CaChannelFactory in test/OrganelleFactory.py
+ *    create whole populations in one call instead of one particle per Python call.
+ * 2, All particles are added to the model before any decorator is set up, and the decorators
+ *    are set up from the last particle to the first, so each attribute table of the model
+ *    grows once to the final population size instead of once per particle.
+ * 3, The particles are attached to a new hierarchy root in one pass.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPINSULINSECRETION_ORGANELLE_FACTORY_H
+#define IMPINSULINSECRETION_ORGANELLE_FACTORY_H
+
+#include <IMP/insulinsecretion/insulinsecretion_config.h>
+#include <IMP/atom/Hierarchy.h>
+#include <IMP/algebra/Vector3D.h>
+#include <IMP/Model.h>
+#include <string>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! Create insulin vesicles at the given positions
+/** Each vesicle "Vesicle_i" is set up as in VesicleFactory.create_vesicle():
+    an optimized XYZR sphere with a (fake) unit mass, a display color,
+    a diffusion coefficient and the secretion counter, maturation state and
+    docking state decorators, all starting at zero.
+
+    @param m the model
+    @param positions the centers of the vesicles
+    @param radius the radius of the vesicles in A
+    @param diffusion_coefficient the diffusion coefficient of the vesicles in A^2/fs
+    @param name the name of the hierarchy root
+    @return the hierarchy root, with one child per vesicle in the order of positions
+ */
+IMPINSULINSECRETIONEXPORT atom::Hierarchy create_vesicles
+  ( Model *m,
+    const algebra::Vector3Ds &positions,
+    double radius,
+    double diffusion_coefficient,
+    std::string name = "Vesicles" );
+
+//! Create insulin vesicles of the given radii at the given positions
+/** As create_vesicles() above, with one radius per vesicle, e.g., drawn
+    from a size distribution of the granules.
+
+    @param m the model
+    @param positions the centers of the vesicles
+    @param radii the radius of each vesicle in A
+    @param diffusion_coefficient the diffusion coefficient of the vesicles in A^2/fs
+    @param name the name of the hierarchy root
+    @return the hierarchy root, with one child per vesicle in the order of positions
+ */
+IMPINSULINSECRETIONEXPORT atom::Hierarchy create_vesicles
+  ( Model *m,
+    const algebra::Vector3Ds &positions,
+    const Floats &radii,
+    double diffusion_coefficient,
+    std::string name = "Vesicles" );
+
+//! Create Ca2+ channels at the given sites on the cell membrane
+/** Each channel "CaChannel_i" is set up as in
+    CaChannelFactory.create_cachannel_with_State(): a sphere with a (fake)
+    unit mass, a display color and a Ca2+ channel state, made a rigid body
+    of a "CaChannel_i_core" sphere so that vesicles can be docked to it.
+
+    @param m the model
+    @param sites the centers of the channels
+    @param initial_states the channel state of each site, -1 for open
+    @param radius the radius of the channels in A
+    @param name the name of the hierarchy root
+    @return the hierarchy root, with one child per channel in the order of sites
+ */
+IMPINSULINSECRETIONEXPORT atom::Hierarchy create_ca_channels
+  ( Model *m,
+    const algebra::Vector3Ds &sites,
+    const Ints &initial_states,
+    double radius,
+    std::string name = "CaChannel" );
+
+IMPINSULINSECRETION_END_NAMESPACE
+
+#endif /* IMPINSULINSECRETION_ORGANELLE_FACTORY_H */
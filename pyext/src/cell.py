@@ -0,0 +1,250 @@
+"""@namespace IMP.insulinsecretion.cell
+   Build the simplified beta cell of test.py as a reusable object.
+
+   The cell is built once with its nucleus, insulin vesicles and Ca2+
+   channel sites. The scoring function and the lifecycle optimizer state
+   depend on the parameters that are swept (K_TRAFFIC, K_RDF, the RDF fit
+   of the glucose condition and READY_STATE), so they are created per run.
+"""
+
+from __future__ import print_function, division
+import math
+import random
+import IMP
+import IMP.algebra
+import IMP.atom
+import IMP.container
+import IMP.core
+import IMP.display
+import IMP.insulinsecretion
+
+# RDF fits of the insulin vesicles for the three glucose conditions
+RDF_FITS = {
+    'c0': [-1.524e-20, 9.173e-16, -2.092e-11, 2.202e-07, -1.141e-03, 3.492e+00], # 2.8mM
+    'c1': [-7.457e-21, 4.486e-16, -1.059e-11, 1.238e-07, -7.798e-04, 2.534e+00], # 16.7mM
+    'c2': [3.137e-20, -1.491e-15, 2.269e-11, -9.993e-08, -3.162e-04, 2.529e+00]} # 16.7mM-Ex4
+
+
+class CellParameters(object):
+    '''The parameters of the cell, with the defaults of test.py'''
+    def __init__(self, **kwargs):
+        self.L = 64000 # Length of our bounding box, A
+        self.R = 30250 # PBC radius, A
+        self.R_NUCLEUS = 18340 # NE radius, A
+        self.N_VESICLES = 200 # Number of vesicles
+        self.R_VESICLES = 1200 # Radius of vesicles, A
+        self.R_VESICLES_CV = 0 # coefficient of variation of the log-normal vesicle radii, 0 for all R_VESICLES
+        self.R_VESICLES_RANGE = 3 # the vesicle radii are within a R_VESICLES_RANGE-fold range around R_VESICLES
+        self.D_VESICLES = 2.3E-10 # diffusion coefficient of vesicles, A^2/fs.
+        self.R_CaChannel = 100 # Ca2+ microdomain radius, A
+        self.N_CaChannel = 451 # Number of Ca2+ channels.
+        self.N_trough = 3 # Number of Ca2+ channels in the opening state at the trough
+        self.N_peak = 450 # Number of Ca2+ channels in the opening state at the peak
+        self.K_BB = 1E-5 # Strength of the harmonic boundary box in kcal/mol/A^2
+        self.K_EXCLUDED = 1E-5 # Strength of lower-harmonic excluded volume score in kcal/mol/A^2
+        self.CONTACT_RANGE = self.R_CaChannel # contact range of vesicle surface to Ca2+ channel for docking, A
+        self.PERIOD = 10 # frame interval of the lifecycle optimizer state
+        self.Oscillation = 80 # number of periods between Ca2+ channel phase flips
+        self.CUT_OFF = (self.R - self.R_NUCLEUS) / 3 # cut-off from the NE surface to reset vesicles, A
+        self.BD_STEP_SIZE_SEC = 1E-2 # a time step of 0.01 s
+        self.SEED = None # random seed of the cell geometry
+        for k, v in kwargs.items():
+            if not hasattr(self, k):
+                raise ValueError("Unknown cell parameter %s" % k)
+            setattr(self, k, v)
+
+    def get_bd_step_size_fs(self):
+        return self.BD_STEP_SIZE_SEC * 1E+15
+
+
+def get_vesicle_radii(N_vesicles, R_mean, cv, max_ratio):
+    '''
+    Return N_vesicles log-normal radii of mean R_mean and coefficient of
+    variation cv, redrawing those outside a max_ratio-fold range around
+    R_mean. All are R_mean if cv is 0.
+    '''
+    if cv == 0:
+        return [float(R_mean)] * N_vesicles
+    sigma = math.sqrt(math.log(1 + cv * cv))
+    mu = math.log(R_mean) - sigma * sigma / 2
+    R_min, R_max = R_mean / math.sqrt(max_ratio), R_mean * math.sqrt(max_ratio)
+    radii = []
+    while len(radii) < N_vesicles:
+        r = random.lognormvariate(mu, sigma)
+        if R_min <= r <= R_max:
+            radii.append(r)
+    return radii
+
+
+def get_random_vesicles_in_cytoplasm(outer_sphere, inner_sphere, radii):
+    '''
+    Return random vectors inside the cell (=outer) sphere and
+    outside the nuclear envelope (=inner) sphere, one per radius, so that
+    the vesicles do not overlap with each other and with the boundaries.
+    '''
+    V_vesicles = []
+    while len(V_vesicles) < len(radii):
+        R_vesicle = radii[len(V_vesicles)]
+        R_inner = inner_sphere.get_radius() + R_vesicle
+        R_outer = outer_sphere.get_radius() - R_vesicle
+        vector = IMP.algebra.get_random_vector_in(outer_sphere)
+        if R_outer > vector.get_magnitude() > R_inner:
+            if all((vector - V).get_magnitude() > R_vesicle + R_V
+                   for V, R_V in zip(V_vesicles, radii)):
+                V_vesicles.append(vector)
+    return V_vesicles
+
+
+def get_configuration_key(params, radii, n_frames, k_traffic=0, k_rdf=0,
+                          param_rdf=RDF_FITS['c1'], channel_site_array=True,
+                          active_set=False, multi_rate=False, single_precision=False):
+    '''
+    Return the ConfigurationCache key of a cell equilibrated for n_frames:
+    everything the equilibrated coordinates depend on, the seed only through
+    the vesicle radii, and the modes of test.py that change the trajectory.
+    Cell and test.py both use it, so that their keys match.
+    '''
+    p = params
+    parameters = [p.L, p.R, p.R_NUCLEUS, p.N_VESICLES, p.D_VESICLES, p.R_CaChannel,
+                  p.N_CaChannel, p.N_trough, p.K_BB, p.K_EXCLUDED, p.BD_STEP_SIZE_SEC,
+                  n_frames, k_traffic, k_rdf] + list(param_rdf) + list(radii) \
+        + [int(channel_site_array), int(active_set), int(multi_rate), int(single_precision)]
+    return IMP.insulinsecretion.ConfigurationCache.get_key(parameters)
+
+
+class Cell(object):
+    '''
+    A simplified beta cell: a nucleus particle, diffusing insulin vesicle
+    particles and a static ChannelSiteArray of Ca2+ channels.
+    '''
+    def __init__(self, params=None):
+        self.params = p = params or CellParameters()
+        if p.SEED is not None:
+            random.seed(p.SEED)
+            IMP.random_number_generator.seed(p.SEED)
+        self.m = IMP.Model()
+        self.h_root = IMP.atom.Hierarchy.setup_particle(IMP.Particle(self.m, "root"))
+        self.bb = IMP.algebra.BoundingBox3D(IMP.algebra.Vector3D(-p.L/2, -p.L/2, -p.L/2),
+                                            IMP.algebra.Vector3D(p.L/2, p.L/2, p.L/2))
+        self.pbc_sphere = IMP.algebra.Sphere3D([0, 0, 0], p.R)
+        self._create_nucleus()
+        self._create_vesicles()
+        self._create_cachannel_sites()
+
+    def _create_nucleus(self):
+        p = self.params
+        p_nucleus = IMP.Particle(self.m, "md")
+        xyzr = IMP.core.XYZR.setup_particle(p_nucleus)
+        xyzr.set_coordinates_are_optimized(True)
+        xyzr.set_coordinates([0, 0, 0])
+        xyzr.set_radius(p.R_NUCLEUS)
+        IMP.display.Colored.setup_particle(p_nucleus, IMP.display.get_display_color(2))
+        IMP.atom.Mass.setup_particle(p_nucleus, 1.0) # fake mass
+        self.h_nucleus = IMP.atom.Hierarchy.setup_particle(p_nucleus)
+        self.h_root.add_child(self.h_nucleus)
+        self.nucleus_sphere = xyzr.get_sphere()
+
+    def _create_vesicles(self):
+        p = self.params
+        self.radii = get_vesicle_radii(p.N_VESICLES, p.R_VESICLES, p.R_VESICLES_CV,
+                                       p.R_VESICLES_RANGE)
+        positions = [IMP.algebra.Vector3D(v) for v in get_random_vesicles_in_cytoplasm(
+            self.pbc_sphere, self.nucleus_sphere, self.radii)]
+        h_vesicles_root = IMP.insulinsecretion.create_vesicles(
+            self.m, positions, self.radii, p.D_VESICLES)
+        self.h_root.add_child(h_vesicles_root)
+        self.vesicles = h_vesicles_root.get_children()
+
+    def _create_cachannel_sites(self):
+        p = self.params
+        V_cachannel = IMP.algebra.get_uniform_surface_cover(self.pbc_sphere, p.N_CaChannel)
+        random.shuffle(V_cachannel)
+        self.cachannel_sites = IMP.insulinsecretion.ChannelSiteArray(V_cachannel, p.R_CaChannel, 0)
+        for i in range(p.N_trough):
+            self.cachannel_sites.set_state(i, -1)
+        self.cachannel_index = IMP.insulinsecretion.ChannelSurfaceIndex(
+            self.cachannel_sites, self.pbc_sphere,
+            p.CONTACT_RANGE + max(self.radii) + p.R_CaChannel)
+
+    def create_scoring_function(self, k_traffic=0, k_rdf=0, param_rdf=RDF_FITS['c1'],
+                                single_precision=False):
+        '''Create the restraints of test.py for the given force constants
+
+        With single_precision, the RDF and trafficking scores are evaluated by the
+        float kernel of MultiCellRadialRestraint instead of two SingletonsRestraints.'''
+        p = self.params
+        rs = []
+        bb_harmonic = IMP.core.HarmonicUpperBound(0, p.K_BB)
+        pbc_bsss = IMP.core.BoundingSphere3DSingletonScore(bb_harmonic, self.pbc_sphere)
+        outer_bbss = IMP.core.BoundingBox3DSingletonScore(bb_harmonic, self.bb)
+        rs.append(IMP.container.SingletonsRestraint(pbc_bsss, self.vesicles))
+        rs.append(IMP.container.SingletonsRestraint(outer_bbss, self.vesicles))
+        rs.append(IMP.core.ExcludedVolumeRestraint(IMP.atom.get_leaves(self.h_root),
+                                                   p.K_EXCLUDED, 10, "EV"))
+        gtsc = IMP.insulinsecretion.VesicleTraffickingSingletonScore([0, 0, 0], k_traffic)
+        rdfss = IMP.insulinsecretion.RadialDistributionFunctionSingletonScore(
+            self.pbc_sphere, self.nucleus_sphere, param_rdf, k_rdf)
+        if single_precision:
+            cells = IMP.insulinsecretion.CellGeometryTable()
+            cells.set_cell(self.vesicles, cells.add_cell(self.pbc_sphere, self.nucleus_sphere))
+            radial = IMP.insulinsecretion.MultiCellRadialRestraint(
+                self.vesicles, cells, rdfss, gtsc, 1)
+            radial.set_single_precision(True)
+            rs.append(radial)
+        else:
+            rs.append(IMP.container.SingletonsRestraint(gtsc, self.vesicles))
+            rs.append(IMP.container.SingletonsRestraint(rdfss, self.vesicles))
+        return IMP.core.RestraintsScoringFunction(rs, "SF")
+
+    def create_lifecycle(self, ready_state):
+        '''Create the Ca2+ channel, docking and secretion optimizer state'''
+        p = self.params
+        return IMP.insulinsecretion.InsulinCellLifecycleOptimizerState(
+            self.m, self.vesicles, self.cachannel_index, self.nucleus_sphere,
+            p.Oscillation, p.N_trough, p.N_peak, p.CONTACT_RANGE, ready_state,
+            p.CUT_OFF, p.PERIOD)
+
+    def create_simulator(self, sf):
+        '''Create the Brownian dynamics simulator of test.py'''
+        bd = IMP.atom.BrownianDynamics(self.m)
+        bd.set_log_level(IMP.SILENT)
+        bd.set_scoring_function(sf)
+        bd.set_maximum_time_step(self.params.get_bd_step_size_fs())
+        bd.set_temperature(310.15) #37 celsius, the temperature used in WF experiments
+        return bd
+
+    def equilibrate(self, n_frames, k_traffic=0, k_rdf=0, param_rdf=RDF_FITS['c1']):
+        '''Diffuse the vesicles without docking or secretion'''
+        bd = self.create_simulator(self.create_scoring_function(k_traffic, k_rdf, param_rdf))
+        bd.optimize(n_frames)
+
+    def get_configuration_key(self, n_frames, k_traffic=0, k_rdf=0, param_rdf=RDF_FITS['c1']):
+        '''Return the ConfigurationCache key of the cell equilibrated for n_frames'''
+        return get_configuration_key(self.params, self.radii, n_frames, k_traffic, k_rdf,
+                                     param_rdf)
+
+    def equilibrate_cached(self, cache, n_frames, k_traffic=0, k_rdf=0,
+                           param_rdf=RDF_FITS['c1'], max_displacement=0):
+        '''
+        Start from the cached equilibrated configuration of the cell, if any,
+        moving each vesicle by up to max_displacement (following the IMP seed);
+        otherwise equilibrate and store the configuration in the cache.
+        Return True if the configuration came from the cache.
+        '''
+        key = self.get_configuration_key(n_frames, k_traffic, k_rdf, param_rdf)
+        snapshot = self.create_snapshot()
+        if cache.restore(key, snapshot, max_displacement):
+            return True
+        self.equilibrate(n_frames, k_traffic, k_rdf, param_rdf)
+        snapshot.save()
+        cache.store(key, snapshot)
+        return False
+
+    def get_number_of_secretions(self):
+        '''Return the total number of secretion events of the vesicles'''
+        return sum(IMP.insulinsecretion.SecretionCounterDecorator(v).get_secretion()
+                   for v in self.vesicles)
+
+    def create_snapshot(self):
+        '''Save the vesicles and the Ca2+ channel states'''
+        return IMP.insulinsecretion.CellSnapshot(self.m, self.vesicles, self.cachannel_sites)
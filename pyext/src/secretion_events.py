@@ -0,0 +1,37 @@
+"""@namespace IMP.insulinsecretion.secretion_events
+   Read the binary secretion event files written by SecretionEventLog.
+
+   Each event holds the secretion time and the docking time in fs (-1 if
+   unknown), the particle index of the vesicle, the channel particle index
+   or site id it was docked to (-1 if unknown) and the position of the
+   vesicle when it was secreted.
+"""
+
+from __future__ import print_function, division
+import collections
+import struct
+
+MAGIC = b'IMPISSEC'
+_RECORD = struct.Struct('=ddii3f')
+
+SecretionEvent = collections.namedtuple(
+    'SecretionEvent',
+    ['time', 'dock_time', 'vesicle', 'channel', 'position'])
+
+
+def read_secretion_events(file_name):
+    """Yield the SecretionEvent records of a secretion event file in order"""
+    with open(file_name, 'rb') as fh:
+        if fh.read(len(MAGIC)) != MAGIC:
+            raise IOError("%s is not a secretion event file" % file_name)
+        while True:
+            data = fh.read(_RECORD.size)
+            if len(data) < _RECORD.size:
+                return
+            t, dock_t, vesicle, channel, x, y, z = _RECORD.unpack(data)
+            yield SecretionEvent(t, dock_t, vesicle, channel, (x, y, z))
+
+
+def get_dwell_times(events):
+    """Return the docking dwell times in fs of the events whose docking time is known"""
+    return [e.time - e.dock_time for e in events if e.dock_time >= 0]
@@ -0,0 +1,122 @@
+"""@namespace IMP.insulinsecretion.sweep
+   Run a parameter sweep from one equilibrated cell.
+
+   The cell is built and equilibrated once and its vesicles and Ca2+
+   channel states are saved in a CellSnapshot. The sweep points then run
+   in worker processes forked from the equilibrated process, so the model,
+   the channel sites and the nucleus are shared copy-on-write instead of
+   being rebuilt, and each point restores the snapshot before it starts.
+   The secretion kinetics of all points are collected in one table.
+
+   Processes are used instead of threads because an IMP Model and its
+   optimizers are not thread-safe and hold the Python interpreter lock
+   while they run.
+"""
+
+from __future__ import print_function, division
+import multiprocessing
+import os
+import IMP
+import IMP.insulinsecretion.cell
+
+# the columns of the consolidated table
+COLUMNS = ['condition', 'K_TRAFFIC', 'K_RDF', 'READY_STATE', 'seed',
+           'time_s', 'secretions']
+
+# the cell and its snapshot, inherited by the forked workers
+_cell = None
+_snapshot = None
+
+
+class SweepPoint(object):
+    '''One parameter point of a sweep'''
+    def __init__(self, condition='c1', k_traffic=0, k_rdf=0, ready_state=100,
+                 seed=0):
+        self.condition = condition
+        self.k_traffic = k_traffic
+        self.k_rdf = k_rdf
+        self.ready_state = ready_state
+        self.seed = seed
+
+    def __repr__(self):
+        return ("SweepPoint(%s, K_TRAFFIC=%g, K_RDF=%g, READY_STATE=%d, seed=%d)"
+                % (self.condition, self.k_traffic, self.k_rdf,
+                   self.ready_state, self.seed))
+
+
+def get_grid(conditions=('c0', 'c1', 'c2'), k_traffic=(0,), k_rdf=(0,),
+             ready_state=(100,), seeds=(0,)):
+    '''Return the SweepPoints of the full grid of the given values'''
+    return [SweepPoint(c, kt, kr, rs, s) for c in conditions
+            for kt in k_traffic for kr in k_rdf for rs in ready_state
+            for s in seeds]
+
+
+def _run_point(args):
+    '''Run one sweep point from the snapshot and return its table rows'''
+    point, n_frames, record_interval = args
+    cell = _cell
+    _snapshot.restore()
+    # the BD noise and the Ca2+ channel phase flips both draw from the IMP generator
+    IMP.random_number_generator.seed(point.seed)
+    secretions0 = cell.get_number_of_secretions()
+    sf = cell.create_scoring_function(point.k_traffic, point.k_rdf,
+                                      IMP.insulinsecretion.cell.RDF_FITS[point.condition])
+    bd = cell.create_simulator(sf)
+    bd.add_optimizer_state(cell.create_lifecycle(point.ready_state))
+    rows = []
+    step_s = cell.params.BD_STEP_SIZE_SEC
+    done = 0
+    while done < n_frames:
+        n = min(record_interval, n_frames - done)
+        bd.optimize(n)
+        done += n
+        rows.append([point.condition, point.k_traffic, point.k_rdf,
+                     point.ready_state, point.seed, done * step_s,
+                     cell.get_number_of_secretions() - secretions0])
+    return rows
+
+
+def run_sweep(points, n_frames, record_interval=100, equilibration_frames=0,
+              params=None, n_workers=None, cache_directory=None):
+    '''
+    Equilibrate one cell and run all points from it.
+
+    @param points the SweepPoints to run
+    @param n_frames the number of BD frames of each point
+    @param record_interval the number of frames between rows of the table
+    @param equilibration_frames the number of BD frames without docking or
+           secretion before the snapshot
+    @param params the CellParameters of the cell
+    @param n_workers the number of worker processes, the number of CPUs if None
+    @param cache_directory a ConfigurationCache directory, the equilibrated
+           cell is read from it or stored in it if given
+    @return the rows of the table, in the order of COLUMNS
+    '''
+    global _cell, _snapshot
+    _cell = IMP.insulinsecretion.cell.Cell(params)
+    if equilibration_frames > 0 and cache_directory is not None:
+        if not os.path.isdir(cache_directory):
+            os.makedirs(cache_directory)
+        cache = IMP.insulinsecretion.ConfigurationCache(cache_directory)
+        _cell.equilibrate_cached(cache, equilibration_frames)
+    elif equilibration_frames > 0:
+        _cell.equilibrate(equilibration_frames)
+    _snapshot = _cell.create_snapshot()
+    # the model is created before forking, so that the workers share it
+    ctx = multiprocessing.get_context('fork')
+    pool = ctx.Pool(n_workers)
+    try:
+        results = pool.map(_run_point, [(p, n_frames, record_interval)
+                                        for p in points], chunksize=1)
+    finally:
+        pool.close()
+        pool.join()
+    return [row for rows in results for row in rows]
+
+
+def write_table(rows, fh):
+    '''Write the consolidated table of secretion kinetics as tab-separated text'''
+    print('\t'.join(COLUMNS), file=fh)
+    for row in rows:
+        print('\t'.join(str(x) for x in row), file=fh)
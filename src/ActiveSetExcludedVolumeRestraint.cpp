@@ -0,0 +1,55 @@
+/**
+ *  \file IMP/insulinsecretion/ActiveSetExcludedVolumeRestraint.cpp
+ *  \brief An excluded volume restraint that skips the pairs of frozen particles.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/ActiveSetExcludedVolumeRestraint.h>
+#include <IMP/core/SoftSpherePairScore.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the restraint
+ActiveSetExcludedVolumeRestraint::ActiveSetExcludedVolumeRestraint
+( VesicleActiveSet *active_set,
+  double k,
+  double slack,
+  std::string name)
+  : Restraint(active_set->get_active_container()->get_model(), name),
+  active_set_(active_set),
+  score_(new core::SoftSpherePairScore(k))
+{
+  active_pairs_ = new container::ClosePairContainer
+    ( active_set->get_active_container(), 0, slack);
+  frozen_pairs_ = new container::CloseBipartitePairContainer
+    ( active_set->get_active_container(),
+      active_set->get_frozen_container(), 0, slack);
+}
+
+//! sum the soft sphere score over the active-active and active-frozen pairs
+double ActiveSetExcludedVolumeRestraint::unprotected_evaluate
+( DerivativeAccumulator *da ) const {
+  Model *m = get_model();
+  double ret = 0;
+  for (const ParticleIndexPair &pip : active_pairs_->get_contents()) {
+    ret += score_->evaluate_index(m, pip, da);
+  }
+  for (const ParticleIndexPair &pip : frozen_pairs_->get_contents()) {
+    ret += score_->evaluate_index(m, pip, da);
+  }
+  return ret;
+}
+
+//! the close pair containers and the particles they may contain
+ModelObjectsTemp ActiveSetExcludedVolumeRestraint::do_get_inputs() const {
+  Model *m = get_model();
+  ModelObjectsTemp ret;
+  ret += score_->get_inputs(m, active_pairs_->get_all_possible_indexes());
+  ret += score_->get_inputs(m, frozen_pairs_->get_all_possible_indexes());
+  ret.push_back(active_pairs_);
+  ret.push_back(frozen_pairs_);
+  return ret;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
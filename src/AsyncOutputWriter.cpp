@@ -0,0 +1,216 @@
+/**
+ *  \file IMP/insulinsecretion/AsyncOutputWriter.cpp
+ *  \brief A background writer thread for the output files of a simulation.
+ *
+ * Description:
+ * 1, The ring holds frames_[first_] ... frames_[first_ + size_ - 1] for the writer thread;
+ *    the simulation thread fills frames_[current_], the slot after them, so the two threads
+ *    never touch the same buffer and the mutex only guards first_, size_ and the counters.
+ * 2, A frame stays queued until it is written, and the last one until the file is flushed,
+ *    so flush() returns once size_ is 0.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/AsyncOutputWriter.h>
+#include <IMP/exception.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define IMPINSULINSECRETION_HAS_FSYNC 1
+#endif
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the writer
+AsyncOutputWriter::AsyncOutputWriter
+( std::string file_name,
+  unsigned int frame_capacity,
+  unsigned int n_buffers)
+  : Object("AsyncOutputWriter%1%"),
+  file_name_(file_name),
+  file_(nullptr),
+  frame_capacity_(frame_capacity),
+  frames_(n_buffers),
+  current_(0),
+  first_(0),
+  size_(0),
+  closing_(false),
+  fsync_(false),
+  n_frames_(0),
+  n_stalls_(0),
+  n_bytes_(0)
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(n_buffers >= 2, "n_buffers must be at least 2");
+  IMP_USAGE_CHECK(frame_capacity > 0, "frame_capacity must be positive");
+  file_ = std::fopen(file_name.c_str(), "wb");
+  if (!file_) {
+    IMP_THROW("Cannot open output file " << file_name, IOException);
+  }
+  for (unsigned int i = 0; i < frames_.size(); ++i) {
+    frames_[i].reserve(frame_capacity);
+  }
+  thread_ = std::thread([this]() { run(); });
+}
+
+void AsyncOutputWriter::set_formatter(Formatter formatter) {
+  IMP_USAGE_CHECK(n_frames_ == 0 || !formatter,
+                  "the formatter must be set before the first frame");
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!formatter) {
+    // the queued frames are in the format of the old formatter
+    freed_.wait(lock, [this]() { return size_ == 0; });
+    frames_[current_].clear();
+  }
+  formatter_ = formatter;
+}
+
+void AsyncOutputWriter::set_fsync(bool fsync) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fsync_ = fsync;
+}
+
+//! raise the error of the writer thread, if any
+void AsyncOutputWriter::check_error() const {
+  if (!error_.empty()) {
+    IMP_THROW(error_, IOException);
+  }
+}
+
+//! keep the first error
+void AsyncOutputWriter::set_error(std::string error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (error_.empty()) {
+    error_ = error;
+  }
+}
+
+//! close the writer, warning instead of raising an error
+void AsyncOutputWriter::do_destroy() {
+  try {
+    close();
+  } catch (const IOException &e) {
+    IMP_WARN("Output lost: " << e.what() << std::endl);
+  }
+}
+
+//! hand the current frame to the writer thread
+void AsyncOutputWriter::end_frame() {
+  IMP_USAGE_CHECK(!closing_, "the writer is closed");
+  std::unique_lock<std::mutex> lock(mutex_);
+  check_error();
+  ++size_;
+  ++n_frames_;
+  queued_.notify_one();
+  if (size_ == frames_.size()) {
+    ++n_stalls_; // all buffers queued, wait for the writer (back-pressure)
+    freed_.wait(lock, [this]() { return size_ < frames_.size(); });
+    check_error();
+  }
+  current_ = (first_ + size_) % frames_.size();
+  frames_[current_].clear(); // keeps the reserved capacity
+}
+
+void AsyncOutputWriter::write(std::string data) {
+  std::string &frame = begin_frame();
+  frame.append(data);
+  if (frame.size() >= frame_capacity_) {
+    end_frame();
+  }
+}
+
+//! hand over the current frame and wait until all frames are written
+void AsyncOutputWriter::flush() {
+  if (closing_) {
+    return;
+  }
+  if (!begin_frame().empty()) {
+    end_frame();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  freed_.wait(lock, [this]() { return size_ == 0; });
+  check_error();
+}
+
+//! write the queued frames, end the writer thread, close the file and raise any error
+void AsyncOutputWriter::close() {
+  if (closing_) {
+    return;
+  }
+  if (!begin_frame().empty()) {
+    try {
+      end_frame();
+    } catch (const IOException &) {
+      // an earlier error, raised below once the thread ended
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+  }
+  queued_.notify_one();
+  thread_.join();
+  if (std::fclose(file_) != 0) {
+    set_error("Cannot close output file " + file_name_);
+  }
+  file_ = nullptr;
+  std::lock_guard<std::mutex> lock(mutex_);
+  check_error();
+}
+
+double AsyncOutputWriter::get_number_of_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return n_bytes_;
+}
+
+//! write one frame, on the writer thread
+void AsyncOutputWriter::write_frame(const std::string &frame) {
+  const std::string *bytes = &frame;
+  if (formatter_) {
+    formatted_.clear();
+    formatter_(frame, formatted_);
+    bytes = &formatted_;
+  }
+  if (std::fwrite(bytes->data(), 1, bytes->size(), file_) != bytes->size()) {
+    set_error("Cannot write to output file " + file_name_);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  n_bytes_ += bytes->size();
+}
+
+//! the loop of the writer thread
+void AsyncOutputWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queued_.wait(lock, [this]() { return size_ > 0 || closing_; });
+    if (size_ == 0) {
+      break; // closing and all frames written
+    }
+    const std::string &frame = frames_[first_];
+    lock.unlock();
+    write_frame(frame);
+    lock.lock();
+    if (size_ == 1) {
+      // the queue is about to empty, put the frames on disk
+      bool fsync = fsync_;
+      lock.unlock();
+      // buffered write errors, e.g., a full disk, show up here
+      if (std::fflush(file_) != 0) {
+        set_error("Cannot flush output file " + file_name_);
+      }
+#ifdef IMPINSULINSECRETION_HAS_FSYNC
+      else if (fsync && ::fsync(fileno(file_)) != 0) {
+        set_error("Cannot fsync output file " + file_name_);
+      }
+#endif
+      lock.lock();
+    }
+    first_ = (first_ + 1) % frames_.size();
+    --size_;
+    freed_.notify_all();
+  }
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,72 @@
+/**
+ *  \file IMP/insulinsecretion/CellGeometryTable.cpp
+ *  \brief The cell and nucleus spheres of the cells of an islet and the cell of each vesicle.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/CellGeometryTable.h>
+#include <IMP/core/XYZ.h>
+#include <limits>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the table
+CellGeometryTable::CellGeometryTable()
+  : Object("CellGeometryTable%1%")
+{}
+
+//! add a cell and return its id
+unsigned int CellGeometryTable::add_cell
+( algebra::Sphere3D cell_sphere,
+  algebra::Sphere3D nucleus_sphere) {
+  IMP_USAGE_CHECK(nucleus_sphere.get_radius() < cell_sphere.get_radius(),
+                  "the nucleus must be smaller than the cell");
+  cell_spheres_.push_back(cell_sphere);
+  nucleus_spheres_.push_back(nucleus_sphere);
+  return cell_spheres_.size() - 1;
+}
+
+//! assign the vesicles to a cell
+void CellGeometryTable::set_cell(ParticleIndexesAdaptor vesicles,
+                                 unsigned int cell) {
+  IMP_USAGE_CHECK(cell < cell_spheres_.size(), "no cell " << cell);
+  for (ParticleIndex pi : vesicles) {
+    if (pi.get_index() >= static_cast<int>(cells_.size())) {
+      cells_.resize(pi.get_index() + 1, -1);
+    }
+    cells_[pi.get_index()] = cell;
+  }
+}
+
+//! assign each vesicle to the cell whose center is closest to it
+void CellGeometryTable::set_cells_by_position(Model *m,
+                                              ParticleIndexesAdaptor vesicles) {
+  IMP_USAGE_CHECK(!cell_spheres_.empty(), "there are no cells");
+  for (ParticleIndex pi : vesicles) {
+    algebra::Vector3D v = core::XYZ(m, pi).get_coordinates();
+    unsigned int closest = 0;
+    double closest_distance = std::numeric_limits<double>::max();
+    for (unsigned int i = 0; i < cell_spheres_.size(); ++i) {
+      double d = algebra::get_distance(v, cell_spheres_[i].get_center());
+      if (d < closest_distance) {
+        closest = i;
+        closest_distance = d;
+      }
+    }
+    set_cell(ParticleIndexes(1, pi), closest);
+  }
+}
+
+//! returns the vesicles assigned to a cell
+ParticleIndexes CellGeometryTable::get_vesicles(unsigned int cell) const {
+  ParticleIndexes ret;
+  for (unsigned int i = 0; i < cells_.size(); ++i) {
+    if (cells_[i] == static_cast<int>(cell)) {
+      ret.push_back(ParticleIndex(i));
+    }
+  }
+  return ret;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,221 @@
+/**
+ *  \file IMP/insulinsecretion/CellSnapshot.cpp
+ *  \brief A snapshot of the coordinates and lifecycle states of a cell that can be restored.
+ *
+ * File layout (integers are varints, signed ones zigzag-encoded):
+ *   "IMPISCFG", version, number of particles, number of lifecycle keys, number of site
+ *   states, clock tick (signed), then for each particle: x, y, z (doubles), optimized flag,
+ *   key mask and the signed values of the keys in the mask, then the signed site states
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/CellSnapshot.h>
+#include <IMP/insulinsecretion/CaChannelStateDecorator.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/LifecycleClock.h>
+#include <IMP/insulinsecretion/MaturationStateDecorator.h>
+#include <IMP/insulinsecretion/SecretionCounterDecorator.h>
+#include <IMP/insulinsecretion/internal/compact_trajectory.h>
+#include <IMP/insulinsecretion/internal/mapped_file.h>
+#include <IMP/core/XYZ.h>
+#include <IMP/exception.h>
+#include <cstring>
+#include <fstream>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+const char CELL_SNAPSHOT_MAGIC[8] = {'I', 'M', 'P', 'I', 'S', 'C', 'F', 'G'};
+const unsigned int CELL_SNAPSHOT_VERSION = 1;
+
+//! returns the lifecycle attributes saved by a snapshot
+const IntKeys &get_lifecycle_keys() {
+  static IntKeys keys;
+  if (keys.empty()) {
+    keys.push_back(DockingStateDecorator::get_dstate_key());
+    keys.push_back(DockingStateDecorator::get_site_key());
+    keys.push_back(MaturationStateDecorator::get_state_key());
+    keys.push_back(MaturationStateDecorator::get_birth_key());
+    keys.push_back(SecretionCounterDecorator::get_secretion_key());
+    keys.push_back(CaChannelStateDecorator::get_channelstate_key());
+  }
+  return keys;
+}
+}
+
+//! for the definition of the snapshot
+CellSnapshot::CellSnapshot
+( Model *m,
+  ParticleIndexesAdaptor particles,
+  ChannelSiteArray *sites)
+  : Object("CellSnapshot%1%"),
+  m_(m),
+  particles_(particles.begin(), particles.end()),
+  sites_(sites),
+  tick_(0)
+{
+  IMP_OBJECT_LOG;
+  save();
+}
+
+//! save the current state
+void CellSnapshot::save() {
+  const IntKeys &keys = get_lifecycle_keys();
+  coordinates_.clear();
+  optimized_.clear();
+  values_.assign(particles_.size() * keys.size(), 0);
+  masks_.assign(particles_.size(), 0);
+  for (unsigned int i = 0; i < particles_.size(); ++i) {
+    core::XYZ xyz(m_, particles_[i]);
+    coordinates_.push_back(xyz.get_coordinates());
+    optimized_.push_back(xyz.get_coordinates_are_optimized());
+    for (unsigned int k = 0; k < keys.size(); ++k) {
+      if (m_->get_has_attribute(keys[k], particles_[i])) {
+        masks_[i] |= 1 << k;
+        values_[i * keys.size() + k] = m_->get_attribute(keys[k], particles_[i]);
+      }
+    }
+  }
+  if (sites_) {
+    site_states_ = sites_->get_states();
+  }
+  tick_ = LifecycleClock::get_tick(m_);
+}
+
+//! restore the saved state
+void CellSnapshot::restore() const {
+  const IntKeys &keys = get_lifecycle_keys();
+  for (unsigned int i = 0; i < particles_.size(); ++i) {
+    ParticleIndex pi = particles_[i];
+    core::XYZ xyz(m_, pi);
+    xyz.set_coordinates(coordinates_[i]);
+    xyz.set_coordinates_are_optimized(optimized_[i]);
+    for (unsigned int k = 0; k < keys.size(); ++k) {
+      bool had = masks_[i] & (1 << k);
+      bool has = m_->get_has_attribute(keys[k], pi);
+      if (had && has) {
+        m_->set_attribute(keys[k], pi, values_[i * keys.size() + k]);
+      } else if (had) {
+        m_->add_attribute(keys[k], pi, values_[i * keys.size() + k]);
+      } else if (has) {
+        // e.g. the docked site of a vesicle that docked after the snapshot
+        m_->remove_attribute(keys[k], pi);
+      }
+    }
+  }
+  for (unsigned int i = 0; i < site_states_.size(); ++i) {
+    sites_->set_state(i, site_states_[i]);
+  }
+  // the maturation states are relative to the clock
+  LifecycleClock::get_clock(m_)->set_tick(tick_);
+}
+
+//! write the saved state to a binary file
+void CellSnapshot::write(std::string file_name) const {
+  unsigned int n_keys = get_lifecycle_keys().size();
+  std::string buffer(CELL_SNAPSHOT_MAGIC, sizeof(CELL_SNAPSHOT_MAGIC));
+  internal::write_varint(buffer, CELL_SNAPSHOT_VERSION);
+  internal::write_varint(buffer, particles_.size());
+  internal::write_varint(buffer, n_keys);
+  internal::write_varint(buffer, site_states_.size());
+  internal::write_signed_varint(buffer, tick_);
+  for (unsigned int i = 0; i < particles_.size(); ++i) {
+    for (unsigned int k = 0; k < 3; ++k) {
+      internal::write_double(buffer, coordinates_[i][k]);
+    }
+    internal::write_varint(buffer, optimized_[i]);
+    internal::write_varint(buffer, masks_[i]);
+    for (unsigned int k = 0; k < n_keys; ++k) {
+      if (masks_[i] & (1 << k)) {
+        internal::write_signed_varint(buffer, values_[i * n_keys + k]);
+      }
+    }
+  }
+  for (unsigned int i = 0; i < site_states_.size(); ++i) {
+    internal::write_signed_varint(buffer, site_states_[i]);
+  }
+  std::ofstream out(file_name.c_str(), std::ios::binary);
+  out.write(buffer.data(), buffer.size());
+  if (!out) {
+    IMP_THROW("Cannot write cell snapshot file " << file_name, IOException);
+  }
+}
+
+//! replace the saved state by the one in a file
+void CellSnapshot::read(std::string file_name) {
+  internal::MappedFile file(file_name);
+  internal::ByteCursor in = {file.get_data(), file.get_data() + file.get_size()};
+  const std::size_t n_magic = sizeof(CELL_SNAPSHOT_MAGIC);
+  std::uint64_t version, n_particles, n_keys, n_sites, u;
+  std::int64_t v;
+  if (file.get_size() < n_magic
+      || std::memcmp(in.pos, CELL_SNAPSHOT_MAGIC, n_magic) != 0) {
+    IMP_THROW(file_name << " is not a cell snapshot file", IOException);
+  }
+  in.pos += n_magic;
+  if (!internal::read_varint(in, version) || version != CELL_SNAPSHOT_VERSION
+      || !internal::read_varint(in, n_particles) || !internal::read_varint(in, n_keys)
+      || !internal::read_varint(in, n_sites) || !internal::read_signed_varint(in, v)) {
+    IMP_THROW(file_name << " is not a cell snapshot file", IOException);
+  }
+  if (n_particles != particles_.size() || n_keys != get_lifecycle_keys().size()
+      || n_sites != (sites_ ? sites_->get_number_of_sites() : 0)) {
+    IMP_THROW(file_name << " holds " << n_particles << " particles and " << n_sites
+              << " sites, not those of this snapshot", IOException);
+  }
+  // parsed into locals, so a truncated file leaves the saved state unchanged
+  int tick = v;
+  algebra::Vector3Ds coordinates(n_particles);
+  Ints optimized(n_particles, 0);
+  Ints masks(n_particles, 0);
+  Ints values(n_particles * n_keys, 0);
+  bool ok = true;
+  for (unsigned int i = 0; ok && i < n_particles; ++i) {
+    for (unsigned int k = 0; k < 3; ++k) {
+      ok = ok && internal::read_double(in, coordinates[i][k]);
+    }
+    ok = ok && internal::read_varint(in, u);
+    optimized[i] = u;
+    ok = ok && internal::read_varint(in, u);
+    masks[i] = u;
+    for (unsigned int k = 0; ok && k < n_keys; ++k) {
+      if (masks[i] & (1 << k)) {
+        ok = internal::read_signed_varint(in, v);
+        values[i * n_keys + k] = v;
+      }
+    }
+  }
+  Ints site_states(n_sites, 0);
+  for (unsigned int i = 0; ok && i < n_sites; ++i) {
+    ok = internal::read_signed_varint(in, v);
+    site_states[i] = v;
+  }
+  if (!ok) {
+    IMP_THROW("Truncated cell snapshot file " << file_name, IOException);
+  }
+  tick_ = tick;
+  coordinates_.swap(coordinates);
+  optimized_.swap(optimized);
+  masks_.swap(masks);
+  values_.swap(values);
+  site_states_.swap(site_states);
+}
+
+//! move the optimized particles to random points near their coordinates
+void CellSnapshot::perturb(double max_displacement) const {
+  IMP_USAGE_CHECK(max_displacement >= 0, "max_displacement must not be negative");
+  if (max_displacement == 0) {
+    return;
+  }
+  for (ParticleIndex pi : particles_) {
+    core::XYZ xyz(m_, pi);
+    if (xyz.get_coordinates_are_optimized()) {
+      xyz.set_coordinates(algebra::get_random_vector_in(
+          algebra::Sphere3D(xyz.get_coordinates(), max_displacement)));
+    }
+  }
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,217 @@
+/**
+ *  \file IMP/insulinsecretion/ChannelMarkovGating.cpp
+ *  \brief Stochastic per-channel Markov gating of Ca2+ channels driven by a waveform.
+ *
+ * Description:
+ * 1, The transition probabilities over one update are the exact propagator exp(Q dt) of the
+ *    rate matrix Q, so round trips within an update are counted and the open fraction
+ *    converges to the stationary one of the rates, w without inactivation. The two-state
+ *    propagator is closed form, P(C -> O) = w (1 - exp(-k dt)) and P(O -> C) =
+ *    (1 - w) (1 - exp(-k dt)); the three-state one is a 3x3 matrix exponential per update.
+ * 2, They are stored as 32-bit thresholds, so a channel moves to its first target if its
+ *    random number is below the first threshold and to its second target if it is below
+ *    the second; both are compared as integers.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/ChannelMarkovGating.h>
+#include <algorithm>
+#include <cmath>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+//! the murmur3 finalizer, a bijective 32-bit mix
+inline std::uint32_t get_mixed(std::uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x;
+}
+
+//! a probability as a threshold of 32-bit random numbers
+std::uint32_t get_threshold(double p) {
+  return static_cast<std::uint32_t>(std::min(std::max(p, 0.0) * 4294967296.0, 4294967295.0));
+}
+
+//! the all-ones mask if c, else 0
+inline std::uint32_t get_mask(bool c) {
+  return 0u - static_cast<std::uint32_t>(c);
+}
+
+//! p = exp(q t) of a 3x3 rate matrix, by scaling and squaring of its Taylor series
+void get_propagator(const double q[3][3], double t, double p[3][3]) {
+  double norm = 0;
+  for (unsigned int i = 0; i < 3; ++i) {
+    norm = std::max(norm, (std::abs(q[i][0]) + std::abs(q[i][1]) + std::abs(q[i][2])) * t);
+  }
+  unsigned int n_squarings = 0;
+  while (norm > 0.5) {
+    norm /= 2;
+    ++n_squarings;
+  }
+  double a[3][3], term[3][3], next[3][3];
+  for (unsigned int i = 0; i < 3; ++i) {
+    for (unsigned int j = 0; j < 3; ++j) {
+      a[i][j] = std::ldexp(q[i][j] * t, -static_cast<int>(n_squarings));
+      term[i][j] = p[i][j] = (i == j);
+    }
+  }
+  // the norm is at most 1/2, so 12 terms are exact to double precision
+  for (unsigned int k = 1; k <= 12; ++k) {
+    for (unsigned int i = 0; i < 3; ++i) {
+      for (unsigned int j = 0; j < 3; ++j) {
+        next[i][j] = (term[i][0] * a[0][j] + term[i][1] * a[1][j]
+                      + term[i][2] * a[2][j]) / k;
+      }
+    }
+    for (unsigned int i = 0; i < 3; ++i) {
+      for (unsigned int j = 0; j < 3; ++j) {
+        term[i][j] = next[i][j];
+        p[i][j] += next[i][j];
+      }
+    }
+  }
+  for (unsigned int s = 0; s < n_squarings; ++s) {
+    for (unsigned int i = 0; i < 3; ++i) {
+      for (unsigned int j = 0; j < 3; ++j) {
+        next[i][j] = p[i][0] * p[0][j] + p[i][1] * p[1][j] + p[i][2] * p[2][j];
+      }
+    }
+    for (unsigned int i = 0; i < 3; ++i) {
+      for (unsigned int j = 0; j < 3; ++j) {
+        p[i][j] = next[i][j];
+      }
+    }
+  }
+}
+}
+
+//! for the definition of the gating
+ChannelMarkovGating::ChannelMarkovGating
+( unsigned int n_channels,
+  const Floats &waveform,
+  double interval,
+  double rate,
+  double inactivation_rate,
+  double recovery_rate,
+  unsigned int seed)
+  : Object("ChannelMarkovGating%1%"),
+  states_(n_channels, CLOSED_GATING_STATE),
+  next_states_(n_channels, CLOSED_GATING_STATE),
+  waveform_(waveform),
+  interval_(interval),
+  rate_(rate),
+  inactivation_rate_(inactivation_rate),
+  recovery_rate_(recovery_rate),
+  seed_(seed),
+  n_updates_(0)
+{
+  IMP_USAGE_CHECK(!waveform.empty(), "the waveform must not be empty");
+  IMP_USAGE_CHECK(interval > 0 && rate >= 0 && inactivation_rate >= 0
+                  && recovery_rate >= 0, "the interval and the rates must be positive");
+  for (unsigned int i = 0; i < waveform.size(); ++i) {
+    IMP_USAGE_CHECK(waveform[i] >= 0 && waveform[i] <= 1,
+                    "the drive of the waveform must be in [0, 1]");
+  }
+}
+
+//! advance the states of all channels by one update
+void ChannelMarkovGating::update() {
+  IMP_OBJECT_LOG;
+  double w = get_drive();
+  double dt = interval_;
+  // the transition probabilities of an update, indexed by the gating states
+  double p[3][3];
+  if (inactivation_rate_ == 0 && recovery_rate_ == 0) {
+    double p_relax = -std::expm1(-rate_ * dt);
+    p[CLOSED_GATING_STATE][OPEN_GATING_STATE] = w * p_relax;
+    p[CLOSED_GATING_STATE][INACTIVATED_GATING_STATE] = 0;
+    p[OPEN_GATING_STATE][CLOSED_GATING_STATE] = (1 - w) * p_relax;
+    p[OPEN_GATING_STATE][INACTIVATED_GATING_STATE] = 0;
+    p[INACTIVATED_GATING_STATE][CLOSED_GATING_STATE] = 0;
+    p[INACTIVATED_GATING_STATE][OPEN_GATING_STATE] = 0;
+  } else {
+    // from C: to O; from O: to C, then to I; from I: to C
+    double q[3][3] = {};
+    q[CLOSED_GATING_STATE][OPEN_GATING_STATE] = rate_ * w;
+    q[OPEN_GATING_STATE][CLOSED_GATING_STATE] = rate_ * (1 - w);
+    q[OPEN_GATING_STATE][INACTIVATED_GATING_STATE] = inactivation_rate_;
+    q[INACTIVATED_GATING_STATE][CLOSED_GATING_STATE] = recovery_rate_;
+    for (unsigned int i = 0; i < 3; ++i) {
+      q[i][i] = -(q[i][0] + q[i][1] + q[i][2]);
+    }
+    get_propagator(q, dt, p);
+  }
+  // the first targets are O, C and C; the second targets are I, I and O
+  const double p_c_first = p[CLOSED_GATING_STATE][OPEN_GATING_STATE];
+  const double p_o_first = p[OPEN_GATING_STATE][CLOSED_GATING_STATE];
+  const double p_i_first = p[INACTIVATED_GATING_STATE][CLOSED_GATING_STATE];
+  const std::uint32_t c_first = get_threshold(p_c_first);
+  const std::uint32_t c_second = get_threshold(
+    p_c_first + p[CLOSED_GATING_STATE][INACTIVATED_GATING_STATE]);
+  const std::uint32_t o_first = get_threshold(p_o_first);
+  const std::uint32_t o_second = get_threshold(
+    p_o_first + p[OPEN_GATING_STATE][INACTIVATED_GATING_STATE]);
+  const std::uint32_t i_first = get_threshold(p_i_first);
+  const std::uint32_t i_second = get_threshold(
+    p_i_first + p[INACTIVATED_GATING_STATE][OPEN_GATING_STATE]);
+  const std::uint32_t key = get_mixed(seed_ ^ get_mixed(n_updates_ + 0x9e3779b9u));
+  const std::uint8_t *states = states_.data();
+  std::uint8_t *next = next_states_.data();
+  unsigned int n = states_.size();
+  for (unsigned int i = 0; i < n; ++i) {
+    std::uint32_t s = states[i];
+    std::uint32_t u = get_mixed(key ^ get_mixed(i)); // the counter-based draw
+    std::uint32_t is_c = get_mask(s == CLOSED_GATING_STATE);
+    std::uint32_t is_o = get_mask(s == OPEN_GATING_STATE);
+    std::uint32_t is_i = get_mask(s == INACTIVATED_GATING_STATE);
+    // the thresholds and targets of the state of the channel
+    std::uint32_t first = (c_first & is_c) | (o_first & is_o) | (i_first & is_i);
+    std::uint32_t second = (c_second & is_c) | (o_second & is_o) | (i_second & is_i);
+    std::uint32_t first_target = (OPEN_GATING_STATE & is_c) | (CLOSED_GATING_STATE & is_o)
+                                 | (CLOSED_GATING_STATE & is_i);
+    std::uint32_t second_target = (INACTIVATED_GATING_STATE & is_c)
+                                  | (INACTIVATED_GATING_STATE & is_o)
+                                  | (OPEN_GATING_STATE & is_i);
+    std::uint32_t to_first = get_mask(u < first);
+    std::uint32_t to_second = get_mask(u < second) & ~to_first;
+    next[i] = static_cast<std::uint8_t>((first_target & to_first)
+                                        | (second_target & to_second)
+                                        | (s & ~(to_first | to_second)));
+  }
+  changed_.clear();
+  for (unsigned int i = 0; i < n; ++i) {
+    if ((states[i] == OPEN_GATING_STATE) != (next[i] == OPEN_GATING_STATE)) {
+      changed_.push_back(i);
+    }
+  }
+  states_.swap(next_states_);
+  ++n_updates_;
+  IMP_LOG_TERSE(changed_.size() << " channels changed, drive " << w << std::endl);
+}
+
+//! the stationary distribution of the rates, (b + c) / a closed and c / r inactivated per open
+double ChannelMarkovGating::get_stationary_open_probability(double w) const {
+  if (inactivation_rate_ == 0) {
+    return w;
+  }
+  double k_open = rate_ * w;
+  if (k_open == 0 || recovery_rate_ == 0) {
+    return 0; // the channels end up inactivated
+  }
+  double k_close = rate_ * (1 - w);
+  return 1 / (1 + (k_close + inactivation_rate_) / k_open
+              + inactivation_rate_ / recovery_rate_);
+}
+
+unsigned int ChannelMarkovGating::get_number_of_open_channels() const {
+  return std::count(states_.begin(), states_.end(),
+                    static_cast<std::uint8_t>(OPEN_GATING_STATE));
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,32 @@
+/**
+ *  \file IMP/insulinsecretion/ChannelSiteArray.cpp
+ *  \brief A dense array of Ca2+ channel sites holding only their positions and open/closed states.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/ChannelSiteArray.h>
+#include <algorithm>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the site array
+ChannelSiteArray::ChannelSiteArray
+( const algebra::Vector3Ds &positions,
+  double radius,
+  int state)
+  : Object("ChannelSiteArray%1%"),
+  positions_(positions),
+  states_(positions.size(), state),
+  radius_(radius)
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(radius >= 0, "the site radius must not be negative");
+}
+
+//! returns the number of open sites
+unsigned int ChannelSiteArray::get_number_of_open_sites() const {
+  return std::count(states_.begin(), states_.end(), -1);
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,216 @@
+/**
+ *  \file IMP/insulinsecretion/ChannelSurfaceIndex.cpp
+ *  \brief A static angular index of Ca2+ channel sites on the cell sphere.
+ *
+ * Description:
+ * 1, Ca2+ channels are placed once on the cell membrane and never move.
+ * 2, The cell sphere is divided into equal-area polar bands (uniform in cos(theta)),
+ *    and each band into azimuthal buckets of about the same angular size (HEALPix-like).
+ * 3, Each channel site is stored in every bucket that its angular reach overlaps, so
+ *    the docking candidates of a vesicle are obtained by a single bucket lookup of
+ *    the projected direction of the vesicle center.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/ChannelSurfaceIndex.h>
+#include <IMP/core/XYZR.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+const double PI = 3.14159265358979323846;
+
+//! returns the azimuth of d in [0, 2*pi)
+double get_azimuth(const algebra::Vector3D &d) {
+  double phi = std::atan2(d[1], d[0]);
+  return phi < 0 ? phi + 2 * PI : phi;
+}
+
+//! returns the angular reach of a site at distance r from the cell center
+/** The distance between a site at radius r and any point whose direction
+    makes an angle gamma with the site satisfies d >= r*sin(gamma) for gamma
+    below 90 degrees and d >= r above, so sites farther than asin(reach/r)
+    can never be within reach. */
+double get_angular_reach(double r, double max_reach) {
+  if (max_reach >= r) return PI;
+  return std::asin(max_reach / r);
+}
+}
+
+//! for the definition of the index
+ChannelSurfaceIndex::ChannelSurfaceIndex
+( Model *m,
+  ParticleIndexesAdaptor cachannel,
+  algebra::Sphere3D cell_sphere,
+  double max_reach,
+  unsigned int n_bands)
+  : Object("ChannelSurfaceIndex%1%"),
+  cell_sphere_(cell_sphere),
+  max_reach_(max_reach),
+  n_bands_(n_bands),
+  max_site_radius_(0),
+  min_site_distance_(std::numeric_limits<double>::max())
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(max_reach > 0, "max_reach must be positive");
+  for(ParticleIndex pi : cachannel) {
+    core::XYZR xyzr(m, pi);
+    channels_.push_back(pi);
+    add_site(xyzr.get_coordinates(), xyzr.get_radius());
+  }
+  setup_index();
+}
+
+//! for the definition of the index of a site array
+ChannelSurfaceIndex::ChannelSurfaceIndex
+( ChannelSiteArray *sites,
+  algebra::Sphere3D cell_sphere,
+  double max_reach,
+  unsigned int n_bands)
+  : Object("ChannelSurfaceIndex%1%"),
+  cell_sphere_(cell_sphere),
+  max_reach_(max_reach),
+  n_bands_(n_bands),
+  site_array_(sites),
+  max_site_radius_(0),
+  min_site_distance_(std::numeric_limits<double>::max())
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(max_reach > 0, "max_reach must be positive");
+  for (unsigned int i = 0; i < sites->get_number_of_sites(); ++i) {
+    add_site(sites->get_coordinates(i), sites->get_radius());
+  }
+  setup_index();
+}
+
+//! store a site and update the site extent
+void ChannelSurfaceIndex::add_site(const algebra::Vector3D &center,
+                                   double radius) {
+  sites_.push_back(center);
+  radii_.push_back(radius);
+  max_site_radius_ = std::max(max_site_radius_, radius);
+  min_site_distance_ = std::min(min_site_distance_,
+                                algebra::get_distance(center,
+                                                      cell_sphere_.get_center()));
+}
+
+//! choose the bands and fill the buckets
+void ChannelSurfaceIndex::setup_index() {
+  if (n_bands_ == 0) {
+    // buckets about as wide as the reach of a site on the membrane
+    double alpha = get_angular_reach(cell_sphere_.get_radius(), max_reach_);
+    n_bands_ = std::max(1, std::min(4096, static_cast<int>(std::ceil(2.0 / alpha))));
+  }
+  setup_buckets();
+  for (unsigned int i = 0; i < sites_.size(); ++i) {
+    add_site_to_buckets(i);
+  }
+}
+
+//! set up the bands and buckets
+void ChannelSurfaceIndex::setup_buckets() {
+  band_offsets_.clear();
+  band_sizes_.clear();
+  int offset = 0;
+  for (unsigned int b = 0; b < n_bands_; ++b) {
+    double theta_lo = std::acos(1.0 - 2.0 * b / n_bands_);
+    double theta_hi = std::acos(std::max(-1.0, 1.0 - 2.0 * (b + 1) / n_bands_));
+    double theta_mid = 0.5 * (theta_lo + theta_hi);
+    int n_phi = static_cast<int>(std::floor(2 * PI * std::sin(theta_mid)
+                                            / (theta_hi - theta_lo) + 0.5));
+    n_phi = std::max(1, n_phi);
+    band_offsets_.push_back(offset);
+    band_sizes_.push_back(n_phi);
+    offset += n_phi;
+  }
+  buckets_.assign(offset, Ints());
+}
+
+//! store site i in all buckets overlapping its angular reach
+void ChannelSurfaceIndex::add_site_to_buckets(unsigned int i) {
+  algebra::Vector3D d = sites_[i] - cell_sphere_.get_center();
+  double r = d.get_magnitude();
+  double alpha = get_angular_reach(r, max_reach_);
+  double cos_theta = r > 0 ? std::max(-1.0, std::min(1.0, d[2] / r)) : 1.0;
+  double theta = std::acos(cos_theta);
+  double phi = get_azimuth(d);
+  // the azimuthal spread of a cap is asin(sin(alpha)/sin(theta)) unless it covers a pole
+  double dphi = PI;
+  if (theta > alpha && theta + alpha < PI && std::sin(alpha) < std::sin(theta)) {
+    dphi = std::asin(std::sin(alpha) / std::sin(theta));
+  }
+  unsigned int b0 = get_band(std::cos(std::max(0.0, theta - alpha)));
+  unsigned int b1 = get_band(std::cos(std::min(PI, theta + alpha)));
+  for (unsigned int b = b0; b <= b1; ++b) {
+    int n_phi = band_sizes_[b];
+    double width = 2 * PI / n_phi;
+    int k0 = static_cast<int>(std::floor((phi - dphi) / width));
+    int k1 = static_cast<int>(std::floor((phi + dphi) / width));
+    if (k1 - k0 + 1 >= n_phi) {
+      k0 = 0;
+      k1 = n_phi - 1;
+    }
+    for (int k = k0; k <= k1; ++k) {
+      int kk = ((k % n_phi) + n_phi) % n_phi;
+      buckets_[band_offsets_[b] + kk].push_back(i);
+    }
+  }
+}
+
+//! returns the band of a cos(theta) value
+unsigned int ChannelSurfaceIndex::get_band(double cos_theta) const {
+  int b = static_cast<int>(std::floor(0.5 * (1.0 - cos_theta) * n_bands_));
+  return std::max(0, std::min(static_cast<int>(n_bands_) - 1, b));
+}
+
+//! returns the bucket of an azimuth within a band
+unsigned int ChannelSurfaceIndex::get_bucket_in_band(unsigned int band,
+                                                     double phi) const {
+  int n_phi = band_sizes_[band];
+  int k = static_cast<int>(std::floor(phi / (2 * PI) * n_phi));
+  return band_offsets_[band] + std::max(0, std::min(n_phi - 1, k));
+}
+
+//! returns the bucket that contains the projected direction of v
+unsigned int ChannelSurfaceIndex::get_bucket(const algebra::Vector3D &v) const {
+  algebra::Vector3D d = v - cell_sphere_.get_center();
+  double r = d.get_magnitude();
+  if (r == 0) return 0;
+  return get_bucket_in_band(get_band(d[2] / r), get_azimuth(d));
+}
+
+//! returns the ids of the sites whose surface is within range of the sphere s
+Ints ChannelSurfaceIndex::get_sites_in_contact(const algebra::Sphere3D &s,
+                                               double range) const {
+  IMP_USAGE_CHECK(s.get_radius() + max_site_radius_ + range <= max_reach_,
+                  "query is beyond the max_reach of the index");
+  Ints ret;
+  const Ints &candidates = get_candidate_sites(s.get_center());
+  for (int i : candidates) {
+    double distance = algebra::get_distance(s.get_center(), sites_[i])
+                      - s.get_radius() - radii_[i];
+    if (distance <= range) {
+      ret.push_back(i);
+    }
+  }
+  return ret;
+}
+
+//! returns the channels whose surface is within range of the sphere s
+ParticleIndexes ChannelSurfaceIndex::get_channels_in_contact
+( const algebra::Sphere3D &s, double range) const {
+  IMP_USAGE_CHECK(channels_.size() == sites_.size(),
+                  "the index of a site array has no channel particles");
+  ParticleIndexes ret;
+  for (int i : get_sites_in_contact(s, range)) {
+    ret.push_back(channels_[i]);
+  }
+  return ret;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
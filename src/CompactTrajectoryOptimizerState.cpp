@@ -0,0 +1,290 @@
+/**
+ *  \file IMP/insulinsecretion/CompactTrajectoryOptimizerState.cpp
+ *  \brief An optimizer state that writes a compact, delta-encoded trajectory of the insulin vesicles.
+ *
+ * Description:
+ * 1, The static particles (Ca2+ channels, nucleus) are written once in the header.
+ * 2, Each frame stores the quantized vesicle coordinates as deltas against the previous
+ *    frame and the lifecycle fields that changed since the previous frame.
+ * 3, A frame is first copied into a snapshot of all quantized coordinates and fields, which
+ *    is encoded right away, or later on the thread of an AsyncOutputWriter.
+ *
+ * File layout (integers are varints, signed ones zigzag-encoded):
+ *   header: "IMPISTRJ", version, resolution (double),
+ *           number of static particles, then for each: name, x, y, z, r (doubles), field mask,
+ *           number of vesicles, then for each: name, r (double), field mask
+ *   frame:  'F', frame number, 3 signed coordinate deltas per vesicle,
+ *           then for each field: number of changes, then for each change
+ *           the gap to the previous changed particle and the signed value delta
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/CompactTrajectoryOptimizerState.h>
+#include <IMP/insulinsecretion/CaChannelStateDecorator.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/MaturationStateDecorator.h>
+#include <IMP/insulinsecretion/SecretionCounterDecorator.h>
+#include <IMP/insulinsecretion/internal/compact_trajectory.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/exception.h>
+#include <cmath>
+#include <cstring>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+// the first byte of a frame handed to the writer thread
+const char RAW_FRAME_TAG = 'R'; // encoded bytes, e.g., the header
+const char SNAPSHOT_FRAME_TAG = 'S'; // a snapshot to encode
+
+//! returns the key of a lifecycle field
+IntKey get_field_key(unsigned int f) {
+  switch (f) {
+    case DOCKING_STATE_FIELD: return DockingStateDecorator::get_dstate_key();
+    case MATURATION_STATE_FIELD: return MaturationStateDecorator::get_state_key();
+    case SECRETION_COUNTER_FIELD: return SecretionCounterDecorator::get_secretion_key();
+    default: return CaChannelStateDecorator::get_channelstate_key();
+  }
+}
+}
+
+//! for the definition of the optimizer state
+CompactTrajectoryOptimizerState::CompactTrajectoryOptimizerState
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  ParticleIndexesAdaptor static_particles,
+  std::string file_name,
+  double resolution,
+  unsigned int periodicity)
+  : P(m, "CompactTrajectoryOptimizerState%1%"),
+  vesicles_(vesicles.begin(), vesicles.end()),
+  static_particles_(static_particles.begin(), static_particles.end()),
+  resolution_(resolution),
+  out_(file_name.c_str(), std::ios::binary),
+  n_frames_(0),
+  n_encoded_frames_(0)
+{
+  IMP_OBJECT_LOG;
+  set_period(periodicity);
+  if (!out_) {
+    IMP_THROW("Cannot open compact trajectory file " << file_name, IOException);
+  }
+  initialize();
+  out_.write(buffer_.data(), buffer_.size());
+}
+
+//! for the definition of the optimizer state with a writer thread
+CompactTrajectoryOptimizerState::CompactTrajectoryOptimizerState
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  ParticleIndexesAdaptor static_particles,
+  AsyncOutputWriter *writer,
+  double resolution,
+  unsigned int periodicity)
+  : P(m, "CompactTrajectoryOptimizerState%1%"),
+  vesicles_(vesicles.begin(), vesicles.end()),
+  static_particles_(static_particles.begin(), static_particles.end()),
+  resolution_(resolution),
+  writer_(writer),
+  n_frames_(0),
+  n_encoded_frames_(0)
+{
+  IMP_OBJECT_LOG;
+  set_period(periodicity);
+  initialize();
+  // runs on the writer thread, which alone touches the encoder state
+  writer_->set_formatter([this](const std::string &frame, std::string &out) {
+    if (frame[0] == RAW_FRAME_TAG) {
+      out.append(frame, 1, std::string::npos);
+    } else {
+      encoder_snapshot_.resize((frame.size() - 1) / sizeof(int));
+      std::memcpy(encoder_snapshot_.data(), frame.data() + 1,
+                  encoder_snapshot_.size() * sizeof(int));
+      encode_frame(encoder_snapshot_.data(), out);
+    }
+  });
+  std::string &frame = writer_->begin_frame();
+  frame.assign(1, RAW_FRAME_TAG);
+  frame.append(buffer_);
+  writer_->end_frame();
+}
+
+//! set up the buffers and encode the header
+void CompactTrajectoryOptimizerState::initialize() {
+  IMP_USAGE_CHECK(resolution_ > 0, "resolution must be positive");
+  last_q_.assign(3 * vesicles_.size(), 0);
+  unsigned int n = vesicles_.size() + static_particles_.size();
+  last_values_.assign(n * NUMBER_OF_COMPACT_TRAJECTORY_FIELDS, 0);
+  snapshot_.assign(last_q_.size() + last_values_.size(), 0);
+  for (ParticleIndex pi : vesicles_) {
+    field_masks_.push_back(get_field_mask(pi));
+  }
+  for (ParticleIndex pi : static_particles_) {
+    field_masks_.push_back(get_field_mask(pi));
+  }
+  write_header();
+}
+
+//! returns the lifecycle field f of particle pi
+int CompactTrajectoryOptimizerState::get_field
+( ParticleIndex pi, unsigned int f) const {
+  if (f == MATURATION_STATE_FIELD) {
+    // computed from the birth tick, the attribute is not advanced
+    return MaturationStateDecorator(get_model(), pi).get_state();
+  }
+  return get_model()->get_attribute(get_field_key(f), pi);
+}
+
+//! returns the bit mask of the fields that particle pi carries
+int CompactTrajectoryOptimizerState::get_field_mask
+( ParticleIndex pi) const {
+  int mask = 0;
+  for (unsigned int f = 0; f < NUMBER_OF_COMPACT_TRAJECTORY_FIELDS; ++f) {
+    if (get_model()->get_has_attribute(get_field_key(f), pi)) {
+      mask |= 1 << f;
+    }
+  }
+  return mask;
+}
+
+//! encode the static particles and the vesicle radii
+void CompactTrajectoryOptimizerState::write_header() {
+  Model *m = get_model();
+  buffer_.assign(internal::COMPACT_TRAJECTORY_MAGIC,
+                 sizeof(internal::COMPACT_TRAJECTORY_MAGIC));
+  internal::write_varint(buffer_, internal::COMPACT_TRAJECTORY_VERSION);
+  internal::write_double(buffer_, resolution_);
+  internal::write_varint(buffer_, static_particles_.size());
+  for (unsigned int i = 0; i < static_particles_.size(); ++i) {
+    ParticleIndex pi = static_particles_[i];
+    core::XYZR xyzr(m, pi);
+    internal::write_string(buffer_, m->get_particle_name(pi));
+    for (unsigned int k = 0; k < 3; ++k) {
+      internal::write_double(buffer_, xyzr.get_coordinates()[k]);
+    }
+    internal::write_double(buffer_, xyzr.get_radius());
+    internal::write_varint(buffer_, field_masks_[vesicles_.size() + i]);
+  }
+  internal::write_varint(buffer_, vesicles_.size());
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    ParticleIndex pi = vesicles_[i];
+    internal::write_string(buffer_, m->get_particle_name(pi));
+    internal::write_double(buffer_, core::XYZR(m, pi).get_radius());
+    internal::write_varint(buffer_, field_masks_[i]);
+  }
+}
+
+//! copy the quantized coordinates and the lifecycle fields of the current frame
+void CompactTrajectoryOptimizerState::snapshot_frame(int *snapshot) const {
+  Model *m = get_model();
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    const algebra::Vector3D &v = core::XYZ(m, vesicles_[i]).get_coordinates();
+    for (unsigned int k = 0; k < 3; ++k) {
+      *snapshot++ = static_cast<int>(std::floor(v[k] / resolution_ + 0.5));
+    }
+  }
+  for (unsigned int j = 0; j < field_masks_.size(); ++j) {
+    ParticleIndex pi = j < vesicles_.size() ? vesicles_[j]
+                       : static_particles_[j - vesicles_.size()];
+    for (unsigned int f = 0; f < NUMBER_OF_COMPACT_TRAJECTORY_FIELDS; ++f) {
+      *snapshot++ = (field_masks_[j] & (1 << f)) ? get_field(pi, f) : 0;
+    }
+  }
+}
+
+//! encode the vesicle coordinates and the changed lifecycle fields
+void CompactTrajectoryOptimizerState::encode_frame
+( const int *snapshot, std::string &out) {
+  out.push_back(internal::COMPACT_TRAJECTORY_FRAME_TAG);
+  internal::write_varint(out, n_encoded_frames_);
+  for (unsigned int i = 0; i < last_q_.size(); ++i) {
+    internal::write_signed_varint(out, snapshot[i] - last_q_[i]);
+    last_q_[i] = snapshot[i];
+  }
+  // the fields of the first frame are written against zero
+  const int *values = snapshot + last_q_.size();
+  unsigned int n = field_masks_.size();
+  for (unsigned int f = 0; f < NUMBER_OF_COMPACT_TRAJECTORY_FIELDS; ++f) {
+    // count the changes first, the count precedes them in the file
+    unsigned int n_changes = 0;
+    for (unsigned int j = 0; j < n; ++j) {
+      unsigned int k = j * NUMBER_OF_COMPACT_TRAJECTORY_FIELDS + f;
+      if ((field_masks_[j] & (1 << f)) && values[k] != last_values_[k]) {
+        ++n_changes;
+      }
+    }
+    internal::write_varint(out, n_changes);
+    unsigned int last_j = 0;
+    for (unsigned int j = 0; j < n && n_changes > 0; ++j) {
+      if (!(field_masks_[j] & (1 << f))) continue;
+      unsigned int k = j * NUMBER_OF_COMPACT_TRAJECTORY_FIELDS + f;
+      if (values[k] != last_values_[k]) {
+        internal::write_varint(out, j - last_j);
+        internal::write_signed_varint(out, values[k] - last_values_[k]);
+        last_values_[k] = values[k];
+        last_j = j;
+        --n_changes;
+      }
+    }
+  }
+  ++n_encoded_frames_;
+}
+
+//! write the current frame, or hand its snapshot to the writer thread
+void CompactTrajectoryOptimizerState::write_frame() {
+  snapshot_frame(snapshot_.data());
+  if (writer_) {
+    std::string &frame = writer_->begin_frame();
+    frame.assign(1, SNAPSHOT_FRAME_TAG);
+    frame.append(reinterpret_cast<const char *>(snapshot_.data()),
+                 snapshot_.size() * sizeof(int));
+    writer_->end_frame();
+  } else {
+    buffer_.clear();
+    encode_frame(snapshot_.data(), buffer_);
+    out_.write(buffer_.data(), buffer_.size());
+  }
+  ++n_frames_;
+}
+
+//! update the optimizer state
+void CompactTrajectoryOptimizerState::do_update
+( unsigned int call_num) {
+  IMP_OBJECT_LOG;
+  set_was_used(true);
+  write_frame();
+}
+
+//! flush the file at the end of each optimization run
+void CompactTrajectoryOptimizerState::do_set_is_optimizing
+( bool is_optimizing) {
+  // the writer thread flushes the file whenever its queue empties
+  if (!is_optimizing && !writer_) {
+    out_.flush();
+  }
+}
+
+//! write the queued frames and remove the formatter, which calls into this object
+void CompactTrajectoryOptimizerState::do_destroy() {
+  try {
+    flush();
+  } catch (const IOException &e) {
+    IMP_WARN("Compact trajectory frames lost: " << e.what() << std::endl);
+  }
+  if (writer_) {
+    // the writer may be shared and outlive this object
+    writer_->set_formatter(AsyncOutputWriter::Formatter());
+  }
+}
+
+void CompactTrajectoryOptimizerState::flush() {
+  if (writer_) {
+    writer_->flush();
+  } else {
+    out_.flush();
+  }
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,138 @@
+/**
+ *  \file IMP/insulinsecretion/CompactTrajectoryReader.cpp
+ *  \brief Reads a compact trajectory written by CompactTrajectoryOptimizerState.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/CompactTrajectoryReader.h>
+#include <IMP/insulinsecretion/internal/compact_trajectory.h>
+#include <IMP/exception.h>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the reader
+CompactTrajectoryReader::CompactTrajectoryReader(std::string file_name)
+  : Object("CompactTrajectoryReader%1%"),
+  file_(new internal::MappedFile(file_name)),
+  pos_(file_->get_data()),
+  end_(file_->get_data() + file_->get_size()),
+  resolution_(1.0),
+  frame_(-1)
+{
+  IMP_OBJECT_LOG;
+  read_header(file_name);
+  q_.assign(3 * vesicle_radii_.size(), 0);
+  dq_.assign(q_.size(), 0);
+  values_.assign(field_masks_.size() * NUMBER_OF_COMPACT_TRAJECTORY_FIELDS, 0);
+}
+
+//! read the static particles and the vesicle radii
+void CompactTrajectoryReader::read_header(std::string file_name) {
+  internal::ByteCursor in = {pos_, end_};
+  const std::size_t n_magic = sizeof(internal::COMPACT_TRAJECTORY_MAGIC);
+  std::uint64_t version, n_static, n_vesicles, mask;
+  if (static_cast<std::size_t>(end_ - pos_) < n_magic
+      || std::memcmp(pos_, internal::COMPACT_TRAJECTORY_MAGIC, n_magic) != 0) {
+    IMP_THROW(file_name << " is not a compact trajectory file", IOException);
+  }
+  in.pos += n_magic;
+  if (!internal::read_varint(in, version)
+      || version != internal::COMPACT_TRAJECTORY_VERSION
+      || !internal::read_double(in, resolution_)
+      || !internal::read_varint(in, n_static)) {
+    IMP_THROW(file_name << " is not a compact trajectory file", IOException);
+  }
+  Ints static_masks;
+  for (unsigned int i = 0; i < n_static; ++i) {
+    std::string name;
+    double x[4];
+    bool ok = internal::read_string(in, name);
+    for (unsigned int k = 0; k < 4; ++k) {
+      ok = ok && internal::read_double(in, x[k]);
+    }
+    if (!ok || !internal::read_varint(in, mask)) {
+      IMP_THROW("Truncated header in " << file_name, IOException);
+    }
+    static_names_.push_back(name);
+    static_spheres_.push_back(
+      algebra::Sphere3D(algebra::Vector3D(x[0], x[1], x[2]), x[3]));
+    static_masks.push_back(mask);
+  }
+  if (!internal::read_varint(in, n_vesicles)) {
+    IMP_THROW("Truncated header in " << file_name, IOException);
+  }
+  for (unsigned int i = 0; i < n_vesicles; ++i) {
+    std::string name;
+    double r;
+    if (!internal::read_string(in, name) || !internal::read_double(in, r)
+        || !internal::read_varint(in, mask)) {
+      IMP_THROW("Truncated header in " << file_name, IOException);
+    }
+    vesicle_names_.push_back(name);
+    vesicle_radii_.push_back(r);
+    field_masks_.push_back(mask);
+  }
+  // the vesicles come first, as in the writer
+  field_masks_.insert(field_masks_.end(), static_masks.begin(), static_masks.end());
+  pos_ = in.pos;
+}
+
+//! decode the next frame, applying it only once it has been parsed completely
+bool CompactTrajectoryReader::read_next_frame() {
+  if (pos_ == end_ || *pos_ != internal::COMPACT_TRAJECTORY_FRAME_TAG) {
+    return false;
+  }
+  internal::ByteCursor in = {pos_ + 1, end_};
+  std::uint64_t frame, n_changes, gap;
+  std::int64_t delta;
+  if (!internal::read_varint(in, frame)) return false;
+  for (unsigned int i = 0; i < dq_.size(); ++i) {
+    if (!internal::read_signed_varint(in, delta)) return false;
+    dq_[i] = delta;
+  }
+  changes_.clear();
+  for (unsigned int f = 0; f < NUMBER_OF_COMPACT_TRAJECTORY_FIELDS; ++f) {
+    if (!internal::read_varint(in, n_changes)) return false;
+    std::uint64_t j = 0;
+    for (std::uint64_t c = 0; c < n_changes; ++c) {
+      if (!internal::read_varint(in, gap)
+          || !internal::read_signed_varint(in, delta)) return false;
+      if (gap >= field_masks_.size() - j) {
+        IMP_THROW("Corrupt compact trajectory frame " << frame, IOException);
+      }
+      j += gap;
+      changes_.push_back(std::make_pair(
+        static_cast<unsigned int>(j * NUMBER_OF_COMPACT_TRAJECTORY_FIELDS + f),
+        static_cast<int>(delta)));
+    }
+  }
+  for (unsigned int i = 0; i < q_.size(); ++i) {
+    q_[i] += dq_[i];
+  }
+  for (unsigned int i = 0; i < changes_.size(); ++i) {
+    values_[changes_[i].first] += changes_[i].second;
+  }
+  frame_ = frame;
+  pos_ = in.pos;
+  return true;
+}
+
+//! returns the sphere of vesicle i in the current frame
+algebra::Sphere3D CompactTrajectoryReader::get_vesicle_sphere
+( unsigned int i) const {
+  algebra::Vector3D v(q_[3 * i] * resolution_,
+                      q_[3 * i + 1] * resolution_,
+                      q_[3 * i + 2] * resolution_);
+  return algebra::Sphere3D(v, vesicle_radii_[i]);
+}
+
+int CompactTrajectoryReader::get_value
+( unsigned int j, CompactTrajectoryField field) const {
+  return values_[j * NUMBER_OF_COMPACT_TRAJECTORY_FIELDS + field];
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
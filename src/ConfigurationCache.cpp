@@ -0,0 +1,93 @@
+/**
+ *  \file IMP/insulinsecretion/ConfigurationCache.cpp
+ *  \brief An on-disk cache of equilibrated cell configurations keyed by their parameters.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/ConfigurationCache.h>
+#include <IMP/exception.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+const std::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const std::uint64_t FNV_PRIME = 1099511628211ULL;
+}
+
+//! for the definition of the cache
+ConfigurationCache::ConfigurationCache(std::string directory)
+  : Object("ConfigurationCache%1%"),
+  directory_(directory)
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(!directory.empty(), "the cache directory must not be empty");
+}
+
+//! returns the FNV-1a hash of the parameters as a key
+std::string ConfigurationCache::get_key(const Floats &parameters) {
+  std::uint64_t h = FNV_OFFSET_BASIS;
+  for (unsigned int i = 0; i < parameters.size(); ++i) {
+    // -0 and 0 are the same parameter
+    double d = parameters[i] == 0 ? 0.0 : parameters[i];
+    unsigned char bytes[sizeof(double)];
+    std::memcpy(bytes, &d, sizeof(double));
+    for (unsigned int k = 0; k < sizeof(double); ++k) {
+      h = (h ^ bytes[k]) * FNV_PRIME;
+    }
+  }
+  std::ostringstream oss;
+  oss << std::hex << std::setw(16) << std::setfill('0') << h;
+  return oss.str();
+}
+
+std::string ConfigurationCache::get_file_name(std::string key) const {
+  return directory_ + "/" + key + ".cfg";
+}
+
+bool ConfigurationCache::get_has_configuration(std::string key) const {
+  return std::ifstream(get_file_name(key).c_str()).good();
+}
+
+//! write the entry to a temporary file and rename it
+void ConfigurationCache::store(std::string key, CellSnapshot *snapshot) const {
+  std::string file_name = get_file_name(key);
+  // unique per writer, the runs sharing the cache may be forked from one process
+  std::ostringstream tmp;
+  tmp << file_name << ".tmp" << std::hex << std::random_device()();
+  snapshot->write(tmp.str());
+  if (std::rename(tmp.str().c_str(), file_name.c_str()) != 0) {
+    std::remove(tmp.str().c_str());
+    IMP_THROW("Cannot store configuration " << file_name, IOException);
+  }
+  IMP_LOG_TERSE("stored configuration " << file_name << std::endl);
+}
+
+//! restore and perturb the entry of key, skipping an unreadable one
+bool ConfigurationCache::restore(std::string key, CellSnapshot *snapshot,
+                                 double max_displacement) const {
+  if (!get_has_configuration(key)) {
+    return false;
+  }
+  try {
+    snapshot->read(get_file_name(key));
+  } catch (const IOException &e) {
+    // e.g. truncated or of an older version; it is not removed, since another
+    // run may have renamed a good entry into place since, and store() replaces it
+    IMP_WARN("Skipping configuration: " << e.what() << std::endl);
+    return false;
+  }
+  snapshot->restore();
+  snapshot->perturb(max_displacement);
+  IMP_LOG_TERSE("restored configuration " << get_file_name(key) << std::endl);
+  return true;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -19,6 +19,11 @@ IntKey DockingStateDecorator::get_dstate_key() {
   return k;
 }
 
+IntKey DockingStateDecorator::get_site_key() {
+  static IntKey k("docked_site");
+  return k;
+}
+
 void DockingStateDecorator::show(std::ostream &out) const {
   out << "Docking state " << get_dstate() << std::endl;
 }
@@ -1,3 +1,3 @@
 set(pyfiles "")
-set(cppfiles "CaChannelOpeningOptimizerState.cpp;CaChannelStateDecorator.cpp;DockingStateDecorator.cpp;InsulinSecretionOptimizerState.cpp;MaturationStateDecorator.cpp;RadialDistributionFunctionSingletonScore.cpp;SecretionCounterDecorator.cpp;VesicleDockingOptimizerState.cpp;VesicleTraffickingSingletonScore.cpp")
+set(cppfiles "ActiveSetExcludedVolumeRestraint.cpp;AsyncOutputWriter.cpp;CaChannelOpeningOptimizerState.cpp;CaChannelStateDecorator.cpp;CellGeometryTable.cpp;CellSnapshot.cpp;ChannelMarkovGating.cpp;ChannelSiteArray.cpp;ChannelSurfaceIndex.cpp;CompactTrajectoryOptimizerState.cpp;CompactTrajectoryReader.cpp;ConfigurationCache.cpp;DockingStateDecorator.cpp;InsulinCellLifecycleOptimizerState.cpp;InsulinSecretionOptimizerState.cpp;LifecycleClock.cpp;LifecycleEventScheduler.cpp;MaturationStateDecorator.cpp;MultiCellRadialRestraint.cpp;MultiRateBrownianDynamics.cpp;MultiTauDiffusionOptimizerState.cpp;NeighborExcludedVolumeRestraint.cpp;RadialConcentrationField.cpp;RadialDistributionFunctionSingletonScore.cpp;SecretionCounterDecorator.cpp;SecretionEventLog.cpp;SharedNeighborProvider.cpp;SpatialReorderingOptimizerState.cpp;SteadyStateOptimizerState.cpp;VesicleActiveSet.cpp;VesicleDockingOptimizerState.cpp;VesicleTraffickingSingletonScore.cpp;internal/lifecycle_stages.cpp;internal/mapped_file.cpp;internal/radius_classes.cpp;organelle_factory.cpp")
 set(cudafiles "")
@@ -0,0 +1,88 @@
+/**
+ *  \file IMP/insulinsecretion/InsulinCellLifecycleOptimizerState.cpp
+ *  \brief An optimizer state that runs the Ca2+ channel, docking and secretion passes in one update.
+ *
+ * Description:
+ * 1, Updates the open/closed state of the Ca2+ channels (as CaChannelOpeningOptimizerState).
+ * 2, Docks the insulin vesicles near open Ca2+ channels and releases the ready ones
+ *    (as VesicleDockingOptimizerState).
+ * 3, Advances the maturation and docking states, secretes the ready vesicles and resets
+ *    them near the nucleus (as InsulinSecretionOptimizerState).
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/InsulinCellLifecycleOptimizerState.h>
+#include <IMP/container/ListSingletonContainer.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the optimizer state
+InsulinCellLifecycleOptimizerState::InsulinCellLifecycleOptimizerState
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  ParticleIndexesAdaptor cachannel,
+  algebra::Sphere3D nucleus_sphere,
+  int oscillation,
+  int troughn,
+  int peakn,
+  double contact_range,
+  double slack,
+  int ready_state,
+  double cut_off,
+  unsigned int periodicity)
+  : P(m, "InsulinCellLifecycleOptimizerState%1%"),
+  oscillation_(cachannel, oscillation, troughn, peakn),
+  docking_(new container::ListSingletonContainer(m, vesicles),
+           new container::ListSingletonContainer(m, cachannel),
+           contact_range, slack, ready_state),
+  secretion_(vesicles, nucleus_sphere, ready_state, cut_off),
+  periodicity_(periodicity)
+{
+  IMP_OBJECT_LOG;
+  set_period(periodicity);
+}
+
+//! for the definition of the optimizer state on a channel site array
+InsulinCellLifecycleOptimizerState::InsulinCellLifecycleOptimizerState
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  ChannelSurfaceIndex *channel_index,
+  algebra::Sphere3D nucleus_sphere,
+  int oscillation,
+  int troughn,
+  int peakn,
+  double contact_range,
+  int ready_state,
+  double cut_off,
+  unsigned int periodicity)
+  : P(m, "InsulinCellLifecycleOptimizerState%1%"),
+  oscillation_(ParticleIndexes(), oscillation, troughn, peakn),
+  docking_(new container::ListSingletonContainer(m, vesicles),
+           channel_index, contact_range, ready_state),
+  secretion_(vesicles, nucleus_sphere, ready_state, cut_off),
+  periodicity_(periodicity)
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(channel_index->get_site_array(),
+                  "the channel index must be built on a ChannelSiteArray");
+  set_period(periodicity);
+  oscillation_.set_sites(channel_index->get_site_array());
+}
+
+//! update the optimizer state
+void InsulinCellLifecycleOptimizerState::do_update
+( unsigned int call_num) {
+  IMP_OBJECT_LOG;
+  set_was_used(true);
+  docking_.advance_clock(get_period());
+  secretion_.advance_clock(get_period());
+  Model *m = get_model();
+  // same order as adding the three separate optimizer states
+  oscillation_.update(m);
+  docking_.update(m);
+  secretion_.update(m);
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
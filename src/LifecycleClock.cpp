@@ -0,0 +1,37 @@
+/**
+ *  \file IMP/insulinsecretion/LifecycleClock.cpp
+ *  \brief The number of secretion passes of a model, from which the maturation states are computed.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/LifecycleClock.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the clock
+LifecycleClock::LifecycleClock()
+  : Object("LifecycleClock%1%"),
+  tick_(0)
+{}
+
+ModelKey LifecycleClock::get_key() {
+  static ModelKey k("lifecycle clock");
+  return k;
+}
+
+//! returns the clock of a model, creating it at tick 0 if needed
+LifecycleClock *LifecycleClock::get_clock(Model *m) {
+  if (!m->get_has_data(get_key())) {
+    m->add_data(get_key(), new LifecycleClock());
+  }
+  return static_cast<LifecycleClock *>(m->get_data(get_key()));
+}
+
+//! returns the current tick of the clock of a model, 0 if it has none
+int LifecycleClock::get_tick(Model *m) {
+  return m->get_has_data(get_key())
+         ? static_cast<LifecycleClock *>(m->get_data(get_key()))->get_tick() : 0;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,92 @@
+/**
+ *  \file IMP/insulinsecretion/LifecycleEventScheduler.cpp
+ *  \brief An optimizer state that schedules vesicle and Ca2+ channel lifecycle events on a timing wheel.
+ *
+ * Description:
+ * 1, Each update of this optimizer state advances the lifecycle clock by one tick.
+ * 2, Other optimizer states enqueue events a number of ticks ahead, e.g., the docking
+ *    state enqueues the undocking/secretion of a vesicle at t + ready_state and the
+ *    Ca2+ channel oscillator enqueues its next phase flip.
+ * 3, Events are stored in the slot (due tick mod wheel size) of a timing wheel, so each
+ *    consumer only visits the events of the current slot instead of scanning all
+ *    vesicles and channels every period.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/LifecycleEventScheduler.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the optimizer state
+LifecycleEventScheduler::LifecycleEventScheduler
+( Model *m,
+  unsigned int periodicity,
+  unsigned int wheel_size)
+  : P(m, "LifecycleEventScheduler%1%"),
+  tick_(0),
+  n_pending_(0)
+{
+  IMP_OBJECT_LOG;
+  set_period(periodicity);
+  unsigned int size = 1;
+  while (size < wheel_size) {
+    size <<= 1;
+  }
+  wheel_.resize(size);
+  mask_ = size - 1;
+}
+
+//! update the optimizer state
+void LifecycleEventScheduler::do_update
+( unsigned int call_num) {
+  IMP_OBJECT_LOG;
+  set_was_used(true);
+  ++tick_;
+}
+
+//! enqueue an event delay ticks ahead of the current tick
+void LifecycleEventScheduler::schedule
+( unsigned int delay,
+  LifecycleEventType type,
+  ParticleIndex vesicle,
+  ParticleIndex channel) {
+  LifecycleEvent event;
+  event.due = tick_ + delay;
+  event.type = type;
+  event.vesicle = vesicle;
+  event.channel = channel;
+  wheel_[event.due & mask_].push_back(event);
+  ++n_pending_;
+}
+
+//! remove and return the events of the given type that are due
+LifecycleEvents LifecycleEventScheduler::pop_due_events
+( LifecycleEventType type) {
+  LifecycleEvents ret;
+  std::vector<LifecycleEvent> &slot = wheel_[tick_ & mask_];
+  // events of other types or later revolutions stay in the slot
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < slot.size(); ++i) {
+    if (slot[i].type == type && slot[i].due <= tick_) {
+      ret.push_back(slot[i]);
+    } else {
+      slot[kept++] = slot[i];
+    }
+  }
+  slot.resize(kept);
+  n_pending_ -= ret.size();
+  return ret;
+}
+
+//! drop all pending events and restart the clock at zero
+void LifecycleEventScheduler::clear() {
+  for (unsigned int i = 0; i < wheel_.size(); ++i) {
+    wheel_[i].clear();
+  }
+  tick_ = 0;
+  n_pending_ = 0;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -19,6 +19,24 @@ IntKey MaturationStateDecorator::get_state_key() {
   return k;
 }
 
+IntKey MaturationStateDecorator::get_birth_key() {
+  static IntKey k("maturation birth");
+  return k;
+}
+
+//! Write the current state of each vesicle to its "state" attribute
+void MaturationStateDecorator::update_states
+( Model *m, ParticleIndexesAdaptor vesicles) {
+  int tick = LifecycleClock::get_tick(m);
+  IntKey sk = get_state_key();
+  IntKey bk = get_birth_key();
+  for (ParticleIndex pi : vesicles) {
+    if (m->get_has_attribute(bk, pi)) {
+      m->set_attribute(sk, pi, tick - m->get_attribute(bk, pi));
+    }
+  }
+}
+
 void MaturationStateDecorator::show(std::ostream &out) const {
   out << "Maturation state " << get_state() << std::endl;
 }
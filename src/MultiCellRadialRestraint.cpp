@@ -0,0 +1,180 @@
+/**
+ *  \file IMP/insulinsecretion/MultiCellRadialRestraint.cpp
+ *  \brief The radial scores of the vesicles of all cells of an islet, evaluated in parallel.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/MultiCellRadialRestraint.h>
+#include <IMP/core/XYZR.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+// fewer vesicles per thread are not worth starting a thread
+const unsigned int MIN_VESICLES_PER_THREAD = 1024;
+}
+
+//! for the definition of the restraint
+MultiCellRadialRestraint::MultiCellRadialRestraint
+( SingletonContainerAdaptor vesicles,
+  CellGeometryTable *cells,
+  RadialDistributionFunctionSingletonScore *rdf,
+  VesicleTraffickingSingletonScore *traffic,
+  unsigned int n_threads,
+  std::string name)
+  : Restraint(vesicles->get_model(), name),
+  vesicles_(vesicles),
+  cells_(cells),
+  rdf_(rdf),
+  traffic_(traffic),
+  n_threads_(n_threads),
+  single_precision_(false)
+{}
+
+//! resize the float arrays, keeping their capacity
+void MultiCellRadialRestraint::SingleBuffers::resize(unsigned int n) {
+  for (std::vector<float> *v : {&dx, &dy, &dz, &r_min, &s_max, &valid, &score, &g}) {
+    v->resize(n);
+  }
+}
+
+//! the score of the vesicles in [begin, end)
+double MultiCellRadialRestraint::evaluate_range
+( const ParticleIndexes &vesicles,
+  unsigned int begin,
+  unsigned int end,
+  DerivativeAccumulator *da) const {
+  Model *m = get_model();
+  double ret = 0;
+  for (unsigned int i = begin; i < end; ++i) {
+    int cell = cells_->get_cell(vesicles[i]);
+    if (cell < 0) {
+      continue;
+    }
+    algebra::Sphere3D cell_sphere = cells_->get_cell_sphere(cell);
+    ret += rdf_->evaluate_in_cell(m, vesicles[i], cell_sphere,
+                                  cells_->get_nucleus_sphere(cell), da);
+    if (traffic_) {
+      ret += traffic_->evaluate_at_center(m, vesicles[i], cell_sphere.get_center(), da);
+    }
+  }
+  return ret;
+}
+
+//! the score of the vesicles in [begin, end), gathered into the float arrays of buffers
+double MultiCellRadialRestraint::evaluate_range_single
+( const ParticleIndexes &vesicles,
+  unsigned int begin,
+  unsigned int end,
+  DerivativeAccumulator *da,
+  SingleBuffers &buffers) const {
+  Model *m = get_model();
+  unsigned int n = end - begin;
+  buffers.resize(n);
+  float *dx = buffers.dx.data(), *dy = buffers.dy.data(), *dz = buffers.dz.data();
+  float *r_min = buffers.r_min.data(), *s_max = buffers.s_max.data();
+  float *valid = buffers.valid.data(), *score = buffers.score.data(), *g = buffers.g.data();
+  // gather: positions relative to the cell center are taken in double so that
+  // large islet coordinates do not lose the float mantissa
+  for (unsigned int i = 0; i < n; ++i) {
+    ParticleIndex pi = vesicles[begin + i];
+    int cell = cells_->get_cell(pi);
+    if (cell < 0) {
+      dx[i] = 1; dy[i] = dz[i] = r_min[i] = s_max[i] = valid[i] = 0;
+      continue;
+    }
+    core::XYZR xyzr(m, pi);
+    algebra::Sphere3D cell_sphere = cells_->get_cell_sphere(cell);
+    double Rnucleus = cells_->get_nucleus_sphere(cell).get_radius();
+    double Rgranule = xyzr.get_radius();
+    algebra::Vector3D d = xyzr.get_coordinates() - cell_sphere.get_center();
+    dx[i] = d[0];
+    dy[i] = d[1];
+    dz[i] = d[2];
+    r_min[i] = Rnucleus + Rgranule;
+    s_max[i] = cell_sphere.get_radius() - Rnucleus - 2 * Rgranule;
+    valid[i] = 1;
+  }
+  // compute: branch-free so that the loop vectorizes
+  Floats poly_param = rdf_->get_poly_param();
+  const float k = rdf_->get_k();
+  const float p0 = poly_param[0], p1 = poly_param[1], p2 = poly_param[2],
+              p3 = poly_param[3], p4 = poly_param[4], p5 = poly_param[5];
+  const float kt = traffic_ ? traffic_->get_k() : 0;
+  for (unsigned int i = 0; i < n; ++i) {
+    float r = std::sqrt(dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]);
+    float s = r - r_min[i];
+    float in_range = (s >= 0 && s <= s_max[i]) ? valid[i] : 0.f;
+    float poly = ((((p0 * s + p1) * s + p2) * s + p3) * s + p4) * s + p5;
+    float dpoly = (((5 * p0 * s + 4 * p1) * s + 3 * p2) * s + 2 * p3) * s + p4;
+    score[i] = in_range * k * poly - valid[i] * kt * r;
+    g[i] = (in_range * k * dpoly - valid[i] * kt) / (r > 0 ? r : 1.f);
+  }
+  // scatter: the score is summed in double
+  double ret = 0;
+  for (unsigned int i = 0; i < n; ++i) {
+    ret += score[i];
+  }
+  if (da) {
+    for (unsigned int i = 0; i < n; ++i) {
+      if (valid[i] != 0) {
+        core::XYZ(m, vesicles[begin + i]).add_to_derivatives(
+            algebra::Vector3D(g[i] * dx[i], g[i] * dy[i], g[i] * dz[i]), *da);
+      }
+    }
+  }
+  return ret;
+}
+
+//! sum the scores of contiguous ranges of vesicles computed by the threads
+double MultiCellRadialRestraint::unprotected_evaluate
+( DerivativeAccumulator *da ) const {
+  ParticleIndexes vesicles = vesicles_->get_contents();
+  unsigned int n_threads = n_threads_;
+  if (n_threads == 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  n_threads = std::max(1u, std::min<unsigned int>(
+      n_threads, vesicles.size() / MIN_VESICLES_PER_THREAD));
+  if (single_precision_ && single_buffers_.size() < n_threads) {
+    single_buffers_.resize(n_threads); // before the threads, each uses its own
+  }
+  if (n_threads == 1) {
+    return single_precision_
+             ? evaluate_range_single(vesicles, 0, vesicles.size(), da, single_buffers_[0])
+             : evaluate_range(vesicles, 0, vesicles.size(), da);
+  }
+  std::vector<double> scores(n_threads, 0);
+  std::vector<std::thread> threads;
+  unsigned int chunk = (vesicles.size() + n_threads - 1) / n_threads;
+  for (unsigned int t = 0; t < n_threads; ++t) {
+    unsigned int begin = std::min<unsigned int>(t * chunk, vesicles.size());
+    unsigned int end = std::min<unsigned int>(begin + chunk, vesicles.size());
+    threads.push_back(std::thread([this, &vesicles, &scores, t, begin, end, da]() {
+      scores[t] = single_precision_
+                    ? evaluate_range_single(vesicles, begin, end, da, single_buffers_[t])
+                    : evaluate_range(vesicles, begin, end, da);
+    }));
+  }
+  double ret = 0;
+  for (unsigned int t = 0; t < n_threads; ++t) {
+    threads[t].join();
+    ret += scores[t];
+  }
+  return ret;
+}
+
+//! the vesicles and their container
+ModelObjectsTemp MultiCellRadialRestraint::do_get_inputs() const {
+  Model *m = get_model();
+  ModelObjectsTemp ret = IMP::get_particles(m, vesicles_->get_all_possible_indexes());
+  ret.push_back(vesicles_);
+  return ret;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,168 @@
+/**
+ *  \file IMP/insulinsecretion/MultiRateBrownianDynamics.cpp
+ *  \brief Brownian dynamics that advances the vesicles in the bulk of the cytoplasm with a large time step.
+ *
+ * Description:
+ * 1, Over a coarse step dt the radial force F of a bulk vesicle is taken as constant, for which
+ *    the BD propagator is exactly Gaussian: mean D dt F / kT and variance 2 D dt per coordinate.
+ * 2, The bulk vesicles are advanced after the fine step that ends a coarse step, so after that
+ *    frame all particles are at the same time when the optimizer states are updated.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/MultiRateBrownianDynamics.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/atom/Diffusion.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/random.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the simulator
+MultiRateBrownianDynamics::MultiRateBrownianDynamics
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  RadialDistributionFunctionSingletonScore *rdf,
+  VesicleTraffickingSingletonScore *traffic,
+  double fine_distance,
+  unsigned int n_substeps,
+  std::string name)
+  : atom::BrownianDynamics(m, name),
+  vesicles_(vesicles.begin(), vesicles.end()),
+  rdf_(rdf),
+  traffic_(traffic),
+  fine_distance_(fine_distance),
+  contact_range_(0),
+  n_substeps_(n_substeps),
+  n_steps_(0),
+  elapsed_(0)
+{
+  IMP_USAGE_CHECK(n_substeps_ > 0, "n_substeps must be positive");
+  IMP_USAGE_CHECK(fine_distance_ >= 0, "fine_distance must not be negative");
+  int max_index = 0;
+  for (ParticleIndex pi : vesicles_) {
+    max_index = std::max(max_index, pi.get_index());
+  }
+  is_bulk_.resize(max_index + 1, 0);
+  fine_ = new container::ListSingletonContainer(m, vesicles_, "FineVesicles%1%");
+  update_bulk();
+}
+
+//! returns the contact range plus 3 rms displacements of a coarse step
+double MultiRateBrownianDynamics::get_minimum_fine_distance
+( double contact_range,
+  double diffusion_coefficient,
+  double time_step,
+  unsigned int n_substeps) {
+  return contact_range
+         + 3 * std::sqrt(2 * diffusion_coefficient * n_substeps * time_step);
+}
+
+//! classify the vesicles as bulk or fine from their positions
+void MultiRateBrownianDynamics::update_bulk() {
+  Model *m = get_model();
+  algebra::Sphere3D cell_sphere = rdf_->get_cell_sphere();
+  double r_nucleus = rdf_->get_nucleus_sphere().get_radius();
+  for (ParticleIndex pi : bulk_) {
+    is_bulk_[pi.get_index()] = 0;
+  }
+  bulk_.clear();
+  ParticleIndexes fine;
+  for (ParticleIndex pi : vesicles_) {
+    core::XYZR xyzr(m, pi);
+    double r = algebra::get_distance(xyzr.get_coordinates(), cell_sphere.get_center());
+    // docked vesicles are at the membrane anyway, frozen ones are not simulated
+    bool bulk = xyzr.get_coordinates_are_optimized()
+                && DockingStateDecorator(m, pi).get_dstate() == 0
+                && cell_sphere.get_radius() - r - xyzr.get_radius() > fine_distance_
+                && r - r_nucleus - xyzr.get_radius() > fine_distance_;
+    if (bulk) {
+      is_bulk_[pi.get_index()] = 1;
+      bulk_.push_back(pi);
+    } else {
+      fine.push_back(pi);
+    }
+  }
+  fine_->set(fine);
+  IMP_LOG_TERSE(bulk_.size() << " bulk and " << fine.size()
+                << " fine vesicles" << std::endl);
+}
+
+//! advance the bulk vesicles by a time dt
+void MultiRateBrownianDynamics::advance_bulk(double dt) {
+  Model *m = get_model();
+  algebra::Vector3D center = rdf_->get_cell_sphere().get_center();
+  double kt = get_kt();
+  double k_traffic = traffic_ ? traffic_->get_k() : 0;
+  std::normal_distribution<double> normal(0, 1);
+  for (ParticleIndex pi : bulk_) {
+    core::XYZR xyzr(m, pi);
+    algebra::Vector3D v = xyzr.get_coordinates();
+    algebra::Vector3D dv = v - center;
+    double r = dv.get_magnitude();
+    double D = atom::Diffusion(m, pi).get_diffusion_coefficient();
+    // the trafficking score is -k r, so its radial derivative is -k
+    double dudr = rdf_->get_radial_derivative(r, xyzr.get_radius()) - k_traffic;
+    double sigma = std::sqrt(2 * D * dt);
+    algebra::Vector3D noise(sigma * normal(random_number_generator),
+                            sigma * normal(random_number_generator),
+                            sigma * normal(random_number_generator));
+    if (r > 0) {
+      noise += dv * (-D * dt * dudr / (kt * r));
+    }
+    xyzr.set_coordinates(v + noise);
+  }
+}
+
+//! classify the vesicles at the start of a run
+void MultiRateBrownianDynamics::setup(const ParticleIndexes &ps) {
+  atom::BrownianDynamics::setup(ps);
+  // the largest rms displacement of a coarse step must stay within fine_distance
+  double max_d = 0;
+  for (ParticleIndex pi : vesicles_) {
+    max_d = std::max(max_d, atom::Diffusion(get_model(), pi).get_diffusion_coefficient());
+  }
+  double min_distance = get_minimum_fine_distance(contact_range_, max_d,
+                                                  get_maximum_time_step(), n_substeps_);
+  IMP_USAGE_CHECK(fine_distance_ >= min_distance,
+                  "fine_distance " << fine_distance_ << " A is below the contact range"
+                  << " plus 3 rms displacements of a coarse step, " << min_distance
+                  << " A, so bulk vesicles can jump into the docking range");
+  if (n_steps_ > 0) {
+    // the last run did not end on a coarse step
+    advance_bulk(elapsed_);
+  }
+  n_steps_ = 0;
+  elapsed_ = 0;
+  update_bulk();
+}
+
+//! advance the fine particles, and the bulk vesicles every n_substeps steps
+double MultiRateBrownianDynamics::do_step
+( const ParticleIndexes &ps,
+  double dt) {
+  ParticleIndexes fine;
+  fine.reserve(ps.size());
+  for (ParticleIndex pi : ps) {
+    if (pi.get_index() >= static_cast<int>(is_bulk_.size())
+        || !is_bulk_[pi.get_index()]) {
+      fine.push_back(pi);
+    }
+  }
+  double ret = atom::BrownianDynamics::do_step(fine, dt);
+  elapsed_ += ret;
+  if (++n_steps_ == n_substeps_) {
+    advance_bulk(elapsed_);
+    n_steps_ = 0;
+    elapsed_ = 0;
+    update_bulk();
+  }
+  return ret;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
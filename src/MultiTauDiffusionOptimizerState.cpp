@@ -0,0 +1,243 @@
+/**
+ *  \file IMP/insulinsecretion/MultiTauDiffusionOptimizerState.cpp
+ *  \brief An optimizer state that estimates the mean-squared displacement of vesicles with a multi-tau correlator.
+ *
+ * Description:
+ * 1, Level l of the correlator of a vesicle receives every 2^l-th position sampled since
+ *    the vesicle was last reset and keeps the last p of them in a ring.
+ * 2, A position stored at level l is compared with the k-th previous position of that level,
+ *    i.e., lag k*2^l; above level 0 only k >= p/2 is used, as shorter lags are covered
+ *    more often by the level below.
+ * 3, set_order() moves the arrays of each vesicle as blocks, so a permutation keeps the
+ *    history of every vesicle and only changes where it is stored.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/MultiTauDiffusionOptimizerState.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/SecretionCounterDecorator.h>
+#include <IMP/core/XYZ.h>
+#include <algorithm>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+//! move block from[s] of v to block s, blocks of size block
+template <class Vector>
+void permute_blocks(Vector &v, const std::vector<unsigned int> &from,
+                    unsigned int block) {
+  if (v.empty()) {
+    return;
+  }
+  Vector permuted(v.size());
+  for (unsigned int s = 0; s < from.size(); ++s) {
+    std::copy(v.begin() + from[s] * block, v.begin() + (from[s] + 1) * block,
+              permuted.begin() + s * block);
+  }
+  v.swap(permuted);
+}
+}
+
+//! for the definition of the optimizer state
+MultiTauDiffusionOptimizerState::MultiTauDiffusionOptimizerState
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  double time_step,
+  unsigned int n_per_level,
+  unsigned int n_levels,
+  unsigned int periodicity,
+  bool single_precision)
+  : P(m, "MultiTauDiffusionOptimizerState%1%"),
+  vesicles_(vesicles.begin(), vesicles.end()),
+  time_step_(time_step),
+  n_per_level_(n_per_level),
+  n_levels_(n_levels)
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(n_per_level >= 2 && n_per_level % 2 == 0,
+                  "n_per_level must be even and at least 2");
+  IMP_USAGE_CHECK(n_levels >= 1 && n_levels <= 31, "n_levels must be in [1, 31]");
+  set_period(periodicity);
+  lag_index_.assign(n_levels_ * n_per_level_, -1);
+  for (unsigned int l = 0; l < n_levels_; ++l) {
+    for (unsigned int k = (l == 0 ? 1 : n_per_level_ / 2); k < n_per_level_; ++k) {
+      lag_index_[l * n_per_level_ + k] = lags_.size();
+      lags_.push_back(k << l);
+    }
+  }
+  if (single_precision) {
+    history_single_.resize(3 * n_per_level_ * n_levels_ * vesicles_.size());
+  } else {
+    history_.resize(3 * n_per_level_ * n_levels_ * vesicles_.size());
+  }
+  lengths_.resize(n_levels_ * vesicles_.size());
+  heads_.resize(n_levels_ * vesicles_.size());
+  n_samples_.resize(vesicles_.size());
+  last_secretion_.resize(vesicles_.size());
+  update_slots();
+  clear();
+}
+
+//! map the particle index of each vesicle to its slot
+void MultiTauDiffusionOptimizerState::update_slots() {
+  int max_index = -1;
+  for (ParticleIndex pi : vesicles_) {
+    max_index = std::max(max_index, pi.get_index());
+  }
+  slots_.assign(max_index + 1, -1);
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    slots_[vesicles_[i].get_index()] = i;
+  }
+}
+
+//! permute the per-vesicle arrays to the given order
+void MultiTauDiffusionOptimizerState::set_order(ParticleIndexesAdaptor order) {
+  std::vector<unsigned int> from; // the old slot of each new slot
+  std::vector<bool> placed(vesicles_.size(), false);
+  for (ParticleIndex pi : order) {
+    if (pi.get_index() < static_cast<int>(slots_.size())) {
+      int slot = slots_[pi.get_index()];
+      if (slot >= 0 && !placed[slot]) {
+        from.push_back(slot);
+        placed[slot] = true;
+      }
+    }
+  }
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    if (!placed[i]) {
+      from.push_back(i);
+    }
+  }
+  permute_blocks(vesicles_, from, 1);
+  permute_blocks(history_, from, 3 * n_per_level_ * n_levels_);
+  permute_blocks(history_single_, from, 3 * n_per_level_ * n_levels_);
+  permute_blocks(lengths_, from, n_levels_);
+  permute_blocks(heads_, from, n_levels_);
+  permute_blocks(n_samples_, from, 1);
+  permute_blocks(last_secretion_, from, 1);
+  update_slots();
+}
+
+//! returns the positions sampled since the vesicle was last reset or docked
+unsigned int MultiTauDiffusionOptimizerState::get_number_of_samples
+( ParticleIndex pi) const {
+  IMP_USAGE_CHECK(pi.get_index() < static_cast<int>(slots_.size())
+                  && slots_[pi.get_index()] >= 0,
+                  "particle is not a followed vesicle");
+  return n_samples_[slots_[pi.get_index()]];
+}
+
+//! update the optimizer state
+void MultiTauDiffusionOptimizerState::do_update
+( unsigned int call_num) {
+  IMP_OBJECT_LOG;
+  set_was_used(true);
+  Model *m = get_model();
+  IntKey dk = DockingStateDecorator::get_dstate_key();
+  IntKey sk = SecretionCounterDecorator::get_secretion_key();
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    ParticleIndex pi = vesicles_[i];
+    bool docked = m->get_has_attribute(dk, pi) && m->get_attribute(dk, pi) != 0;
+    int secretion = m->get_has_attribute(sk, pi) ? m->get_attribute(sk, pi) : 0;
+    if (docked || secretion != last_secretion_[i]) {
+      // a docked vesicle does not diffuse and a secreted one was moved to the nucleus
+      clear_vesicle(i);
+      last_secretion_[i] = secretion;
+      if (docked) continue;
+    }
+    if (history_single_.empty()) {
+      add_sample(history_, i, core::XYZ(m, pi).get_coordinates());
+    } else {
+      add_sample(history_single_, i, core::XYZ(m, pi).get_coordinates());
+    }
+  }
+}
+
+//! drop the stored positions of vesicle i
+void MultiTauDiffusionOptimizerState::clear_vesicle(unsigned int i) {
+  for (unsigned int l = 0; l < n_levels_; ++l) {
+    lengths_[i * n_levels_ + l] = 0;
+    heads_[i * n_levels_ + l] = 0;
+  }
+  n_samples_[i] = 0;
+}
+
+//! store a position of vesicle i and accumulate its displacements
+template <class T>
+void MultiTauDiffusionOptimizerState::add_sample
+( std::vector<T> &history, unsigned int i, const algebra::Vector3D &v) {
+  unsigned int n = n_samples_[i]++;
+  for (unsigned int l = 0; l < n_levels_; ++l) {
+    if (n & ((1u << l) - 1)) break; // not a multiple of 2^l
+    unsigned int li = i * n_levels_ + l;
+    T *ring = &history[3 * n_per_level_ * li];
+    for (unsigned int k = 1; k < static_cast<unsigned int>(lengths_[li]) + 1
+                             && k < n_per_level_; ++k) {
+      int index = lag_index_[l * n_per_level_ + k];
+      if (index < 0) continue;
+      const T *x = ring + 3 * ((heads_[li] + n_per_level_ + 1 - k) % n_per_level_);
+      double d2 = 0;
+      for (unsigned int c = 0; c < 3; ++c) {
+        d2 += (v[c] - x[c]) * (v[c] - x[c]);
+      }
+      msd_sum_[index] += d2;
+      msd_count_[index] += 1;
+    }
+    heads_[li] = (heads_[li] + 1) % n_per_level_;
+    T *slot = ring + 3 * heads_[li];
+    for (unsigned int c = 0; c < 3; ++c) {
+      slot[c] = v[c];
+    }
+    if (lengths_[li] < static_cast<int>(n_per_level_)) ++lengths_[li];
+  }
+}
+
+//! returns the lag times in fs
+Floats MultiTauDiffusionOptimizerState::get_lag_times() const {
+  Floats ret;
+  for (int lag : lags_) {
+    ret.push_back(lag * get_period() * time_step_);
+  }
+  return ret;
+}
+
+//! returns the mean-squared displacement at each lag time
+Floats MultiTauDiffusionOptimizerState::get_mean_squared_displacements() const {
+  Floats ret;
+  for (unsigned int j = 0; j < lags_.size(); ++j) {
+    ret.push_back(msd_count_[j] > 0 ? msd_sum_[j] / msd_count_[j] : 0);
+  }
+  return ret;
+}
+
+//! returns the apparent diffusion coefficient
+double MultiTauDiffusionOptimizerState::get_diffusion_coefficient
+( double min_time,
+  double max_time) const {
+  Floats times = get_lag_times();
+  Floats msd = get_mean_squared_displacements();
+  double sum_xt = 0, sum_tt = 0;
+  for (unsigned int j = 0; j < lags_.size(); ++j) {
+    if (msd_count_[j] == 0 || times[j] < min_time || times[j] > max_time) continue;
+    sum_xt += msd[j] * times[j];
+    sum_tt += times[j] * times[j];
+  }
+  return sum_tt > 0 ? sum_xt / (6 * sum_tt) : 0;
+}
+
+//! drop all stored positions and accumulated displacements
+void MultiTauDiffusionOptimizerState::clear() {
+  Model *m = get_model();
+  IntKey sk = SecretionCounterDecorator::get_secretion_key();
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    clear_vesicle(i);
+    last_secretion_[i] = m->get_has_attribute(sk, vesicles_[i])
+                         ? m->get_attribute(sk, vesicles_[i]) : 0;
+  }
+  msd_sum_.assign(lags_.size(), 0);
+  msd_count_.assign(lags_.size(), 0);
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,48 @@
+/**
+ *  \file IMP/insulinsecretion/NeighborExcludedVolumeRestraint.cpp
+ *  \brief An excluded volume restraint over the candidate pairs of a SharedNeighborProvider.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/NeighborExcludedVolumeRestraint.h>
+#include <IMP/core/SoftSpherePairScore.h>
+#include <IMP/core/rigid_bodies.h>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the restraint
+NeighborExcludedVolumeRestraint::NeighborExcludedVolumeRestraint
+( SharedNeighborProvider *neighbors,
+  double k,
+  std::string name)
+  : Restraint(neighbors->get_model(), name),
+  neighbors_(neighbors),
+  score_(new core::SoftSpherePairScore(k))
+{}
+
+//! sum the soft sphere score over the candidate pairs
+double NeighborExcludedVolumeRestraint::unprotected_evaluate
+( DerivativeAccumulator *da ) const {
+  Model *m = get_model();
+  double ret = 0;
+  for (const ParticleIndexPair &pip : neighbors_->get_candidate_pairs()) {
+    if (core::RigidMember::get_is_setup(m, pip[0])
+        && core::RigidMember::get_is_setup(m, pip[1])
+        && core::RigidMember(m, pip[0]).get_rigid_body().get_particle_index()
+           == core::RigidMember(m, pip[1]).get_rigid_body().get_particle_index()) {
+      continue; // rigid within the same body
+    }
+    ret += score_->evaluate_index(m, pip, da);
+  }
+  return ret;
+}
+
+//! the shared close pair list and the particles it may contain
+ModelObjectsTemp NeighborExcludedVolumeRestraint::do_get_inputs() const {
+  ModelObjectsTemp ret = neighbors_->get_inputs();
+  ret.push_back(neighbors_);
+  return ret;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,246 @@
+/**
+ *  \file IMP/insulinsecretion/RadialConcentrationField.cpp
+ *  \brief An optimizer state that represents the vesicles deep in the cytoplasm as a radial concentration field.
+ *
+ * Description:
+ * 1, The field between the nucleus and the field radius is divided into shells of equal width.
+ * 2, The flux between the centers of two shells is the Scharfetter-Gummel flux
+ *    J = D / h * (B(dW) c_i - B(-dW) c_i+1), B(x) = x / (e^x - 1), with the densities c and the
+ *    radial score W in kT, which is exact for a linear potential between the centers.
+ * 3, The counts are stepped explicitly, with substeps short enough that no shell loses
+ *    more than half of its vesicles in one substep, so the counts stay positive.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/RadialConcentrationField.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/internal/radius_classes.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/algebra/vector_generators.h>
+#include <IMP/constants.h>
+#include <IMP/random.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+// the ratio of the largest to the smallest radius of a radius class of the field
+const double FIELD_RADIUS_CLASS_RATIO = 1.1;
+
+//! the Bernoulli function x / (e^x - 1)
+double get_bernoulli(double x) {
+  if (std::abs(x) < 1e-8) {
+    return 1 - x / 2;
+  }
+  return x / std::expm1(x);
+}
+
+//! the volume of the shell between r0 and r1
+double get_shell_volume(double r0, double r1) {
+  return 4.0 / 3.0 * PI * (r1 * r1 * r1 - r0 * r0 * r0);
+}
+}
+
+//! for the definition of the optimizer state
+RadialConcentrationField::RadialConcentrationField
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  VesicleActiveSet *active_set,
+  RadialDistributionFunctionSingletonScore *rdf,
+  double field_distance,
+  double time_step,
+  double diffusion_coefficient,
+  double bin_width,
+  double temperature,
+  unsigned int periodicity)
+  : P(m, "RadialConcentrationField%1%"),
+  vesicles_(vesicles.begin(), vesicles.end()),
+  active_set_(active_set),
+  rdf_(rdf),
+  time_step_(time_step),
+  diffusion_coefficient_(diffusion_coefficient),
+  kt_(0.0019872041 * temperature) // Boltzmann constant in kcal/mol/K
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(!vesicles_.empty(), "there must be at least one vesicle");
+  IMP_USAGE_CHECK(bin_width > 0, "bin_width must be positive");
+  set_period(periodicity);
+  Floats radii(vesicles_.size());
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    radii[i] = core::XYZR(m, vesicles_[i]).get_radius();
+  }
+  unsigned int n_classes =
+      internal::get_radius_classes(radii, FIELD_RADIUS_CLASS_RATIO, classes_).size();
+  class_radii_.assign(n_classes, 0);
+  Floats class_sizes(n_classes, 0);
+  for (unsigned int i = 0; i < radii.size(); ++i) {
+    class_radii_[classes_[i]] += radii[i];
+    class_sizes[classes_[i]] += 1;
+  }
+  for (unsigned int c = 0; c < n_classes; ++c) {
+    class_radii_[c] /= class_sizes[c];
+  }
+  double min_radius = *std::min_element(radii.begin(), radii.end());
+  double max_radius = *std::max_element(radii.begin(), radii.end());
+  r_min_ = rdf_->get_nucleus_sphere().get_radius() + min_radius;
+  r_field_ = rdf_->get_cell_sphere().get_radius() - max_radius - field_distance;
+  IMP_USAGE_CHECK(r_field_ > r_min_, "the field is empty, field_distance is too large");
+  n_shells_ = std::max(1, static_cast<int>(std::ceil((r_field_ - r_min_) / bin_width)));
+  bin_width_ = (r_field_ - r_min_) / n_shells_; // equal shells filling the field exactly
+  counts_.assign(n_classes * n_shells_, 0);
+  right_.assign(n_classes * n_shells_, 0);
+  left_.assign(n_classes * n_shells_, 0);
+  outflow_.assign(n_classes, 0);
+  absorbed_.resize(n_classes);
+}
+
+//! compute the Scharfetter-Gummel rate coefficients of the shells
+void RadialConcentrationField::update_rates() {
+  unsigned int n = n_shells_;
+  double h = bin_width_;
+  Floats w(n), volumes(n);
+  for (unsigned int c = 0; c < class_radii_.size(); ++c) {
+    double radius = class_radii_[c];
+    double *right = &right_[c * n];
+    double *left = &left_[c * n];
+    for (unsigned int i = 0; i < n; ++i) {
+      double r = get_shell_radius(i);
+      w[i] = rdf_->get_radial_score(r + h / 2, radius) / kt_;
+      volumes[i] = get_shell_volume(r, r + h);
+    }
+    // from the center of shell i to the center of shell i + 1, reflecting at the nucleus
+    left[0] = 0;
+    for (unsigned int i = 0; i + 1 < n; ++i) {
+      double r = get_shell_radius(i + 1);
+      double dw = w[i + 1] - w[i];
+      double flux = diffusion_coefficient_ * 4 * PI * r * r / h;
+      right[i] = flux * get_bernoulli(dw) / volumes[i];
+      left[i + 1] = flux * get_bernoulli(-dw) / volumes[i + 1];
+    }
+    // from the center of the last shell out of the field, where the particles take over
+    double dw = rdf_->get_radial_score(r_field_, radius) / kt_ - w[n - 1];
+    double flux = diffusion_coefficient_ * 4 * PI * r_field_ * r_field_ / (h / 2);
+    right[n - 1] = flux * get_bernoulli(dw) / volumes[n - 1];
+  }
+}
+
+//! absorb the free vesicles inside the field
+void RadialConcentrationField::absorb_vesicles() {
+  Model *m = get_model();
+  algebra::Vector3D center = rdf_->get_cell_sphere().get_center();
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    ParticleIndex pi = vesicles_[i];
+    if (active_set_->get_is_absorbed(pi) || active_set_->get_is_frozen(pi)
+        || DockingStateDecorator(m, pi).get_dstate() != 0) {
+      continue;
+    }
+    core::XYZR xyzr(m, pi);
+    double r = algebra::get_distance(xyzr.get_coordinates(), center);
+    if (r >= r_field_) {
+      continue;
+    }
+    int shell = static_cast<int>((r - r_min_) / bin_width_);
+    shell = std::max(0, std::min(shell, static_cast<int>(n_shells_) - 1));
+    counts_[classes_[i] * n_shells_ + shell] += 1;
+    xyzr.set_coordinates_are_optimized(false);
+    active_set_->set_is_absorbed(pi, true);
+    absorbed_[classes_[i]].push_back(pi);
+  }
+}
+
+//! evolve the shell counts of radius class c for a time dt
+void RadialConcentrationField::evolve(unsigned int c, double dt) {
+  unsigned int n = n_shells_;
+  double *counts = &counts_[c * n];
+  const double *right = &right_[c * n];
+  const double *left = &left_[c * n];
+  double max_rate = 0;
+  for (unsigned int i = 0; i < n; ++i) {
+    max_rate = std::max(max_rate, right[i] + left[i]);
+  }
+  unsigned int n_substeps = std::max(1, static_cast<int>(std::ceil(dt * max_rate / 0.5)));
+  double ddt = dt / n_substeps;
+  Floats flows(n); // the vesicles moving from shell i to shell i + 1 in a substep
+  for (unsigned int s = 0; s < n_substeps; ++s) {
+    for (unsigned int i = 0; i + 1 < n; ++i) {
+      flows[i] = ddt * (right[i] * counts[i] - left[i + 1] * counts[i + 1]);
+    }
+    flows[n - 1] = ddt * right[n - 1] * counts[n - 1];
+    for (unsigned int i = 0; i < n; ++i) {
+      counts[i] -= flows[i];
+      if (i > 0) {
+        counts[i] += flows[i - 1];
+      }
+    }
+    outflow_[c] += flows[n - 1];
+  }
+}
+
+//! emit a vesicle of radius class c from the field as a particle in the buffer shell
+void RadialConcentrationField::emit_vesicle(unsigned int c) {
+  ParticleIndex pi = absorbed_[c].back();
+  absorbed_[c].pop_back();
+  // uniform in the volume between the field radius and the center of a half shell outside
+  double r0 = r_field_, r1 = r_field_ + bin_width_ / 2;
+  double u = std::uniform_real_distribution<double>(0, 1)(random_number_generator);
+  double r = std::cbrt(r0 * r0 * r0 + u * (r1 * r1 * r1 - r0 * r0 * r0));
+  core::XYZR xyzr(get_model(), pi);
+  xyzr.set_coordinates(algebra::get_random_vector_on(
+      algebra::Sphere3D(rdf_->get_cell_sphere().get_center(), r)));
+  xyzr.set_coordinates_are_optimized(true);
+  active_set_->set_is_absorbed(pi, false);
+  outflow_[c] -= 1;
+}
+
+//! update the optimizer state
+void RadialConcentrationField::do_update
+( unsigned int call_num) {
+  IMP_OBJECT_LOG;
+  set_was_used(true);
+  absorb_vesicles();
+  update_rates();
+  for (unsigned int c = 0; c < class_radii_.size(); ++c) {
+    evolve(c, get_period() * time_step_);
+    while (outflow_[c] >= 1 && !absorbed_[c].empty()) {
+      emit_vesicle(c);
+    }
+  }
+  active_set_->update();
+  IMP_LOG_TERSE("Field vesicles " << get_number_of_field_vesicles()
+                << ", absorbed particles " << get_number_of_absorbed_vesicles() << std::endl);
+}
+
+//! returns the number of vesicles held by the field, including those flowing out
+double RadialConcentrationField::get_number_of_field_vesicles() const {
+  double ret = 0;
+  for (unsigned int c = 0; c < outflow_.size(); ++c) {
+    ret += outflow_[c];
+  }
+  for (unsigned int i = 0; i < counts_.size(); ++i) {
+    ret += counts_[i];
+  }
+  return ret;
+}
+
+//! returns the number of vesicles in each shell of the field, summed over the radius classes
+Floats RadialConcentrationField::get_shell_counts() const {
+  Floats ret(n_shells_, 0);
+  for (unsigned int i = 0; i < counts_.size(); ++i) {
+    ret[i % n_shells_] += counts_[i];
+  }
+  return ret;
+}
+
+unsigned int RadialConcentrationField::get_number_of_absorbed_vesicles() const {
+  unsigned int ret = 0;
+  for (unsigned int c = 0; c < absorbed_.size(); ++c) {
+    ret += absorbed_[c].size();
+  }
+  return ret;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -43,11 +43,23 @@ double RadialDistributionFunctionSingletonScore::evaluate_index
   DerivativeAccumulator *da) const {
 
   IMP_OBJECT_LOG;
+  double score = evaluate_in_cell(m, pi, cell_sphere_, nucleus_sphere_, da);
+  IMP_LOG(VERBOSE, "score " << score << std::endl);
+  return score;
+}
+
+// the score in the given cell, without logging so that it can run in threads
+double RadialDistributionFunctionSingletonScore::evaluate_in_cell
+( Model *m,
+  ParticleIndex pi,
+  const algebra::Sphere3D &cell_sphere,
+  const algebra::Sphere3D &nucleus_sphere,
+  DerivativeAccumulator *da) const {
   core::XYZR xyzr(m,pi);
-  double Rcell = cell_sphere_.get_radius(); 
-  double Rnucleus = nucleus_sphere_.get_radius();
+  double Rcell = cell_sphere.get_radius();
+  double Rnucleus = nucleus_sphere.get_radius();
   double Rgranule = xyzr.get_radius();
-  algebra::Vector3D dxyz = xyzr.get_coordinates() - cell_sphere_.get_center();
+  algebra::Vector3D dxyz = xyzr.get_coordinates() - cell_sphere.get_center();
   double dxyz_magnitude = algebra::get_magnitude_and_normalize_in_place( dxyz ) - Rnucleus - Rgranule;
   if (0 <= dxyz_magnitude && dxyz_magnitude <= Rcell - Rnucleus - 2*Rgranule) {
     double score =  k_ * (poly_param_[0] * pow(dxyz_magnitude,5) + poly_param_[1] * pow(dxyz_magnitude,4) 
@@ -58,14 +70,45 @@ double RadialDistributionFunctionSingletonScore::evaluate_index
       algebra::Vector3D deriv= k_ * (5 * poly_param_[0] * pow(dxyz_magnitude,4) + 4 * poly_param_[1] * pow(dxyz_magnitude,3) 
                     + 3 * poly_param_[2] * pow(dxyz_magnitude,2) + 2 * poly_param_[3] * dxyz_magnitude
                     + poly_param_[4]) * dxyz_normalized; 
-      IMP_LOG(VERBOSE, "score " << score
-          << " and derivative " << deriv << std::endl);
       xyzr.add_to_derivatives(deriv, *da);
     }
     return score;
   }
+  return 0; // no score outside the fitted range
 }
   
+double RadialDistributionFunctionSingletonScore::get_radial_score
+( double r,
+  double radius) const {
+  double Rcell = cell_sphere_.get_radius();
+  double Rnucleus = nucleus_sphere_.get_radius();
+  double s = r - Rnucleus - radius;
+  if (s < 0 || s > Rcell - Rnucleus - 2*radius) {
+    return 0;
+  }
+  double score = 0;
+  for (unsigned int i = 0; i < 6; ++i) {
+    score = score * s + poly_param_[i]; // Horner form of the 5-order polynomial
+  }
+  return k_ * score;
+}
+
+double RadialDistributionFunctionSingletonScore::get_radial_derivative
+( double r,
+  double radius) const {
+  double Rcell = cell_sphere_.get_radius();
+  double Rnucleus = nucleus_sphere_.get_radius();
+  double s = r - Rnucleus - radius;
+  if (s < 0 || s > Rcell - Rnucleus - 2*radius) {
+    return 0;
+  }
+  double deriv = 0;
+  for (unsigned int i = 0; i < 5; ++i) {
+    deriv = deriv * s + (5 - i) * poly_param_[i]; // Horner form of the derivative
+  }
+  return k_ * deriv;
+}
+
 // for do_get_inputs
 ModelObjectsTemp 
 RadialDistributionFunctionSingletonScore
@@ -0,0 +1,178 @@
+/**
+ *  \file IMP/insulinsecretion/SecretionEventLog.cpp
+ *  \brief A log of timestamped secretion events in a preallocated ring buffer.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/SecretionEventLog.h>
+#include <IMP/exception.h>
+#include <cstdint>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+const char SECRETION_EVENT_LOG_MAGIC[8] = {'I', 'M', 'P', 'I', 'S', 'S', 'E', 'C'};
+
+template <class T>
+void write_raw(std::ofstream &out, T v) {
+  out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <class T>
+void write_raw(std::string &out, T v) {
+  out.append(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+}
+
+//! for the definition of the log
+SecretionEventLog::SecretionEventLog(unsigned int capacity, double time_step)
+  : Object("SecretionEventLog%1%"),
+  time_step_(time_step),
+  ring_(capacity),
+  first_(0),
+  size_(0),
+  n_secretions_(0),
+  n_dropped_(0)
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(capacity > 0, "capacity must be positive");
+}
+
+//! write the events to a binary file as the buffer fills up
+void SecretionEventLog::set_output_file(std::string file_name) {
+  writer_ = nullptr;
+  out_.close();
+  out_.clear();
+  file_name_ = file_name;
+  out_.open(file_name.c_str(), std::ios::binary);
+  if (!out_) {
+    IMP_THROW("Cannot open secretion event file " << file_name, IOException);
+  }
+  out_.write(SECRETION_EVENT_LOG_MAGIC, sizeof(SECRETION_EVENT_LOG_MAGIC));
+  check_output();
+}
+
+//! write the events through a writer thread as the buffer fills up
+void SecretionEventLog::set_output_writer(AsyncOutputWriter *writer) {
+  out_.close();
+  out_.clear();
+  writer_ = writer;
+  writer_->write(std::string(SECRETION_EVENT_LOG_MAGIC, sizeof(SECRETION_EVENT_LOG_MAGIC)));
+}
+
+//! raise an error if a write to the output file failed, e.g., on a full disk
+void SecretionEventLog::check_output() const {
+  if (!out_) {
+    IMP_THROW("Cannot write secretion event file " << file_name_, IOException);
+  }
+}
+
+//! write the records of the buffered events
+template <class Out>
+void SecretionEventLog::write_events(Out &out) const {
+  for (unsigned int i = 0; i < size_; ++i) {
+    const SecretionEvent &e = get_event(i);
+    write_raw(out, e.time);
+    write_raw(out, e.dock_time);
+    write_raw(out, static_cast<std::int32_t>(e.vesicle));
+    write_raw(out, static_cast<std::int32_t>(e.channel));
+    for (unsigned int k = 0; k < 3; ++k) {
+      write_raw(out, e.position[k]);
+    }
+  }
+}
+
+//! write the buffered events to the output and empty the buffer
+void SecretionEventLog::write_buffered_events() {
+  if (writer_) {
+    write_events(writer_->begin_frame());
+    writer_->end_frame();
+  } else {
+    write_events(out_);
+  }
+  // the events are gone from the buffer either way
+  first_ = 0;
+  size_ = 0;
+  if (!writer_) {
+    check_output();
+  }
+}
+
+void SecretionEventLog::flush() {
+  if (writer_) {
+    write_buffered_events();
+    writer_->flush();
+  } else if (out_.is_open()) {
+    write_buffered_events();
+    out_.flush();
+    check_output();
+  }
+}
+
+//! write the buffered events and close the file on destruction, without throwing
+void SecretionEventLog::do_destroy() {
+  try {
+    flush();
+    if (out_.is_open()) {
+      out_.close();
+      check_output();
+    }
+  } catch (const IOException &e) {
+    IMP_WARN("Secretion events lost: " << e.what() << std::endl);
+  }
+}
+
+//! record that vesicle pi docked to a channel
+void SecretionEventLog::add_docking(ParticleIndex pi, int channel,
+                                   unsigned long step) {
+  unsigned int i = pi.get_index();
+  if (i >= dock_times_.size()) {
+    dock_times_.resize(i + 1, -1);
+    dock_channels_.resize(i + 1, -1);
+  }
+  dock_times_[i] = step * time_step_;
+  dock_channels_[i] = channel;
+}
+
+//! record the secretion of vesicle pi
+void SecretionEventLog::add_secretion(ParticleIndex pi,
+                                     const algebra::Vector3D &position,
+                                     unsigned long step) {
+  if (size_ == ring_.size()) {
+    if (get_has_output()) {
+      write_buffered_events();
+    } else {
+      first_ = (first_ + 1) % ring_.size(); // overwrite the oldest event
+      --size_;
+      ++n_dropped_;
+    }
+  }
+  unsigned int i = pi.get_index();
+  SecretionEvent &e = ring_[(first_ + size_) % ring_.size()];
+  e.time = step * time_step_;
+  e.vesicle = i;
+  e.dock_time = i < dock_times_.size() ? dock_times_[i] : -1;
+  e.channel = i < dock_channels_.size() ? dock_channels_[i] : -1;
+  for (unsigned int k = 0; k < 3; ++k) {
+    e.position[k] = position[k];
+  }
+  if (i < dock_times_.size()) {
+    dock_times_[i] = -1; // the vesicle starts a new life near the nucleus
+    dock_channels_[i] = -1;
+  }
+  ++size_;
+  ++n_secretions_;
+}
+
+//! drop the buffered events and the docking records
+void SecretionEventLog::clear() {
+  first_ = 0;
+  size_ = 0;
+  n_secretions_ = 0;
+  n_dropped_ = 0;
+  dock_times_.clear();
+  dock_channels_.clear();
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
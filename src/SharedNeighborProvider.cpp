@@ -0,0 +1,220 @@
+/**
+ *  \file IMP/insulinsecretion/SharedNeighborProvider.cpp
+ *  \brief One close pair list of the vesicles, channels and nucleus, shared by the excluded volume and docking.
+ *
+ * Description:
+ * 1, The small particles are sorted by the key of their grid cell, so the particles of a
+ *    cell are contiguous and the 27 neighbouring cells are found by binary search.
+ * 2, Each radius class has its own grid, whose cell size fits the largest radius of the
+ *    class. A particle searches the grids of its class and of the larger classes, whose
+ *    cells are also large enough for it, so each pair of different classes is tested once.
+ * 3, Within a class each pair is tested once: from the particle in the cell with the lower
+ *    key, or from the earlier particle when both are in the same cell.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/SharedNeighborProvider.h>
+#include <IMP/insulinsecretion/internal/radius_classes.h>
+#include <IMP/core/XYZR.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+// the ratio of the largest to the smallest radius of a radius class
+const double RADIUS_CLASS_RATIO = 1.5;
+
+// the offset of the grid coordinates, which take 21 bits each in a key
+const long long GRID_OFFSET = 1LL << 20;
+
+//! the key of a grid cell, increasing with (x, y, z) in lexicographic order
+long long get_cell_key(long long x, long long y, long long z) {
+  return ((x + GRID_OFFSET) << 42) | ((y + GRID_OFFSET) << 21) | (z + GRID_OFFSET);
+}
+
+long long get_grid_coordinate(double x, double cell_size) {
+  return static_cast<long long>(std::floor(x / cell_size));
+}
+}
+
+//! for the definition of the score state
+SharedNeighborProvider::SharedNeighborProvider
+( SingletonContainerAdaptor particles,
+  double distance,
+  double slack,
+  std::string name)
+  : ScoreState(particles->get_model(), name),
+  particles_(particles),
+  distance_(distance),
+  slack_(slack),
+  n_rebuilds_(0),
+  n_radius_classes_(0)
+{
+  IMP_USAGE_CHECK(distance >= 0, "distance must not be negative");
+  IMP_USAGE_CHECK(slack > 0, "slack must be positive");
+}
+
+//! pair these particles with all others directly
+void SharedNeighborProvider::set_large_particles(ParticleIndexesAdaptor large) {
+  is_large_.clear();
+  for (ParticleIndex pi : large) {
+    if (pi.get_index() >= static_cast<int>(is_large_.size())) {
+      is_large_.resize(pi.get_index() + 1, 0);
+    }
+    is_large_[pi.get_index()] = 1;
+  }
+  indexes_.clear(); // rebuild at the next update
+}
+
+//! whether a particle moved more than slack or the particles changed
+bool SharedNeighborProvider::get_needs_rebuild
+( const ParticleIndexes &indexes) const {
+  if (indexes.size() != indexes_.size()
+      || !std::equal(indexes.begin(), indexes.end(), indexes_.begin())) {
+    return true;
+  }
+  Model *m = get_model();
+  double slack2 = slack_ * slack_;
+  for (unsigned int i = 0; i < indexes.size(); ++i) {
+    algebra::Vector3D d = core::XYZ(m, indexes[i]).get_coordinates() - positions_[i];
+    if (d.get_squared_magnitude() > slack2) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//! find the candidate pairs of the current positions
+void SharedNeighborProvider::rebuild(const ParticleIndexes &indexes) {
+  Model *m = get_model();
+  unsigned int n = indexes.size();
+  indexes_ = indexes;
+  positions_.resize(n);
+  Floats radii(n);
+  for (unsigned int i = 0; i < n; ++i) {
+    core::XYZR xyzr(m, indexes[i]);
+    positions_[i] = xyzr.get_coordinates();
+    radii[i] = xyzr.get_radius();
+  }
+  pairs_.clear();
+  ++n_rebuilds_;
+  if (n < 2) {
+    return;
+  }
+  double reach = distance_ + 2 * slack_;
+  auto add_if_close = [&](unsigned int i, unsigned int j) {
+    double r = radii[i] + radii[j] + reach;
+    if ((positions_[i] - positions_[j]).get_squared_magnitude() < r * r) {
+      pairs_.push_back(ParticleIndexPair(indexes[i], indexes[j]));
+    }
+  };
+  // split off the large particles given by the caller, e.g., the nucleus
+  auto get_is_large = [this, &indexes](unsigned int i) {
+    return indexes[i].get_index() < static_cast<int>(is_large_.size())
+           && is_large_[indexes[i].get_index()];
+  };
+  Ints large, small;
+  Floats small_radii;
+  for (unsigned int i = 0; i < n; ++i) {
+    if (get_is_large(i)) {
+      large.push_back(i);
+    } else {
+      small.push_back(i);
+      small_radii.push_back(radii[i]);
+    }
+  }
+  // the small particles sorted by grid cell, one grid per radius class
+  Ints classes;
+  Floats max_radii = internal::get_radius_classes(small_radii, RADIUS_CLASS_RATIO, classes);
+  n_radius_classes_ = max_radii.size();
+  Floats cell_sizes(max_radii.size());
+  for (unsigned int c = 0; c < max_radii.size(); ++c) {
+    cell_sizes[c] = 2 * max_radii[c] + reach;
+  }
+  std::vector<std::vector<std::pair<long long, unsigned int> > > cells(max_radii.size());
+  for (unsigned int s = 0; s < small.size(); ++s) {
+    unsigned int i = small[s];
+    double cell_size = cell_sizes[classes[s]];
+    cells[classes[s]].push_back(std::make_pair(get_cell_key(
+        get_grid_coordinate(positions_[i][0], cell_size),
+        get_grid_coordinate(positions_[i][1], cell_size),
+        get_grid_coordinate(positions_[i][2], cell_size)), s));
+  }
+  for (unsigned int c = 0; c < cells.size(); ++c) {
+    std::sort(cells[c].begin(), cells[c].end());
+  }
+  for (unsigned int c = 0; c < cells.size(); ++c) {
+    for (unsigned int a = 0; a < cells[c].size(); ++a) {
+      unsigned int i = small[cells[c][a].second];
+      // the cells of a class are large enough for the pairs with the smaller classes
+      for (unsigned int d = c; d < cells.size(); ++d) {
+        const std::vector<std::pair<long long, unsigned int> > &grid = cells[d];
+        long long x = get_grid_coordinate(positions_[i][0], cell_sizes[d]);
+        long long y = get_grid_coordinate(positions_[i][1], cell_sizes[d]);
+        long long z = get_grid_coordinate(positions_[i][2], cell_sizes[d]);
+        for (int dx = -1; dx <= 1; ++dx) {
+          for (int dy = -1; dy <= 1; ++dy) {
+            for (int dz = -1; dz <= 1; ++dz) {
+              long long key = get_cell_key(x + dx, y + dy, z + dz);
+              if (d == c && key < cells[c][a].first) {
+                continue; // tested from the other cell
+              }
+              auto begin = std::lower_bound(grid.begin(), grid.end(),
+                                            std::make_pair(key, 0u));
+              for (auto it = begin; it != grid.end() && it->first == key; ++it) {
+                if (d == c && key == cells[c][a].first && it - grid.begin() <= a) {
+                  continue; // tested from the earlier particle of the cell
+                }
+                add_if_close(i, small[it->second]);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  // the large particles against all others
+  for (unsigned int l = 0; l < large.size(); ++l) {
+    for (unsigned int j = 0; j < n; ++j) {
+      bool is_earlier_large = get_is_large(j) && j <= static_cast<unsigned int>(large[l]);
+      if (!is_earlier_large) {
+        add_if_close(large[l], j);
+      }
+    }
+  }
+  IMP_LOG_TERSE("rebuilt " << pairs_.size() << " candidate pairs of "
+                << n << " particles" << std::endl);
+}
+
+//! check the displacements and rebuild the list if needed
+void SharedNeighborProvider::update() {
+  ParticleIndexes indexes = particles_->get_contents();
+  if (n_rebuilds_ == 0 || get_needs_rebuild(indexes)) {
+    rebuild(indexes);
+  }
+}
+
+void SharedNeighborProvider::do_before_evaluate() {
+  IMP_OBJECT_LOG;
+  update();
+}
+
+//! the particles and their container
+ModelObjectsTemp SharedNeighborProvider::do_get_inputs() const {
+  Model *m = get_model();
+  ModelObjectsTemp ret = IMP::get_particles(m, particles_->get_all_possible_indexes());
+  ret.push_back(particles_);
+  return ret;
+}
+
+//! the list is read directly by the consumers
+ModelObjectsTemp SharedNeighborProvider::do_get_outputs() const {
+  return ModelObjectsTemp();
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
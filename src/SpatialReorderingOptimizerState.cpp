@@ -0,0 +1,99 @@
+/**
+ *  \file IMP/insulinsecretion/SpatialReorderingOptimizerState.cpp
+ *  \brief An optimizer state that periodically sorts the vesicle containers along a Morton curve.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/SpatialReorderingOptimizerState.h>
+#include <IMP/core/XYZ.h>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+//! spread the lower 21 bits of x so that there are two zero bits between them
+std::uint64_t spread_bits(std::uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+//! the Morton code of v, quantized to 21 bits per axis of bb
+std::uint64_t get_morton_code(const algebra::Vector3D &v,
+                              const algebra::BoundingBox3D &bb) {
+  const double n_cells = (1 << 21) - 1;
+  std::uint64_t ret = 0;
+  for (unsigned int k = 0; k < 3; ++k) {
+    double lo = bb.get_corner(0)[k], hi = bb.get_corner(1)[k];
+    double f = (v[k] - lo) / (hi - lo);
+    f = std::max(0.0, std::min(1.0, f));
+    ret |= spread_bits(static_cast<std::uint64_t>(f * n_cells)) << k;
+  }
+  return ret;
+}
+}
+
+//! for the definition of the optimizer state
+SpatialReorderingOptimizerState::SpatialReorderingOptimizerState
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  algebra::BoundingBox3D bb,
+  unsigned int periodicity)
+  : P(m, "SpatialReorderingOptimizerState%1%"),
+  vesicles_(vesicles.begin(), vesicles.end()),
+  bb_(bb),
+  order_(vesicles_)
+{
+  IMP_OBJECT_LOG;
+  set_period(periodicity);
+}
+
+//! sort the vesicles along the Morton curve and apply the order to the containers and arrays
+void SpatialReorderingOptimizerState::do_update
+( unsigned int call_num) {
+  IMP_OBJECT_LOG;
+  set_was_used(true);
+  Model *m = get_model();
+  std::vector<std::pair<std::uint64_t, ParticleIndex> > codes(vesicles_.size());
+  for (unsigned int i = 0; i < vesicles_.size(); ++i) {
+    codes[i] = std::make_pair(
+        get_morton_code(core::XYZ(m, vesicles_[i]).get_coordinates(), bb_),
+        vesicles_[i]);
+  }
+  std::sort(codes.begin(), codes.end());
+  Ints rank(m->get_particles_size(), vesicles_.size());
+  for (unsigned int i = 0; i < codes.size(); ++i) {
+    order_[i] = codes[i].second;
+    rank[order_[i].get_index()] = i;
+  }
+  if (active_set_) {
+    active_set_->set_order(order_);
+    active_set_->update();
+  }
+  for (unsigned int i = 0; i < containers_.size(); ++i) {
+    ParticleIndexes contents = containers_[i]->get_contents();
+    std::stable_sort(contents.begin(), contents.end(),
+                     [&rank](ParticleIndex a, ParticleIndex b) {
+                       return rank[a.get_index()] < rank[b.get_index()];
+                     });
+    containers_[i]->set(contents);
+  }
+  for (unsigned int i = 0; i < secretion_states_.size(); ++i) {
+    secretion_states_[i]->set_order(order_);
+  }
+  for (unsigned int i = 0; i < lifecycle_states_.size(); ++i) {
+    lifecycle_states_[i]->set_order(order_);
+  }
+  for (unsigned int i = 0; i < diffusion_states_.size(); ++i) {
+    diffusion_states_[i]->set_order(order_);
+  }
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -0,0 +1,252 @@
+/**
+ *  \file IMP/insulinsecretion/SteadyStateOptimizerState.cpp
+ *  \brief An optimizer state that detects when the secretion statistics of a run have converged.
+ *
+ * Description:
+ * 1, The secretion rate of an update is the increase of the summed secretion counters of
+ *    the vesicles since the previous update, over the time of periodicity BD steps.
+ * 2, The batch means are kept as rows of all observables, so merging two batches is the
+ *    average of two rows and the samples themselves are not stored.
+ *
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/SteadyStateOptimizerState.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/SecretionCounterDecorator.h>
+#include <IMP/core/XYZ.h>
+#include <IMP/exception.h>
+#include <cmath>
+#include <fstream>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the optimizer state
+SteadyStateOptimizerState::SteadyStateOptimizerState
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  algebra::Sphere3D cell_sphere,
+  algebra::Sphere3D nucleus_sphere,
+  double time_step,
+  unsigned int n_shells,
+  unsigned int burn_in,
+  unsigned int min_batches,
+  unsigned int periodicity)
+  : P(m, "SteadyStateOptimizerState%1%"),
+  vesicles_(vesicles.begin(), vesicles.end()),
+  cell_sphere_(cell_sphere),
+  nucleus_sphere_(nucleus_sphere),
+  n_shells_(n_shells),
+  time_step_(time_step),
+  periodicity_(periodicity),
+  burn_in_(burn_in),
+  min_batches_(min_batches),
+  min_batch_size_(8),
+  z_(1.96)
+{
+  IMP_OBJECT_LOG;
+  IMP_USAGE_CHECK(!vesicles_.empty(), "no vesicles");
+  IMP_USAGE_CHECK(n_shells >= 1, "n_shells must be positive");
+  IMP_USAGE_CHECK(min_batches >= 2, "min_batches must be at least 2");
+  IMP_USAGE_CHECK(cell_sphere.get_radius() > nucleus_sphere.get_radius(),
+                  "the nucleus must be smaller than the cell");
+  set_period(periodicity);
+  targets_.assign(get_number_of_observables(), 0);
+  clear();
+}
+
+//! drop all samples
+void SteadyStateOptimizerState::clear() {
+  n_updates_ = 0;
+  last_secretions_ = -1;
+  batch_sums_.assign(get_number_of_observables(), 0);
+  n_in_batch_ = 0;
+  batch_size_ = 1;
+  batch_means_.clear();
+  n_converged_ = 0;
+}
+
+void SteadyStateOptimizerState::set_precision
+( SteadyStateObservable observable, double half_width) {
+  IMP_USAGE_CHECK(half_width >= 0, "half_width must not be negative");
+  if (observable == SHELL_OCCUPANCY_OBSERVABLE) {
+    for (unsigned int i = SHELL_OCCUPANCY_OBSERVABLE; i < targets_.size(); ++i) {
+      targets_[i] = half_width;
+    }
+  } else {
+    targets_[observable] = half_width;
+  }
+}
+
+void SteadyStateOptimizerState::set_z(double z) {
+  IMP_USAGE_CHECK(z > 0, "z must be positive");
+  z_ = z;
+}
+
+void SteadyStateOptimizerState::set_min_batch_size(unsigned int min_batch_size) {
+  IMP_USAGE_CHECK(min_batch_size >= 2, "min_batch_size must be at least 2");
+  min_batch_size_ = min_batch_size;
+}
+
+unsigned int SteadyStateOptimizerState::get_number_of_batches() const {
+  return batch_means_.size() / get_number_of_observables();
+}
+
+//! add the observables of one update to the current batch, true if batches were merged
+bool SteadyStateOptimizerState::add_sample(const Floats &sample) {
+  unsigned int n = get_number_of_observables();
+  for (unsigned int i = 0; i < n; ++i) {
+    batch_sums_[i] += sample[i];
+  }
+  if (++n_in_batch_ < batch_size_) {
+    return false;
+  }
+  for (unsigned int i = 0; i < n; ++i) {
+    batch_means_.push_back(batch_sums_[i] / batch_size_);
+  }
+  batch_sums_.assign(n, 0);
+  n_in_batch_ = 0;
+  if (get_number_of_batches() == 2 * min_batches_) {
+    // merge adjacent batches, so there are min_batches batches of twice the size
+    for (unsigned int b = 0; b < min_batches_; ++b) {
+      for (unsigned int i = 0; i < n; ++i) {
+        batch_means_[b * n + i] = (batch_means_[2 * b * n + i]
+                                   + batch_means_[(2 * b + 1) * n + i]) / 2;
+      }
+    }
+    batch_means_.resize(min_batches_ * n);
+    batch_size_ *= 2;
+    return true;
+  }
+  return false;
+}
+
+//! update the optimizer state
+void SteadyStateOptimizerState::do_update
+( unsigned int call_num) {
+  IMP_OBJECT_LOG;
+  set_was_used(true);
+  Model *m = get_model();
+  IntKey dk = DockingStateDecorator::get_dstate_key();
+  IntKey sk = SecretionCounterDecorator::get_secretion_key();
+  Floats sample(get_number_of_observables(), 0);
+  double r_inner = nucleus_sphere_.get_radius();
+  double shell_width = (cell_sphere_.get_radius() - r_inner) / n_shells_;
+  int secretions = 0;
+  for (ParticleIndex pi : vesicles_) {
+    secretions += m->get_attribute(sk, pi);
+    if (m->get_attribute(dk, pi) != 0) {
+      sample[DOCKED_FRACTION_OBSERVABLE] += 1;
+    }
+    double r = algebra::get_distance(core::XYZ(m, pi).get_coordinates(),
+                                     cell_sphere_.get_center());
+    int shell = static_cast<int>(std::floor((r - r_inner) / shell_width));
+    if (shell >= 0 && shell < static_cast<int>(n_shells_)) {
+      sample[SHELL_OCCUPANCY_OBSERVABLE + shell] += 1;
+    }
+  }
+  for (unsigned int i = DOCKED_FRACTION_OBSERVABLE; i < sample.size(); ++i) {
+    sample[i] /= vesicles_.size();
+  }
+  bool first = last_secretions_ < 0;
+  sample[SECRETION_RATE_OBSERVABLE] = (secretions - last_secretions_)
+                                      / (periodicity_ * time_step_ * 1e-15);
+  last_secretions_ = secretions;
+  if (first || ++n_updates_ <= burn_in_) {
+    return; // no rate yet, or still equilibrating
+  }
+  // tested only when the batches were merged, so the batch means are of full length
+  bool merged = add_sample(sample);
+  if (merged && !get_is_converged() && get_targets_are_met()) {
+    n_converged_ = n_updates_;
+    IMP_LOG_TERSE("steady state converged after " << n_updates_
+                  << " updates" << std::endl);
+  }
+}
+
+Floats SteadyStateOptimizerState::get_means() const {
+  unsigned int n = get_number_of_observables();
+  unsigned int n_batches = get_number_of_batches();
+  Floats ret(n, 0);
+  for (unsigned int b = 0; b < n_batches; ++b) {
+    for (unsigned int i = 0; i < n; ++i) {
+      ret[i] += batch_means_[b * n + i] / n_batches;
+    }
+  }
+  return ret;
+}
+
+Floats SteadyStateOptimizerState::get_half_widths() const {
+  unsigned int n = get_number_of_observables();
+  unsigned int n_batches = get_number_of_batches();
+  Floats ret(n, 0);
+  if (n_batches < 2) {
+    return ret;
+  }
+  Floats means = get_means();
+  for (unsigned int b = 0; b < n_batches; ++b) {
+    for (unsigned int i = 0; i < n; ++i) {
+      double d = batch_means_[b * n + i] - means[i];
+      ret[i] += d * d;
+    }
+  }
+  for (unsigned int i = 0; i < n; ++i) {
+    ret[i] = z_ * std::sqrt(ret[i] / (n_batches - 1) / n_batches);
+  }
+  return ret;
+}
+
+//! whether all targeted observables reached their precision
+bool SteadyStateOptimizerState::get_targets_are_met() const {
+  if (get_number_of_batches() < min_batches_ || batch_size_ < min_batch_size_) {
+    return false;
+  }
+  Floats half_widths = get_half_widths();
+  bool any = false;
+  for (unsigned int i = 0; i < targets_.size(); ++i) {
+    if (targets_[i] > 0) {
+      any = true;
+      // zero variance, e.g., no secretion yet, is not a precise estimate
+      if (half_widths[i] <= 0 || half_widths[i] > targets_[i]) {
+        return false;
+      }
+    }
+  }
+  return any;
+}
+
+double SteadyStateOptimizerState::get_converged_time() const {
+  // the first update only sets the secretion count
+  return (n_converged_ > 0 ? n_converged_ + 1 : 0)
+         * periodicity_ * time_step_ * 1e-15;
+}
+
+//! Write the estimates and the convergence state to a text file
+void SteadyStateOptimizerState::write_record(std::string file_name) const {
+  std::ofstream out(file_name.c_str());
+  if (!out) {
+    IMP_THROW("Cannot open steady state record file " << file_name, IOException);
+  }
+  Floats means = get_means();
+  Floats half_widths = get_half_widths();
+  out << "# converged " << (get_is_converged() ? 1 : 0)
+      << " time_s " << get_converged_time()
+      << " batches " << get_number_of_batches()
+      << " batch_size " << batch_size_
+      << " burn_in " << burn_in_
+      << " z " << z_ << std::endl;
+  out << "# observable mean half_width target" << std::endl;
+  for (unsigned int i = 0; i < means.size(); ++i) {
+    if (i == SECRETION_RATE_OBSERVABLE) {
+      out << "secretion_rate";
+    } else if (i == DOCKED_FRACTION_OBSERVABLE) {
+      out << "docked_fraction";
+    } else {
+      out << "shell_occupancy_" << i - SHELL_OCCUPANCY_OBSERVABLE;
+    }
+    out << " " << means[i] << " " << half_widths[i] << " " << targets_[i] << std::endl;
+  }
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
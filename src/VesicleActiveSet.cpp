@@ -0,0 +1,143 @@
+/**
+ *  \file IMP/insulinsecretion/VesicleActiveSet.cpp
+ *  \brief Keeps the diffusing (active) and the frozen particles of a cell in two containers.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/VesicleActiveSet.h>
+#include <IMP/core/XYZ.h>
+#include <algorithm>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+//! for the definition of the active set
+VesicleActiveSet::VesicleActiveSet
+( Model *m,
+  ParticleIndexesAdaptor vesicles,
+  ParticleIndexesAdaptor static_particles)
+  : Object("VesicleActiveSet%1%"),
+  m_(m),
+  n_absorbed_(0),
+  changed_(false)
+{
+  IMP_OBJECT_LOG;
+  int max_index = -1;
+  for (ParticleIndex pi : vesicles) {
+    max_index = std::max(max_index, pi.get_index());
+  }
+  for (ParticleIndex pi : static_particles) {
+    max_index = std::max(max_index, pi.get_index());
+  }
+  slots_.assign(max_index + 1, -1);
+  for (ParticleIndex pi : vesicles) {
+    if (core::XYZ(m, pi).get_coordinates_are_optimized()) {
+      append(active_, pi, true);
+    } else {
+      append(frozen_, pi, false);
+    }
+  }
+  for (ParticleIndex pi : static_particles) {
+    append(frozen_, pi, false);
+  }
+  active_container_ = new container::ListSingletonContainer(m, active_,
+                                                            "ActiveVesicles%1%");
+  frozen_container_ = new container::ListSingletonContainer(m, frozen_,
+                                                            "FrozenParticles%1%");
+}
+
+//! append the particle to a list and record its slot
+void VesicleActiveSet::append(ParticleIndexes &list, ParticleIndex pi,
+                              bool active) {
+  slots_[pi.get_index()] = active ? list.size() : -2 - static_cast<int>(list.size());
+  list.push_back(pi);
+}
+
+//! remove the particle at position i of list by moving the last one there
+void VesicleActiveSet::remove_at(ParticleIndexes &list, int i, bool active) {
+  ParticleIndex last = list.back();
+  list[i] = last;
+  slots_[last.get_index()] = active ? i : -2 - i;
+  list.pop_back();
+}
+
+//! remove the particle from the list it is in
+void VesicleActiveSet::remove(ParticleIndex pi) {
+  int slot = slots_[pi.get_index()];
+  if (slot >= 0) {
+    remove_at(active_, slot, true);
+  } else {
+    remove_at(frozen_, -2 - slot, false);
+  }
+}
+
+//! move a particle to the frozen or to the active container
+void VesicleActiveSet::set_is_frozen(ParticleIndex pi, bool frozen) {
+  IMP_USAGE_CHECK(pi.get_index() < static_cast<int>(slots_.size())
+                  && slots_[pi.get_index()] != -1,
+                  "particle is not in the active set");
+  IMP_USAGE_CHECK(!get_is_absorbed(pi), "particle is absorbed");
+  int slot = slots_[pi.get_index()];
+  if (frozen && slot >= 0) {
+    remove_at(active_, slot, true);
+    append(frozen_, pi, false);
+    changed_ = true;
+  } else if (!frozen && slot < -1) {
+    remove_at(frozen_, -2 - slot, false);
+    append(active_, pi, true);
+    changed_ = true;
+  }
+}
+
+//! remove a vesicle from both containers, or return it to the active one
+void VesicleActiveSet::set_is_absorbed(ParticleIndex pi, bool absorbed) {
+  IMP_USAGE_CHECK(pi.get_index() < static_cast<int>(slots_.size())
+                  && slots_[pi.get_index()] != -1,
+                  "particle is not in the active set");
+  if (absorbed == get_is_absorbed(pi)) {
+    return;
+  }
+  if (absorbed) {
+    remove(pi);
+    slots_[pi.get_index()] = get_absorbed_slot();
+    ++n_absorbed_;
+  } else {
+    append(active_, pi, true);
+    --n_absorbed_;
+  }
+  changed_ = true;
+}
+
+//! sort the lists in the given order, the particles not in it last
+void VesicleActiveSet::set_order(ParticleIndexesAdaptor order) {
+  Ints rank(slots_.size(), order.size());
+  for (unsigned int i = 0; i < order.size(); ++i) {
+    if (order[i].get_index() < static_cast<int>(rank.size())) {
+      rank[order[i].get_index()] = i;
+    }
+  }
+  auto by_rank = [&rank](ParticleIndex a, ParticleIndex b) {
+    return rank[a.get_index()] < rank[b.get_index()];
+  };
+  std::stable_sort(active_.begin(), active_.end(), by_rank);
+  std::stable_sort(frozen_.begin(), frozen_.end(), by_rank);
+  for (unsigned int i = 0; i < active_.size(); ++i) {
+    slots_[active_[i].get_index()] = i;
+  }
+  for (unsigned int i = 0; i < frozen_.size(); ++i) {
+    slots_[frozen_[i].get_index()] = -2 - static_cast<int>(i);
+  }
+  changed_ = true;
+}
+
+//! refresh the containers if the set changed
+void VesicleActiveSet::update() {
+  if (!changed_) {
+    return;
+  }
+  active_container_->set(active_);
+  frozen_container_->set(frozen_);
+  changed_ = false;
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -34,16 +34,25 @@ double VesicleTraffickingSingletonScore::evaluate_index
   // check if derivatives are requested
   // IMP_USAGE_CHECK(!da, "Derivatives not available");
 
+  double score = evaluate_at_center(m, pi, center_, da);
+  IMP_LOG(VERBOSE, "score " << score << std::endl);
+  return score;
+}
+
+// the score around the given center, without logging so that it can run in threads
+double VesicleTraffickingSingletonScore::evaluate_at_center
+( Model *m,
+  ParticleIndex pi,
+  const algebra::Vector3D &center,
+  DerivativeAccumulator *da) const {
   core::XYZ xyz(m,pi);
-  algebra::Vector3D dxyz = xyz.get_coordinates() - center_;
+  algebra::Vector3D dxyz = xyz.get_coordinates() - center;
   double dxyz_magnitude = algebra::get_magnitude_and_normalize_in_place( dxyz );
   double score = -k_  * dxyz_magnitude; // score decreases (improves) radially 
   // The derivative accumulator
   if (da) {
     algebra::Vector3D& dxyz_normalized= dxyz; // it is now a normalized version of itself
     algebra::Vector3D deriv= -k_ * dxyz_normalized; 
-    IMP_LOG(VERBOSE, "score " << score
-          << " and derivative " << deriv << std::endl);
     xyz.add_to_derivatives(deriv, *da);
   }
   return score;
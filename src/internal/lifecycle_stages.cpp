@@ -0,0 +1,553 @@
+/**
+ *  \file IMP/insulinsecretion/internal/lifecycle_stages.cpp
+ *  \brief The Ca2+ channel, docking and secretion passes shared by the lifecycle optimizer states.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/internal/lifecycle_stages.h>
+#include <IMP/insulinsecretion/CaChannelStateDecorator.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/LifecycleClock.h>
+#include <IMP/insulinsecretion/MaturationStateDecorator.h>
+#include <IMP/insulinsecretion/SecretionCounterDecorator.h>
+#include <IMP/core/rigid_bodies.h>
+#include <IMP/algebra/vector_generators.h>
+#include <IMP/exception.h>
+#include <IMP/random.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+IMPINSULINSECRETION_BEGIN_INTERNAL_NAMESPACE
+
+/* ---------------- Ca2+ channel oscillation ---------------- */
+
+ChannelOscillationStage::ChannelOscillationStage
+( ParticleIndexesAdaptor cachannel,
+  int oscillation,
+  int troughn,
+  int peakn)
+  : cachannel_(cachannel.begin(), cachannel.end()),
+  oscillation_(oscillation),
+  troughn_(troughn),
+  peakn_(peakn),
+  flip_scheduled_(false)
+{}
+
+void ChannelOscillationStage::update(Model *m) {
+  if (gating_) {
+    update_gating(m);
+  }
+  else if (scheduler_) {
+    update_scheduled(m);
+  }
+  else {
+    update_timers(m);
+  }
+}
+
+//! oscillating the voltage for the opening of Ca2+ channles
+void ChannelOscillationStage::update_timers(Model *m) {
+  int count = 0;
+  bool found = false;
+  unsigned int n = get_number_of_channels();
+  for (unsigned int i = 0; i < n; ++i) {
+    int channel_state = get_state(m, i);
+    if (channel_state == -1){
+      ++count;
+    }
+    else if (channel_state == oscillation_){
+      found = true;
+    }
+    else{
+      set_state(m, i, channel_state + 1);
+    }
+  }
+  if (found == true){
+    flip_phase(m, count);
+  }
+}
+
+//! flip when the scheduled phase flip is due
+void ChannelOscillationStage::update_scheduled(Model *m) {
+  if (!flip_scheduled_) {
+    // the closed channels start at 0 and flip once they reach oscillation
+    scheduler_->schedule(oscillation_, CHANNEL_FLIP_EVENT);
+    flip_scheduled_ = true;
+  }
+  LifecycleEvents due = scheduler_->pop_due_events(CHANNEL_FLIP_EVENT);
+  if (due.empty()) {
+    return;
+  }
+  int count = 0;
+  int n = get_number_of_channels();
+  for (int i = 0; i < n; ++i) {
+    if (get_state(m, i) == -1){
+      ++count;
+    }
+  }
+  if (count < n){
+    flip_phase(m, count);
+  }
+  // the timers restart at 0 after a flip, hence oscillation + 1 updates to the next one
+  scheduler_->schedule(oscillation_ + 1, CHANNEL_FLIP_EVENT);
+}
+
+//! open a new random block of channels when the phase flips
+void ChannelOscillationStage::flip_phase(Model *m, int count) {
+  int totaln = get_number_of_channels();
+  int openn;
+  if (count == peakn_){
+    openn = troughn_;
+  }
+  else if (count == troughn_){
+    openn = peakn_;
+  }
+  else {
+    std::cerr << "Error: Incorrect number of Ca2+ channels in the open state." << std::endl;
+    exit(1);
+  }
+  int open_start = 0;
+  if (totaln > openn && openn > 0) {
+    // from the IMP generator, so the run seed fixes the open blocks
+    std::uniform_int_distribution<int> start(0, totaln - openn - 1);
+    open_start = start(random_number_generator);
+  }
+  for (int pind = 0; pind < totaln; ++pind) {
+    set_state(m, pind, 0);
+  }
+  for (int pind = open_start; pind < open_start + openn; ++pind) {
+    set_state(m, pind, -1);
+  }
+}
+
+//! gate each channel by a Markov model instead of the global phase flips
+void ChannelOscillationStage::set_gating(ChannelMarkovGating *gating) {
+  IMP_USAGE_CHECK(!gating || gating->get_number_of_channels() == get_number_of_channels(),
+                  "the gating must have one state per Ca2+ channel");
+  gating_ = gating;
+}
+
+//! advance the Markov gating and write the channels that opened or closed
+void ChannelOscillationStage::update_gating(Model *m) {
+  bool first = gating_->get_number_of_updates() == 0;
+  gating_->update();
+  if (first) {
+    // the channels may hold the states of the phase flips
+    for (unsigned int i = 0; i < get_number_of_channels(); ++i) {
+      set_state(m, i, gating_->get_is_open(i) ? -1 : 0);
+    }
+    return;
+  }
+  const Ints &changed = gating_->get_changed_channels();
+  for (unsigned int k = 0; k < changed.size(); ++k) {
+    set_state(m, changed[k], gating_->get_is_open(changed[k]) ? -1 : 0);
+  }
+}
+
+/* ---------------- vesicle docking ---------------- */
+
+VesicleDockingStage::VesicleDockingStage
+( SingletonContainerAdaptor vesicles_container,
+  SingletonContainerAdaptor cachannel_container,
+  double contact_range,
+  double slack,
+  int ready_state)
+  : vesicles_container_(vesicles_container),
+  cachannel_container_(cachannel_container),
+  contact_range_(contact_range),
+  slack_(slack),
+  ready_state_(ready_state),
+  steps_(0)
+{
+  close_bipartite_pair_container_ =
+    new container::CloseBipartitePairContainer // pairs (channel, vesicle) within contact_range
+    ( cachannel_container,
+      vesicles_container,
+      contact_range,
+      slack);
+}
+
+VesicleDockingStage::VesicleDockingStage
+( SingletonContainerAdaptor vesicles_container,
+  ChannelSurfaceIndex *channel_index,
+  double contact_range,
+  int ready_state)
+  : vesicles_container_(vesicles_container),
+  channel_index_(channel_index),
+  contact_range_(contact_range),
+  slack_(0),
+  ready_state_(ready_state),
+  steps_(0)
+{}
+
+void VesicleDockingStage::set_neighbor_provider(SharedNeighborProvider *neighbors) {
+  if (!cachannel_container_) {
+    // also in fast builds, the channel particles are dereferenced below
+    IMP_THROW("Shared neighbors need the channels as particles,"
+              << " not a site array or a channel index", UsageException);
+  }
+  IMP_USAGE_CHECK(neighbors->get_distance() >= contact_range_ + slack_,
+                  "the shared close pairs must reach contact_range + slack");
+  neighbors_ = neighbors;
+  // the candidates may hold the channels or their rigid members, e.g., the
+  // cores among the leaves of the hierarchy, but not the docked vesicles
+  Model *m = cachannel_container_->get_model();
+  channel_of_.clear();
+  auto set_channel = [this](ParticleIndex pi, ParticleIndex ci) {
+    if (pi.get_index() >= static_cast<int>(channel_of_.size())) {
+      channel_of_.resize(pi.get_index() + 1, -1);
+    }
+    channel_of_[pi.get_index()] = ci.get_index();
+  };
+  for (ParticleIndex ci : cachannel_container_->get_contents()) {
+    set_channel(ci, ci);
+    for (ParticleIndex mi : core::RigidBody(m, ci).get_member_indexes()) {
+      if (!DockingStateDecorator::get_is_setup(m, mi)) {
+        set_channel(mi, ci);
+      }
+    }
+  }
+}
+
+void VesicleDockingStage::update(Model *m) {
+  if (scheduler_) {
+    release_due_vesicles(m);
+  }
+  if (channel_index_ && channel_index_->get_site_array()) {
+    dock_with_site_array(m);
+  }
+  else if (channel_index_) {
+    dock_with_channel_index(m);
+  }
+  else if (neighbors_) {
+    dock_with_neighbor_provider(m);
+  }
+  else {
+    dock_with_pair_container(m);
+  }
+  if (active_set_) {
+    active_set_->update();
+  }
+}
+
+//! dock the (channel, vesicle) pairs of the close pair container
+void VesicleDockingStage::dock_with_pair_container(Model *m) {
+  close_bipartite_pair_container_->do_score_state_before_evaluate();
+  IMP_CONTAINER_FOREACH   // The macros take the name of the container and the operation to perform.
+  (container::CloseBipartitePairContainer,
+   close_bipartite_pair_container_,
+   {
+    ParticleIndexPair const& pip = _1;
+    rigidify_pair(m, pip);
+   }
+  );
+}
+
+//! dock the (channel, vesicle) pairs among the candidates of the shared close pair list
+void VesicleDockingStage::dock_with_neighbor_provider(Model *m) {
+  neighbors_->update(); // the particles moved since the last evaluation
+  Ints is_vesicle;
+  for (ParticleIndex pi : vesicles_container_->get_contents()) {
+    if (pi.get_index() >= static_cast<int>(is_vesicle.size())) {
+      is_vesicle.resize(pi.get_index() + 1, 0);
+    }
+    is_vesicle[pi.get_index()] = 1;
+  }
+  auto get_channel = [this](ParticleIndex pi) {
+    return pi.get_index() < static_cast<int>(channel_of_.size())
+           ? channel_of_[pi.get_index()] : -1;
+  };
+  auto get_is_vesicle = [&is_vesicle](ParticleIndex pi) {
+    return pi.get_index() < static_cast<int>(is_vesicle.size())
+           && is_vesicle[pi.get_index()];
+  };
+  // a channel may be in the list both as a particle and through its core
+  std::vector<std::pair<int, int> > docking_pairs;
+  for (const ParticleIndexPair &pip : neighbors_->get_candidate_pairs()) {
+    for (unsigned int k = 0; k < 2; ++k) {
+      int channel = get_channel(pip[k]);
+      ParticleIndex vi = pip[1 - k];
+      if (channel < 0 || !get_is_vesicle(vi)) {
+        continue;
+      }
+      // the fixed cutoff of the docking rule, contact range plus slack; the close
+      // pair container instead docks every pair it lists, all those within the
+      // contact range and, depending on when it was rebuilt, some up to
+      // contact range + 2 * slack, so the two do not dock the same pairs
+      if (algebra::get_distance(core::XYZR(m, ParticleIndex(channel)).get_sphere(),
+                                core::XYZR(m, vi).get_sphere())
+          <= contact_range_ + slack_) {
+        docking_pairs.push_back(std::make_pair(channel, vi.get_index()));
+      }
+    }
+  }
+  std::sort(docking_pairs.begin(), docking_pairs.end());
+  docking_pairs.erase(std::unique(docking_pairs.begin(), docking_pairs.end()),
+                      docking_pairs.end());
+  for (const std::pair<int, int> &dp : docking_pairs) {
+    rigidify_pair(m, ParticleIndexPair(ParticleIndex(dp.first), ParticleIndex(dp.second)));
+  }
+}
+
+//! release the vesicles whose undocking event is due
+void VesicleDockingStage::release_due_vesicles(Model *m) {
+  LifecycleEvents due = scheduler_->pop_due_events(UNDOCK_EVENT);
+  for (unsigned int i = 0; i < due.size(); ++i) {
+    if (due[i].channel == ParticleIndex()) {
+      release_site(m, due[i].vesicle);
+    } else {
+      release_pair(m, ParticleIndexPair(due[i].channel, due[i].vesicle));
+    }
+    // secreted later in this same update
+    scheduler_->schedule(0, SECRETION_EVENT, due[i].vesicle, due[i].channel);
+  }
+}
+
+//! look up the docking candidates of each near-membrane vesicle in the channel index
+void VesicleDockingStage::dock_with_channel_index(Model *m) {
+  ParticleIndexes vesicles = vesicles_container_->get_contents();
+  for (ParticleIndex pi : vesicles) {
+    core::XYZR xyzr(m, pi);
+    if (!channel_index_->get_is_near_surface(xyzr.get_coordinates())) {
+      continue; // deep in the cytoplasm, no channel in reach
+    }
+    ParticleIndexes channels =
+      channel_index_->get_channels_in_contact(xyzr.get_sphere(), contact_range_);
+    for (ParticleIndex ci : channels) {
+      rigidify_pair(m, ParticleIndexPair(ci, pi));
+    }
+  }
+}
+
+//! dock vesicles to the open sites of the site array of the channel index
+void VesicleDockingStage::dock_with_site_array(Model *m) {
+  ChannelSiteArray *sites = channel_index_->get_site_array();
+  IntKey dk = DockingStateDecorator::get_dstate_key();
+  IntKey sk = DockingStateDecorator::get_site_key();
+  ParticleIndexes vesicles = vesicles_container_->get_contents();
+  for (ParticleIndex pi : vesicles) {
+    int dstate = m->get_attribute(dk, pi);
+    if (m->get_has_attribute(sk, pi) && m->get_attribute(sk, pi) >= 0) {
+      if (dstate == ready_state_ && !scheduler_){
+        release_site(m, pi);
+      }
+      continue;
+    }
+    if (dstate != 0) {
+      continue;
+    }
+    core::XYZR xyzr(m, pi);
+    if (!channel_index_->get_is_near_surface(xyzr.get_coordinates())) {
+      continue; // deep in the cytoplasm, no channel in reach
+    }
+    Ints in_contact = channel_index_->get_sites_in_contact(xyzr.get_sphere(), contact_range_);
+    for (int site : in_contact) {
+      if (sites->get_is_open(site)) {
+        dock_to_site(m, pi, site);
+        break;
+      }
+    }
+  }
+}
+
+//! freeze the insulin vesicle at the channel site
+void VesicleDockingStage::dock_to_site(Model *m, ParticleIndex pi, int site) {
+  core::XYZ(m, pi).set_coordinates_are_optimized(false);
+  if (active_set_) {
+    active_set_->set_is_frozen(pi, true);
+  }
+  m->set_attribute(DockingStateDecorator::get_dstate_key(), pi, -1);
+  DockingStateDecorator(m, pi).set_site(site);
+  if (event_log_) {
+    event_log_->add_docking(pi, site, steps_);
+  }
+  if (scheduler_) {
+    // no channel particle, the undocking event releases the site
+    scheduler_->schedule(ready_state_, UNDOCK_EVENT, pi);
+  }
+}
+
+//! release the insulin vesicle from its channel site
+void VesicleDockingStage::release_site(Model *m, ParticleIndex pi) {
+  m->set_attribute(DockingStateDecorator::get_site_key(), pi, -1);
+}
+
+//! rigidify the calcium channel and insulin vesicle upon docking
+void VesicleDockingStage::rigidify_pair(Model *m, ParticleIndexPair pip) {
+  IMP_USAGE_CHECK(core::XYZR::get_is_setup(m, pip[0]),
+                  "particles for rigidifications must be spheres as well");
+  IntKey dk = DockingStateDecorator::get_dstate_key();
+  int dstate = m->get_attribute(dk, pip[1]);
+  core::RigidBody rb0= core::RigidBody(m, pip[0]);
+  ParticleIndexes members = rb0.get_member_indexes();
+  if (std::find(members.begin(), members.end(), pip[1]) != members.end()) {
+    if (dstate == ready_state_ && !scheduler_){
+      release_pair(m, pip);
+    }
+  }
+  else if (dstate == 0){
+    int channelstate = m->get_attribute(CaChannelStateDecorator::get_channelstate_key(), pip[0]);
+    if (channelstate == -1){
+      core::XYZR caxyzr(m, pip[0]); // granule
+      core::XYZR xyzr(m, pip[1]); // glucose
+      double original_radius= caxyzr.get_radius();
+      rb0.add_member(pip[1]);
+      caxyzr.set_radius(original_radius);
+      xyzr.set_coordinates_are_optimized(false);
+      if (active_set_) {
+        active_set_->set_is_frozen(pip[1], true);
+      }
+      m->set_attribute(dk, pip[1], -1);
+      if (event_log_) {
+        event_log_->add_docking(pip[1], pip[0].get_index(), steps_);
+      }
+      if (scheduler_) {
+        scheduler_->schedule(ready_state_, UNDOCK_EVENT, pip[1], pip[0]);
+      }
+    }
+  }
+}
+
+//! release the insulin vesicle from the calcium channel
+void VesicleDockingStage::release_pair(Model *m, ParticleIndexPair pip) {
+  core::RigidBody rb0= core::RigidBody(m, pip[0]);
+  core::XYZR caxyzr(m, pip[0]); // granule
+  double original_radius= caxyzr.get_radius();
+  rb0.remove_member(pip[1]);
+  caxyzr.set_radius(original_radius);
+}
+
+/* ---------------- vesicle secretion ---------------- */
+
+VesicleSecretionStage::VesicleSecretionStage
+( ParticleIndexesAdaptor vesicles,
+  algebra::Sphere3D nucleus_sphere,
+  int ready_state,
+  double cut_off)
+  : vesicles_(vesicles.begin(), vesicles.end()),
+  nucleus_sphere_(nucleus_sphere),
+  ready_state_(ready_state),
+  cut_off_(cut_off),
+  steps_(0)
+{}
+
+//! sort the vesicles in the given order, the vesicles not in it last
+void VesicleSecretionStage::set_order(ParticleIndexesAdaptor order) {
+  int max_index = -1;
+  for (ParticleIndex pi : vesicles_) {
+    max_index = std::max(max_index, pi.get_index());
+  }
+  Ints rank(max_index + 1, order.size());
+  for (unsigned int i = 0; i < order.size(); ++i) {
+    if (order[i].get_index() <= max_index) {
+      rank[order[i].get_index()] = i;
+    }
+  }
+  std::stable_sort(vesicles_.begin(), vesicles_.end(),
+                   [&rank](ParticleIndex a, ParticleIndex b) {
+                     return rank[a.get_index()] < rank[b.get_index()];
+                   });
+}
+
+//! update the secretion counter decorator
+void VesicleSecretionStage::update(Model *m) {
+  // every vesicle gains one maturation state, computed from its birth tick
+  LifecycleClock::get_clock(m)->advance();
+  IntKey dk = DockingStateDecorator::get_dstate_key();
+  if (!scheduler_) {
+    for (ParticleIndex pi : vesicles_) {
+      int dstate = m->get_attribute(dk, pi);
+      if (dstate == -1){
+        m->set_attribute(dk, pi, 1);
+      }
+      else if (dstate == ready_state_){
+        secrete(m, pi);
+      }
+      else if (dstate >= 1 && dstate < ready_state_){
+        m->set_attribute(dk, pi, dstate + 1);
+      }
+      else if (dstate > ready_state_){
+        std::cerr << "Error: Incorrect docking state of insulin vesicless." << std::endl;
+        exit(1);
+      }
+    }
+  } else {
+    // the docking states are driven by the scheduled events
+    LifecycleEvents due = scheduler_->pop_due_events(SECRETION_EVENT);
+    for (unsigned int i = 0; i < due.size(); ++i) {
+      secrete(m, due[i].vesicle);
+    }
+  }
+  if (active_set_) {
+    active_set_->update();
+  }
+}
+
+//! Count the secretion of a vesicle and reset it near the nucleus
+void VesicleSecretionStage::secrete(Model *m, ParticleIndex pi) {
+  IntKey sk = SecretionCounterDecorator::get_secretion_key();
+  m->set_attribute(sk, pi, m->get_attribute(sk, pi) + 1); // the count of secretion evens is +1
+  if (event_log_) {
+    event_log_->add_secretion(pi, core::XYZ(m, pi).get_coordinates(), steps_);
+  }
+  MaturationStateDecorator(m, pi).set_state(0); // reset to the imature state
+  m->set_attribute(DockingStateDecorator::get_dstate_key(), pi, 0);
+  do_reset(m, pi);
+}
+
+//! the nucleus of the cell of vesicle pi
+algebra::Sphere3D VesicleSecretionStage::get_nucleus_sphere(ParticleIndex pi) const {
+  int cell = cells_ ? cells_->get_cell(pi) : -1;
+  return cell >= 0 ? cells_->get_nucleus_sphere(cell) : nucleus_sphere_;
+}
+
+//! Reset insulin vesicles
+void VesicleSecretionStage::do_reset(Model *m, ParticleIndex pi) {
+  IMP_LOG_TERSE("Reseting: " << m->get_particle(pi)->get_name() << std::endl);
+  core::XYZR xyzr0(m, pi); // granule
+  algebra::Sphere3D nucleus_sphere = get_nucleus_sphere(pi);
+  algebra::Sphere3D near_nucleus = algebra::Sphere3D(nucleus_sphere.get_center(),
+                                                   nucleus_sphere.get_radius() + cut_off_ - xyzr0.get_radius());
+  algebra::Vector3D v2 = get_random_vector_in(m, near_nucleus, nucleus_sphere, xyzr0);
+  xyzr0.set_coordinates(v2); // reset the insulin vesicles
+  xyzr0.set_coordinates_are_optimized(true);
+  if (active_set_) {
+    active_set_->set_is_frozen(pi, false);
+  }
+}
+
+//! reset the position of vesicles
+algebra::Vector3D VesicleSecretionStage::get_random_vector_in
+( Model *m, algebra::Sphere3D sphere, algebra::Sphere3D nucleus_sphere,
+  core::XYZR xyzr) const {
+  IMP_LOG_TERSE("Searching for the a random vector to reset" << std::endl);
+  int i = 1;
+  while (true) {
+    algebra::Vector3D random_vector = algebra::get_random_vector_in(sphere);
+    algebra::Vector3D new_v_from_origin= (random_vector - nucleus_sphere.get_center());
+    double new_d_from_origin= new_v_from_origin.get_magnitude();
+    if (new_d_from_origin > nucleus_sphere.get_radius() + xyzr.get_radius()){
+      bool overlap1 = false;
+      for (ParticleIndex pi : vesicles_) {
+        core::XYZR xyzr0(m, pi); // vesicle
+        double distance1 = (random_vector - xyzr0.get_coordinates()).get_magnitude();
+        if (distance1 <= xyzr.get_radius() + xyzr0.get_radius()){
+          overlap1 = true;
+          break;
+        }
+      }
+      if(overlap1 == false){
+        IMP_LOG_TERSE("Searched"<< i << "for the a random vector to reset" << std::endl);
+        return random_vector;
+      }
+    }
+    i++;
+  }
+}
+
+IMPINSULINSECRETION_END_INTERNAL_NAMESPACE
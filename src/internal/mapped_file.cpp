@@ -0,0 +1,60 @@
+/**
+ *  \file IMP/insulinsecretion/internal/mapped_file.cpp
+ *  \brief A read-only memory mapping of a file.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/internal/mapped_file.h>
+#include <IMP/exception.h>
+#include <fstream>
+#include <iterator>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IMPINSULINSECRETION_HAS_MMAP 1
+#endif
+
+IMPINSULINSECRETION_BEGIN_INTERNAL_NAMESPACE
+
+MappedFile::MappedFile(std::string file_name) : data_(nullptr), size_(0) {
+#ifdef IMPINSULINSECRETION_HAS_MMAP
+  int fd = open(file_name.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0) {
+    size_ = st.st_size;
+    if (size_ > 0) {
+      void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        madvise(p, size_, MADV_SEQUENTIAL); // read ahead, drop pages behind
+        data_ = static_cast<const char *>(p);
+      }
+    }
+    close(fd);
+    if (data_ || size_ == 0) {
+      return;
+    }
+  } else if (fd >= 0) {
+    close(fd);
+  }
+#endif
+  std::ifstream in(file_name.c_str(), std::ios::binary);
+  if (!in) {
+    IMP_THROW("Cannot open " << file_name, IOException);
+  }
+  buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+}
+
+MappedFile::~MappedFile() {
+#ifdef IMPINSULINSECRETION_HAS_MMAP
+  if (data_ && buffer_.empty() && size_ > 0) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+#endif
+}
+
+IMPINSULINSECRETION_END_INTERNAL_NAMESPACE
@@ -0,0 +1,59 @@
+/**
+ *  \file IMP/insulinsecretion/internal/radius_classes.cpp
+ *  \brief Geometric size classes of polydisperse spheres.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/internal/radius_classes.h>
+#include <IMP/check_macros.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+IMPINSULINSECRETION_BEGIN_INTERNAL_NAMESPACE
+
+//! Assign the radii to geometric size classes
+Floats get_radius_classes(const Floats &radii, double ratio, Ints &classes) {
+  IMP_USAGE_CHECK(ratio > 1, "the ratio of the radius classes must exceed 1");
+  classes.assign(radii.size(), 0);
+  if (radii.empty()) {
+    return Floats();
+  }
+  // the smallest positive radius, points join the first class
+  double r0 = std::numeric_limits<double>::max();
+  for (unsigned int i = 0; i < radii.size(); ++i) {
+    if (radii[i] > 0) {
+      r0 = std::min(r0, radii[i]);
+    }
+  }
+  double log_ratio = std::log(ratio);
+  int n_bins = 1;
+  for (unsigned int i = 0; i < radii.size(); ++i) {
+    if (radii[i] > r0) {
+      classes[i] = static_cast<int>(std::floor(std::log(radii[i] / r0) / log_ratio));
+      n_bins = std::max(n_bins, classes[i] + 1);
+    }
+  }
+  // drop the empty bins
+  Floats max_radii(n_bins, 0);
+  Ints counts(n_bins, 0);
+  for (unsigned int i = 0; i < radii.size(); ++i) {
+    max_radii[classes[i]] = std::max(max_radii[classes[i]], radii[i]);
+    ++counts[classes[i]];
+  }
+  Ints renumbered(n_bins, -1);
+  Floats ret;
+  for (int b = 0; b < n_bins; ++b) {
+    if (counts[b] > 0) {
+      renumbered[b] = ret.size();
+      ret.push_back(max_radii[b]);
+    }
+  }
+  for (unsigned int i = 0; i < radii.size(); ++i) {
+    classes[i] = renumbered[classes[i]];
+  }
+  return ret;
+}
+
+IMPINSULINSECRETION_END_INTERNAL_NAMESPACE
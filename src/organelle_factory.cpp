@@ -0,0 +1,115 @@
+/**
+ *  \file IMP/insulinsecretion/organelle_factory.cpp
+ *  \brief Create populations of insulin vesicles and Ca2+ channels in bulk.
+ *
+ *  Copyright 2007-2019 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/insulinsecretion/organelle_factory.h>
+#include <IMP/insulinsecretion/CaChannelStateDecorator.h>
+#include <IMP/insulinsecretion/DockingStateDecorator.h>
+#include <IMP/insulinsecretion/MaturationStateDecorator.h>
+#include <IMP/insulinsecretion/SecretionCounterDecorator.h>
+#include <IMP/atom/Diffusion.h>
+#include <IMP/atom/Mass.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/core/rigid_bodies.h>
+#include <IMP/display/Colored.h>
+#include <sstream>
+
+IMPINSULINSECRETION_BEGIN_NAMESPACE
+
+namespace {
+//! add n particles named prefix_i (and the suffix), returns their indexes
+ParticleIndexes add_particles(Model *m, unsigned int n, std::string prefix,
+                              std::string suffix = "") {
+  ParticleIndexes ret(n);
+  for (unsigned int i = 0; i < n; ++i) {
+    std::ostringstream oss;
+    oss << prefix << "_" << i << suffix;
+    ret[i] = m->add_particle(oss.str());
+  }
+  return ret;
+}
+
+//! an optimized sphere with a (fake) mass, as _create_vesicle_core() in OrganelleFactory.py
+void setup_sphere(Model *m, ParticleIndex pi, const algebra::Vector3D &v,
+                  double radius) {
+  core::XYZR xyzr = core::XYZR::setup_particle(m, pi, algebra::Sphere3D(v, radius));
+  xyzr.set_coordinates_are_optimized(true);
+  atom::Mass::setup_particle(m, pi, 1);
+}
+
+//! a hierarchy root with a (fake) mass and the given children
+atom::Hierarchy create_root(Model *m, std::string name,
+                            const ParticleIndexes &children) {
+  ParticleIndex root = m->add_particle(name);
+  atom::Mass::setup_particle(m, root, 1.0);
+  return atom::Hierarchy::setup_particle(m, root, children);
+}
+}
+
+//! create insulin vesicles at the given positions
+atom::Hierarchy create_vesicles
+( Model *m,
+  const algebra::Vector3Ds &positions,
+  double radius,
+  double diffusion_coefficient,
+  std::string name) {
+  return create_vesicles(m, positions, Floats(positions.size(), radius),
+                         diffusion_coefficient, name);
+}
+
+//! create insulin vesicles of the given radii at the given positions
+atom::Hierarchy create_vesicles
+( Model *m,
+  const algebra::Vector3Ds &positions,
+  const Floats &radii,
+  double diffusion_coefficient,
+  std::string name) {
+  IMP_USAGE_CHECK(positions.size() == radii.size(),
+                  "There must be one radius per vesicle position");
+  ParticleIndexes vesicles = add_particles(m, positions.size(), "Vesicle");
+  // the last particle first, so each attribute table is resized once
+  for (int i = vesicles.size() - 1; i >= 0; --i) {
+    ParticleIndex pi = vesicles[i];
+    setup_sphere(m, pi, positions[i], radii[i]);
+    atom::Hierarchy::setup_particle(m, pi);
+    display::Colored::setup_particle(m, pi, display::get_display_color(0));
+    atom::Diffusion::setup_particle(m, pi, diffusion_coefficient);
+    SecretionCounterDecorator::setup_particle(m, pi, 0);
+    MaturationStateDecorator::setup_particle(m, pi, 0);
+    DockingStateDecorator::setup_particle(m, pi, 0);
+  }
+  return create_root(m, name, vesicles);
+}
+
+//! create Ca2+ channels at the given sites on the cell membrane
+atom::Hierarchy create_ca_channels
+( Model *m,
+  const algebra::Vector3Ds &sites,
+  const Ints &initial_states,
+  double radius,
+  std::string name) {
+  IMP_USAGE_CHECK(sites.size() == initial_states.size(),
+                  "There must be one initial state per channel site");
+  ParticleIndexes channels = add_particles(m, sites.size(), "CaChannel");
+  ParticleIndexes cores = add_particles(m, sites.size(), "CaChannel", "_core");
+  for (int i = channels.size() - 1; i >= 0; --i) {
+    setup_sphere(m, cores[i], sites[i], radius);
+    atom::Hierarchy::setup_particle(m, cores[i]);
+  }
+  for (int i = channels.size() - 1; i >= 0; --i) {
+    ParticleIndex pi = channels[i];
+    setup_sphere(m, pi, sites[i], radius);
+    display::Colored::setup_particle(m, pi, display::get_display_color(1));
+    CaChannelStateDecorator::setup_particle(m, pi, initial_states[i]);
+    atom::Hierarchy::setup_particle(m, pi, ParticleIndexes(1, cores[i]));
+    // the core particle is the first rigid member, docked vesicles are added later
+    core::RigidBody rb = core::RigidBody::setup_particle(m, pi, ParticleIndexes(1, cores[i]));
+    rb.set_coordinates_are_optimized(true);
+  }
+  return create_root(m, name, channels);
+}
+
+IMPINSULINSECRETION_END_NAMESPACE
@@ -107,3 +107,15 @@ class CaChannelFactory:
         h.add_child(IMP.atom.Hierarchy(p_cachannel_core))
         rb.set_coordinates_are_optimized(True)
         return p
+
+def create_cachannel_site_array(V_cachannel, R, n_open):
+    '''
+    Create a ChannelSiteArray of Ca2+ channels at positions V_cachannel
+    with radius R, where the first n_open channels are open; the channels
+    are not particles of the model
+    '''
+    sites= IMP.insulinsecretion.ChannelSiteArray(
+        [IMP.algebra.Vector3D(v) for v in V_cachannel], R, 0)
+    for i in range(n_open):
+        sites.set_state(i, -1)
+    return sites
@@ -13,8 +13,10 @@ import IMP.display
 import numpy as np
 import OrganelleFactory
 import time
+import os
 import random
 import IMP.insulinsecretion
+import IMP.insulinsecretion.cell
 
 # set time
 start=time.time()
@@ -38,14 +40,32 @@ def convert_time_ns_to_frames(time_ns, step_size_fs):
     n_frames= int(round(n_frames_float))
     return max(n_frames, 1)
 
-def get_random_vesicles_in_cytoplasm(outer_sphere, inner_sphere, N_vesicles, R_vesicle):
+def get_vesicle_radii(N_vesicles, R_mean, cv, max_ratio):
+    '''
+    Return N_vesicles log-normal radii of mean R_mean and coefficient of variation cv,
+    redrawing those outside a max_ratio-fold range around R_mean. All are R_mean if cv is 0.
+    '''
+    if cv == 0:
+        return [float(R_mean)] * N_vesicles
+    sigma = np.sqrt(np.log(1 + cv*cv))
+    mu = np.log(R_mean) - sigma*sigma/2
+    R_min, R_max = R_mean/np.sqrt(max_ratio), R_mean*np.sqrt(max_ratio)
+    radii = []
+    while len(radii) < N_vesicles:
+        r = random.lognormvariate(mu, sigma)
+        if R_min <= r <= R_max:
+            radii.append(r)
+    return radii
+
+def get_random_vesicles_in_cytoplasm(outer_sphere, inner_sphere, radii):
     '''
     Return random vectors inside the cell (=outer) sphere and
-    outside the nuclear envelope (=inner) sphere, and make sure they do not overlap 
-    with each other and with the boundaries.
+    outside the nuclear envelope (=inner) sphere, one per radius, and make sure the vesicles
+    do not overlap with each other and with the boundaries.
     '''
     V_vesicles = []
     while True:
+        R_vesicle = radii[len(V_vesicles)]
         R_inner= inner_sphere.get_radius() + R_vesicle
         R_outer= outer_sphere.get_radius() - R_vesicle
         vector = IMP.algebra.get_random_vector_in(outer_sphere)
@@ -54,13 +74,13 @@ def get_random_vesicles_in_cytoplasm(outer_sphere, inner_sphere, N_vesicles, R_v
                 V_vesicles.append(list(vector))
             elif len(V_vesicles) > 0:
                 overlap = False
-                for V in V_vesicles:
-                    if (vector-V).get_magnitude() <= 2*R_vesicle:
+                for V, R_V in zip(V_vesicles, radii):
+                    if (vector-V).get_magnitude() <= R_vesicle + R_V:
                         overlap = True
                         break
                 if not overlap:
                     V_vesicles.append(list(vector))
-        if len(V_vesicles) == N_vesicles:
+        if len(V_vesicles) == len(radii):
             return V_vesicles
 
 def get_uniform_cacium_channel_on_cell(outer_sphere, N_CaChannel):
@@ -99,6 +119,16 @@ def do_stats_after_optimize(vesicles):
         docked.append(IMP.insulinsecretion.DockingStateDecorator(g).get_dstate())
     return coord, distance, mature, docked
 
+class MaturationStateWriter(IMP.OptimizerState):
+    '''write the maturation states of the vesicles to their attributes, for the RMF frames'''
+    def __init__(self, m, vesicles, period):
+        IMP.OptimizerState.__init__(self, m, "MaturationStateWriter%1%")
+        self.vesicles = vesicles
+        self.set_period(period)
+
+    def do_update(self, call_num):
+        IMP.insulinsecretion.MaturationStateDecorator.update_states(self.get_model(), self.vesicles)
+
 # --------------------
 
 # Set simulation parameters
@@ -111,11 +141,19 @@ R = 30250 # PBC radius, A
 R_NUCLEUS = 18340 # NE radius, A
 N_VESICLES = 200 # Number of vesicles
 R_VESICLES = 1200 # Radius of vesicles, A
+R_VESICLES_CV = 0 # coefficient of variation of the log-normal vesicle radii around R_VESICLES, 0 for all R_VESICLES
+R_VESICLES_RANGE = 3 # the vesicle radii are within a R_VESICLES_RANGE-fold range around R_VESICLES
 D_VESICLES = 2.3E-10 # diffusion coefficient of vesicles, A^2/fs.
 R_CaChannel = 100 # Ca2+ microdomain radius, A
 N_CaChannel = 451 # Number of Ca2+ channels.
 N_trough = 3 # Number of Ca2+ channels in the opening state at the trough
 N_peak = 450 # Number of Ca2+ channels in the opening state at the peak
+CHANNEL_SITE_ARRAY = False # store Ca2+ channels as a ChannelSiteArray instead of rigid-body particles
+ACTIVE_SET = False # skip frozen (docked and static) particles in the singleton and excluded volume restraints
+HYBRID_FIELD = False # represent free vesicles deep in the cytoplasm as a radial concentration field, requires ACTIVE_SET
+FIELD_DISTANCE = (R - R_NUCLEUS)/2 # vesicles farther than this from the membrane are in the field, A
+SPATIAL_REORDER = False # sort the active set along a Morton curve every ISOS_PERIOD frames, requires ACTIVE_SET
+SHARED_NEIGHBORS = False # one close pair list for the excluded volume and the docking pass, requires neither ACTIVE_SET nor CHANNEL_SITE_ARRAY
 
 # II. Interaction parameters
 K_BB = 1E-5  # Strength of the harmonic boundary box in kcal/mol/A^2
@@ -128,6 +166,10 @@ VDOS_PERIOD = 10 # update the maturation secretion decorator periodically.
 
 Oscillation = 80 # number of steps to update the Ca2+ channel opening state, Oscillation*OscillationPeriod = 800, 8s
 OscillationPeriod = VDOS_PERIOD # oscillation period
+MARKOV_GATING = False # gate each Ca2+ channel stochastically, driven by the trough/peak oscillation, instead of flipping them together
+GATING_RATE = 10 # rate at which the channels follow the drive, 1/s
+INACTIVATION_RATE = 0 # rate of open -> inactivated channels, 1/s, 0 for two-state gating
+RECOVERY_RATE = 0 # rate of inactivated -> closed channels, 1/s
 
 ISOS_CUT_OFF = (R - R_NUCLEUS)/3 # cut-off from the NE surface to reset vesicles, has to be larger than R_vesicleS*2, A
 ISOS_PERIOD = VDOS_PERIOD # update the maturation secretion decorator periodically.
@@ -156,6 +198,33 @@ sim_time_frames= convert_time_ns_to_frames(sim_time_ns, bd_step_size_fs)
 tot_frames = int(sim_time_frames/VDOS_PERIOD) # Total frames to save
 RMF_DUMP_INTERVAL_NS= sim_time_ns / tot_frames
 rmf_dump_interval_frames= convert_time_ns_to_frames(RMF_DUMP_INTERVAL_NS, bd_step_size_fs)
+COMPACT_TRAJECTORY = False # write the compact vesicle trajectory instead of the full RMF, convert with insulinsecretion_trajectory_to_rmf
+COMPACT_RESOLUTION = 1.0 # quantization step of the vesicle coordinates in the compact trajectory, A
+ASYNC_OUTPUT = False # write the .xvg files, the secretion events and the compact trajectory on background threads (the RMF file is always written in the loop)
+DIFFUSION_ESTIMATE = False # estimate the apparent diffusion coefficient of free vesicles on the fly, requires MULTI_RATE off
+MULTI_RATE = False # advance the vesicles far from the membrane and the nucleus MULTI_RATE_SUBSTEPS BD steps at once
+MULTI_RATE_SUBSTEPS = VDOS_PERIOD # BD steps per coarse step of the bulk vesicles, must divide the optimizer state periods
+# vesicles closer than this to the membrane or the nucleus take every BD step, A: the contact range
+# plus 3 rms displacements of a coarse step, so bulk vesicles cannot jump into the docking range
+MULTI_RATE_DISTANCE = IMP.insulinsecretion.MultiRateBrownianDynamics.get_minimum_fine_distance(
+    VDOS_CONTACT_RANGE, D_VESICLES, bd_step_size_fs, MULTI_RATE_SUBSTEPS)
+SINGLE_PRECISION = False # evaluate the RDF and trafficking scores in float and store the diffusion history as float
+STEADY_STATE = False # end the run once the steady-state statistics reach the precisions below, SIM_TIME_SEC is the longest run
+STEADY_STATE_BURN_IN = 100 # lifecycle periods discarded before the batch means start
+STEADY_STATE_RATE_PRECISION = 0.05 # confidence half-width of the secretion rate, 1/s
+STEADY_STATE_DOCKED_PRECISION = 0.01 # confidence half-width of the docked fraction
+STEADY_STATE_SHELL_PRECISION = 0.02 # confidence half-width of the occupancy of each radial shell
+EQUILIBRATION_SEC = 0 # diffuse the vesicles without docking or secretion before the run, s
+CONFIGURATION_CACHE = None # directory of equilibrated configurations keyed by the parameters, a matching one replaces the equilibration
+CACHE_PERTURBATION = R_VESICLES/10 # the vesicles of a cached configuration are moved by up to this, A
+
+if (HYBRID_FIELD or SPATIAL_REORDER) and not ACTIVE_SET:
+    raise ValueError("HYBRID_FIELD and SPATIAL_REORDER require ACTIVE_SET")
+if SHARED_NEIGHBORS and (ACTIVE_SET or CHANNEL_SITE_ARRAY):
+    raise ValueError("SHARED_NEIGHBORS requires neither ACTIVE_SET nor CHANNEL_SITE_ARRAY")
+if DIFFUSION_ESTIMATE and MULTI_RATE:
+    # the bulk vesicles stand still between coarse steps, so their MSD would be biased low
+    raise ValueError("DIFFUSION_ESTIMATE requires MULTI_RATE off")
 
 # --------------------
 
@@ -173,11 +242,17 @@ c2 - 16.7 Glu + Ex - 30 min
 '''
 
 f1=open(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_record.txt', 'w')
-f2=open(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_secretion.xvg','w')
-f3=open(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_coord.xvg','w')
-f4=open(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_VESICLE-NE_distance.xvg','w')
-f5=open(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_maturation.xvg','w')
-f6=open(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_docked.xvg','w')
+def open_output(file_name):
+    # a writer thread takes file.write() off the simulation loop, print(..., file=) works on both
+    if ASYNC_OUTPUT:
+        return IMP.insulinsecretion.AsyncOutputWriter(file_name, 1 << 16)
+    return open(file_name, 'w')
+
+f2=open_output(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_secretion.xvg')
+f3=open_output(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_coord.xvg')
+f4=open_output(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_VESICLE-NE_distance.xvg')
+f5=open_output(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_maturation.xvg')
+f6=open_output(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_docked.xvg')
 
 # --------------------
 
@@ -204,45 +279,26 @@ nucleus_sphere= IMP.core.XYZR(p_nucleus).get_sphere()
 
 # II. Vesicles and Ca2+ channels
 # Vectors for vesicles and Ca2+ channels
-V_VESICLES = get_random_vesicles_in_cytoplasm(pbc_sphere, nucleus_sphere, N_VESICLES, R_VESICLES)
+RADII_VESICLES = get_vesicle_radii(N_VESICLES, R_VESICLES, R_VESICLES_CV, R_VESICLES_RANGE)
+V_VESICLES = get_random_vesicles_in_cytoplasm(pbc_sphere, nucleus_sphere, RADII_VESICLES)
 V_CaChannel = get_uniform_cacium_channel_on_cell(pbc_sphere, N_CaChannel)
 
-# Vesicles hierarchy root:
-p_vesicles_root= IMP.Particle(m, "Vesicles")
-IMP.atom.Mass.setup_particle(p_vesicles_root, 1.0) # fake mass
-h_vesicles_root= IMP.atom.Hierarchy.setup_particle(p_vesicles_root)
+# Vesicles hierarchy root and actual vesicles, created in bulk:
+h_vesicles_root= IMP.insulinsecretion.create_vesicles(m, [IMP.algebra.Vector3D(v) for v in V_VESICLES], RADII_VESICLES, D_VESICLES)
 h_root.add_child(h_vesicles_root)
 
-# Actual vesicles:
-for i in range(N_VESICLES):
-    grnf=OrganelleFactory.VesicleFactory(model= m, default_R= R_VESICLES, v =V_VESICLES[i])
-    vesicle= grnf.create_vesicle("Vesicle_{}".format(i))
-    h_vesicle= IMP.atom.Hierarchy(vesicle)
-    #print(h_vesicle.get_children())
-    h_vesicles_root.add_child(h_vesicle)
-    IMP.atom.Diffusion(vesicle).set_diffusion_coefficient(D_VESICLES)
-    #print(IMP.atom.Diffusion(vesicle).get_diffusion_coefficient())
-    #print(IMP.insulinsecretion.DockingStateDecorator(vesicle).get_dstate())
-    #print(IMP.core.XYZR(vesicle).get_radius())
-    
-# Calcium channel hierarchy root:
-p_cachannel_root= IMP.Particle(m, "CaChannel")
-IMP.atom.Mass.setup_particle(p_cachannel_root, 1.0) # fake mass
-h_cachannel_root= IMP.atom.Hierarchy.setup_particle(p_cachannel_root)
+# Calcium channel hierarchy root and actual cachannel:
+if CHANNEL_SITE_ARRAY:
+    p_cachannel_root= IMP.Particle(m, "CaChannel")
+    IMP.atom.Mass.setup_particle(p_cachannel_root, 1.0) # fake mass
+    h_cachannel_root= IMP.atom.Hierarchy.setup_particle(p_cachannel_root)
+    # Static sites without particles, looked up by angle for docking
+    cachannel_sites= OrganelleFactory.create_cachannel_site_array(V_CaChannel, R_CaChannel, N_trough)
+    cachannel_index= IMP.insulinsecretion.ChannelSurfaceIndex(cachannel_sites, pbc_sphere, VDOS_CONTACT_RANGE + max(RADII_VESICLES) + R_CaChannel)
+else:
+    # the first N_trough channels are open
+    h_cachannel_root= IMP.insulinsecretion.create_ca_channels(m, V_CaChannel, [-1] * N_trough + [0] * (N_CaChannel - N_trough), R_CaChannel)
 h_root.add_child(h_cachannel_root)
-
-# Actual cachannel:
-for i in range(N_trough):
-    cachannelf=OrganelleFactory.CaChannelFactory(model= m,default_R= R_CaChannel, v = V_CaChannel[i])
-    cachannel= cachannelf.create_cachannel_with_State("CaChannel_{}".format(i), -1)
-    h_cachannel= IMP.atom.Hierarchy(cachannel)
-    h_cachannel_root.add_child(h_cachannel)
-    
-for i in range(N_trough, N_CaChannel):
-    cachannelf=OrganelleFactory.CaChannelFactory(model= m,default_R= R_CaChannel, v = V_CaChannel[i])
-    cachannel= cachannelf.create_cachannel_with_State("CaChannel_{}".format(i), 0)
-    h_cachannel= IMP.atom.Hierarchy(cachannel)
-    h_cachannel_root.add_child(h_cachannel)
 #print(IMP.core.RigidBody(h_cachannel_root.get_children()[0]).get_rigid_members())
 # --------------------
 
@@ -250,11 +306,35 @@ for i in range(N_trough, N_CaChannel):
 
 # --------------------
 # I. Optimizer States
-cavos= IMP.insulinsecretion.CaChannelOpeningOptimizerState(m, h_cachannel_root.get_children(), Oscillation, N_trough, N_peak, OscillationPeriod)
-
-vdos=IMP.insulinsecretion.VesicleDockingOptimizerState(h_vesicles_root.get_children(), h_cachannel_root.get_children(), VDOS_CONTACT_RANGE, VDOS_SLACK, READY_STATE, VDOS_PERIOD)
-
-isos= IMP.insulinsecretion.InsulinSecretionOptimizerState(m, h_vesicles_root.get_children(),nucleus_sphere, READY_STATE, ISOS_CUT_OFF,ISOS_PERIOD)
+# Ca2+ channel opening, vesicle docking and secretion in one pass (OscillationPeriod = ISOS_PERIOD = VDOS_PERIOD)
+if CHANNEL_SITE_ARRAY:
+    lcos= IMP.insulinsecretion.InsulinCellLifecycleOptimizerState(m, h_vesicles_root.get_children(), cachannel_index, nucleus_sphere, Oscillation, N_trough, N_peak, VDOS_CONTACT_RANGE, READY_STATE, ISOS_CUT_OFF, VDOS_PERIOD)
+else:
+    lcos= IMP.insulinsecretion.InsulinCellLifecycleOptimizerState(m, h_vesicles_root.get_children(), h_cachannel_root.get_children(), nucleus_sphere, Oscillation, N_trough, N_peak, VDOS_CONTACT_RANGE, VDOS_SLACK, READY_STATE, ISOS_CUT_OFF, VDOS_PERIOD)
+
+# Timestamped secretion events (time, vesicle, channel, dock time, position) and the running secretion count
+secretion_log = IMP.insulinsecretion.SecretionEventLog(4096, bd_step_size_fs)
+secretion_events_file = str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_' + str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_secretion_events.bin'
+if ASYNC_OUTPUT:
+    secretion_log.set_output_writer(IMP.insulinsecretion.AsyncOutputWriter(secretion_events_file))
+else:
+    secretion_log.set_output_file(secretion_events_file)
+lcos.set_event_log(secretion_log)
+
+# Per-channel Markov gating, with the open fractions of the trough and the peak as the drive
+if MARKOV_GATING:
+    gating_waveform = [float(N_trough)/N_CaChannel] * (Oscillation + 1) + [float(N_peak)/N_CaChannel] * (Oscillation + 1)
+    gating = IMP.insulinsecretion.ChannelMarkovGating(N_CaChannel, gating_waveform, VDOS_PERIOD * BD_STEP_SIZE_SEC, GATING_RATE, INACTIVATION_RATE, RECOVERY_RATE, int(repeat))
+    lcos.set_gating(gating)
+
+# Vesicles scored by the singleton restraints, all of them or only the diffusing ones
+scored_vesicles = h_vesicles_root.get_children()
+if ACTIVE_SET:
+    vesicle_indexes = set(IMP.get_indexes(h_vesicles_root.get_children()))
+    static_leaves = [l for l in IMP.atom.get_leaves(h_root) if l.get_particle_index() not in vesicle_indexes]
+    active_set = IMP.insulinsecretion.VesicleActiveSet(m, h_vesicles_root.get_children(), static_leaves)
+    lcos.set_active_set(active_set)
+    scored_vesicles = active_set.get_active_container()
 
 # I. Restraintsss
 # Restraints - match score with particles:
@@ -264,20 +344,49 @@ rs = []
 bb_harmonic= IMP.core.HarmonicUpperBound(0, K_BB)
 pbc_bsss = IMP.core.BoundingSphere3DSingletonScore(bb_harmonic, pbc_sphere)
 outer_bbss = IMP.core.BoundingBox3DSingletonScore(bb_harmonic, bb)
-rs.append(IMP.container.SingletonsRestraint(pbc_bsss, h_vesicles_root.get_children()))
-rs.append(IMP.container.SingletonsRestraint(outer_bbss, h_vesicles_root.get_children()))
+rs.append(IMP.container.SingletonsRestraint(pbc_bsss, scored_vesicles))
+rs.append(IMP.container.SingletonsRestraint(outer_bbss, scored_vesicles))
 
 # Add excluded volume restraints among all (close pairs of) particles, slack affects speed only
-ev = IMP.core.ExcludedVolumeRestraint(IMP.atom.get_leaves(h_root), K_EXCLUDED, 10, "EV")
+if ACTIVE_SET:
+    ev = IMP.insulinsecretion.ActiveSetExcludedVolumeRestraint(active_set, K_EXCLUDED, 10, "EV")
+elif SHARED_NEIGHBORS:
+    # the docking pairs are filtered from the excluded volume candidates instead of searched again
+    neighbors = IMP.insulinsecretion.SharedNeighborProvider(IMP.atom.get_leaves(h_root), VDOS_CONTACT_RANGE + VDOS_SLACK, 10)
+    neighbors.set_large_particles([h_nucleus]) # the vesicles and channel cores are gridded by radius class
+    ev = IMP.insulinsecretion.NeighborExcludedVolumeRestraint(neighbors, K_EXCLUDED, "EV")
+    lcos.set_neighbor_provider(neighbors)
+else:
+    ev = IMP.core.ExcludedVolumeRestraint(IMP.atom.get_leaves(h_root), K_EXCLUDED, 10, "EV")
 rs.append(ev)
 
 # Add vesicle trafficking restraint
 gtsc= IMP.insulinsecretion.VesicleTraffickingSingletonScore([0, 0, 0], K_TRAFFIC) # Push particles radially away or towards the center of some sphere
-rs.append(IMP.container.SingletonsRestraint(gtsc,h_vesicles_root.get_children()))
 
 # Add RDF restraints on insulin vesicles
 rdfss= IMP.insulinsecretion.RadialDistributionFunctionSingletonScore(pbc_sphere, nucleus_sphere, PARAM_RDF, K_RDF)
-rs.append(IMP.container.SingletonsRestraint(rdfss, h_vesicles_root.get_children()))
+if MULTI_RATE:
+    # the bulk vesicles are advanced in the radial potential by the simulator, so only the others are scored
+    bd = IMP.insulinsecretion.MultiRateBrownianDynamics(m, h_vesicles_root.get_children(), rdfss, gtsc,
+                                                        MULTI_RATE_DISTANCE, MULTI_RATE_SUBSTEPS)
+    bd.set_contact_range(VDOS_CONTACT_RANGE)
+    if not ACTIVE_SET:
+        scored_vesicles = bd.get_fine_container()
+if SINGLE_PRECISION:
+    # both scores in one batched float pass over the vesicles of the (single) cell
+    cells = IMP.insulinsecretion.CellGeometryTable()
+    cells.set_cell(h_vesicles_root.get_children(), cells.add_cell(pbc_sphere, nucleus_sphere))
+    radial = IMP.insulinsecretion.MultiCellRadialRestraint(scored_vesicles, cells, rdfss, gtsc, 1)
+    radial.set_single_precision(True)
+    rs.append(radial)
+else:
+    rs.append(IMP.container.SingletonsRestraint(gtsc, scored_vesicles))
+    rs.append(IMP.container.SingletonsRestraint(rdfss, scored_vesicles))
+
+# Absorb the free vesicles deep in the cytoplasm into a radial field evolved in the RDF potential
+if HYBRID_FIELD:
+    field = IMP.insulinsecretion.RadialConcentrationField(m, h_vesicles_root.get_children(), active_set, rdfss,
+                                                          FIELD_DISTANCE, bd_step_size_fs, D_VESICLES, 250, 310.15, VDOS_PERIOD)
 
 # Scoring Function from restraints
 sf = IMP.core.RestraintsScoringFunction(rs, "SF")
@@ -288,33 +397,99 @@ sf = IMP.core.RestraintsScoringFunction(rs, "SF")
 
 # --------------------
 
-bd = IMP.atom.BrownianDynamics(m)
+if not MULTI_RATE:
+    bd = IMP.atom.BrownianDynamics(m)
 bd.set_log_level(IMP.SILENT)
 bd.set_scoring_function(sf)
 bd.set_maximum_time_step(bd_step_size_fs) # in femtoseconds
 bd.set_temperature(310.15) #37 celsius, the temperature used in WF experiments
 
+# -------- Equilibration --------
+if EQUILIBRATION_SEC > 0:
+    equilibration_frames = convert_time_ns_to_frames(EQUILIBRATION_SEC * 1E+9, bd_step_size_fs)
+    equilibrated = IMP.insulinsecretion.CellSnapshot(m, h_vesicles_root.get_children(),
+                                                     cachannel_sites if CHANNEL_SITE_ARRAY else None)
+    cache = None
+    if CONFIGURATION_CACHE:
+        if not os.path.isdir(CONFIGURATION_CACHE):
+            os.makedirs(CONFIGURATION_CACHE)
+        cache = IMP.insulinsecretion.ConfigurationCache(CONFIGURATION_CACHE)
+        cache_params = IMP.insulinsecretion.cell.CellParameters(
+            L=L, R=R, R_NUCLEUS=R_NUCLEUS, N_VESICLES=N_VESICLES, D_VESICLES=D_VESICLES,
+            R_CaChannel=R_CaChannel, N_CaChannel=N_CaChannel, N_trough=N_trough,
+            K_BB=K_BB, K_EXCLUDED=K_EXCLUDED, BD_STEP_SIZE_SEC=BD_STEP_SIZE_SEC)
+        cache_key = IMP.insulinsecretion.cell.get_configuration_key(
+            cache_params, RADII_VESICLES, equilibration_frames, K_TRAFFIC, K_RDF, PARAM_RDF,
+            CHANNEL_SITE_ARRAY, ACTIVE_SET, MULTI_RATE, SINGLE_PRECISION)
+    if cache and cache.restore(cache_key, equilibrated, CACHE_PERTURBATION):
+        print("Equilibrated configuration {} restored from the cache".format(cache_key), file = f1)
+    else:
+        bd.optimize(equilibration_frames)
+        if cache:
+            equilibrated.save()
+            cache.store(cache_key, equilibrated)
+
 # -------- Add RMF visualization --------
-rmf = RMF.create_rmf_file(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_'+ str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat.rmf')
-rmf.set_description("Brownian dynamics trajectory with {}fs timestep.\n"\
-                    .format(bd_step_size_fs))
-IMP.rmf.add_hierarchy(rmf, h_root)
-IMP.rmf.add_restraints(rmf, rs)
-IMP.rmf.add_geometry(rmf, IMP.display.BoundingBoxGeometry(bb))
-IMP.rmf.add_geometry(rmf, IMP.display.SphereGeometry(pbc_sphere))
-
-# Pair RMF with model using an OptimizerState ("listener")
-sos = IMP.rmf.SaveOptimizerState(m, rmf)
-sos.set_log_level(IMP.SILENT)
-sos.set_simulator(bd)
-sos.set_period(rmf_dump_interval_frames)
-bd.add_optimizer_state(cavos)
-bd.add_optimizer_state(vdos)
-bd.add_optimizer_state(isos)
-bd.add_optimizer_state(sos)
-
-# Dump initial frame to RMF
-sos.update_always("initial conformation")
+bd.add_optimizer_state(lcos)
+if HYBRID_FIELD:
+    bd.add_optimizer_state(field)
+if SPATIAL_REORDER:
+    # keep neighbouring vesicles next to each other in the containers after the resets
+    sros = IMP.insulinsecretion.SpatialReorderingOptimizerState(m, h_vesicles_root.get_children(), bb, ISOS_PERIOD)
+    sros.set_active_set(active_set)
+    sros.add_lifecycle_state(lcos)
+    bd.add_optimizer_state(sros)
+if DIFFUSION_ESTIMATE:
+    # multi-tau MSD of free vesicles, docked and secreted vesicles restart their history
+    mtds = IMP.insulinsecretion.MultiTauDiffusionOptimizerState(m, h_vesicles_root.get_children(), bd_step_size_fs,
+                                                                16, 16, 1, SINGLE_PRECISION)
+    if SPATIAL_REORDER:
+        sros.add_diffusion_state(mtds)
+    bd.add_optimizer_state(mtds)
+if STEADY_STATE:
+    # batch means of the secretion rate, docked fraction and radial shell occupancy, sampled every lifecycle period
+    ssos = IMP.insulinsecretion.SteadyStateOptimizerState(m, h_vesicles_root.get_children(), pbc_sphere, nucleus_sphere,
+                                                          bd_step_size_fs, 5, STEADY_STATE_BURN_IN, 10, ISOS_PERIOD)
+    ssos.set_precision(IMP.insulinsecretion.SECRETION_RATE_OBSERVABLE, STEADY_STATE_RATE_PRECISION)
+    ssos.set_precision(IMP.insulinsecretion.DOCKED_FRACTION_OBSERVABLE, STEADY_STATE_DOCKED_PRECISION)
+    ssos.set_precision(IMP.insulinsecretion.SHELL_OCCUPANCY_OBSERVABLE, STEADY_STATE_SHELL_PRECISION)
+    bd.add_optimizer_state(ssos)
+if COMPACT_TRAJECTORY:
+    # Static particles are written once, then only vesicle coordinates and lifecycle changes
+    trajectory_file = str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_'+ str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat.trj'
+    if ASYNC_OUTPUT:
+        # the frames are encoded and written on the writer thread
+        trajectory_file = IMP.insulinsecretion.AsyncOutputWriter(trajectory_file)
+    cos = IMP.insulinsecretion.CompactTrajectoryOptimizerState(m, h_vesicles_root.get_children(),
+                                                               h_cachannel_root.get_children() + [h_nucleus],
+                                                               trajectory_file,
+                                                               COMPACT_RESOLUTION, rmf_dump_interval_frames)
+    bd.add_optimizer_state(cos)
+    # Dump initial frame
+    cos.update_always()
+else:
+    rmf = RMF.create_rmf_file(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_'+ str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat.rmf')
+    rmf.set_description("Brownian dynamics trajectory with {}fs timestep.\n"\
+                        .format(bd_step_size_fs))
+    IMP.rmf.add_hierarchy(rmf, h_root)
+    IMP.rmf.add_restraints(rmf, rs)
+    IMP.rmf.add_geometry(rmf, IMP.display.BoundingBoxGeometry(bb))
+    IMP.rmf.add_geometry(rmf, IMP.display.SphereGeometry(pbc_sphere))
+
+    # The maturation states are computed from the lifecycle clock, write them before each frame
+    msw = MaturationStateWriter(m, h_vesicles_root.get_children(), rmf_dump_interval_frames)
+    bd.add_optimizer_state(msw)
+
+    # Pair RMF with model using an OptimizerState ("listener")
+    sos = IMP.rmf.SaveOptimizerState(m, rmf)
+    sos.set_log_level(IMP.SILENT)
+    sos.set_simulator(bd)
+    sos.set_period(rmf_dump_interval_frames)
+    bd.add_optimizer_state(sos)
+
+    # Dump initial frame to RMF
+    msw.update_always()
+    sos.update_always("initial conformation")
 
 # -------- Run simulation ---------
 print("Running simulation", file = f1)
@@ -324,21 +499,31 @@ frames_per_cycle=VDOS_PERIOD  # can be 10, or 100, dependeing on the frequency o
 while n_frames_left>0:
     cur_n_frames=min(frames_per_cycle, n_frames_left)
     bd.optimize(cur_n_frames)
-    count = []
-    for i in range(0, N_VESICLES):
-        count.append(IMP.insulinsecretion.SecretionCounterDecorator(h_vesicles_root.get_children()[i]).get_secretion())
     print(sim_time_frames - n_frames_left, sep=" ", file = f1)
-    print(sum(count),file = f2)
-    for key, values in do_stats_after_optimize(h_vesicles_root.get_children())[0].items():
+    print(secretion_log.get_number_of_secretions(),file = f2)
+    stats = do_stats_after_optimize(h_vesicles_root.get_children())
+    for key, values in stats[0].items():
         f3.write(" ".join(map(str, values)) + " ")
     f3.write("\n")
-    print(*do_stats_after_optimize(h_vesicles_root.get_children())[1], sep="  ", file = f4)  #only vesicle
-    print(*do_stats_after_optimize(h_vesicles_root.get_children())[2], sep="  ", file = f5)  #only vesicle
-    print(*do_stats_after_optimize(h_vesicles_root.get_children())[3], sep="  ", file = f6)  #only vesicle
+    print(*stats[1], sep="  ", file = f4)  #only vesicle
+    print(*stats[2], sep="  ", file = f5)  #only vesicle
+    print(*stats[3], sep="  ", file = f6)  #only vesicle
     n_frames_left = n_frames_left - cur_n_frames
+    if STEADY_STATE and ssos.get_is_converged():
+        print("Steady state reached after {:g} s".format(ssos.get_converged_time()), file = f1)
+        break
     
+secretion_log.flush()
+if COMPACT_TRAJECTORY:
+    cos.flush()
+for f in (f2, f3, f4, f5, f6):
+    f.close()
+if STEADY_STATE:
+    ssos.write_record(str(condition) + '_' + str(K_TRAFFIC) + 'Ktraffic_'+ str(K_RDF) + 'Krdf_' + str(READY_STATE) + 'readystate_' + str(repeat) + 'repeat_steadystate.txt')
 print("Run finished succesfully", file = f1)
 print("Score ater: {:f}".format(sf.evaluate(True)), file = f1)
+if DIFFUSION_ESTIMATE:
+    print("Apparent D of vesicles: {:g} A^2/fs (D_VESICLES = {:g})".format(mtds.get_diffusion_coefficient(), D_VESICLES), file = f1)
 
 end=time.time()
 print('running time={} s'.format(end-start), file = f1)